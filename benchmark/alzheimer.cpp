@@ -6,6 +6,7 @@
 
 #include <benchmark/benchmark.h>
 #include <string>
+#include <vector>
 
 
 void benchmark_alzheimer(Dataset dataset, benchmark::State &state) {
@@ -19,6 +20,29 @@ void benchmark_alzheimer(Dataset dataset, benchmark::State &state) {
     memory_logger.stop();
 }
 
+void benchmark_alzheimer_planned(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_planned_" + get_dataset_name(dataset));
+
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer(dataset, true);
+
+    memory_logger.stop();
+}
+
+void benchmark_alzheimer_recompute(Dataset dataset, benchmark::State &state) {
+    Recompute recompute = (Recompute) state.range(0);
+    GPUMemoryLogger memory_logger("alzheimer_recompute_" + get_recompute_name(recompute) + "_" + get_dataset_name(dataset));
+
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer(dataset, false, recompute);
+
+    memory_logger.stop();
+}
+
 void benchmark_alzheimer_chunked(Dataset dataset, benchmark::State &state) {
     GPUMemoryLogger memory_logger("alzheimer_chunked_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0)));
     memory_logger.start();
@@ -29,6 +53,59 @@ void benchmark_alzheimer_chunked(Dataset dataset, benchmark::State &state) {
     memory_logger.stop();
 }
 
+void benchmark_alzheimer_chunked_history(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_chunked_history_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0)));
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_chunked(dataset, state.range(0), true);
+
+    memory_logger.stop();
+}
+
+// the second argument is the NumaPlacement of the chunks
+void benchmark_alzheimer_chunked_history_numa(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_chunked_history_numa_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0))
+                                  + "_" + std::to_string(state.range(1)));
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_chunked(dataset, state.range(0), true, false, recompute_none, (NumaPlacement) state.range(1));
+
+    memory_logger.stop();
+}
+
+void benchmark_alzheimer_chunked_dataflow(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_chunked_dataflow_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0)));
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_chunked(dataset, state.range(0), false, true);
+
+    memory_logger.stop();
+}
+
+void benchmark_alzheimer_chunked_recompute(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_chunked_recompute_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0)));
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_chunked(dataset, state.range(0), false, false, recompute_relu_dropout);
+
+    memory_logger.stop();
+}
+
+void benchmark_alzheimer_tuned(Dataset dataset, bool pipelined, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_tuned_" + get_dataset_name(dataset) + "_" + std::to_string(pipelined) + "_"
+                                  + std::to_string(state.range(0)));
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_tuned(dataset, state.range(0), pipelined);
+
+    memory_logger.stop();
+}
+
 void benchmark_alzheimer_pipelined(Dataset dataset, benchmark::State &state) {
     GPUMemoryLogger memory_logger("alzheimer_pipelined_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0)));
     memory_logger.start();
@@ -39,6 +116,74 @@ void benchmark_alzheimer_pipelined(Dataset dataset, benchmark::State &state) {
     memory_logger.stop();
 }
 
+// the second argument turns the passes of the model graph on
+void benchmark_alzheimer_model(Dataset dataset, ModelMode mode, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_model_" + get_model_mode_name(mode) + "_" + get_dataset_name(dataset) + "_"
+                                  + std::to_string(state.range(0)) + "_" + std::to_string(state.range(1)));
+    ModelConfig config;
+    config.mode = mode;
+    config.fuse_relu_dropout = state.range(1);
+    config.fuse_sage_linear_add = state.range(1);
+    config.elide_layout_changes = state.range(1);
+    config.eliminate_dead_buffers = state.range(1);
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_model(dataset, config, state.range(0));
+
+    memory_logger.stop();
+}
+
+// the second argument is the NumaPlacement of the chunks
+void benchmark_alzheimer_model_numa(Dataset dataset, ModelMode mode, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_model_numa_" + get_model_mode_name(mode) + "_" + get_dataset_name(dataset) + "_"
+                                  + std::to_string(state.range(0)) + "_" + std::to_string(state.range(1)));
+    ModelConfig config;
+    config.mode = mode;
+    config.numa_placement = (NumaPlacement) state.range(1);
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_model(dataset, config, state.range(0));
+
+    memory_logger.stop();
+}
+
+// with the checkpoint of a chunked alzheimer_model run
+void benchmark_alzheimer_inference(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_inference_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0))
+                                  + "_" + std::to_string(state.range(1)));
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_inference(dataset, get_checkpoint_path(dataset, "model_chunked"), state.range(0), state.range(1));
+
+    memory_logger.stop();
+}
+
+void benchmark_alzheimer_sampled(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_sampled_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0))
+                                  + "_" + std::to_string(state.range(1)));
+    std::vector<long> fanouts = {25, 10, 10};
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_sampled(dataset, state.range(0), &fanouts, state.range(1));
+
+    memory_logger.stop();
+}
+
+void benchmark_alzheimer_clustered(Dataset dataset, benchmark::State &state) {
+    GPUMemoryLogger memory_logger("alzheimer_clustered_" + get_dataset_name(dataset) + "_" + std::to_string(state.range(0))
+                                  + "_" + std::to_string(state.range(1)));
+    memory_logger.start();
+
+    for (auto _ : state)
+        alzheimer_clustered(dataset, state.range(0), state.range(1));
+
+    memory_logger.stop();
+}
+
 // LAYER --- LAYER --- LAYER
 
 static void BM_Alzheimer_Layer_Flickr(benchmark::State &state) {
@@ -56,6 +201,36 @@ static void BM_Alzheimer_Layer_Products(benchmark::State &state) {
 }
 BENCHMARK(BM_Alzheimer_Layer_Products);
 
+static void BM_Alzheimer_Layer_Planned_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_planned(flickr, state);
+}
+BENCHMARK(BM_Alzheimer_Layer_Planned_Flickr);
+
+static void BM_Alzheimer_Layer_Planned_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_planned(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Layer_Planned_Reddit);
+
+static void BM_Alzheimer_Layer_Planned_Products(benchmark::State &state) {
+    benchmark_alzheimer_planned(products, state);
+}
+BENCHMARK(BM_Alzheimer_Layer_Planned_Products);
+
+static void BM_Alzheimer_Layer_Recompute_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_recompute(flickr, state);
+}
+BENCHMARK(BM_Alzheimer_Layer_Recompute_Flickr)->DenseRange(recompute_dropout, recompute_relu_dropout);
+
+static void BM_Alzheimer_Layer_Recompute_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_recompute(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Layer_Recompute_Reddit)->DenseRange(recompute_dropout, recompute_relu_dropout);
+
+static void BM_Alzheimer_Layer_Recompute_Products(benchmark::State &state) {
+    benchmark_alzheimer_recompute(products, state);
+}
+BENCHMARK(BM_Alzheimer_Layer_Recompute_Products)->DenseRange(recompute_dropout, recompute_relu_dropout);
+
 // CHUNKED --- CHUNKED --- CHUNKED
 
 static void BM_Alzheimer_Chunked_Flickr(benchmark::State &state) {
@@ -122,6 +297,91 @@ static void BM_Alzheimer_Chunked_Ivy_X(benchmark::State &state) {
 }
 BENCHMARK(BM_Alzheimer_Chunked_Ivy_X)->Arg(1371507);
 
+// HISTORY --- HISTORY --- HISTORY
+
+static void BM_Alzheimer_Chunked_History_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_chunked_history(flickr, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_History_Flickr)->RangeMultiplier(2)->Range(1 << 14, 1 << 16);
+
+static void BM_Alzheimer_Chunked_History_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_chunked_history(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_History_Reddit)->RangeMultiplier(2)->Range(1 << 14, 1 << 17);
+
+static void BM_Alzheimer_Chunked_History_Products(benchmark::State &state) {
+    benchmark_alzheimer_chunked_history(products, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_History_Products)->RangeMultiplier(2)->Range(1 << 14, 1 << 20);
+
+static void BM_Alzheimer_Chunked_History_Numa_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_chunked_history_numa(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_History_Numa_Reddit)
+    ->Args({1 << 15, numa_none})->Args({1 << 15, numa_interleaved})->Args({1 << 15, numa_blocked});
+
+static void BM_Alzheimer_Chunked_History_Numa_Products(benchmark::State &state) {
+    benchmark_alzheimer_chunked_history_numa(products, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_History_Numa_Products)
+    ->Args({1 << 18, numa_none})->Args({1 << 18, numa_interleaved})->Args({1 << 18, numa_blocked});
+
+// DATAFLOW --- DATAFLOW --- DATAFLOW
+
+static void BM_Alzheimer_Chunked_Dataflow_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_chunked_dataflow(flickr, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Dataflow_Flickr)->RangeMultiplier(2)->Range(1 << 14, 1 << 16);
+
+static void BM_Alzheimer_Chunked_Dataflow_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_chunked_dataflow(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Dataflow_Reddit)->RangeMultiplier(2)->Range(1 << 14, 1 << 17);
+
+static void BM_Alzheimer_Chunked_Dataflow_Products(benchmark::State &state) {
+    benchmark_alzheimer_chunked_dataflow(products, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Dataflow_Products)->RangeMultiplier(2)->Range(1 << 14, 1 << 20);
+
+// RECOMPUTE --- RECOMPUTE --- RECOMPUTE
+
+static void BM_Alzheimer_Chunked_Recompute_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_chunked_recompute(flickr, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Recompute_Flickr)->RangeMultiplier(2)->Range(1 << 14, 1 << 16);
+
+static void BM_Alzheimer_Chunked_Recompute_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_chunked_recompute(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Recompute_Reddit)->RangeMultiplier(2)->Range(1 << 14, 1 << 17);
+
+static void BM_Alzheimer_Chunked_Recompute_Products(benchmark::State &state) {
+    benchmark_alzheimer_chunked_recompute(products, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Recompute_Products)->RangeMultiplier(2)->Range(1 << 14, 1 << 20);
+
+// TUNED --- TUNED --- TUNED
+
+static void BM_Alzheimer_Chunked_Tuned_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_tuned(flickr, false, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Tuned_Flickr)->RangeMultiplier(4)->Range(1l << 28, 1l << 32);
+
+static void BM_Alzheimer_Chunked_Tuned_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_tuned(reddit, false, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Tuned_Reddit)->RangeMultiplier(4)->Range(1l << 28, 1l << 32);
+
+static void BM_Alzheimer_Chunked_Tuned_Products(benchmark::State &state) {
+    benchmark_alzheimer_tuned(products, false, state);
+}
+BENCHMARK(BM_Alzheimer_Chunked_Tuned_Products)->RangeMultiplier(4)->Range(1l << 28, 1l << 32);
+
+static void BM_Alzheimer_Pipelined_Tuned_Products(benchmark::State &state) {
+    benchmark_alzheimer_tuned(products, true, state);
+}
+BENCHMARK(BM_Alzheimer_Pipelined_Tuned_Products)->RangeMultiplier(4)->Range(1l << 28, 1l << 32);
+
 // PIPELINED --- PIPELINED --- PIPELINED
 
 static void BM_Alzheimer_Pipelined_Flickr(benchmark::State &state) {
@@ -143,3 +403,82 @@ static void BM_Alzheimer_Pipelined_Ivy(benchmark::State &state) {
     benchmark_alzheimer_pipelined(ivy, state);
 }
 BENCHMARK(BM_Alzheimer_Pipelined_Ivy)->RangeMultiplier(2)->Range(1 << 14, 1 << 19);
+
+// MODEL --- MODEL --- MODEL
+
+static void BM_Alzheimer_Model_Full_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_model(flickr, model_full, state);
+}
+BENCHMARK(BM_Alzheimer_Model_Full_Flickr)->Args({0, 0})->Args({0, 1});
+
+static void BM_Alzheimer_Model_Full_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_model(reddit, model_full, state);
+}
+BENCHMARK(BM_Alzheimer_Model_Full_Reddit)->Args({0, 0})->Args({0, 1});
+
+static void BM_Alzheimer_Model_Chunked_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_model(reddit, model_chunked, state);
+}
+BENCHMARK(BM_Alzheimer_Model_Chunked_Reddit)->Ranges({{1 << 14, 1 << 17}, {0, 1}});
+
+static void BM_Alzheimer_Model_Chunked_Products(benchmark::State &state) {
+    benchmark_alzheimer_model(products, model_chunked, state);
+}
+BENCHMARK(BM_Alzheimer_Model_Chunked_Products)->Ranges({{1 << 14, 1 << 21}, {0, 1}});
+
+static void BM_Alzheimer_Model_Pipelined_Products(benchmark::State &state) {
+    benchmark_alzheimer_model(products, model_pipelined, state);
+}
+BENCHMARK(BM_Alzheimer_Model_Pipelined_Products)->Ranges({{1 << 14, 1 << 20}, {0, 1}});
+
+static void BM_Alzheimer_Model_Chunked_Numa_Products(benchmark::State &state) {
+    benchmark_alzheimer_model_numa(products, model_chunked, state);
+}
+BENCHMARK(BM_Alzheimer_Model_Chunked_Numa_Products)
+    ->Args({1 << 18, numa_none})->Args({1 << 18, numa_interleaved})->Args({1 << 18, numa_blocked});
+
+// INFERENCE --- INFERENCE --- INFERENCE
+
+static void BM_Alzheimer_Inference_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_inference(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Inference_Reddit)->Ranges({{1 << 14, 1 << 17}, {0, 1}});
+
+static void BM_Alzheimer_Inference_Products(benchmark::State &state) {
+    benchmark_alzheimer_inference(products, state);
+}
+BENCHMARK(BM_Alzheimer_Inference_Products)->Ranges({{1 << 14, 1 << 21}, {0, 1}});
+
+// SAMPLED --- SAMPLED --- SAMPLED
+
+static void BM_Alzheimer_Sampled_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_sampled(flickr, state);
+}
+BENCHMARK(BM_Alzheimer_Sampled_Flickr)->Ranges({{1 << 10, 1 << 13}, {0, 1 << 14}});
+
+static void BM_Alzheimer_Sampled_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_sampled(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Sampled_Reddit)->Ranges({{1 << 10, 1 << 13}, {0, 1 << 16}});
+
+static void BM_Alzheimer_Sampled_Products(benchmark::State &state) {
+    benchmark_alzheimer_sampled(products, state);
+}
+BENCHMARK(BM_Alzheimer_Sampled_Products)->Ranges({{1 << 10, 1 << 13}, {0, 1 << 18}});
+
+// CLUSTERED --- CLUSTERED --- CLUSTERED
+
+static void BM_Alzheimer_Clustered_Flickr(benchmark::State &state) {
+    benchmark_alzheimer_clustered(flickr, state);
+}
+BENCHMARK(BM_Alzheimer_Clustered_Flickr)->Args({1 << 10, 1})->Args({1 << 10, 4})->Args({1 << 12, 1})->Args({1 << 12, 4});
+
+static void BM_Alzheimer_Clustered_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_clustered(reddit, state);
+}
+BENCHMARK(BM_Alzheimer_Clustered_Reddit)->Args({1 << 12, 1})->Args({1 << 12, 4})->Args({1 << 14, 1})->Args({1 << 14, 4});
+
+static void BM_Alzheimer_Clustered_Products(benchmark::State &state) {
+    benchmark_alzheimer_clustered(products, state);
+}
+BENCHMARK(BM_Alzheimer_Clustered_Products)->Args({1 << 14, 1})->Args({1 << 14, 4})->Args({1 << 16, 1})->Args({1 << 16, 4});
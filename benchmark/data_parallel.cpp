@@ -0,0 +1,24 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "alzheimer.hpp"
+#include "dataset.hpp"
+
+#include <benchmark/benchmark.h>
+
+
+// own executable, the training processes are forked from a process that has not touched CUDA yet. no memory logger
+// for the same reason
+void benchmark_alzheimer_data_parallel(Dataset dataset, long chunk_size, benchmark::State &state) {
+    for (auto _ : state)
+        alzheimer_data_parallel(dataset, chunk_size, state.range(0));
+}
+
+static void BM_Alzheimer_Data_Parallel_Reddit(benchmark::State &state) {
+    benchmark_alzheimer_data_parallel(reddit, 1 << 15, state);
+}
+BENCHMARK(BM_Alzheimer_Data_Parallel_Reddit)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+static void BM_Alzheimer_Data_Parallel_Products(benchmark::State &state) {
+    benchmark_alzheimer_data_parallel(products, 1 << 18, state);
+}
+BENCHMARK(BM_Alzheimer_Data_Parallel_Products)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
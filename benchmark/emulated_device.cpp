@@ -0,0 +1,126 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "emulated_device.hpp"
+#include "chunking.hpp"
+#include "cuda_helper.hpp"
+#include "dataset.hpp"
+#include "feature_aggregation.hpp"
+#include "pipeline.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+const std::string dir_path = "/mnt/data";
+
+
+// the schedule of LinearPipelined on an emulated device with 16 GB/s, chunks of products, 100 to 256 features,
+// the weight stays on the device, compute at 10 TFLOP/s. the iterations take the virtual time of the device
+void benchmark_emulated_linear_pipelined(benchmark::State &state) {
+    long num_nodes = 2449029;
+    long num_in_features = 100;
+    long num_out_features = 256;
+    long chunk_size = state.range(0);
+    long num_buffers = state.range(1);
+    long num_chunks = (num_nodes + chunk_size - 1) / chunk_size;
+    long bytes_in = chunk_size * num_in_features * sizeof(float);
+    long bytes_out = chunk_size * num_out_features * sizeof(float);
+
+    std::vector<float> x(chunk_size * num_in_features);
+    std::vector<float> y(chunk_size * num_out_features);
+    EmulatedDevice device(16l << 30, 16e9, 10e12);
+    double seconds = device.get_compute_time(2.0 * chunk_size * num_in_features * num_out_features);
+    void *d_weight = device.allocate(num_in_features * num_out_features * sizeof(float));
+    std::vector<void *> d_x(num_buffers);
+    std::vector<void *> d_y(num_buffers);
+    for (long i = 0; i < num_buffers; ++i) {
+        d_x.at(i) = device.allocate(bytes_in);
+        d_y.at(i) = device.allocate(bytes_out);
+    }
+
+    Pipeline pipeline(num_buffers, &device);
+    pipeline.add_emulated_stage([&](long chunk, long buffer) {
+        device.memcpy_async(d_x.at(buffer), x.data(), bytes_in, device.stream_in_);
+    }, device.stream_in_);
+    pipeline.add_emulated_stage([&](long chunk, long buffer) {
+        device.launch([]() {}, seconds, device.stream_compute_);
+    }, device.stream_compute_);
+    pipeline.add_emulated_stage([&](long chunk, long buffer) {
+        device.memcpy_async(y.data(), d_y.at(buffer), bytes_out, device.stream_out_);
+    }, device.stream_out_);
+
+    for (auto _ : state) {
+        device.reset_stats();
+        pipeline.run(num_chunks);
+        state.SetIterationTime(device.get_stats().time);
+    }
+
+    EmulatedDeviceStats stats = device.get_stats();
+    state.counters["peak_memory"] = stats.peak_memory;
+    state.counters["overlap_ratio"] = stats.overlap_ratio;
+    state.counters["stall_time"] = stats.stall_time;
+
+    for (long i = 0; i < num_buffers; ++i) {
+        device.deallocate(d_x.at(i));
+        device.deallocate(d_y.at(i));
+    }
+    device.deallocate(d_weight);
+}
+
+static void BM_Emulated_Linear_Pipelined(benchmark::State &state) {
+    benchmark_emulated_linear_pipelined(state);
+}
+BENCHMARK(BM_Emulated_Linear_Pipelined)->Ranges({{1 << 14, 1 << 18}, {1, 4}})->UseManualTime();
+
+// FeatureAggregationPipelined on flickr on an emulated device with 16 GB/s, 10 TFLOP/s and 1 GB, it runs without a GPU.
+// the iterations take the virtual time of the device
+void benchmark_emulated_feature_aggregation_pipelined(Dataset dataset, benchmark::State &state, bool forward) {
+    std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
+    Matrix<float> features = load_npy_matrix<float>(dataset_path + "/features.npy");
+    long num_nodes = features.num_rows_;
+    long num_features = features.num_columns_;
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(dataset_path + "/adjacency.mtx");
+
+    long chunk_size = state.range(0);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    std::vector<Matrix<float>> features_chunked(num_chunks);
+    chunk_up(&features, &features_chunked, &boundaries);
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp(&adjacency, &adjacencies, &boundaries);
+    Matrix<float> adjacency_row_sum(num_nodes, 1, true);
+    sp_mat_sum_rows(&adjacency, &adjacency_row_sum);
+
+    CudaHelper cuda_helper;
+    FeatureAggregationPipelined feature_aggr(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_features, &boundaries);
+    EmulatedDevice device(1l << 30, 16e9, 10e12);
+    feature_aggr.set_emulated_device(&device);
+
+    for (auto _ : state) {
+        device.reset_stats();
+        if (forward) {
+            feature_aggr.forward(&features_chunked);
+        } else {
+            feature_aggr.backward(&features_chunked);
+        }
+        state.SetIterationTime(device.get_stats().time);
+    }
+
+    EmulatedDeviceStats stats = device.get_stats();
+    state.counters["peak_memory"] = stats.peak_memory;
+    state.counters["overlap_ratio"] = stats.overlap_ratio;
+    state.counters["stall_time"] = stats.stall_time;
+}
+
+static void BM_Emulated_FeatureAggregation_Flickr_Pipelined_Forward(benchmark::State &state) {
+    benchmark_emulated_feature_aggregation_pipelined(flickr, state, true);
+}
+BENCHMARK(BM_Emulated_FeatureAggregation_Flickr_Pipelined_Forward)->RangeMultiplier(2)->Range(1 << 12, 1 << 16)->UseManualTime();
+
+static void BM_Emulated_FeatureAggregation_Flickr_Pipelined_Backward(benchmark::State &state) {
+    benchmark_emulated_feature_aggregation_pipelined(flickr, state, false);
+}
+BENCHMARK(BM_Emulated_FeatureAggregation_Flickr_Pipelined_Backward)->RangeMultiplier(2)->Range(1 << 12, 1 << 16)->UseManualTime();
@@ -0,0 +1,88 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "dataset.hpp"
+#include "feature_aggregation.hpp"
+#include "numa.hpp"
+#include "tensors.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cmath>
+
+const std::string dir_path = "/mnt/data";
+
+
+// the halo aggregates of the history are the SpMM on the host, range(0) is the placement and range(1) the number of
+// nodes, so the runs with one node against the runs with every node show the cross-socket scaling. without a
+// placement every cpu works on whatever memory the first touch gave
+void benchmark_numa_halo_aggregates(Dataset dataset, benchmark::State &state) {
+    NumaPlacement placement = static_cast<NumaPlacement>(state.range(0));
+    NumaTopology topology;
+    get_numa_topology(&topology);
+    if (state.range(1) > (long) topology.nodes.size()) {
+        state.SkipWithError("Not enough NUMA nodes");
+        return;
+    }
+    topology.nodes.resize(state.range(1));
+    topology.cpus.resize(state.range(1));
+
+    std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
+    std::string path = dataset_path + "/features.npy";
+    Matrix<float> *features = new Matrix<float>();
+    load_npy_matrix<float>(path, features);
+    long num_nodes = features->num_rows_;
+    long num_features = features->num_columns_;
+    SparseMatrix<float> *adjacency = new SparseMatrix<float>();
+    load_sp_matrix<float>(get_adjacency_path(dataset_path), adjacency);
+
+    long chunk_size = 1 << 16;
+    long num_chunks = ceil((double) num_nodes / (double) chunk_size);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    std::vector<Matrix<float>> features_chunked(num_chunks);
+    chunk_up(features, &features_chunked, &boundaries);
+    delete features;
+    std::vector<SparseMatrix<float>> tiles(num_chunks * num_chunks);
+    double_chunk_up_sp(adjacency, &tiles, &boundaries);
+    delete adjacency;
+    TileIndex tile_index;
+    index_tiles(&tiles, &tile_index);
+    std::vector<Matrix<float>> aggregates(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        aggregates.at(i).set(boundaries.at(i + 1) - boundaries.at(i), num_features, false);
+    }
+
+    // in the layout the SpMM reads, converting after the placement would undo it
+    for (Matrix<float> &chunk : features_chunked) {
+        to_column_major_inplace(&chunk);
+    }
+    place_chunks(&topology, placement, &features_chunked);
+    place_chunks(&topology, placement, &aggregates);
+    place_tiles(&topology, placement, &tiles);
+
+    for (auto _ : state) {
+        get_halo_aggregates(&tiles, &tile_index, &features_chunked, &aggregates, &topology, placement);
+    }
+}
+
+static void BM_Numa_Halo_Aggregates_Reddit(benchmark::State &state) {
+    benchmark_numa_halo_aggregates(reddit, state);
+}
+BENCHMARK(BM_Numa_Halo_Aggregates_Reddit)
+        ->Args({numa_none, 1})
+        ->Args({numa_interleaved, 1})
+        ->Args({numa_interleaved, 2})
+        ->Args({numa_blocked, 2})
+        ->Args({numa_interleaved, 4})
+        ->Args({numa_blocked, 4});
+
+static void BM_Numa_Halo_Aggregates_Products(benchmark::State &state) {
+    benchmark_numa_halo_aggregates(products, state);
+}
+BENCHMARK(BM_Numa_Halo_Aggregates_Products)
+        ->Args({numa_none, 1})
+        ->Args({numa_interleaved, 1})
+        ->Args({numa_interleaved, 2})
+        ->Args({numa_blocked, 2})
+        ->Args({numa_interleaved, 4})
+        ->Args({numa_blocked, 4});
@@ -1,8 +1,10 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "sparse_computation.hpp"
+#include "chunking.hpp"
 #include "cuda_helper.hpp"
 #include "gpu_memory_logger.hpp"
+#include "sanitize.hpp"
 #include "tensors.hpp"
 
 #include <benchmark/benchmark.h>
@@ -53,4 +55,32 @@ static void BM_OP_Transpose_CSR_Reddit_Chunked(benchmark::State &state) {
 
     memory_logger.stop();
 }
-BENCHMARK(BM_OP_Transpose_CSR_Reddit_Chunked)->Range(1 << 12, 1 << 17);
\ No newline at end of file
+BENCHMARK(BM_OP_Transpose_CSR_Reddit_Chunked)->Range(1 << 12, 1 << 17);
+
+static void BM_OP_Double_Chunk_Up_Products(benchmark::State &state) {
+    std::string path;
+    long chunk_size = state.range(0);
+
+    path = products_dir_path + "/adjacency.mtx";
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(path);
+    long num_chunks = ceil((double) adjacency.num_rows_ / (double) chunk_size);
+
+    for (auto _ : state) {
+        std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+        double_chunk_up_sp(&adjacency, &adjacencies, chunk_size);
+    }
+}
+BENCHMARK(BM_OP_Double_Chunk_Up_Products)->RangeMultiplier(2)->Range(1 << 16, 1 << 21);
+
+static void BM_OP_Sanitize_Products(benchmark::State &state) {
+    std::string path;
+
+    path = products_dir_path + "/adjacency.mtx";
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(path);
+
+    for (auto _ : state) {
+        SparseMatrix<float> sanitized;
+        sanitize_graph(&adjacency, false, true, mean_normalization, &sanitized);
+    }
+}
+BENCHMARK(BM_OP_Sanitize_Products);
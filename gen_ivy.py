@@ -1,6 +1,9 @@
-import numpy as np
-import scipy.sparse as sp
-import scipy.io
+import os
+import subprocess
+
+
+home = os.getenv("HOME")
+generate_path = home + "/gpu_memory_reduction/alzheimer/build/generate"
 
 
 def gen_data():
@@ -14,27 +17,20 @@ def gen_data():
     print("c {}".format(c))
     density = 1e-5
 
-    classes = np.random.randint(0, c, n)
-    classes = classes.astype(np.int32)
-    path = dir_path + "/classes.npy"
-    np.save(path, classes)
-
-    features = np.random.randn(n, f)
-    features = features.astype(np.float32)
-    path = dir_path + "/features.npy"
-    np.save(path, features)
-
     k = int(n * n * density)
     print("k {}".format(k))
-    values = np.ones(k, dtype=np.float32)
-    i = np.random.randint(n, size=k, dtype=np.int32)
-    j = np.random.randint(n, size=k, dtype=np.int32)
-    adj = sp.coo_matrix((values, (i, j)), shape=(n, n)).asformat("csr")
 
-    path = dir_path + "/adjacency.mtx"
-    scipy.io.mmwrite(path, adj)
+    # the native generator draws an R-MAT graph in parallel and streams it to adjacency.csr
+    subprocess.run([generate_path,
+                    "--model", "rmat",
+                    "--nodes", str(n),
+                    "--edges", str(k),
+                    "--features", str(f),
+                    "--classes", str(c),
+                    "--seed", "0",
+                    "--output", dir_path],
+                   check=True)
 
 
 if __name__ == "__main__":
     gen_data()
-
@@ -25,6 +25,10 @@ private:
 public:
     Adam(CudaHelper *helper, float learning_rate, std::vector<Matrix<float> *> parameters, std::vector<Matrix<float> *> gradients);
     void step();
+    long get_t();
+    void set_t(long t);
+    std::vector<Matrix<float>> *get_momentum_ms();
+    std::vector<Matrix<float>> *get_momentum_vs();
 };
 
 #endif//ADAM_HPP
@@ -27,27 +27,40 @@ private:
 public:
     std::string name_;
 
+    Add();
     Add(CudaHelper *cuda_helper, long num_nodes, long num_features);
+    void set(CudaHelper *cuda_helper, long num_nodes, long num_features);
     Matrix<float> *forward(Matrix<float> *a, Matrix<float> *b);
     AddGradients *backward(Matrix<float> *incoming_gradients);
+    Matrix<float> *get_y();
 };
 
 class AddChunked {
 protected:
     long num_chunks_;
     long chunk_size_;
-    long last_chunk_size_;
     CudaHelper *cuda_helper_;
     std::vector<Matrix<float>> y_;
     AddGradientsChunked gradients_;
+    std::vector<Matrix<float>> *a_ = NULL;
+    std::vector<Matrix<float>> *b_ = NULL;
+    float *d_a_forward_ = NULL;
+    float *d_b_forward_ = NULL;
 
 public:
     std::string name_;
 
     AddChunked();
+    virtual ~AddChunked();
     AddChunked(CudaHelper *cuda_helper, long chunk_size, long num_nodes, long num_features);
+    AddChunked(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features);
     virtual void set(CudaHelper *cuda_helper, long chunk_size, long num_nodes, long num_features);
+    virtual void set(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features);
     virtual std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *a, std::vector<Matrix<float>> *b);
+    // the forward pass one chunk at a time, chunk i of the output is valid once forward_chunk(i) returned
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *a, std::vector<Matrix<float>> *b);
+    void forward_chunk(long chunk);
+    void forward_end();
     virtual AddGradientsChunked *backward(std::vector<Matrix<float>> *incoming_gradients);
 };
 
@@ -57,13 +70,13 @@ protected:
     std::vector<float *> d_a_;
     std::vector<float *> d_b_;
     std::vector<float *> d_c_;
-    std::vector<Matrix<float>> *a_;
-    std::vector<Matrix<float>> *b_;
 
 public:
     AddPipelined();
     AddPipelined(CudaHelper *cuda_helper, long chunk_size, long num_nodes, long num_features);
+    AddPipelined(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features);
     void set(CudaHelper *cudaHelper, long chunkSize, long numNodes, long numFeatures) override;
+    void set(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features) override;
     void forward_in(long chunk, long buffer) override;
     void forward_out(long chunk, long buffer) override;
     void forward_compute(long chunk, long buffer) override;
@@ -4,14 +4,75 @@
 #define ALZHEIMER_ALZHEIMER_H
 
 #include "dataset.hpp"
+#include "model.hpp"
 
 #include <string>
+#include <vector>
 
 
+// activations dropped after the forward pass and computed again once the backward pass needs them,
+// every level trades more recompute for less memory
+enum Recompute { recompute_none,
+                 recompute_dropout,      // dropout outputs, from their inputs and the kept masks
+                 recompute_relu_dropout};// relu outputs as well, from the linear outputs
+
+std::string get_recompute_name(Recompute recompute);
+
+// where trainer saves its checkpoints of dataset, every trainer and mode has its own
+std::string get_checkpoint_path(Dataset dataset, std::string trainer);
+
 void alzheimer(Dataset dataset);
 
+// activations and gradients with disjoint lifetimes share one arena
+void alzheimer(Dataset dataset, bool plan_memory);
+
+// not together with a memory plan, released matrices can not be views into its arena
+void alzheimer(Dataset dataset, bool plan_memory, Recompute recompute);
+
 void alzheimer_chunked(Dataset dataset, long chunk_size);
 
+// with historical embeddings in the hidden layers
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history);
+
+// the forward pass as a dataflow of (layer, chunk) tasks, element-wise layers run chunk by chunk instead of layer by layer
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history, bool use_dataflow);
+
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history, bool use_dataflow, Recompute recompute);
+
+// the features and tiles of row chunk i on the NUMA node the placement gives it, with history the hidden layers
+// compute their halo aggregates on that node too
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history, bool use_dataflow, Recompute recompute,
+                       NumaPlacement numa_placement);
+
 void alzheimer_pipelined(Dataset dataset, long chunk_size);
 
+// the model built from a graph, optimized by the passes of the config and run in its mode. the channels come from the
+// dataset if the config has none, the chunk size is ignored in full mode
+void alzheimer_model(Dataset dataset, ModelConfig config, long chunk_size);
+
+// predictions and last hidden embeddings of every node with the parameters of the checkpoint, layer by layer over
+// chunks of about chunk_size rows. the mean comes from the row sums like in the chunked trainers, so take the
+// checkpoint of one of them, get_checkpoint_path(dataset, "model_chunked") for example. spill keeps the embeddings
+// of the previous layer on disk
+void alzheimer_inference(Dataset dataset, std::string checkpoint_path, long chunk_size, bool spill);
+
+// num_processes forked processes, each trains the chunked model on its share of the row chunks and a halo one hop
+// deep, whose rows and gradients they exchange in shared memory around every aggregation. they share the dataset in
+// memory and average their gradients before every step. call before this process touches CUDA, the forked processes
+// need their own contexts
+void alzheimer_data_parallel(Dataset dataset, long chunk_size, long num_processes);
+
+// the chunk size of the chunked or pipelined training whose layers fit memory_budget bytes of the GPU and run the
+// fastest trial epoch, cached next to the dataset for this machine. parts of the partition tool that fit the budget
+// are kept without a trial, else they are capped at the candidate chunk sizes
+long tune_chunk_size(Dataset dataset, long memory_budget, bool pipelined);
+
+void alzheimer_tuned(Dataset dataset, long memory_budget, bool pipelined);
+
+// mini-batches of neighbour-sampled blocks, one fanout per layer, features of the num_cached_nodes highest in-degree nodes cached
+void alzheimer_sampled(Dataset dataset, long batch_size, std::vector<long> *fanouts, long num_cached_nodes);
+
+// Cluster-GCN, every batch is the subgraph of a random union of clusters_per_batch chunks
+void alzheimer_clustered(Dataset dataset, long chunk_size, long clusters_per_batch);
+
 #endif//ALZHEIMER_ALZHEIMER_H
@@ -0,0 +1,54 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_CHECKPOINT_HPP
+#define ALZHEIMER_CHECKPOINT_HPP
+
+#include "adam.hpp"
+#include "tensors.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// file layout: header, one entry per matrix (parameters, then Adam's ms and vs), 64 byte aligned matrix values
+struct CheckpointHeader {
+    char magic[8];
+    long version;
+    long epoch;
+    long t;
+    long num_matrices;
+    long size;
+    unsigned long checksum;// over everything after the header
+};
+
+struct CheckpointEntry {
+    long num_rows;
+    long num_columns;
+    long is_row_major;
+    long offset;
+};
+
+unsigned long get_checksum(const char *data, long size);
+
+void snapshot_checkpoint(std::vector<char> *buffer, long epoch, std::vector<Matrix<float> *> *parameters, Adam *adam);
+
+void write_checkpoint(std::vector<char> *buffer, std::string path);
+
+// without an optimiser only the parameters, they come first in the checkpoint
+long restore_checkpoint(std::string path, std::vector<Matrix<float> *> *parameters, Adam *adam);
+
+// snapshots synchronously, writes in a background thread while training continues
+class Checkpoint {
+private:
+    std::thread writer_;
+    std::vector<char> buffer_;
+    const char *error_ = NULL;
+
+public:
+    ~Checkpoint();
+    void save(std::string path, long epoch, std::vector<Matrix<float> *> *parameters, Adam *adam);
+    void wait();
+};
+
+#endif//ALZHEIMER_CHECKPOINT_HPP
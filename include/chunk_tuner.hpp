@@ -0,0 +1,60 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_CHUNK_TUNER_HPP
+#define ALZHEIMER_CHUNK_TUNER_HPP
+
+#include "tensors.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// bytes of device memory the largest chunked layer of a SAGE model allocates, channels are the features of the input
+// and of the output of every layer. pipelined layers keep num_buffers chunks on the device, chunked layers one
+long get_chunk_memory(long chunk_size, long max_chunk_nnz, std::vector<long> *channels, long num_buffers);
+
+// non-zeros of the row chunk with the most, a bound for the non-zeros of its tiles
+long get_max_chunk_nnz(int *row_ptr, std::vector<long> *boundaries);
+
+// the GPU and the host, tuned chunk sizes are only valid on the machine they were measured on
+std::string get_hardware_fingerprint();
+
+struct ChunkTrial {
+    long chunk_size;
+    long max_chunk_size;// of the balanced boundaries
+    long memory;        // of the model, in bytes
+    double seconds;     // of an epoch, 0 if the chunk size does not fit the budget
+};
+
+// picks the chunk size of the chunked or pipelined training. candidates are the powers of two between a minimum and a
+// maximum chunk size with the boundaries get_dataset_boundaries gives for them, the ones whose layers fit the
+// memory budget run a trial epoch and the fastest wins
+class ChunkTuner {
+private:
+    long memory_budget_;
+    std::vector<long> channels_;
+    long num_buffers_;
+    std::vector<ChunkTrial> trials_;
+
+    ChunkTrial get_trial(int *row_ptr, long chunk_size, std::vector<long> *boundaries);
+
+public:
+    ChunkTuner(long memory_budget, std::vector<long> channels, long num_buffers);
+    // with balanced boundaries. trial gets the boundaries of a candidate and returns the seconds of an epoch with them
+    long tune(int *row_ptr, long num_nodes, long min_chunk_size, long max_chunk_size,
+              std::function<double(std::vector<long> *boundaries)> trial);
+    // with the parts of the partition tool capped at every candidate. parts that fit the budget as they are win
+    // without a trial, their largest part is the chunk size
+    long tune(int *row_ptr, std::vector<long> *parts, long min_chunk_size, long max_chunk_size,
+              std::function<double(std::vector<long> *boundaries)> trial);
+    // the parts of the partition tool if the dataset has any, else balanced boundaries. the chunk size of an earlier
+    // tune with the same budget, model, parts and hardware if there is a cache next to the dataset
+    long tune_cached(std::string dataset_path, int *row_ptr, long num_nodes, long min_chunk_size, long max_chunk_size,
+                     std::function<double(std::vector<long> *boundaries)> trial);
+    std::string get_cache_path(std::string dataset_path);
+    std::vector<ChunkTrial> *get_trials();
+    void print();
+};
+
+#endif//ALZHEIMER_CHUNK_TUNER_HPP
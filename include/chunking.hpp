@@ -5,15 +5,101 @@
 
 #include "tensors.hpp"
 
+#include <string>
 #include <vector>
 
 
+// non-empty tiles of the tiled adjacency, so chunked layers skip empty tiles without touching them
+struct TileIndex {
+    long num_chunks = 0;
+    long num_non_empty = 0;
+    long nnz = 0;
+    long max_nnz = 0;
+    std::vector<std::vector<long>> non_empty;// column chunks of the non-empty tiles of each row chunk
+};
+
+// chunk i holds the rows from boundaries[i] up to boundaries[i + 1], the last boundary is the number of nodes
+void get_uniform_boundaries(long num_nodes, long chunk_size, std::vector<long> *boundaries);
+
+// boundaries such that every chunk has roughly the same number of non-zeros plus rows times features
+void get_balanced_boundaries(int *row_ptr, long num_nodes, long num_features, long num_chunks, std::vector<long> *boundaries);
+
+void get_balanced_boundaries(SparseMatrix<float> *sp_mat, long num_features, long num_chunks, std::vector<long> *boundaries);
+
+long get_max_chunk_size(std::vector<long> *boundaries);
+
+void print_boundaries(std::vector<long> *boundaries);
+
+void save_boundaries(std::string path, std::vector<long> *boundaries);
+
+// boundaries written by the partition tool, false if there are none for this number of nodes
+bool load_boundaries(std::string path, long num_nodes, std::vector<long> *boundaries);
+
+// splits every chunk of more than max_chunk_size rows into nearly equal ones. the balance by non-zeros and the parts of
+// the partition tool do not bound the rows of a chunk. returns whether a chunk was split
+bool cap_boundaries(std::vector<long> *boundaries, long max_chunk_size);
+
+// the parts of the partition tool if the dataset has any, else as many chunks as the chunk size gives, balanced by
+// non-zeros and features instead of rows. either way no chunk has more than chunk_size rows
+void get_dataset_boundaries(std::string dataset_path, long num_nodes, long num_features, long chunk_size, std::vector<long> *boundaries);
+
 void init_set_random_values(std::vector<Matrix<float>> *mat, long num_nodes, long num_features, long chunk_size, bool is_row_major);
 
+void init_set_random_values(std::vector<Matrix<float>> *mat, std::vector<long> *boundaries, long num_features, bool is_row_major);
+
 void chunk_up(Matrix<float> *x, std::vector<Matrix<float>> *x_chunked, long chunk_size);
 
+void chunk_up(Matrix<float> *x, std::vector<Matrix<float>> *x_chunked, std::vector<long> *boundaries);
+
 void stitch(std::vector<Matrix<float>> *x_chunked, Matrix<float> *x);
 
 void double_chunk_up_sp(SparseMatrix<float> *sp_mat, std::vector<SparseMatrix<float>> *chunks, long chunk_size);
 
+void double_chunk_up_sp(SparseMatrix<float> *sp_mat, std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries);
+
+void index_tiles(std::vector<SparseMatrix<float>> *tiles, TileIndex *index);
+
+double get_tile_density(TileIndex *index);
+
+void print_tile_index(TileIndex *index);
+
+std::string get_chunk_cache_path(std::string path, std::vector<long> *boundaries);
+
+void save_double_chunked_sp(std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries, std::string source_path, std::string path);
+
+bool load_double_chunked_sp(std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries, std::string source_path, std::string path);
+
+void double_chunk_up_sp_cached(std::string path, std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries);
+
+std::string get_row_ptr_cache_path(std::string path);
+
+void save_row_ptr(std::vector<int> *row_ptr, std::string source_path, std::string path);
+
+bool load_row_ptr(std::vector<int> *row_ptr, std::string source_path, std::string path);
+
+// the row pointers of an mtx adjacency are cached next to it, so the balanced boundaries do not parse it every run
+void load_sp_matrix_row_ptr_cached(std::string path, std::vector<int> *row_ptr);
+
+// random unions of clusters_per_batch chunks, every chunk in one batch per epoch, each batch sorted
+void get_cluster_batches(long num_chunks, long clusters_per_batch, long seed, long epoch, std::vector<std::vector<long>> *batches);
+
+// nodes of the chunks of a batch, in the order of the batch
+void get_cluster_nodes(std::vector<long> *boundaries, std::vector<long> *clusters, std::vector<int> *nodes);
+
+// the tiles between the chunks of a batch as one adjacency, edges to other chunks are dropped
+void get_cluster_subgraph(std::vector<SparseMatrix<float>> *tiles, std::vector<long> *boundaries, std::vector<long> *clusters,
+                          SparseMatrix<float> *subgraph);
+
+void stitch(std::vector<Matrix<float>> *x_chunked, std::vector<long> *clusters, Matrix<float> *x);
+
+// like get_cluster_subgraph, but from the whole adjacency instead of its tiles
+void get_chunks_subgraph(SparseMatrix<float> *adjacency, std::vector<long> *boundaries, std::vector<long> *chunks,
+                         SparseMatrix<float> *subgraph);
+
+// the tiles on the diagonal as one adjacency, edges between chunks are dropped
+void get_diagonal_subgraph(SparseMatrix<float> *adjacency, std::vector<long> *boundaries, SparseMatrix<float> *subgraph);
+
+// tiles off the diagonal with at least one non-zero
+long get_num_off_diagonal_tiles(SparseMatrix<float> *adjacency, std::vector<long> *boundaries);
+
 #endif//ALZHEIMER_CHUNK_H
@@ -0,0 +1,146 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_DATA_PARALLEL_HPP
+#define ALZHEIMER_DATA_PARALLEL_HPP
+
+#include "tensors.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+// memory mapped by several processes. an anonymous segment is shared with the processes forked after it, a named one
+// with every process that attaches to the name
+class SharedSegment {
+private:
+    std::string name_;
+    char *data_ = NULL;
+    long size_ = 0;
+    bool is_creator_ = false;
+
+public:
+    // anonymous
+    SharedSegment(long size);
+    // named, created by this process and unlinked by its destructor
+    SharedSegment(std::string name, long size);
+    // named, created by another process
+    SharedSegment(std::string name);
+    ~SharedSegment();
+    char *get_data();
+    long get_size();
+};
+
+struct SharedBarrierState {
+    std::atomic<long> counter;// only grows
+    std::atomic<bool> is_aborted;
+};
+
+// every process waits until all of them arrived, spinning on the counter. call in the same order in every process
+class SharedBarrier {
+private:
+    SharedBarrierState *state_;
+    long num_processes_;
+    long num_waits_ = 0;
+
+public:
+    // the state in shared memory, initialised before any process waits
+    SharedBarrier(SharedBarrierState *state, long num_processes);
+    static void init(SharedBarrierState *state);
+    // throws once a process aborted, so the others do not wait for it forever
+    void wait();
+    void abort();
+};
+
+// allreduce and broadcast through one slot per process in shared memory. every process writes its slot, reduces
+// its share of the values over all slots, and reads the reduced values of the others. the same traffic as a ring
+// allreduce without its handoffs, and no locks, only the barrier
+class SharedAllreduce {
+private:
+    SharedBarrier *barrier_;
+    float *slots_;// one per process, then the reduced values
+    long rank_;
+    long num_processes_;
+    long count_;
+
+    long copy_to_slot(std::vector<Matrix<float> *> *matrices, float *slot);
+    void copy_from_slot(float *slot, std::vector<Matrix<float> *> *matrices);
+
+public:
+    // floats of the slots of count values each
+    static long get_slots_size(long num_processes, long count);
+    SharedAllreduce(SharedBarrier *barrier, float *slots, long rank, long num_processes, long count);
+    // mean over the processes, every process passes matrices of the same shapes and layouts in the same order
+    void allreduce(std::vector<Matrix<float> *> *matrices);
+    // the values of root in every process
+    void broadcast(std::vector<Matrix<float> *> *matrices, long root);
+};
+
+// the dataset and the allreduce slots in one segment, loaded by one process for all of them
+struct SharedGraphHeader {
+    long num_processes;
+    long num_nodes;
+    long num_features;
+    long nnz;
+    long slots_size;// floats of the allreduce slots
+};
+
+struct SharedGraph {
+    SharedGraphHeader *header;
+    long *num_halo_nodes;// per process
+    float *features;// row-major
+    int *row_ptr;
+    int *col_ind;
+    float *values;
+    int *classes;
+    float *slots;
+};
+
+// bytes of the segment
+long get_shared_graph_size(SharedGraphHeader *header);
+
+// the arrays of the segment, which starts with the header
+void map_shared_graph(char *data, SharedGraph *graph);
+
+// rows first_row up to last_row of the graph, followed by their halo, the nodes outside of the rows at most num_hops
+// hops away. the halo nodes of the last hop keep their neighbours among the local nodes, or get a self loop without
+// any, all others keep their neighbours, so num_hops layers compute the rows as on the whole graph. with one hop and
+// a halo exchange before every aggregation, the halo rows pass the gradients of the rows to their owners on a
+// symmetric graph. nodes are the global ids of the local ones
+void get_partition_graph(int *row_ptr, int *col_ind, float *values, long num_nodes, long first_row, long last_row,
+                         long num_hops, std::vector<long> *nodes, SparseMatrix<float> *adjacency);
+
+// the halo rows of the local graphs of get_partition_graph through a named segment with a row for every halo node of
+// every process. before an aggregation the owners of the rows write them to the halos that hold them, after its
+// backward pass every process writes the gradients of its halo rows and the owners add them to their rows
+class SharedHaloExchange {
+private:
+    SharedBarrier *barrier_;
+    SharedSegment *segment_ = NULL;
+    float *buffers_;
+    long rank_;
+    long num_rows_;
+    long max_features_;
+    long offset_;// first row of the buffer of the process
+    long num_halo_nodes_;
+    std::vector<long> boundaries_;
+    std::vector<long> send_rows_;   // local rows of the process in the halos of the others
+    std::vector<long> send_offsets_;// and their rows in the buffers
+
+    float *get_value(std::vector<Matrix<float>> *x, long row, long column);
+
+public:
+    // num_halo_nodes in shared memory, one per process. nodes and num_rows like get_partition_graph gives them,
+    // boundaries of the chunks of the local rows. call in every process at the same time
+    SharedHaloExchange(SharedBarrier *barrier, long *num_halo_nodes, std::string segment_name, long rank,
+                       long num_processes, std::vector<long> *nodes, long num_rows, long max_features,
+                       std::vector<long> *boundaries);
+    ~SharedHaloExchange();
+    // the halo rows of x get the values of their owners
+    void exchange(std::vector<Matrix<float>> *x);
+    // the owners add the gradients of their rows in the halos of the others, the halo rows are zero afterwards
+    void reduce(std::vector<Matrix<float>> *gradients);
+    long get_num_halo_nodes();
+};
+
+#endif//ALZHEIMER_DATA_PARALLEL_HPP
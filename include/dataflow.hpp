@@ -0,0 +1,62 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_DATAFLOW_HPP
+#define ALZHEIMER_DATAFLOW_HPP
+
+#include "chunking.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+
+// what chunk c of a node needs of one of its inputs
+enum DataflowEdge { chunk_edge,// chunk c, element-wise layers
+                    tile_edge, // every chunk with a non-empty tile in row chunk c, feature aggregation
+                    all_edge };// every chunk
+
+struct DataflowNode {
+    std::string name;
+    std::function<void(long chunk)> run;
+    std::function<void()> end;// after the last chunk, may be empty
+    std::vector<long> inputs;
+    std::vector<DataflowEdge> edges;
+};
+
+// runs a DAG of chunked layers as (node, chunk) tasks, every task starts once the chunks it reads are done,
+// so element-wise chains run chunk by chunk instead of layer by layer and only aggregations wait for more than one chunk.
+// the chunks of a node run in order, one at a time, ready tasks of earlier chunks and later nodes first
+class Dataflow {
+private:
+    long num_chunks_;
+    TileIndex *tile_index_;
+    std::vector<DataflowNode> nodes_;
+    std::vector<std::vector<long>> readers_;// row chunks with a non-empty tile in column chunk j
+    std::vector<std::vector<long>> consumers_;// nodes reading node n
+    // state of run
+    std::vector<long> num_missing_;// per task, dependencies not done yet
+    std::priority_queue<std::pair<long, long>> ready_;// minus chunk and node
+    long num_left_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::exception_ptr error_;// the first error of a task
+
+    long get_num_dependencies(long node, long chunk);
+    void done(long node, long chunk);
+    void run_worker();
+
+public:
+    Dataflow(long num_chunks, TileIndex *tile_index);
+    // nodes are added in topological order, returns the id of the node
+    long add_node(std::string name, std::function<void(long chunk)> run, std::function<void()> end,
+                  std::vector<long> inputs, std::vector<DataflowEdge> edges);
+    long get_num_nodes();
+    // returns once every node is done with every chunk, rethrows the first error of a task
+    void run(long num_threads);
+};
+
+#endif//ALZHEIMER_DATAFLOW_HPP
@@ -15,4 +15,6 @@ std::string get_dataset_name(Dataset dataset);
 
 long get_dataset_num_classes(Dataset dataset);
 
+std::string get_adjacency_path(std::string dataset_path);
+
 #endif//ALZHEIMER_DATASET_HPP
@@ -12,14 +12,14 @@
 
 class Dropout : public Layer {
 protected:
-    CudaHelper *cuda_helper_ = NULL;
     float probability_;
     unsigned long long seed_;
     size_t state_size_;
     char *reserve_space_ = NULL;
     size_t reserve_space_size_;
-    Matrix<float> y_;
-    Matrix<float> gradients_;
+    Matrix<float> *x_ = NULL;
+    bool keep_layout_ = false;
+    bool is_row_major_mask_ = true;// layout of the last forward pass, the mask only fits it
 
 public:
     Dropout();
@@ -30,6 +30,11 @@ public:
     void forward(Matrix<float> *x, Matrix<float> *y);
     Matrix<float> *backward(Matrix<float> *in_gradients);
     void backward(Matrix<float> *incoming_gradients, Matrix<float> *y, Matrix<float> *gradients);
+    // runs in the layout of the input instead of row-major, element-wise it is the same
+    void set_keep_layout(bool keep_layout);
+    // activation recomputation, the output comes back from the input and the mask of the last forward pass
+    void release_y();
+    void recompute_y();
 };
 
 class DropoutChunked : public LayerChunked {
@@ -38,21 +43,41 @@ protected:
     float probability_;
     unsigned long long seed_;
     int chunk_size_;
-    int last_chunk_size_;
     int num_chunks_;
     size_t state_size_;
     std::vector<char *> reserve_space_;
     size_t reserve_space_size_;
     std::vector<Matrix<float>> y_;
     std::vector<Matrix<float>> gradients_;
+    std::vector<Matrix<float>> *x_ = NULL;
+    bool keep_layout_ = false;
+    std::vector<bool> is_row_major_mask_;
+    void *d_states_forward_ = NULL;
+    cudnnDropoutDescriptor_t dropout_desc_forward_;
+    void *d_x_forward_;
+    void *d_y_forward_;
+    void *d_reserve_space_forward_;
+    cudnnTensorDescriptor_t x_desc_forward_;
+    cudnnTensorDescriptor_t y_desc_forward_;
 
 public:
     DropoutChunked();
     DropoutChunked(CudaHelper *helper, int chunk_size, int num_nodes, long num_features);
+    DropoutChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features);
     ~DropoutChunked();
     void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x) override;
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *x) override;
+    void forward_chunk(long chunk) override;
+    void forward_end() override;
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
+    // every chunk stays in the layout it comes in
+    void set_keep_layout(bool keep_layout);
+    std::vector<Matrix<float>> *get_input_gradients();
+    // activation recomputation, the output comes back from the input and the masks of the last forward pass
+    void release_y();
+    void recompute_y();
 };
 
 class DropoutPipelined : public LayerPipelined, public DropoutChunked {
@@ -69,13 +94,14 @@ protected:
     std::vector<float *> d_dy_;
     std::vector<char *> d_states_;
     std::vector<char *> d_reserve_space_;
-    std::vector<Matrix<float>> *x_ = NULL;
     std::vector<Matrix<float>> *incoming_gradients_ = NULL;
 
 public:
     DropoutPipelined();
     DropoutPipelined(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
+    DropoutPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_features);
     void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x);
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
     void forward_in(long chunk, long buffer) override;
@@ -0,0 +1,109 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_EMULATED_DEVICE_HPP
+#define ALZHEIMER_EMULATED_DEVICE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+class EmulatedDevice;
+
+// runs its operations in order on its own worker thread, like a CUDA stream
+class EmulatedStream {
+private:
+    EmulatedDevice *device_;
+    std::thread worker_;
+    std::deque<std::function<void()>> queue_;
+    long num_enqueued_ = 0;
+    long num_done_ = 0;
+    bool stop_ = false;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+
+    void run();
+
+public:
+    EmulatedStream(EmulatedDevice *device);
+    ~EmulatedStream();
+    void enqueue(std::function<void()> operation);
+    // waits for every operation enqueued so far
+    void synchronize();
+};
+
+// a point in a stream, operations enqueued after a wait for it start once the stream reached the last record
+struct EmulatedEvent {
+    long num_recorded = 0;
+    long num_reached = 0;
+    std::vector<double> times;// on the virtual timeline, per record
+};
+
+// on the virtual timeline, in seconds
+struct EmulatedDeviceStats {
+    long peak_memory = 0;
+    double time = 0.0;         // since the last reset until the last stream is done
+    double busy_time = 0.0;    // at least one stream copies or computes
+    double overlap_ratio = 1.0;// busy time of all streams summed up over busy_time, 1 without any overlap, 3 at most
+    double stall_time = 0.0;   // streams waiting for events of other streams
+};
+
+// host memory and threads standing in for a GPU with a hard memory capacity, a limited transfer bandwidth and
+// compute rate, so out-of-core schedules run, and can be tuned, on machines without one. operations run in stream
+// order, but take their cost on a virtual timeline instead of the wall clock, so the stats are the same on any machine.
+// FeatureAggregationPipelined runs on it entirely, the layers on LayerPipelined only take their timing from it
+class EmulatedDevice {
+private:
+    long capacity_;
+    double bandwidth_;
+    double flop_rate_;
+    std::map<void *, long> allocations_;
+    long memory_used_ = 0;
+    std::map<EmulatedStream *, double> clocks_;// virtual time every stream is done at
+    double start_time_ = 0.0;                  // of the last reset
+    EmulatedDeviceStats stats_;
+    std::vector<std::pair<double, double>> busy_;// start and end of every copy and kernel
+    std::exception_ptr error_;                   // the first error of an operation on a stream
+    std::mutex mutex_;
+    std::condition_variable reached_;
+
+    void advance(EmulatedStream *stream, double seconds);
+
+public:
+    EmulatedStream *stream_in_;
+    EmulatedStream *stream_compute_;
+    EmulatedStream *stream_out_;
+
+    // capacity in bytes, bandwidth in bytes per second, flop rate in floating point operations per second
+    EmulatedDevice(long capacity, double bandwidth, double flop_rate);
+    // at 10 TFLOP/s
+    EmulatedDevice(long capacity, double bandwidth);
+    ~EmulatedDevice();
+    void *allocate(long size);
+    void deallocate(void *ptr);
+    long get_memory_used();
+    double get_copy_time(long size);
+    double get_compute_time(double num_flops);
+    // takes get_copy_time(size) on the stream
+    void memcpy_async(void *dst, const void *src, long size, EmulatedStream *stream);
+    // takes seconds on the stream, however long kernel runs on the host
+    void launch(std::function<void()> kernel, double seconds, EmulatedStream *stream);
+    void record(EmulatedEvent *event, EmulatedStream *stream);
+    void wait(EmulatedStream *stream, EmulatedEvent *event);
+    // the host waits, rethrows the first error of an operation, errors stick like they do on a GPU.
+    // the host issues on the virtual timeline without delay
+    void synchronize(EmulatedEvent *event);
+    void synchronize();
+    void set_error(std::exception_ptr error);
+    EmulatedDeviceStats get_stats();
+    // while the streams are idle
+    void reset_stats();
+};
+
+#endif//ALZHEIMER_EMULATED_DEVICE_HPP
@@ -3,9 +3,13 @@
 #ifndef GRAPH_CONVOLUTION_H
 #define GRAPH_CONVOLUTION_H
 
+#include <thread>
 #include <vector>
 
+#include "chunking.hpp"
 #include "cuda_helper.hpp"
+#include "hybrid.hpp"
+#include "numa.hpp"
 #include "tensors.hpp"
 
 
@@ -13,10 +17,16 @@ class FeatureAggregation {
 private:
     CudaHelper *cuda_helper_;
     SparseMatrix<float> *adjacency_;
+    SparseMatrix<float> *adjacency_transposed_;
+    // each direction in the hybrid format if its degrees are skewed
+    bool use_hybrid_ = true;
+    bool is_hybrid_;
+    HybridSparseMatrix hybrid_;
+    bool is_hybrid_transposed_;
+    HybridSparseMatrix hybrid_transposed_;
     Matrix<float> *adjacency_row_sum_;
     std::string reduction_;
     bool mean_;
-    Matrix<float> sum_;
     Matrix<float> y_;
     Matrix<float> gradients_;
 
@@ -28,53 +38,122 @@ public:
                        long num_nodes, long num_features, Matrix<float> *sum);
     void set(CudaHelper *helper, SparseMatrix<float> *adjacency, std::string reduction,
              long num_nodes, long num_features, Matrix<float> *sum);
+    // bipartite adjacency of a sampled block, the backward pass multiplies with the transposed one
+    void set(CudaHelper *helper, SparseMatrix<float> *adjacency, SparseMatrix<float> *adjacency_transposed,
+             std::string reduction, long num_features, Matrix<float> *sum);
+    // call before set, off for adjacencies that change every batch as the conversion runs on the CPU in set
+    void set_hybrid(bool use_hybrid);
     Matrix<float> *forward(Matrix<float> *x);
     Matrix<float> *backward(Matrix<float> *in_gradients);
+    Matrix<float> *get_y();
+    Matrix<float> *get_input_gradients();
 };
 
 class FeatureAggregationChunked {
 protected:
     CudaHelper *cuda_helper_;
     long chunk_size_;
-    long last_chunk_size_;
     long num_chunks_;
+    std::vector<long> boundaries_;
     bool mean_;
     std::vector<SparseMatrix<float>> *adjacencies_;
+    TileIndex tile_index_;
+    // tiles with skewed degrees in the hybrid format, the others stay in CSR
+    HybridTiles own_hybrid_tiles_;
+    HybridTiles *hybrid_tiles_ = NULL;
     Matrix<float> *adjacency_row_sum_;
     std::vector<Matrix<float>> y_;
     std::vector<Matrix<float>> gradients_;
+    // historical embeddings, GNNAutoScale style
+    bool use_history_ = false;
+    bool history_ready_ = false;
+    bool history_used_ = false;// by the last forward pass
+    std::vector<Matrix<float>> history_;        // input of the last forward pass
+    std::vector<Matrix<float>> halo_aggregates_;// what every row chunk got from the other chunks in the last forward pass
+    std::thread history_thread_;
+    NumaTopology numa_topology_;
+    NumaPlacement numa_placement_ = numa_none;
+    // state of a forward pass between forward_begin and forward_end
+    std::vector<Matrix<float>> *x_ = NULL;
+    float *d_x_forward_ = NULL;
+    float *d_y_forward_ = NULL;
+    float *d_sum_chunk_ = NULL;
+
+    void wait_history();
 
 public:
     std::string name_;
 
     FeatureAggregationChunked();
+    virtual ~FeatureAggregationChunked();
     FeatureAggregationChunked(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
                               std::string reduction, long num_features, long chunk_size, long num_nodes);
+    FeatureAggregationChunked(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+                              std::string reduction, long num_features, std::vector<long> *boundaries);
     virtual void set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
                      std::string reduction, long num_features, long chunk_size, long num_nodes);
+    virtual void set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+                     std::string reduction, long num_features, std::vector<long> *boundaries);
+    // neighbours outside the row chunk are read from the last forward pass instead of the current input,
+    // so every row chunk only moves its own input, tile and halo aggregate, call after set
+    void set_history(bool use_history);
+    // the history and halo aggregates of row chunk i live on its node, which also computes the halo aggregates.
+    // call after set_history, the tiles and the input should be placed the same way
+    void set_numa_placement(NumaPlacement placement);
+    // converts the tiles the first time, layers on the same tiles should share the result, call after set
+    HybridTiles *get_hybrid_tiles();
+    void set_hybrid_tiles(HybridTiles *hybrid_tiles);
     virtual std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x);
+    // the forward pass one row chunk at a time, row chunk i needs every chunk of x with a non-empty tile in it
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *x);
+    void forward_chunk(long chunk);
+    void forward_end();
+    // true after forward_begin if row chunk i only reads chunk i of x, the history is ready from the second pass on
+    bool is_history_used();
     virtual std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients);
+    std::vector<Matrix<float>> *get_input_gradients();
 };
 
+// products of the tiles off the diagonal with the chunks of x, summed per row chunk, in column-major order
+void get_halo_aggregates(std::vector<SparseMatrix<float>> *tiles, TileIndex *tile_index, std::vector<Matrix<float>> *x,
+                         std::vector<Matrix<float>> *aggregates);
+// row chunk i on threads pinned to its node
+void get_halo_aggregates(std::vector<SparseMatrix<float>> *tiles, TileIndex *tile_index, std::vector<Matrix<float>> *x,
+                         std::vector<Matrix<float>> *aggregates, NumaTopology *topology, NumaPlacement placement);
+
+class EmulatedDevice;
+
 class FeatureAggregationPipelined : public FeatureAggregationChunked {
 protected:
+    EmulatedDevice *emulated_device_ = NULL;
     long num_steps_;
     float *d_y_;
     float *d_sum_forward_;
     float *d_gradients_;
     std::vector<float *> d_x_;
     std::vector<SparseMatrixCuda<float>> d_adj_;
+    std::vector<HybridSparseMatrixCuda> d_hybrid_;
     std::vector<float *> d_incoming_gradients_;
     std::vector<float *> d_sum_backward_;
 
+    // the pipeline on the streams of the emulated device, y gets the products of the tiles with x
+    void run_emulated(std::vector<Matrix<float>> *x, std::vector<Matrix<float>> *y, bool forward);
+
 public:
     FeatureAggregationPipelined();
     FeatureAggregationPipelined(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
                                 std::string reduction, long num_features, long chunk_size, long num_nodes);
+    FeatureAggregationPipelined(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+                                std::string reduction, long num_features, std::vector<long> *boundaries);
     void set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
              std::string reduction, long num_features, long chunk_size, long num_nodes) override;
+    void set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+             std::string reduction, long num_features, std::vector<long> *boundaries) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x) override;
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
+    // forward and backward allocate their buffers on the device, copy through its streams and multiply the tiles in
+    // CSR on the host, so they need no GPU and stay within the capacity of the device. NULL for the GPU
+    void set_emulated_device(EmulatedDevice *device);
 };
 
 #endif
@@ -0,0 +1,34 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_FEATURE_CACHE_HPP
+#define ALZHEIMER_FEATURE_CACHE_HPP
+
+#include "tensors.hpp"
+
+#include <vector>
+
+
+// feature rows of the nodes with the highest in-degree, which neighbour sampling draws into nearly every mini-batch,
+// in one contiguous buffer so gathers read them from there instead of from the whole feature matrix
+class FeatureCache {
+public:
+    long num_nodes_ = 0;
+    long num_features_ = 0;
+    std::vector<int> slots_;    // slot of every node, -1 if it is not cached
+    std::vector<int> nodes_;    // node of every slot, by decreasing in-degree
+    std::vector<float> values_; // row-major, one row per slot
+
+    FeatureCache();
+    FeatureCache(SparseMatrix<float> *adjacency, Matrix<float> *features, long num_cached);
+    void set(SparseMatrix<float> *adjacency, Matrix<float> *features, long num_cached);
+    // cached row of the node, NULL on a miss
+    float *get_row(long node);
+};
+
+// number of non-zeros in every column
+void get_in_degrees(SparseMatrix<float> *adjacency, std::vector<long> *in_degrees);
+
+// the num_nodes nodes with the highest in-degree, ties broken by the lower id
+void get_hot_nodes(std::vector<long> *in_degrees, long num_nodes, std::vector<int> *nodes);
+
+#endif//ALZHEIMER_FEATURE_CACHE_HPP
@@ -0,0 +1,38 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_GENERATOR_HPP
+#define ALZHEIMER_GENERATOR_HPP
+
+#include "ingest.hpp"
+
+#include <string>
+#include <vector>
+
+
+enum GraphModel { rmat,
+                  power_law };
+
+struct GeneratorOptions {
+    GraphModel model = rmat;
+    long num_nodes = 1l << 20;
+    long num_edges = 1l << 24;// edges drawn before deduplication and symmetrization
+    double a = 0.57;          // R-MAT quadrant probabilities, d = 1 - a - b - c
+    double b = 0.19;
+    double c = 0.19;
+    double exponent = 2.1;// power-law degree exponent, larger than 2
+    bool permute = true;  // shuffle node ids so hubs are not clustered at low ids
+    long num_features = 512;
+    long num_classes = 64;
+    long seed = 0;
+    long batch_size = 1l << 20;// edges or values drawn per task
+};
+
+void generate_edges(GeneratorOptions *options, std::vector<int> *permutation, long batch, std::vector<Edge> *edges);
+
+long generate_graph(std::string csr_path, GeneratorOptions *options, IngestOptions *ingest_options);
+
+long generate_features(std::string npy_path, GeneratorOptions *options, IngestOptions *ingest_options);
+
+long generate_labels(std::string npy_path, GeneratorOptions *options, IngestOptions *ingest_options);
+
+#endif//ALZHEIMER_GENERATOR_HPP
@@ -0,0 +1,119 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_HYBRID_HPP
+#define ALZHEIMER_HYBRID_HPP
+
+#include "cuda_helper.hpp"
+#include "tensors.hpp"
+
+#include <cstddef>
+#include <vector>
+
+
+// page-locked host memory, so the copies of the hybrid arrays on the copy stream are asynchronous like the ones of the
+// CSR tiles
+template<typename T>
+class PinnedAllocator {
+public:
+    typedef T value_type;
+
+    PinnedAllocator() {}
+    template<typename U>
+    PinnedAllocator(const PinnedAllocator<U> &) {}
+    T *allocate(std::size_t n) {
+        T *values;
+        check_cuda(cudaMallocHost(&values, n * sizeof(T)));
+        return values;
+    }
+    void deallocate(T *values, std::size_t) {
+        check_cuda(cudaFreeHost(values));
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const PinnedAllocator<T> &, const PinnedAllocator<U> &) {
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const PinnedAllocator<T> &, const PinnedAllocator<U> &) {
+    return false;
+}
+
+template<typename T>
+using PinnedVector = std::vector<T, PinnedAllocator<T>>;
+
+// short rows in SELL-C-sigma slices, hub rows in CSR so their non-zeros are split across threads
+class HybridSparseMatrix {
+public:
+    long num_rows_ = 0;
+    long num_columns_ = 0;
+    long nnz_ = 0;
+    long hub_degree_ = 0;// rows with more non-zeros are hubs
+    long slice_size_ = 0;// C, rows per slice
+    long num_slices_ = 0;
+    PinnedVector<int> slice_ptr_; // first position of each slice, the last entry is the padded size
+    PinnedVector<int> slice_rows_;// row of every lane, -1 for padding lanes
+    PinnedVector<int> sell_col_ind_;// lane after lane, position slice_ptr + k * C + lane holds the k-th entry of the lane
+    PinnedVector<float> sell_val_;
+    long hub_nnz_ = 0;
+    PinnedVector<int> hub_rows_;
+    PinnedVector<int> hub_row_ptr_;// over all rows, rows that are no hubs are empty
+    PinnedVector<int> hub_col_ind_;
+    PinnedVector<float> hub_val_;
+};
+
+// the tiles of an adjacency with skewed degrees in the hybrid format, with the largest sizes any of them needs on the GPU
+class HybridTiles {
+public:
+    std::vector<bool> is_hybrid_;
+    std::vector<HybridSparseMatrix> hybrids_;
+    long max_slice_size_ = 0;
+    long max_num_slices_ = 0;
+    long max_sell_size_ = 0;
+    long max_hub_nnz_ = 0;
+};
+
+class HybridSparseMatrixCuda {
+public:
+    bool freed_ = true;
+    long num_rows_ = 0;
+    long num_columns_ = 0;
+    long slice_size_ = 0;
+    long num_slices_ = 0;
+    int *slice_ptr_ = NULL;
+    int *slice_rows_ = NULL;
+    int *sell_col_ind_ = NULL;
+    float *sell_val_ = NULL;
+    SparseMatrixCuda<float> hubs_;
+
+    HybridSparseMatrixCuda();
+    // room for any matrix up to these sizes
+    void set(long num_rows, long num_columns, long slice_size, long num_slices, long sell_size, long hub_nnz);
+    void free();
+    ~HybridSparseMatrixCuda();
+};
+
+// rows per power-of-two degree bucket, bucket 0 holds empty rows and bucket b the degrees from 2^(b - 1) to 2^b - 1
+void get_degree_histogram(SparseMatrix<float> *sp_mat, std::vector<long> *histogram);
+
+// 0 if the degrees are not skewed enough for the hybrid format to pay off
+long get_hub_degree(SparseMatrix<float> *sp_mat);
+
+void to_hybrid(SparseMatrix<float> *sp_mat, long hub_degree, long slice_size, long sort_window, HybridSparseMatrix *hybrid);
+
+// converts the matrix if its degree histogram asks for it, returns whether it did
+bool to_hybrid_if_skewed(SparseMatrix<float> *sp_mat, HybridSparseMatrix *hybrid);
+
+void to_hybrid_tiles(std::vector<SparseMatrix<float>> *tiles, HybridTiles *hybrid_tiles);
+
+void hybrid_mat_mat_multi(HybridSparseMatrix *sp_mat, Matrix<float> *mat, Matrix<float> *result, bool add_to_result);
+
+void malloc_memcpy_hybrid(HybridSparseMatrixCuda *d_sp_mat, HybridSparseMatrix *sp_mat);
+
+void memcpy_hybrid_async(HybridSparseMatrixCuda *d_sp_mat, HybridSparseMatrix *sp_mat, cudaStream_t stream);
+
+void hybrid_mat_mat_multi_cuda(CudaHelper *cuda_helper, HybridSparseMatrixCuda *d_sp_mat, float *d_mat, float *d_result,
+                               long mat_columns, bool add_to_result);
+
+#endif//ALZHEIMER_HYBRID_HPP
@@ -0,0 +1,72 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_INFERENCE_HPP
+#define ALZHEIMER_INFERENCE_HPP
+
+#include "chunking.hpp"
+#include "cuda_helper.hpp"
+#include "tensors.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// full-graph inference with trained SAGE parameters, layer by layer over the row chunks. only the embeddings of the
+// previous and of the current layer are alive, there are no gradients and no intermediate outputs
+class Inference {
+private:
+    CudaHelper *cuda_helper_;
+    std::vector<SparseMatrix<float>> *adjacencies_;
+    Matrix<float> *adjacency_row_sum_;// NULL for a sum
+    std::vector<long> boundaries_;
+    std::vector<Matrix<float> *> parameters_;
+    TileIndex tile_index_;
+    cudnnActivationDescriptor_t relu_desc_;
+    long num_chunks_;
+    long chunk_size_;
+    long num_layers_;
+    std::string spill_dir_;
+    std::string embeddings_path_;
+    std::vector<int> *new_ids_ = NULL;
+    std::vector<int> old_ids_;
+    // embeddings of the previous and of the current layer, in host memory if nothing is spilled
+    std::vector<Matrix<float>> *features_ = NULL;
+    std::vector<Matrix<float>> previous_;
+    std::vector<Matrix<float>> current_;
+    Matrix<float> spill_chunk_;
+    std::ifstream spill_in_;
+    std::ofstream spill_out_;
+    // device buffers of a single row chunk
+    float *d_x_ = NULL;
+    float *d_self_ = NULL;
+    float *d_aggregation_ = NULL;
+    float *d_y_ = NULL;
+    float *d_sum_ = NULL;
+    float *d_ones_ = NULL;
+    float *d_weight_self_ = NULL;
+    float *d_weight_neighbourhood_ = NULL;
+    float *d_bias_ = NULL;
+
+    std::string get_spill_path(long layer);
+    long get_num_features(long layer);
+    Matrix<float> *get_input(long layer, long chunk);
+    void forward_layer_init(long layer);
+    void forward_chunk(long layer, long chunk, Matrix<float> *y);
+    void forward_layer_free();
+
+public:
+    // parameters in the order of Model::get_parameters, four per layer. mean if there is a row sum
+    Inference(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+              std::vector<long> *boundaries, std::vector<Matrix<float> *> parameters);
+    // the embeddings of the previous layer go to a file in this directory instead of host memory
+    void set_spill_dir(std::string path);
+    // output of the last hidden layer, one row per node
+    void set_embeddings_path(std::string path);
+    // the graph is reordered, new_ids[old id] = new id. the outputs are written in the order of the old ids
+    void set_permutation(std::vector<int> *new_ids);
+    // class of every node, appended to the npy file chunk by chunk. returns the number of nodes
+    long run(std::vector<Matrix<float>> *features, std::string predictions_path);
+};
+
+#endif//ALZHEIMER_INFERENCE_HPP
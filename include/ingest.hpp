@@ -0,0 +1,50 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_INGEST_HPP
+#define ALZHEIMER_INGEST_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+
+struct IngestOptions {
+    long num_nodes = 0;// 0 means largest node id + 1
+    bool symmetrize = false;
+    long memory_limit = 1l << 32;// bytes for sorting and merging edges, the parsed block and the row counts come on top
+    long block_size = 1l << 26;  // bytes read from the input per parsing round
+    long num_threads = 0;        // 0 means hardware concurrency
+    std::string tmp_dir = "/tmp";
+};
+
+typedef std::pair<int, int> Edge;
+
+long get_num_threads(IngestOptions *options);
+
+void parse_edges(const char *begin, const char *end, std::vector<Edge> *edges, bool symmetrize, long *max_node);
+
+void parse_values(const char *begin, const char *end, std::vector<float> *values, long *num_rows, long *num_columns);
+
+void sort_unique_edges(std::vector<Edge> *edges, long num_threads);
+
+// edges that fit into half of the memory limit, the sort needs the other half
+long get_max_buffered_edges(IngestOptions *options);
+
+// spills the buffered edges as a sorted run to the tmp dir once they reach the maximum, or always if forced
+void spill_edges(std::vector<Edge> *edges, std::vector<std::string> *run_paths, IngestOptions *options, bool force);
+
+// appends new edges without growing the buffer past the maximum, spilling first if they do not fit
+void buffer_edges(std::vector<Edge> *edges, std::vector<Edge> *new_edges, std::vector<std::string> *run_paths,
+                  IngestOptions *options);
+
+// sorts, deduplicates and merges the buffered edges and runs into a CSR file, returns the number of edges
+long write_sorted_csr(std::vector<Edge> *edges, std::vector<std::string> *run_paths, std::string csr_path, long num_nodes,
+                      IngestOptions *options);
+
+long ingest_edge_list(std::string path, std::string csr_path, IngestOptions *options);
+
+long ingest_feature_table(std::string path, std::string npy_path, IngestOptions *options);
+
+long ingest_label_table(std::string path, std::string npy_path, IngestOptions *options);
+
+#endif//ALZHEIMER_INGEST_HPP
@@ -17,15 +17,18 @@ protected:
 public:
     std::string name_;
 
+    virtual ~Layer();
     virtual Matrix<float> *forward(Matrix<float> *x) = 0;
     virtual Matrix<float> *backward(Matrix<float> *incoming_gradients) = 0;
     virtual void set(CudaHelper *helper, long num_nodes, long num_features) = 0;
+    // the buffers of the layer, for a memory plan
+    Matrix<float> *get_y();
+    Matrix<float> *get_input_gradients();
 };
 
 class LayerChunked {
 protected:
-    long chunk_size_;
-    long last_chunk_size_;
+    long chunk_size_;// rows of the largest chunk
     long num_chunks_;
     CudaHelper *cuda_helper_;
     std::vector<Matrix<float>> y_;
@@ -34,12 +37,24 @@ protected:
 public:
     std::string name_;
 
+    virtual ~LayerChunked();
     virtual std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x) = 0;
+    // the forward pass one chunk at a time, so an executor can interleave the chunks of several layers,
+    // chunk i of the returned output is valid once forward_chunk(i) returned
+    virtual std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *x) = 0;
+    virtual void forward_chunk(long chunk) = 0;
+    virtual void forward_end() = 0;
     virtual std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) = 0;
     virtual void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) = 0;
+    virtual void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) = 0;
 };
 
+class EmulatedDevice;
+
 class LayerPipelined {
+protected:
+    EmulatedDevice *emulated_device_ = NULL;
+
 public:
     virtual void forward_in(long chunk, long buffer) = 0;
     virtual void forward_out(long chunk, long buffer) = 0;
@@ -47,7 +62,14 @@ public:
     virtual void backward_in(long chunk, long buffer) = 0;
     virtual void backward_out(long chunk, long buffer) = 0;
     virtual void backward_compute(long chunk, long buffer) = 0;
-    void pipeline(bool forward, long num_chunks);
+    // bytes the in and out stages copy and floating point operations of the compute stage for a chunk
+    virtual void get_chunk_costs(bool forward, long chunk, long *in_size, double *num_flops, long *out_size);
+    // the stages are scheduled on the streams of the device and take the costs of their chunk on its virtual timeline.
+    // only the timing is emulated: each stage still issues its CUDA calls to the helper and waits for them, and the
+    // layer allocates with cudaMalloc, so this needs a GPU and ignores the capacity. NULL for the streams of the helper
+    void set_emulated_device(EmulatedDevice *device);
+    // in, compute and out of every chunk as a three stage pipeline over num_buffers device buffers
+    void pipeline(CudaHelper *helper, bool forward, long num_chunks, long num_buffers);
 };
 
 #endif//ALZHEIMER_LAYER_H
\ No newline at end of file
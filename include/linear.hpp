@@ -38,6 +38,7 @@ public:
     Linear();
     Linear(CudaHelper *helper, long in_features, long out_features, long num_nodes);
     void set(CudaHelper *helper, long in_features, long out_features, long num_nodes);
+    void set_num_nodes(long num_nodes);
     std::vector<Matrix<float> *> get_parameters();
     std::vector<Matrix<float> *> get_gradients();
     std::vector<float *> get_gradients_cuda();
@@ -50,12 +51,13 @@ public:
     void backward_compute(float *d_dy, float *d_x, long num_rows, float *d_dx);
     void backward_free();
     Matrix<float> *backward(Matrix<float> *incoming_gradients);
+    Matrix<float> *get_y();
+    Matrix<float> *get_input_gradients();
 };
 
 class LinearChunked {
 protected:
     long chunk_size_;
-    long last_chunk_size_;
     long num_chunks_;
     CudaHelper *cuda_helper_;
     std::vector<Matrix<float>> y_;
@@ -64,14 +66,22 @@ protected:
     long num_in_features_;
     long num_out_features_;
     std::vector<Matrix<float>> *x_;
+    float *d_x_forward_ = NULL;
+    float *d_y_forward_ = NULL;
 
 public:
     std::string name_;
 
     LinearChunked();
     LinearChunked(CudaHelper *helper, long chunk_size, long num_nodes, long num_in_features, long num_out_features);
+    LinearChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features);
     virtual void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_in_features, long num_out_features);
+    virtual void set(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features);
     virtual std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x);
+    // the forward pass one chunk at a time, chunk i of the output is valid once forward_chunk(i) returned
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *x);
+    void forward_chunk(long chunk);
+    void forward_end();
     virtual std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients);
     std::vector<Matrix<float> *> get_parameters();
     std::vector<Matrix<float> *> get_gradients();
@@ -89,7 +99,9 @@ protected:
 public:
     LinearPipelined();
     LinearPipelined(CudaHelper *helper, long chunk_size, long num_nodes, long num_in_features, long num_out_features);
+    LinearPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features);
     void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_in_features, long num_out_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features) override;
     void forward_in(long chunk, long buffer) override;
     void forward_out(long chunk, long buffer) override;
     void forward_compute(long chunk, long buffer) override;
@@ -97,6 +109,7 @@ public:
     void backward_in(long chunk, long buffer) override;
     void backward_out(long chunk, long buffer) override;
     void backward_compute(long chunk, long buffer) override;
+    void get_chunk_costs(bool forward, long chunk, long *in_size, double *num_flops, long *out_size) override;
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
 };
 
@@ -35,16 +35,25 @@ protected:
     float alpha_;
     float beta_;
     long chunk_size_;
-    long last_chunk_size_;
     long num_chunks_;
     std::vector<Matrix<float>> y_;
     std::vector<Matrix<float>> gradients_;
+    std::vector<Matrix<float>> *x_ = NULL;
+    float *d_x_forward_ = NULL;
+    float *d_y_forward_ = NULL;
+    cudnnTensorDescriptor_t x_desc_forward_;
+    cudnnTensorDescriptor_t y_desc_forward_;
 
 public:
     LogSoftmaxChunked();
     LogSoftmaxChunked(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
-    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
+    LogSoftmaxChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features);
+    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x);
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *x) override;
+    void forward_chunk(long chunk) override;
+    void forward_end() override;
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients);
 };
 
@@ -59,13 +68,14 @@ protected:
     std::vector<float *> d_y_;
     std::vector<float *> d_dx_;
     std::vector<float *> d_dy_;
-    std::vector<Matrix<float>> *x_ = NULL;
     std::vector<Matrix<float>> *incoming_gradients_ = NULL;
 
 public:
     LogSoftmaxPipelined();
     LogSoftmaxPipelined(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
-    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
+    LogSoftmaxPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_features);
+    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x) override;
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
     void forward_in(long chunk, long buffer) override;
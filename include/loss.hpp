@@ -17,6 +17,7 @@ public:
     float forward(Matrix<float> *x, Matrix<int> *labels);
     float forward(std::vector<Matrix<float>> *x, Matrix<int> *labels);
     Matrix<float> *backward();
+    Matrix<float> *get_input_gradients();
 };
 
 #endif
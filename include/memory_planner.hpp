@@ -0,0 +1,48 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_MEMORY_PLANNER_HPP
+#define ALZHEIMER_MEMORY_PLANNER_HPP
+
+#include "tensors.hpp"
+
+#include <map>
+#include <set>
+#include <vector>
+
+
+struct PlannedTensor {
+    Matrix<float> *matrix;
+    long size;      // in floats, aligned
+    long first_step;// writes it first
+    long last_step; // reads it last
+    long offset;    // in the arena, in floats
+};
+
+// places the activations and gradients of a fixed sequence of steps in one arena, tensors with disjoint lifetimes
+// share memory. matrices only read, like the features, stay where they are. apply after the layers are set
+// and keep the planner alive as long as they are used
+class MemoryPlanner {
+private:
+    std::vector<PlannedTensor> tensors_;
+    std::map<Matrix<float> *, long> ids_;
+    std::set<Matrix<float> *> external_;// read before any step wrote them
+    long num_steps_ = 0;
+    long arena_size_ = 0;
+    float *arena_ = NULL;
+
+public:
+    ~MemoryPlanner();
+    void add_step(std::vector<Matrix<float> *> reads, std::vector<Matrix<float> *> writes);
+    // largest tensors first, each at the lowest offset not used by a tensor live at the same time
+    void plan();
+    // the planned matrices become views into the arena, their values are lost
+    void apply();
+    long get_num_tensors();
+    long get_offset(Matrix<float> *matrix);
+    // in bytes, every tensor in its own buffer and all of them in the arena
+    long get_size_before();
+    long get_size_after();
+    void print();
+};
+
+#endif//ALZHEIMER_MEMORY_PLANNER_HPP
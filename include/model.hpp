@@ -0,0 +1,145 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_MODEL_HPP
+#define ALZHEIMER_MODEL_HPP
+
+#include "add.hpp"
+#include "feature_aggregation.hpp"
+#include "layer.hpp"
+#include "sage_linear.hpp"
+#include "tensors.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+enum ModelMode { model_full,
+                 model_chunked,
+                 model_pipelined };
+
+std::string get_model_mode_name(ModelMode mode);
+
+enum ModelOp { op_dropout,
+               op_aggregation,
+               op_sage_linear,// reads the self input first, then the aggregation
+               op_relu,
+               op_log_softmax,
+               op_relu_dropout };
+
+std::string get_model_op_name(ModelOp op);
+
+// how the gradients of a node with several consumers add up
+enum GradientSum { sum_add,       // in the buffer of an Add layer
+                   sum_in_place };// in the self gradients of the SageLinear layer that reads the node
+
+struct ModelConfig {
+    ModelMode mode = model_full;
+    std::vector<long> channels;// features of the input and of the output of every SAGE layer
+    // passes
+    bool fuse_relu_dropout = true;
+    bool fuse_sage_linear_add = true;
+    bool elide_layout_changes = true;
+    bool eliminate_dead_buffers = true;
+    // of the chunks of the features and tiles in host memory, chunked and pipelined mode
+    NumaPlacement numa_placement = numa_none;
+};
+
+struct ModelNode {
+    ModelOp op;
+    std::string name;
+    std::vector<long> inputs;// -1 is the input of the model
+    long num_features;       // of the output
+    bool is_removed = false; // by a fusion
+    bool needs_input_gradients = true;
+    GradientSum gradient_sum = sum_add;
+    bool keep_layout = false;// element-wise nodes run in the layout of their input instead of row-major
+};
+
+// the SAGE model as a graph of layers, passes rewrite it before a Model runs it in any of the modes
+class ModelGraph {
+private:
+    ModelConfig config_;
+    std::vector<ModelNode> nodes_;
+    long output_;
+    bool is_input_column_major_ = false;
+
+    long add_node(ModelOp op, std::string name, std::vector<long> inputs, long num_features);
+    bool is_row_major_output(long node);
+    bool is_row_major_input(long node);
+
+public:
+    ModelGraph(ModelConfig config);
+    // the passes the config asks for
+    void optimize();
+    // relu followed by its only consumer, a dropout, becomes one relu_dropout. not pipelined, there is no pipelined layer for it
+    void fuse_relu_dropout();
+    // inputs of SageLinear layers sum their gradients in place instead of in an Add layer
+    void fuse_sage_linear_add();
+    // element-wise nodes between column-major producers and consumers stay column-major, so does the input if it
+    // only feeds a dropout
+    void elide_layout_changes();
+    // nodes before the first layer with parameters pass no gradients back, their gradient buffers are freed
+    void eliminate_dead_buffers();
+    ModelConfig *get_config();
+    std::vector<ModelNode> *get_nodes();
+    std::vector<long> get_consumers(long node);
+    long get_output();
+    long get_num_nodes();
+    // in-place transpositions of a forward pass
+    long get_num_layout_changes();
+    bool is_input_column_major();
+    void print();
+};
+
+// runs a graph with the layers of its mode. the layers are built once, every pass reuses their buffers
+class Model {
+private:
+    CudaHelper *cuda_helper_;
+    ModelGraph *graph_;
+    // one layer per node, the kind depends on the op and the mode
+    std::vector<Layer *> layers_;
+    std::vector<FeatureAggregation *> aggregations_;
+    std::vector<SageLinear *> linears_;
+    std::vector<Add *> adds_;
+    std::vector<LayerChunked *> layers_chunked_;
+    std::vector<FeatureAggregationChunked *> aggregations_chunked_;
+    std::vector<SageLinearChunkedParent *> linears_chunked_;
+    std::vector<AddChunked *> adds_chunked_;
+    // output and gradients of the output of every node in the last pass
+    std::vector<Matrix<float> *> y_;
+    std::vector<Matrix<float> *> gradients_;
+    std::vector<std::vector<Matrix<float>> *> y_chunked_;
+    std::vector<std::vector<Matrix<float>> *> gradients_chunked_;
+    std::function<void(std::vector<Matrix<float>> *x)> aggregation_input_hook_;
+    std::function<void(std::vector<Matrix<float>> *gradients)> aggregation_gradients_hook_;
+
+    void set_layers(long num_nodes);
+    void release_dead_buffers();
+    void add_gradients(long node, Matrix<float> *gradients);
+    void add_gradients(long node, std::vector<Matrix<float>> *gradients);
+    std::vector<Matrix<float> *> get_inputs(ModelNode *node, Matrix<float> *x);
+    std::vector<std::vector<Matrix<float>> *> get_inputs(ModelNode *node, std::vector<Matrix<float>> *x);
+
+public:
+    // full mode, the adjacency and its transpose like FeatureAggregation takes them
+    Model(CudaHelper *helper, ModelGraph *graph, SparseMatrix<float> *adjacency, SparseMatrix<float> *adjacency_transposed,
+          std::string reduction, Matrix<float> *sum);
+    // chunked and pipelined mode
+    Model(CudaHelper *helper, ModelGraph *graph, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+          std::string reduction, std::vector<long> *boundaries);
+    ~Model();
+    Matrix<float> *forward(Matrix<float> *x);
+    std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x);
+    // gradients of the parameters, the model input gets none
+    void backward(Matrix<float> *incoming_gradients);
+    void backward(std::vector<Matrix<float>> *incoming_gradients);
+    std::vector<Matrix<float> *> get_parameters();
+    std::vector<Matrix<float> *> get_gradients();
+    // chunked and pipelined mode. input_hook gets the input of every aggregation before the aggregation reads it,
+    // gradients_hook the gradients of that input once they are complete, before the layer that computed it gets them
+    void set_aggregation_hooks(std::function<void(std::vector<Matrix<float>> *x)> input_hook,
+                               std::function<void(std::vector<Matrix<float>> *gradients)> gradients_hook);
+};
+
+#endif//ALZHEIMER_MODEL_HPP
@@ -0,0 +1,45 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_NUMA_HPP
+#define ALZHEIMER_NUMA_HPP
+
+#include "tensors.hpp"
+
+#include <functional>
+#include <vector>
+
+
+// where the row chunks, their tiles and the threads working on them live
+enum NumaPlacement { numa_none,       // wherever the first touch happens
+                     numa_interleaved,// row chunk i on node i modulo the number of nodes
+                     numa_blocked };  // consecutive row chunks on the same node, like the parts of a partition
+
+struct NumaTopology {
+    std::vector<long> nodes;            // ids of the nodes with cpus the process may use
+    std::vector<std::vector<int>> cpus;// of every node
+};
+
+// from sysfs, a single node with every cpu of the process if there is no sysfs
+void get_numa_topology(NumaTopology *topology);
+
+// index into the nodes of the topology
+long get_numa_node(long chunk, long num_chunks, long num_nodes, NumaPlacement placement);
+
+// pins the calling thread to the cpus of the node and prefers the memory of the node for its new pages
+void bind_thread_to_numa_node(NumaTopology *topology, long node);
+
+// calls function for every chunk on threads pinned to the node of the chunk, as many threads per node as it has cpus.
+// without a placement on unpinned threads. rethrows an error of the threads once all of them are done
+void run_on_numa_nodes(NumaTopology *topology, NumaPlacement placement, long num_chunks, std::function<void(long chunk)> function);
+
+// copies the values of every chunk into memory of its node. a later change of the layout allocates new values on the
+// calling thread, so convert the chunks to the layout their users read first
+void place_chunks(NumaTopology *topology, NumaPlacement placement, std::vector<Matrix<float>> *chunks);
+
+// tile (i, j) goes to the node of row chunk i, the node that aggregates row chunk i
+void place_tiles(NumaTopology *topology, NumaPlacement placement, std::vector<SparseMatrix<float>> *tiles);
+
+// id of the node that holds the page, -1 if the kernel does not tell
+long get_numa_node_of(void *address);
+
+#endif//ALZHEIMER_NUMA_HPP
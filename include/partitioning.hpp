@@ -0,0 +1,56 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_PARTITIONING_HPP
+#define ALZHEIMER_PARTITIONING_HPP
+
+#include "tensors.hpp"
+
+#include <random>
+#include <vector>
+
+
+struct PartitionOptions {
+    long num_parts = 2;
+    double imbalance = 0.03;        // parts may be this much heavier than an equal share
+    long coarsen_to = 0;            // 0 means 20 nodes per part
+    long num_refinement_passes = 8;// FM passes per level
+    long seed = 0;
+};
+
+// undirected graph with node and edge weights, coarse nodes weigh as much as the nodes they merge
+struct WeightedGraph {
+    std::vector<long> offsets;
+    std::vector<int> neighbours;
+    std::vector<int> edge_weights;
+    std::vector<int> node_weights;
+};
+
+void get_weighted_graph(SparseMatrix<float> *adjacency, WeightedGraph *graph);
+
+long get_total_weight(WeightedGraph *graph);
+
+// matches every node with its unmatched neighbour of the heaviest edge, returns the number of coarse nodes
+long match_heavy_edges(WeightedGraph *graph, long max_node_weight, std::mt19937_64 *generator, std::vector<int> *coarse_ids);
+
+void contract_graph(WeightedGraph *graph, std::vector<int> *coarse_ids, long num_coarse_nodes, WeightedGraph *coarse);
+
+// splits a breadth-first order into num_parts runs of equal weight
+void get_initial_partition(WeightedGraph *graph, long num_parts, std::vector<int> *parts);
+
+long get_cut_weight(WeightedGraph *graph, std::vector<int> *parts);
+
+// k-way Fiduccia-Mattheyses with rollback to the best prefix of moves, returns the cut weight
+long refine_partition(WeightedGraph *graph, long num_parts, long max_part_weight, long num_passes, std::vector<int> *parts);
+
+// multilevel partitioning, coarsen by heavy-edge matching, partition, refine while projecting back
+void partition_graph(SparseMatrix<float> *adjacency, PartitionOptions *options, std::vector<int> *parts);
+
+// non-zeros whose row and column lie in different parts
+long count_cut_edges(SparseMatrix<float> *adjacency, std::vector<int> *parts);
+
+void get_boundary_parts(std::vector<long> *boundaries, std::vector<int> *parts);
+
+// numbers the nodes part by part, so part i becomes the chunk from boundaries[i] to boundaries[i + 1]
+void get_partition_permutation(std::vector<int> *parts, long num_parts, std::vector<int> *new_ids, std::vector<long> *boundaries);
+
+#endif//ALZHEIMER_PARTITIONING_HPP
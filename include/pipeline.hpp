@@ -0,0 +1,51 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_PIPELINE_HPP
+#define ALZHEIMER_PIPELINE_HPP
+
+#include "cuda_helper.hpp"
+#include "emulated_device.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+struct PipelineStage {
+    std::function<void(long chunk, long buffer)> run;
+    cudaStream_t stream;// the stream a GPU stage issues its calls to, NULL for stages that compute on the CPU
+    EmulatedStream *emulated_stream;// the same for stages of a pipeline on an emulated device
+};
+
+// runs every stage on every chunk in order, each stage on its own worker thread, chunk c lives in buffer c % num_buffers.
+// stage s starts on chunk c once stage s - 1 is done with it and stage s + 1 is done with chunk c - num_buffers,
+// so a stage may only hand data to the stage after it. GPU stages count as done once their calls are issued,
+// the stages after them wait for an event of that buffer instead of the whole device
+class Pipeline {
+private:
+    long num_buffers_;
+    EmulatedDevice *device_ = NULL;
+    std::vector<PipelineStage> stages_;
+    std::vector<std::vector<cudaEvent_t>> events_;// per stage and buffer, recorded after every GPU stage
+    std::vector<std::vector<EmulatedEvent>> emulated_events_;
+    std::vector<long> num_done_;                  // chunks every stage is done with
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::exception_ptr error_;                    // the first error of any stage, rethrown by run
+
+    bool wait_for(long stage, long chunk, long waiting_stage);
+    void run_stage(long stage, long num_chunks);
+
+public:
+    Pipeline(long num_buffers);
+    // GPU stages run on the streams of the emulated device
+    Pipeline(long num_buffers, EmulatedDevice *device);
+    void add_stage(std::function<void(long chunk, long buffer)> run, cudaStream_t stream);
+    void add_emulated_stage(std::function<void(long chunk, long buffer)> run, EmulatedStream *stream);
+    // returns once every stage is done with every chunk and the streams of the GPU stages are synchronized
+    void run(long num_chunks);
+};
+
+#endif//ALZHEIMER_PIPELINE_HPP
@@ -14,15 +14,19 @@ class Relu : public Layer {
 protected:
     float alpha_;
     float beta_;
-    cudnnActivationDescriptor_t relu_desc_;
+    cudnnActivationDescriptor_t relu_desc_ = NULL;
     Matrix<float> *x_ = NULL;
 
 public:
     Relu();
     Relu(CudaHelper *helper, long num_nodes, long num_features);
+    // may be called again for another number of nodes, like once per mini-batch
     void set(CudaHelper *helper, long num_nodes, long num_features) override;
     Matrix<float> *forward(Matrix<float> *x) override;
     Matrix<float> *backward(Matrix<float> *incoming_gradients) override;
+    // activation recomputation, drops the output after the forward pass and computes it again from the input
+    void release_y();
+    void recompute_y();
 };
 
 class ReluChunked : public LayerChunked {
@@ -31,13 +35,25 @@ protected:
     float beta_;
     cudnnActivationDescriptor_t relu_desc_;
     std::vector<Matrix<float>> *x_ = NULL;
+    float *d_x_forward_ = NULL;
+    float *d_y_forward_ = NULL;
+    cudnnTensorDescriptor_t x_desc_forward_;
+    cudnnTensorDescriptor_t y_desc_forward_;
 
 public:
     ReluChunked();
     ReluChunked(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
-    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
+    ReluChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features);
+    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x) override;
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *x) override;
+    void forward_chunk(long chunk) override;
+    void forward_end() override;
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
+    // activation recomputation, drops the output after the forward pass and computes it again from the input
+    void release_y();
+    void recompute_y();
 };
 
 class ReluPipelined : public LayerPipelined, public ReluChunked {
@@ -56,7 +72,9 @@ protected:
 public:
     ReluPipelined();
     ReluPipelined(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
-    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
+    ReluPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_features);
+    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x) override;
     std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
     void forward_in(long chunk, long buffer) override;
@@ -0,0 +1,76 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_RELU_DROPOUT_H
+#define ALZHEIMER_RELU_DROPOUT_H
+
+#include "cuda_helper.hpp"
+#include "layer.hpp"
+#include "tensors.hpp"
+
+#include <vector>
+
+
+// ReLU and dropout in one round trip to the device. the output of the ReLU is never kept, the backward pass of the
+// ReLU reads the output of the dropout instead, it is positive at the same entries wherever the mask keeps a gradient
+class ReluDropout : public Layer {
+protected:
+    float alpha_;
+    float beta_;
+    cudnnActivationDescriptor_t relu_desc_;
+    float probability_;
+    unsigned long long seed_;
+    size_t state_size_;
+    char *reserve_space_ = NULL;
+    size_t reserve_space_size_;
+    bool keep_layout_ = false;
+    bool is_row_major_mask_ = true;// layout of the last forward pass, the mask only fits it
+
+public:
+    ReluDropout();
+    ReluDropout(CudaHelper *helper, long num_nodes, long num_features);
+    ~ReluDropout();
+    void set(CudaHelper *helper, long num_nodes, long num_features) override;
+    // runs in the layout of the input instead of row-major
+    void set_keep_layout(bool keep_layout);
+    Matrix<float> *forward(Matrix<float> *x) override;
+    Matrix<float> *backward(Matrix<float> *incoming_gradients) override;
+};
+
+class ReluDropoutChunked : public LayerChunked {
+protected:
+    float alpha_;
+    float beta_;
+    cudnnActivationDescriptor_t relu_desc_;
+    float probability_;
+    unsigned long long seed_;
+    size_t state_size_;
+    std::vector<char *> reserve_space_;
+    size_t reserve_space_size_;
+    bool keep_layout_ = false;
+    std::vector<bool> is_row_major_mask_;
+    std::vector<Matrix<float>> *x_ = NULL;
+    // state of a forward pass between forward_begin and forward_end
+    void *d_states_forward_ = NULL;
+    cudnnDropoutDescriptor_t dropout_desc_forward_;
+    float *d_x_forward_;
+    float *d_y_forward_;
+    void *d_reserve_space_forward_;
+    cudnnTensorDescriptor_t x_desc_forward_;
+
+public:
+    ReluDropoutChunked();
+    ReluDropoutChunked(CudaHelper *helper, long chunk_size, long num_nodes, long num_features);
+    ReluDropoutChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features);
+    ~ReluDropoutChunked();
+    void set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) override;
+    void set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) override;
+    // every chunk stays in the layout it comes in
+    void set_keep_layout(bool keep_layout);
+    std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *x) override;
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *x) override;
+    void forward_chunk(long chunk) override;
+    void forward_end() override;
+    std::vector<Matrix<float>> *backward(std::vector<Matrix<float>> *incoming_gradients) override;
+};
+
+#endif//ALZHEIMER_RELU_DROPOUT_H
@@ -0,0 +1,45 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_REORDERING_HPP
+#define ALZHEIMER_REORDERING_HPP
+
+#include "tensors.hpp"
+
+#include <string>
+#include <vector>
+
+
+enum Ordering { original,
+                rcm,
+                degree,
+                community };
+
+std::string get_ordering_name(Ordering ordering);
+
+// undirected neighbourhoods without self-loops, A + A^T
+void get_undirected(SparseMatrix<float> *adjacency, std::vector<long> *offsets, std::vector<int> *neighbours);
+
+// new_ids[old id] = new id
+void get_permutation(SparseMatrix<float> *adjacency, Ordering ordering, std::vector<int> *new_ids);
+
+void get_rcm_permutation(SparseMatrix<float> *adjacency, std::vector<int> *new_ids);
+
+void get_degree_permutation(SparseMatrix<float> *adjacency, std::vector<int> *new_ids);
+
+void get_community_permutation(SparseMatrix<float> *adjacency, long num_iterations, std::vector<int> *new_ids);
+
+// renumbers rows and columns, P A P^T
+void permute_sp_matrix(SparseMatrix<float> *sp_mat, std::vector<int> *new_ids, SparseMatrix<float> *permuted);
+
+template<typename T>
+void permute_rows(Matrix<T> *mat, std::vector<int> *new_ids, Matrix<T> *permuted);
+
+// maps rows of a reordered matrix back to the original ids
+template<typename T>
+void unpermute_rows(Matrix<T> *permuted, std::vector<int> *new_ids, Matrix<T> *mat);
+
+long count_non_empty_tiles(SparseMatrix<float> *sp_mat, long chunk_size);
+
+long count_non_empty_tiles(SparseMatrix<float> *sp_mat, std::vector<long> *boundaries);
+
+#endif//ALZHEIMER_REORDERING_HPP
@@ -37,10 +37,14 @@ public:
     SageLinear();
     SageLinear(CudaHelper *helper, long in_features, long out_features, long num_nodes);
     void set(CudaHelper *helper, long in_features, long out_features, long num_nodes);
+    void set_num_nodes(long num_nodes);
     Matrix<float> *forward(Matrix<float> *features, Matrix<float> *aggr);
     SageLinearGradients *backward(Matrix<float> *in_gradients);
     std::vector<Matrix<float> *> get_parameters();
     std::vector<Matrix<float> *> get_gradients();
+    Matrix<float> *get_y();
+    Linear *get_linear_self();
+    Linear *get_linear_neigh();
 };
 
 class SageLinearChunkedParent {
@@ -49,7 +53,6 @@ protected:
     long num_out_features_;
     CudaHelper *cuda_helper_;
     long chunk_size_;
-    long last_chunk_size_;
     long num_chunks_;
     std::vector<Matrix<float>> *y_;
     SageLinearGradientsChunked input_gradients_;
@@ -57,7 +60,9 @@ protected:
 public:
     std::string name_;
 
+    virtual ~SageLinearChunkedParent();
     virtual void set(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes) = 0;
+    virtual void set(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries) = 0;
     virtual std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *features, std::vector<Matrix<float>> *aggr) = 0;
     virtual SageLinearGradientsChunked *backward(std::vector<Matrix<float>> *incoming_gradients) = 0;
     virtual std::vector<Matrix<float> *> get_parameters() = 0;
@@ -73,8 +78,14 @@ protected:
 public:
     SageLinearChunked();
     SageLinearChunked(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes);
+    SageLinearChunked(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries);
     void set(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes) override;
+    void set(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *features, std::vector<Matrix<float>> *aggr) override;
+    // the forward pass one chunk at a time, chunk i of the output is valid once forward_chunk(i) returned
+    std::vector<Matrix<float>> *forward_begin(std::vector<Matrix<float>> *features, std::vector<Matrix<float>> *aggr);
+    void forward_chunk(long chunk);
+    void forward_end();
     SageLinearGradientsChunked *backward(std::vector<Matrix<float>> *incoming_gradients) override;
     std::vector<Matrix<float> *> get_parameters() override;
     std::vector<Matrix<float> *> get_gradients() override;
@@ -89,7 +100,9 @@ protected:
 public:
     SageLinearPipelined();
     SageLinearPipelined(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes);
+    SageLinearPipelined(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries);
     void set(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes) override;
+    void set(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries) override;
     std::vector<Matrix<float>> *forward(std::vector<Matrix<float>> *features, std::vector<Matrix<float>> *aggr) override;
     SageLinearGradientsChunked *backward(std::vector<Matrix<float>> *incoming_gradients) override;
     std::vector<Matrix<float> *> get_parameters() override;
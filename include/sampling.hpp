@@ -0,0 +1,74 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_SAMPLING_HPP
+#define ALZHEIMER_SAMPLING_HPP
+
+#include "feature_cache.hpp"
+#include "tensors.hpp"
+
+#include <thread>
+#include <vector>
+
+
+// bipartite adjacency of one layer, dst node i is src node i, so the dst nodes are the first rows of the src features
+struct SampledBlock {
+    long num_dst = 0;
+    long num_src = 0;
+    SparseMatrix<float> adjacency;// num_dst x num_src
+    SparseMatrix<float> adjacency_transposed;// num_src x num_dst, for the backward pass
+    Matrix<float> row_sum;
+};
+
+struct MiniBatch {
+    std::vector<std::vector<int>> nodes;// src nodes of every block, the last entry holds the seeds
+    std::vector<SampledBlock> blocks;   // first block is the input layer
+    Matrix<float> features;             // rows of nodes[0], row-major
+    Matrix<int> classes;                // rows of the seeds
+    long num_cache_hits = 0;            // feature rows gathered from the feature cache
+    long num_cache_misses = 0;
+};
+
+// number of mini-batches of an epoch
+long get_num_batches(long num_nodes, long batch_size);
+
+// nodes of every mini-batch in a random order, the same for the same seed and epoch
+void get_batch_order(long num_nodes, long seed, long epoch, std::vector<int> *order);
+
+// the seeds of one mini-batch, the last one can be smaller
+void get_batch_seeds(std::vector<int> *order, long batch, long batch_size, std::vector<int> *seeds);
+
+// first rows of the src features, the self features of the dst nodes
+void get_dst_rows(Matrix<float> *src, long num_dst, Matrix<float> *dst);
+
+// adds the gradients of the dst nodes to the first rows of the src gradients
+void add_dst_rows(Matrix<float> *dst, Matrix<float> *src);
+
+// layer-wise neighbour sampling, fanouts from the input layer to the output layer
+class NeighbourSampler {
+private:
+    SparseMatrix<float> *adjacency_;
+    Matrix<float> *features_;
+    Matrix<int> *classes_;
+    std::vector<long> fanouts_;
+    long seed_;
+    FeatureCache *feature_cache_ = NULL;
+    std::vector<int> local_ids_;// -1 for nodes not in the current block
+    std::thread sampler_;
+    const char *error_ = NULL;
+
+    void sample_block(long batch, long layer, std::vector<int> *dst_nodes, std::vector<int> *src_nodes, SampledBlock *block);
+    void gather(MiniBatch *mini_batch);
+
+public:
+    NeighbourSampler(SparseMatrix<float> *adjacency, Matrix<float> *features, Matrix<int> *classes,
+                     std::vector<long> *fanouts, long seed);
+    ~NeighbourSampler();
+    // gathers try the cache first, NULL to gather everything from the features
+    void set_feature_cache(FeatureCache *feature_cache);
+    void sample(std::vector<int> *seeds, long batch, MiniBatch *mini_batch);
+    // samples in a background thread while the current mini-batch is computed, wait before using the result
+    void sample_async(std::vector<int> *seeds, long batch, MiniBatch *mini_batch);
+    void wait();
+};
+
+#endif//ALZHEIMER_SAMPLING_HPP
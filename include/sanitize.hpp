@@ -0,0 +1,26 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef ALZHEIMER_SANITIZE_HPP
+#define ALZHEIMER_SANITIZE_HPP
+
+#include "tensors.hpp"
+
+#include <string>
+
+
+enum Normalization { no_normalization,
+                     mean_normalization,     // 1 / d_i, every row sums to one
+                     symmetric_normalization};// 1 / sqrt(d_i d_j), like GCN, keeps the matrix symmetric
+
+std::string get_normalization_name(Normalization normalization);
+
+// drops duplicate edges, optionally adds self-loops and A^T, sorts the columns of every row, rows in parallel
+void sanitize_graph(SparseMatrix<float> *adjacency, bool add_self_loops, bool symmetrize, SparseMatrix<float> *sanitized);
+
+// bakes the normalization into the values, so aggregations can sum instead of dividing by the degree every pass
+void normalize_graph(SparseMatrix<float> *adjacency, Normalization normalization);
+
+void sanitize_graph(SparseMatrix<float> *adjacency, bool add_self_loops, bool symmetrize, Normalization normalization,
+                    SparseMatrix<float> *sanitized);
+
+#endif//ALZHEIMER_SANITIZE_HPP
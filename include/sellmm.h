@@ -0,0 +1,13 @@
+// Copyright 2020 Marcel Wagenländer
+
+#ifndef SELLMM_H
+#define SELLMM_H
+
+#include <cuda_runtime.h>
+
+// result = sell * mat (+ result), dense matrices in column-major order, on the given stream
+void sell_mat_mat_multi(int *slice_ptr, int *slice_rows, int *col_ind, float *val, int num_slices, int slice_size,
+                        float *mat, float *result, int num_rows, int num_columns, int mat_columns, bool add_to_result,
+                        cudaStream_t stream);
+
+#endif//SELLMM_H
@@ -29,6 +29,8 @@ void sp_mat_sum_rows(CudaHelper *cuda_helper, SparseMatrix<float> *sp_mat, Matri
 
 void sp_mat_sum_rows(SparseMatrix<float> *sp_mat, Matrix<float> *sum);
 
+void sp_mat_sum_rows(std::vector<SparseMatrix<float>> *sp_mats, Matrix<float> *sum);
+
 void transpose_csr_matrix(SparseMatrix<float> *mat, CudaHelper *cuda_helper);
 
 void transpose_csr_matrix_cpu(SparseMatrix<float> *mat);
@@ -17,10 +17,17 @@ public:
     long size_ = 0;
     T *values_ = NULL;
     bool is_row_major_ = true;
+    bool is_owner_ = true;// false for views into memory of someone else, like the arena of a memory plan
     Matrix();
     Matrix(long num_rows, long num_columns, bool is_row_major);
     void set(long num_rows, long num_columns, bool is_row_major);
     void set(long num_rows, long num_columns, T *matrix_values, bool is_row_major);
+    // keeps the shape, the values live in memory the matrix does not free
+    void set_view(T *values);
+    // frees the values and keeps the shape, allocate gets them back
+    void release();
+    // only if the values are released
+    void allocate();
     void set_random_values();
     void set_values(T value);
     ~Matrix();
@@ -43,6 +50,16 @@ public:
     ~SparseMatrix();
 };
 
+// header of the binary CSR format, followed by row pointers, column indices and values
+struct CsrFileHeader {
+    char magic[8];
+    long num_rows;
+    long num_columns;
+    long nnz;
+};
+
+const char csr_file_magic[8] = {'A', 'L', 'Z', 'C', 'S', 'R', '0', '1'};
+
 template<typename T>
 class SparseMatrixCuda {
 public:
@@ -79,6 +96,18 @@ SparseMatrix<T> load_mtx_matrix(std::string path);
 template<typename T>
 void load_mtx_matrix(std::string path, SparseMatrix<T> *sp_mat);
 
+template<typename T>
+void load_csr_matrix(std::string path, SparseMatrix<T> *sp_mat);
+
+template<typename T>
+void save_csr_matrix(SparseMatrix<T> *sp_mat, std::string path);
+
+template<typename T>
+void load_sp_matrix(std::string path, SparseMatrix<T> *sp_mat);
+
+// row pointers of a sparse matrix file, without reading the column indices and values of a CSR file
+void load_sp_matrix_row_ptr(std::string path, std::vector<int> *row_ptr);
+
 template<typename T>
 void save_npy_matrix(Matrix<T> *mat, std::string path);
 
@@ -97,6 +126,10 @@ void to_column_major_inplace(Matrix<T> *mat);
 template<typename T>
 void to_row_major_inplace(Matrix<T> *mat);
 
+// row-major or column-major, whatever is_row_major says
+template<typename T>
+void to_layout_inplace(Matrix<T> *mat, bool is_row_major);
+
 void get_rows(SparseMatrix<float> *reduced_mat, SparseMatrix<float> *mat, int start_row, int end_row);
 
 void print_sparse_matrix(SparseMatrix<float> *mat);
@@ -111,4 +144,6 @@ bool check_nans(std::vector<Matrix<float>> *x, std::string name);
 
 bool check_equality(Matrix<float> *a, Matrix<float> *b);
 
+bool check_equality(SparseMatrix<float> *a, SparseMatrix<float> *b);
+
 #endif
@@ -3,10 +3,12 @@ import numpy as np
 import scipy.sparse as sp
 import scipy.io
 import os
+import subprocess
 
 
 home = os.getenv("HOME")
 data_path = home + "/gpu_memory_reduction/alzheimer/data"
+ingest_path = home + "/gpu_memory_reduction/alzheimer/build/ingest"
 
 
 def print_array_prop(a):
@@ -105,26 +107,14 @@ def preprocess_products():
     print("Number of edges: {}".format(num_edges))
     print("Number of classes: {}".format(num_classes))
 
-    path = products_path + "/raw/edge.csv"
-    edges = np.genfromtxt(path, dtype=np.int64, delimiter=",")
-    data = np.ones(num_edges)
-    adjacency = sp.coo_matrix((data, (edges[:, 0], edges[:, 1])), shape=(num_classes, num_classes))
-    adjacency = adjacency.tocsr()
-    adjacency = adjacency.astype(np.float32)
-    path = products_path + "/adjacency.mtx"
-    scipy.io.mmwrite(path, adjacency)
-
-    path = products_path + "/raw/node-feat.csv"
-    features = np.genfromtxt(path, dtype=np.float64, delimiter=",")
-    features = features.astype(np.float32)
-    path = products_path + "/features.npy"
-    np.save(path, features)
-
-    path = products_path + "/raw/node-label.csv"
-    classes = np.genfromtxt(path, dtype=np.int64, delimiter=",")
-    classes = classes.astype(np.int32)
-    path = products_path + "/classes.npy"
-    np.save(path, classes)
+    # the native ingestion tool streams the raw tables into adjacency.csr, features.npy and classes.npy
+    subprocess.run([ingest_path,
+                    "--edges", products_path + "/raw/edge.csv",
+                    "--features", products_path + "/raw/node-feat.csv",
+                    "--labels", products_path + "/raw/node-label.csv",
+                    "--num-nodes", str(num_classes),
+                    "--output", products_path],
+                   check=True)
 
 
 if __name__ == "__main__":
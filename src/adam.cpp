@@ -111,3 +111,19 @@ void Adam::step() {
 
     t_ = t_ + 1;
 }
+
+long Adam::get_t() {
+    return t_;
+}
+
+void Adam::set_t(long t) {
+    t_ = t;
+}
+
+std::vector<Matrix<float>> *Adam::get_momentum_ms() {
+    return &momentum_ms_;
+}
+
+std::vector<Matrix<float>> *Adam::get_momentum_vs() {
+    return &momentum_vs_;
+}
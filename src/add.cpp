@@ -1,10 +1,17 @@
 // 2020 Marcel Wagenländer
 
 #include "add.hpp"
+#include "chunking.hpp"
 #include "dense_computation.hpp"
 
 
+Add::Add() {}
+
 Add::Add(CudaHelper *cuda_helper, long num_nodes, long num_features) {
+    set(cuda_helper, num_nodes, num_features);
+}
+
+void Add::set(CudaHelper *cuda_helper, long num_nodes, long num_features) {
     name_ = "add";
     cuda_helper_ = cuda_helper;
     y_.set(num_nodes, num_features, true);
@@ -23,68 +30,94 @@ AddGradients *Add::backward(Matrix<float> *incoming_gradients) {
     return &gradients_;
 }
 
+Matrix<float> *Add::get_y() {
+    return &y_;
+}
+
 // CHUNKED --- CHUNKED --- CHUNKED
 
 AddChunked::AddChunked() {}
 
+AddChunked::~AddChunked() {}
+
 AddChunked::AddChunked(CudaHelper *cuda_helper, long chunk_size, long num_nodes, long num_features) {
     set(cuda_helper, chunk_size, num_nodes, num_features);
 }
 
+AddChunked::AddChunked(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features) {
+    set(cuda_helper, boundaries, num_features);
+}
+
 void AddChunked::set(CudaHelper *cuda_helper, long chunk_size, long num_nodes, long num_features) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(cuda_helper, &boundaries, num_features);
+}
+
+void AddChunked::set(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features) {
     name_ = "add_chunked";
     cuda_helper_ = cuda_helper;
-    chunk_size_ = chunk_size;
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size);
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
-    }
+    chunk_size_ = get_max_chunk_size(boundaries);
+    num_chunks_ = boundaries->size() - 1;
 
     y_ = std::vector<Matrix<float>>(num_chunks_);
-    long current_chunk_size = chunk_size_;
     for (long i = 0; i < num_chunks_; ++i) {
-        if (i == num_chunks_ - 1) {
-            current_chunk_size = last_chunk_size_;
-        }
+        long current_chunk_size = boundaries->at(i + 1) - boundaries->at(i);
         y_.at(i).set(current_chunk_size, num_features, false);
     }
 }
 
-std::vector<Matrix<float>> *AddChunked::forward(std::vector<Matrix<float>> *a, std::vector<Matrix<float>> *b) {
+std::vector<Matrix<float>> *AddChunked::forward_begin(std::vector<Matrix<float>> *a, std::vector<Matrix<float>> *b) {
     if (a->size() != b->size()) {
         throw "Inputs have unequal number of chunks";
     }
+    a_ = a;
+    b_ = b;
 
-    if (a->at(0).is_row_major_ != b->at(0).is_row_major_) {
-        for (long i = 0; i < num_chunks_; ++i) {
-            to_row_major_inplace(&a->at(i));
-            to_row_major_inplace(&b->at(i));
-        }
+    return &y_;
+}
+
+void AddChunked::forward_chunk(long chunk) {
+    if (a_->at(chunk).is_row_major_ != b_->at(chunk).is_row_major_) {
+        to_row_major_inplace(&a_->at(chunk));
+        to_row_major_inplace(&b_->at(chunk));
     }
 
-    float *d_a;
-    check_cuda(cudaMalloc(&d_a, a->at(0).size_ * sizeof(float)));
-    float *d_b;
-    check_cuda(cudaMalloc(&d_b, b->at(0).size_ * sizeof(float)));
+    if (d_a_forward_ == NULL) {
+        check_cuda(cudaMalloc(&d_a_forward_, chunk_size_ * a_->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_b_forward_, chunk_size_ * b_->at(0).num_columns_ * sizeof(float)));
+    }
+
+    // in
+    check_cuda(cudaMemcpy(d_a_forward_, a_->at(chunk).values_, a_->at(chunk).size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMemcpy(d_b_forward_, b_->at(chunk).values_, b_->at(chunk).size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+
+    // compute
+    mat_mat_add_cuda(cuda_helper_, d_a_forward_, d_b_forward_, a_->at(chunk).size_);
+
+    // out
+    check_cuda(cudaMemcpy(y_.at(chunk).values_, d_b_forward_, y_.at(chunk).size_ * sizeof(float),
+                          cudaMemcpyDeviceToHost));
+}
 
+void AddChunked::forward_end() {
+    if (d_a_forward_ == NULL) {
+        return;
+    }
+    check_cuda(cudaFree(d_a_forward_));
+    check_cuda(cudaFree(d_b_forward_));
+    d_a_forward_ = NULL;
+    d_b_forward_ = NULL;
+}
+
+std::vector<Matrix<float>> *AddChunked::forward(std::vector<Matrix<float>> *a, std::vector<Matrix<float>> *b) {
+    forward_begin(a, b);
     for (long i = 0; i < num_chunks_; ++i) {
-        // in
-        check_cuda(cudaMemcpy(d_a, a->at(i).values_, a->at(i).size_ * sizeof(float),
-                              cudaMemcpyHostToDevice));
-        check_cuda(cudaMemcpy(d_b, b->at(i).values_, b->at(i).size_ * sizeof(float),
-                              cudaMemcpyHostToDevice));
-
-        // compute
-        mat_mat_add_cuda(cuda_helper_, d_a, d_b, a->at(i).size_);
-
-        // out
-        check_cuda(cudaMemcpy(y_.at(i).values_, d_b, y_.at(i).size_ * sizeof(float),
-                              cudaMemcpyDeviceToHost));
+        forward_chunk(i);
     }
-    check_cuda(cudaFree(d_a));
-    check_cuda(cudaFree(d_b));
+    forward_end();
 
     return &y_;
 }
@@ -104,8 +137,18 @@ AddPipelined::AddPipelined(CudaHelper *cuda_helper, long chunk_size, long num_no
     set(cuda_helper, chunk_size, num_nodes, num_features);
 }
 
+AddPipelined::AddPipelined(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features) {
+    set(cuda_helper, boundaries, num_features);
+}
+
 void AddPipelined::set(CudaHelper *cuda_helper, long chunk_size, long num_nodes, long num_features) {
-    AddChunked::set(cuda_helper, chunk_size, num_nodes, num_features);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(cuda_helper, &boundaries, num_features);
+}
+
+void AddPipelined::set(CudaHelper *cuda_helper, std::vector<long> *boundaries, long num_features) {
+    AddChunked::set(cuda_helper, boundaries, num_features);
 
     name_ = "add_pipelined";
     num_steps_ = 2;
@@ -148,12 +191,12 @@ std::vector<Matrix<float>> *AddPipelined::forward(std::vector<Matrix<float>> *a,
     }
 
     for (long i = 0; i < num_steps_; ++i) {
-        check_cuda(cudaMalloc(&d_a_.at(i), a->at(0).size_ * sizeof(float)));
-        check_cuda(cudaMalloc(&d_b_.at(i), b->at(0).size_ * sizeof(float)));
-        check_cuda(cudaMalloc(&d_c_.at(i), b->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_a_.at(i), chunk_size_ * a->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_b_.at(i), chunk_size_ * b->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_c_.at(i), chunk_size_ * b->at(0).num_columns_ * sizeof(float)));
     }
 
-    pipeline(true, num_chunks_);
+    pipeline(cuda_helper_, true, num_chunks_, num_steps_);
 
     for (long i = 0; i < num_steps_; ++i) {
         check_cuda(cudaFree(d_a_.at(i)));
@@ -3,23 +3,74 @@
 #include "alzheimer.hpp"
 #include "adam.hpp"
 #include "add.hpp"
+#include "checkpoint.hpp"
+#include "chunk_tuner.hpp"
 #include "chunking.hpp"
 #include "cuda_helper.hpp"
+#include "data_parallel.hpp"
+#include "dataflow.hpp"
 #include "dropout.hpp"
 #include "feature_aggregation.hpp"
+#include "inference.hpp"
 #include "log_softmax.hpp"
 #include "loss.hpp"
+#include "memory_planner.hpp"
+#include "numa.hpp"
 #include "relu.hpp"
 #include "sage_linear.hpp"
+#include "sampling.hpp"
+#include "sanitize.hpp"
 #include "sparse_computation.hpp"
 #include "tensors.hpp"
 
+#include "cnpy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 const std::string dir_path = "/mnt/data";
 
 
+double get_seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+std::string get_recompute_name(Recompute recompute) {
+    if (recompute == recompute_none) {
+        return "none";
+    } else if (recompute == recompute_dropout) {
+        return "dropout";
+    } else if (recompute == recompute_relu_dropout) {
+        return "relu_dropout";
+    } else {
+        throw "Unknown recompute level";
+    }
+}
+
+std::string get_checkpoint_path(Dataset dataset, std::string trainer) {
+    return "/tmp/benchmark/checkpoint_" + get_dataset_name(dataset) + "_" + trainer + ".bin";
+}
+
 void alzheimer(Dataset dataset) {
+    alzheimer(dataset, false);
+}
+
+void alzheimer(Dataset dataset, bool plan_memory) {
+    alzheimer(dataset, plan_memory, recompute_none);
+}
+
+void alzheimer(Dataset dataset, bool plan_memory, Recompute recompute) {
+    if (plan_memory && recompute != recompute_none) {
+        throw "Recomputation can not release planned matrices";
+    }
+
     // read tensors
     // set path to directory
     std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
@@ -45,8 +96,9 @@ void alzheimer(Dataset dataset) {
     //    matrix<bool> test_mask = load_npy_matrix<bool>(path);
 
     // read adjacency
-    path = dataset_path + "/adjacency.mtx";
-    SparseMatrix<float> adjacency = load_mtx_matrix<float>(path);
+    path = get_adjacency_path(dataset_path);
+    SparseMatrix<float> adjacency;
+    load_sp_matrix<float>(path, &adjacency);
 
     // FORWARD PASS
     CudaHelper cuda_helper;
@@ -55,51 +107,96 @@ void alzheimer(Dataset dataset) {
     long num_hidden_channels = 256;
     long num_classes = get_dataset_num_classes(dataset);
 
-    // get sums of adjacency rows
-    Matrix<float> adjacency_row_sum(num_nodes, 1, true);
-    sp_mat_sum_rows(&adjacency, &adjacency_row_sum);
+    // bake the mean into the adjacency, so the aggregations only sum
+    SparseMatrix<float> adjacency_normalized;
+    sanitize_graph(&adjacency, false, true, mean_normalization, &adjacency_normalized);
+    // D^-1 A is not symmetric, the backward pass needs its transpose
+    SparseMatrix<float> adjacency_normalized_transposed;
+    sanitize_graph(&adjacency_normalized, false, false, &adjacency_normalized_transposed);
+    transpose_csr_matrix_cpu(&adjacency_normalized_transposed);
 
     // layers
     NLLLoss loss_layer(num_nodes, num_classes);
     Add add_1(&cuda_helper, num_nodes, num_hidden_channels);
     Add add_2(&cuda_helper, num_nodes, num_hidden_channels);
     Dropout dropout_0(&cuda_helper, num_nodes, features.num_columns_);
-    FeatureAggregation graph_convolution_0(&cuda_helper, &adjacency, "mean", num_nodes, features.num_columns_, &adjacency_row_sum);
+    FeatureAggregation graph_convolution_0;
+    graph_convolution_0.set(&cuda_helper, &adjacency_normalized, &adjacency_normalized_transposed, "sum", features.num_columns_, NULL);
     SageLinear linear_0(&cuda_helper, features.num_columns_, num_hidden_channels, num_nodes);
     Relu relu_0(&cuda_helper, num_nodes, num_hidden_channels);
     Dropout dropout_1(&cuda_helper, num_nodes, num_hidden_channels);
-    FeatureAggregation graph_convolution_1(&cuda_helper, &adjacency, "mean", num_nodes, num_hidden_channels, &adjacency_row_sum);
+    FeatureAggregation graph_convolution_1;
+    graph_convolution_1.set(&cuda_helper, &adjacency_normalized, &adjacency_normalized_transposed, "sum", num_hidden_channels, NULL);
     SageLinear linear_1(&cuda_helper, num_hidden_channels, num_hidden_channels, num_nodes);
     Relu relu_1(&cuda_helper, num_nodes, num_hidden_channels);
     Dropout dropout_2(&cuda_helper, num_nodes, num_hidden_channels);
-    FeatureAggregation graph_convolution_2(&cuda_helper, &adjacency, "mean", num_nodes, num_hidden_channels, &adjacency_row_sum);
+    FeatureAggregation graph_convolution_2;
+    graph_convolution_2.set(&cuda_helper, &adjacency_normalized, &adjacency_normalized_transposed, "sum", num_hidden_channels, NULL);
     SageLinear linear_2(&cuda_helper, num_hidden_channels, num_classes, num_nodes);
     LogSoftmax log_softmax(&cuda_helper, num_nodes, num_classes);
 
-    // optimizer
-    long num_parameters = 6;
-    std::vector<Matrix<float> *> parameters(num_parameters);
-    std::vector<Matrix<float> *> params = linear_0.get_parameters();
-    parameters[0] = params[0];
-    parameters[1] = params[1];
-    params = linear_1.get_parameters();
-    parameters[2] = params[0];
-    parameters[3] = params[1];
-    params = linear_2.get_parameters();
-    parameters[4] = params[0];
-    parameters[5] = params[1];
-    std::vector<Matrix<float> *> parameter_gradients(num_parameters);
-    std::vector<Matrix<float> *> grads = linear_0.get_gradients();
-    parameter_gradients[0] = grads[0];
-    parameter_gradients[1] = grads[1];
-    grads = linear_1.get_gradients();
-    parameter_gradients[2] = grads[0];
-    parameter_gradients[3] = grads[1];
-    grads = linear_2.get_gradients();
-    parameter_gradients[4] = grads[0];
-    parameter_gradients[5] = grads[1];
+    // what every step of an epoch reads and writes, the backward passes read what their forward passes kept
+    MemoryPlanner memory_planner;
+    Dropout *dropouts[3] = {&dropout_0, &dropout_1, &dropout_2};
+    FeatureAggregation *graph_convolutions[3] = {&graph_convolution_0, &graph_convolution_1, &graph_convolution_2};
+    SageLinear *linears[3] = {&linear_0, &linear_1, &linear_2};
+    Relu *relus[2] = {&relu_0, &relu_1};
+    Add *adds[2] = {&add_1, &add_2};
+    Matrix<float> *x = &features;
+    for (long l = 0; l < 3; ++l) {
+        Matrix<float> *x_dropout = dropouts[l]->get_y();
+        memory_planner.add_step({x}, {x_dropout});
+        memory_planner.add_step({x_dropout}, {graph_convolutions[l]->get_y()});
+        memory_planner.add_step({x_dropout, graph_convolutions[l]->get_y()},
+                                {linears[l]->get_linear_self()->get_y(), linears[l]->get_linear_neigh()->get_y(), linears[l]->get_y()});
+        x = linears[l]->get_y();
+        if (l < 2) {
+            memory_planner.add_step({x}, {relus[l]->get_y()});
+            x = relus[l]->get_y();
+        }
+    }
+    memory_planner.add_step({x}, {log_softmax.get_y()});
+    memory_planner.add_step({log_softmax.get_y()}, {});
+    memory_planner.add_step({}, {loss_layer.get_input_gradients()});
+    memory_planner.add_step({log_softmax.get_y(), loss_layer.get_input_gradients()}, {log_softmax.get_input_gradients()});
+    Matrix<float> *gradients_in = log_softmax.get_input_gradients();
+    for (long l = 2; l >= 0; --l) {
+        Linear *linear_self = linears[l]->get_linear_self();
+        Linear *linear_neigh = linears[l]->get_linear_neigh();
+        memory_planner.add_step({gradients_in, dropouts[l]->get_y(), graph_convolutions[l]->get_y()},
+                                {linear_self->get_input_gradients(), linear_neigh->get_input_gradients()});
+        if (l == 0) {
+            break;
+        }
+        memory_planner.add_step({linear_neigh->get_input_gradients()}, {graph_convolutions[l]->get_input_gradients()});
+        memory_planner.add_step({linear_self->get_input_gradients(), graph_convolutions[l]->get_input_gradients()}, {adds[l - 1]->get_y()});
+        memory_planner.add_step({adds[l - 1]->get_y()}, {dropouts[l]->get_input_gradients()});
+        memory_planner.add_step({dropouts[l]->get_input_gradients(), relus[l - 1]->get_y(), linears[l - 1]->get_y()},
+                                {relus[l - 1]->get_input_gradients()});
+        gradients_in = relus[l - 1]->get_input_gradients();
+    }
+    memory_planner.plan();
+    memory_planner.print();
+    if (plan_memory) {
+        memory_planner.apply();
+    }
+
+    // optimizer over the self and neighbour weights of every layer
+    std::vector<Matrix<float> *> parameters;
+    std::vector<Matrix<float> *> parameter_gradients;
+    for (long l = 0; l < 3; ++l) {
+        std::vector<Matrix<float> *> params = linears[l]->get_parameters();
+        parameters.insert(parameters.end(), params.begin(), params.end());
+        std::vector<Matrix<float> *> grads = linears[l]->get_gradients();
+        parameter_gradients.insert(parameter_gradients.end(), grads.begin(), grads.end());
+    }
     Adam adam(&cuda_helper, learning_rate, parameters, parameter_gradients);
 
+    // checkpoint all SageLinear parameters
+    std::vector<Matrix<float> *> checkpoint_parameters = parameters;
+    std::string checkpoint_path = get_checkpoint_path(dataset, "full");
+    Checkpoint checkpoint;
+
     Matrix<float> *signals;
     Matrix<float> *signals_dropout;
     Matrix<float> *gradients;
@@ -109,10 +206,11 @@ void alzheimer(Dataset dataset) {
     path = "/tmp/benchmark/loss_" + get_dataset_name(dataset) + ".csv";
     std::ofstream loss_file;
     loss_file.open(path, std::ios::trunc);
-    loss_file << "epoch,loss\n";
+    loss_file << "epoch,loss,seconds\n";
 
     int num_epochs = 10;
     for (int i = 0; i < num_epochs; ++i) {
+        std::chrono::steady_clock::time_point epoch_start = std::chrono::steady_clock::now();
 
         // dropout 0
         signals_dropout = dropout_0.forward(&features);
@@ -122,37 +220,51 @@ void alzheimer(Dataset dataset) {
 
         // linear layer 0
         signals = linear_0.forward(signals_dropout, signals);
+        if (recompute != recompute_none) {
+            dropout_0.release_y();
+        }
 
         // ReLU 0
         signals = relu_0.forward(signals);
 
         // dropout 1
         signals_dropout = dropout_1.forward(signals);
+        if (recompute == recompute_relu_dropout) {
+            relu_0.release_y();
+        }
 
         // graph convolution 1
         signals = graph_convolution_1.forward(signals_dropout);
 
         // linear layer 1
         signals = linear_1.forward(signals_dropout, signals);
+        if (recompute != recompute_none) {
+            dropout_1.release_y();
+        }
 
         // ReLU 1
         signals = relu_1.forward(signals);
 
         // dropout 2
         signals_dropout = dropout_2.forward(signals);
+        if (recompute == recompute_relu_dropout) {
+            relu_1.release_y();
+        }
 
         // graph convolution 2
         signals = graph_convolution_2.forward(signals_dropout);
 
         // linear layer 2
         signals = linear_2.forward(signals_dropout, signals);
+        if (recompute != recompute_none) {
+            dropout_2.release_y();
+        }
 
         // log-softmax
         signals = log_softmax.forward(signals);
 
         // loss
         loss = loss_layer.forward(signals, &classes);
-        loss_file << i << "," << loss << "\n";
 
         // BACKPROPAGATION
         //loss
@@ -161,8 +273,13 @@ void alzheimer(Dataset dataset) {
         // log-softmax
         gradients = log_softmax.backward(gradients);
 
-        // linear layer 2
+        // linear layer 2, its inputs come back if they were released
+        relu_1.recompute_y();
+        dropout_2.recompute_y();
         sage_linear_gradients = linear_2.backward(gradients);
+        if (recompute != recompute_none) {
+            dropout_2.release_y();
+        }
 
         // graph convolution 2
         gradients = graph_convolution_2.backward(sage_linear_gradients->neighbourhood_gradients);
@@ -175,12 +292,20 @@ void alzheimer(Dataset dataset) {
 
         // relu 1
         gradients = relu_1.backward(gradients);
+        if (recompute == recompute_relu_dropout) {
+            relu_1.release_y();
+        }
 
-        // linear layer 1
+        // linear layer 1, its inputs come back if they were released
+        relu_0.recompute_y();
+        dropout_1.recompute_y();
         sage_linear_gradients = linear_1.backward(gradients);
+        if (recompute != recompute_none) {
+            dropout_1.release_y();
+        }
 
         // graph convolution 1
-        gradients = graph_convolution_1.backward(gradients);
+        gradients = graph_convolution_1.backward(sage_linear_gradients->neighbourhood_gradients);
 
         // add sage_linear_gradients.self_grads + gradients
         gradients = add_1.forward(sage_linear_gradients->self_gradients, gradients);
@@ -190,20 +315,50 @@ void alzheimer(Dataset dataset) {
 
         // relu 0
         gradients = relu_0.backward(gradients);
+        if (recompute == recompute_relu_dropout) {
+            relu_0.release_y();
+        }
 
         // linear layer 0
+        dropout_0.recompute_y();
         sage_linear_gradients = linear_0.backward(gradients);
+        if (recompute != recompute_none) {
+            dropout_0.release_y();
+        }
 
         // no need for graph conv 0 and dropout 0
 
         // optimiser
         adam.step();
+
+        // written in the background during the next epoch
+        checkpoint.save(checkpoint_path, i, &checkpoint_parameters, &adam);
+
+        loss_file << i << "," << loss << "," << get_seconds_since(epoch_start) << "\n";
     }// end training loop
 
+    checkpoint.wait();
     loss_file.close();
 }
 
 void alzheimer_chunked(Dataset dataset, long chunk_size) {
+    alzheimer_chunked(dataset, chunk_size, false);
+}
+
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history) {
+    alzheimer_chunked(dataset, chunk_size, use_history, false);
+}
+
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history, bool use_dataflow) {
+    alzheimer_chunked(dataset, chunk_size, use_history, use_dataflow, recompute_none);
+}
+
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history, bool use_dataflow, Recompute recompute) {
+    alzheimer_chunked(dataset, chunk_size, use_history, use_dataflow, recompute, numa_none);
+}
+
+void alzheimer_chunked(Dataset dataset, long chunk_size, bool use_history, bool use_dataflow, Recompute recompute,
+                       NumaPlacement numa_placement) {
     // read tensors
     // set path to directory
     std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
@@ -216,10 +371,14 @@ void alzheimer_chunked(Dataset dataset, long chunk_size) {
     long num_nodes = features->num_rows_;
     long num_features = features->num_columns_;
 
+    std::vector<long> boundaries;
+    get_dataset_boundaries(dataset_path, num_nodes, num_features, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    print_boundaries(&boundaries);
+
     // chunk features
-    long num_chunks = ceil((float) features->num_rows_ / (float) chunk_size);
     std::vector<Matrix<float>> features_chunked(num_chunks);
-    chunk_up(features, &features_chunked, chunk_size);
+    chunk_up(features, &features_chunked, &boundaries);
 
     delete features;
 
@@ -239,20 +398,28 @@ void alzheimer_chunked(Dataset dataset, long chunk_size) {
     //    path = dataset_path + "/test_mask.npy";
     //    matrix<bool> test_mask = load_npy_matrix<bool>(path);
 
-    // read adjacency
-    path = dataset_path + "/adjacency.mtx";
-    SparseMatrix<float> *adjacency = new SparseMatrix<float>();
-    load_mtx_matrix<float>(path, adjacency);
-
-    // chunk adjacency
+    // read chunked adjacency, reuse the tiles cached next to the dataset if they are up to date
+    path = get_adjacency_path(dataset_path);
     std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
-    double_chunk_up_sp(adjacency, &adjacencies, chunk_size);
+    double_chunk_up_sp_cached(path, &adjacencies, &boundaries);
+    TileIndex tile_index;
+    index_tiles(&adjacencies, &tile_index);
+    print_tile_index(&tile_index);
+
+    // both come in first-touched by a single thread, the first dropout reads the features row-major
+    if (numa_placement != numa_none) {
+        for (Matrix<float> &chunk : features_chunked) {
+            to_row_major_inplace(&chunk);
+        }
+    }
+    NumaTopology numa_topology;
+    get_numa_topology(&numa_topology);
+    place_chunks(&numa_topology, numa_placement, &features_chunked);
+    place_tiles(&numa_topology, numa_placement, &adjacencies);
 
     // get sums of adjacency rows
     Matrix<float> adjacency_row_sum(num_nodes, 1, true);
-    sp_mat_sum_rows(adjacency, &adjacency_row_sum);
-
-    delete adjacency;
+    sp_mat_sum_rows(&adjacencies, &adjacency_row_sum);
 
     // FORWARD PASS
     CudaHelper cuda_helper;
@@ -262,45 +429,99 @@ void alzheimer_chunked(Dataset dataset, long chunk_size) {
 
     // layers
     NLLLoss loss_layer(num_nodes, num_classes);
-    AddChunked add_1(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    AddChunked add_2(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    DropoutChunked dropout_0(&cuda_helper, chunk_size, num_nodes, num_features);
-    FeatureAggregationChunked graph_convolution_0(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_features, chunk_size, num_nodes);
-    SageLinearChunked linear_0(&cuda_helper, num_features, num_hidden_channels, chunk_size, num_nodes);
-    ReluChunked relu_0(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    DropoutChunked dropout_1(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    FeatureAggregationChunked graph_convolution_1(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_hidden_channels, chunk_size, num_nodes);
-    SageLinearChunked linear_1(&cuda_helper, num_hidden_channels, num_hidden_channels, chunk_size, num_nodes);
-    ReluChunked relu_1(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    DropoutChunked dropout_2(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    FeatureAggregationChunked graph_convolution_2(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_hidden_channels, chunk_size, num_nodes);
-    SageLinearChunked linear_2(&cuda_helper, num_hidden_channels, num_classes, chunk_size, num_nodes);
-    LogSoftmaxChunked log_softmax(&cuda_helper, chunk_size, num_nodes, num_classes);
-
-    // optimizer
-    long num_parameters = 6;
-    std::vector<Matrix<float> *> parameters(num_parameters);
-    std::vector<Matrix<float> *> params = linear_0.get_parameters();
-    parameters[0] = params[0];
-    parameters[1] = params[1];
-    params = linear_1.get_parameters();
-    parameters[2] = params[0];
-    parameters[3] = params[1];
-    params = linear_2.get_parameters();
-    parameters[4] = params[0];
-    parameters[5] = params[1];
-    std::vector<Matrix<float> *> parameter_gradients(num_parameters);
-    std::vector<Matrix<float> *> grads = linear_0.get_gradients();
-    parameter_gradients[0] = grads[0];
-    parameter_gradients[1] = grads[1];
-    grads = linear_1.get_gradients();
-    parameter_gradients[2] = grads[0];
-    parameter_gradients[3] = grads[1];
-    grads = linear_2.get_gradients();
-    parameter_gradients[4] = grads[0];
-    parameter_gradients[5] = grads[1];
+    AddChunked add_1(&cuda_helper, &boundaries, num_hidden_channels);
+    AddChunked add_2(&cuda_helper, &boundaries, num_hidden_channels);
+    DropoutChunked dropout_0(&cuda_helper, &boundaries, num_features);
+    FeatureAggregationChunked graph_convolution_0(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_features, &boundaries);
+    SageLinearChunked linear_0(&cuda_helper, num_features, num_hidden_channels, &boundaries);
+    ReluChunked relu_0(&cuda_helper, &boundaries, num_hidden_channels);
+    DropoutChunked dropout_1(&cuda_helper, &boundaries, num_hidden_channels);
+    FeatureAggregationChunked graph_convolution_1(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_hidden_channels, &boundaries);
+    SageLinearChunked linear_1(&cuda_helper, num_hidden_channels, num_hidden_channels, &boundaries);
+    ReluChunked relu_1(&cuda_helper, &boundaries, num_hidden_channels);
+    DropoutChunked dropout_2(&cuda_helper, &boundaries, num_hidden_channels);
+    FeatureAggregationChunked graph_convolution_2(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_hidden_channels, &boundaries);
+    SageLinearChunked linear_2(&cuda_helper, num_hidden_channels, num_classes, &boundaries);
+    LogSoftmaxChunked log_softmax(&cuda_helper, &boundaries, num_classes);
+
+    // the layers share the tiles and their hybrids
+    graph_convolution_1.set_hybrid_tiles(graph_convolution_0.get_hybrid_tiles());
+    graph_convolution_2.set_hybrid_tiles(graph_convolution_0.get_hybrid_tiles());
+
+    // hidden layers read neighbours outside the row chunk from the last epoch
+    if (use_history) {
+        graph_convolution_1.set_history(true);
+        graph_convolution_2.set_history(true);
+        graph_convolution_1.set_numa_placement(numa_placement);
+        graph_convolution_2.set_numa_placement(numa_placement);
+    }
+
+    // optimizer over the self and neighbour weights of every layer
+    SageLinearChunked *linears[3] = {&linear_0, &linear_1, &linear_2};
+    std::vector<Matrix<float> *> parameters;
+    std::vector<Matrix<float> *> parameter_gradients;
+    for (long l = 0; l < 3; ++l) {
+        std::vector<Matrix<float> *> params = linears[l]->get_parameters();
+        parameters.insert(parameters.end(), params.begin(), params.end());
+        std::vector<Matrix<float> *> grads = linears[l]->get_gradients();
+        parameter_gradients.insert(parameter_gradients.end(), grads.begin(), grads.end());
+    }
     Adam adam(&cuda_helper, learning_rate, parameters, parameter_gradients);
 
+    // checkpoint all SageLinear parameters
+    std::vector<Matrix<float> *> checkpoint_parameters = parameters;
+    std::string checkpoint_path = get_checkpoint_path(dataset, use_history ? "chunked_history" : "chunked");
+    Checkpoint checkpoint;
+
+    // the forward pass as chunk tasks, only the graph convolutions wait for the chunks of their non-empty tiles.
+    // one thread, the layers share the handles of the CUDA helper
+    Dataflow forward_dataflow(num_chunks, &tile_index);
+    // once the history is ready, row chunk i of the hidden graph convolutions only reads input chunk i
+    Dataflow history_dataflow(num_chunks, &tile_index);
+    DropoutChunked *dropouts[3] = {&dropout_0, &dropout_1, &dropout_2};
+    FeatureAggregationChunked *graph_convolutions[3] = {&graph_convolution_0, &graph_convolution_1, &graph_convolution_2};
+    ReluChunked *relus[2] = {&relu_0, &relu_1};
+    auto add_forward_nodes = [&](Dataflow *dataflow, bool is_history_used) {
+        std::vector<DataflowEdge> chunk_edges = {chunk_edge};
+        std::vector<DataflowEdge> sage_edges = {chunk_edge, chunk_edge};
+        long node = -1;
+        long node_dropout;
+        for (long l = 0; l < 3; ++l) {
+            DropoutChunked *dropout = dropouts[l];
+            FeatureAggregationChunked *graph_convolution = graph_convolutions[l];
+            SageLinearChunked *linear = linears[l];
+            std::vector<long> inputs;
+            if (node >= 0) {
+                inputs.push_back(node);
+            }
+            node_dropout = dataflow->add_node("dropout_" + std::to_string(l), [dropout](long chunk) { dropout->forward_chunk(chunk); },
+                                              [dropout]() { dropout->forward_end(); }, inputs,
+                                              std::vector<DataflowEdge>(inputs.size(), chunk_edge));
+            DataflowEdge aggregation_edge = tile_edge;
+            if (is_history_used && l > 0) {
+                aggregation_edge = chunk_edge;
+            }
+            node = dataflow->add_node("graph_convolution_" + std::to_string(l),
+                                      [graph_convolution](long chunk) { graph_convolution->forward_chunk(chunk); },
+                                      [graph_convolution]() { graph_convolution->forward_end(); }, {node_dropout}, {aggregation_edge});
+            node = dataflow->add_node("linear_" + std::to_string(l), [linear](long chunk) { linear->forward_chunk(chunk); },
+                                      [linear]() { linear->forward_end(); }, {node_dropout, node}, sage_edges);
+            if (l < 2) {
+                ReluChunked *relu = relus[l];
+                node = dataflow->add_node("relu_" + std::to_string(l), [relu](long chunk) { relu->forward_chunk(chunk); },
+                                          [relu]() { relu->forward_end(); }, {node}, chunk_edges);
+            }
+        }
+        dataflow->add_node("log_softmax", [&log_softmax](long chunk) { log_softmax.forward_chunk(chunk); },
+                           [&log_softmax]() { log_softmax.forward_end(); }, {node}, chunk_edges);
+    };
+    if (use_dataflow) {
+        add_forward_nodes(&forward_dataflow, false);
+        if (use_history) {
+            add_forward_nodes(&history_dataflow, true);
+        }
+    }
+
     std::vector<Matrix<float>> *signals;
     std::vector<Matrix<float>> *signals_dropout;
     std::vector<Matrix<float>> *gradients;
@@ -317,41 +538,89 @@ void alzheimer_chunked(Dataset dataset, long chunk_size) {
     int num_epochs = 10;
     for (int i = 0; i < num_epochs; ++i) {
 
-        // dropout 0
-        signals_dropout = dropout_0.forward(&features_chunked);
-
-        // graph convolution 0
-        signals = graph_convolution_0.forward(signals_dropout);
-
-        // linear layer 0
-        signals = linear_0.forward(signals_dropout, signals);
-
-        // ReLU 0
-        signals = relu_0.forward(signals);
-
-        // dropout 1
-        signals_dropout = dropout_1.forward(signals);
-
-        // graph convolution 1
-        signals = graph_convolution_1.forward(signals_dropout);
-
-        // linear layer 1
-        signals = linear_1.forward(signals_dropout, signals);
-
-        // ReLU 1
-        signals = relu_1.forward(signals);
-
-        // dropout 2
-        signals_dropout = dropout_2.forward(signals);
-
-        // graph convolution 2
-        signals = graph_convolution_2.forward(signals_dropout);
-
-        // linear layer 2
-        signals = linear_2.forward(signals_dropout, signals);
-
-        // log-softmax
-        signals = log_softmax.forward(signals);
+        if (use_dataflow) {
+            // the outputs of the layers are known before any chunk is computed
+            signals_dropout = dropout_0.forward_begin(&features_chunked);
+            signals = graph_convolution_0.forward_begin(signals_dropout);
+            signals = linear_0.forward_begin(signals_dropout, signals);
+            signals = relu_0.forward_begin(signals);
+            signals_dropout = dropout_1.forward_begin(signals);
+            signals = graph_convolution_1.forward_begin(signals_dropout);
+            signals = linear_1.forward_begin(signals_dropout, signals);
+            signals = relu_1.forward_begin(signals);
+            signals_dropout = dropout_2.forward_begin(signals);
+            signals = graph_convolution_2.forward_begin(signals_dropout);
+            signals = linear_2.forward_begin(signals_dropout, signals);
+            signals = log_softmax.forward_begin(signals);
+            // the first epoch has no history yet and reads the chunks of every non-empty tile
+            if (graph_convolution_1.is_history_used()) {
+                history_dataflow.run(1);
+            } else {
+                forward_dataflow.run(1);
+            }
+
+            // the chunks of the layers interleave, so the outputs are released after the whole pass
+            if (recompute != recompute_none) {
+                dropout_0.release_y();
+                dropout_1.release_y();
+                dropout_2.release_y();
+            }
+            if (recompute == recompute_relu_dropout) {
+                relu_0.release_y();
+                relu_1.release_y();
+            }
+        } else {
+            // dropout 0
+            signals_dropout = dropout_0.forward(&features_chunked);
+
+            // graph convolution 0
+            signals = graph_convolution_0.forward(signals_dropout);
+
+            // linear layer 0
+            signals = linear_0.forward(signals_dropout, signals);
+            if (recompute != recompute_none) {
+                dropout_0.release_y();
+            }
+
+            // ReLU 0
+            signals = relu_0.forward(signals);
+
+            // dropout 1
+            signals_dropout = dropout_1.forward(signals);
+            if (recompute == recompute_relu_dropout) {
+                relu_0.release_y();
+            }
+
+            // graph convolution 1
+            signals = graph_convolution_1.forward(signals_dropout);
+
+            // linear layer 1
+            signals = linear_1.forward(signals_dropout, signals);
+            if (recompute != recompute_none) {
+                dropout_1.release_y();
+            }
+
+            // ReLU 1
+            signals = relu_1.forward(signals);
+
+            // dropout 2
+            signals_dropout = dropout_2.forward(signals);
+            if (recompute == recompute_relu_dropout) {
+                relu_1.release_y();
+            }
+
+            // graph convolution 2
+            signals = graph_convolution_2.forward(signals_dropout);
+
+            // linear layer 2
+            signals = linear_2.forward(signals_dropout, signals);
+            if (recompute != recompute_none) {
+                dropout_2.release_y();
+            }
+
+            // log-softmax
+            signals = log_softmax.forward(signals);
+        }
 
         // loss
         loss = loss_layer.forward(signals, &classes);
@@ -361,13 +630,18 @@ void alzheimer_chunked(Dataset dataset, long chunk_size) {
         //loss
         loss_gradients = loss_layer.backward();
 
-        chunk_up(loss_gradients, &loss_gradients_chunked, chunk_size);
+        chunk_up(loss_gradients, &loss_gradients_chunked, &boundaries);
 
         // log-softmax
         gradients = log_softmax.backward(&loss_gradients_chunked);
 
-        // linear layer 2
+        // linear layer 2, its inputs come back if they were released
+        relu_1.recompute_y();
+        dropout_2.recompute_y();
         sage_linear_gradients = linear_2.backward(gradients);
+        if (recompute != recompute_none) {
+            dropout_2.release_y();
+        }
 
         // graph convolution 2
         gradients = graph_convolution_2.backward(sage_linear_gradients->neighbourhood_gradients);
@@ -380,12 +654,20 @@ void alzheimer_chunked(Dataset dataset, long chunk_size) {
 
         // relu 1
         gradients = relu_1.backward(gradients);
+        if (recompute == recompute_relu_dropout) {
+            relu_1.release_y();
+        }
 
-        // linear layer 1
+        // linear layer 1, its inputs come back if they were released
+        relu_0.recompute_y();
+        dropout_1.recompute_y();
         sage_linear_gradients = linear_1.backward(gradients);
+        if (recompute != recompute_none) {
+            dropout_1.release_y();
+        }
 
         // graph convolution 1
-        gradients = graph_convolution_1.backward(gradients);
+        gradients = graph_convolution_1.backward(sage_linear_gradients->neighbourhood_gradients);
 
         // add sage_linear_gradients.self_grads + gradients
         gradients = add_1.forward(sage_linear_gradients->self_gradients, gradients);
@@ -395,20 +677,37 @@ void alzheimer_chunked(Dataset dataset, long chunk_size) {
 
         // relu 0
         gradients = relu_0.backward(gradients);
+        if (recompute == recompute_relu_dropout) {
+            relu_0.release_y();
+        }
 
         // linear layer 0
+        dropout_0.recompute_y();
         sage_linear_gradients = linear_0.backward(gradients);
+        if (recompute != recompute_none) {
+            dropout_0.release_y();
+        }
 
         // no need for graph conv 0 and dropout 0
 
         // optimiser
         adam.step();
+
+        // written in the background during the next epoch
+        checkpoint.save(checkpoint_path, i, &checkpoint_parameters, &adam);
     }// end training loop
 
+    checkpoint.wait();
     loss_file.close();
 }
 
 void alzheimer_pipelined(Dataset dataset, long chunk_size) {
+    ModelConfig config;
+    config.mode = model_pipelined;
+    alzheimer_model(dataset, config, chunk_size);
+}
+
+void alzheimer_model(Dataset dataset, ModelConfig config, long chunk_size) {
     // read tensors
     // set path to directory
     std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
@@ -421,194 +720,885 @@ void alzheimer_pipelined(Dataset dataset, long chunk_size) {
     long num_nodes = features->num_rows_;
     long num_features = features->num_columns_;
 
-    // chunk features
-    long num_chunks = ceil((float) features->num_rows_ / (float) chunk_size);
-    std::vector<Matrix<float>> features_chunked(num_chunks);
-    chunk_up(features, &features_chunked, chunk_size);
-
-    delete features;
-
     // read classes
     path = dataset_path + "/classes.npy";
     Matrix<int> classes = load_npy_matrix<int>(path);
 
-    //    // read train_mask
-    //    path = dataset_path + "/train_mask.npy";
-    //    matrix<bool> train_mask = load_npy_matrix<bool>(path);
-    //
-    //    // read val_mask
-    //    path = dataset_path + "/val_mask.npy";
-    //    matrix<bool> val_mask = load_npy_matrix<bool>(path);
-    //
-    //    // read test_mask
-    //    path = dataset_path + "/test_mask.npy";
-    //    matrix<bool> test_mask = load_npy_matrix<bool>(path);
-
-    // read adjacency
-    path = dataset_path + "/adjacency.mtx";
-    SparseMatrix<float> *adjacency = new SparseMatrix<float>();
-    load_mtx_matrix<float>(path, adjacency);
-
-    // chunk adjacency
-    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
-    double_chunk_up_sp(adjacency, &adjacencies, chunk_size);
-
-    // get sums of adjacency rows
-    Matrix<float> adjacency_row_sum(num_nodes, 1, true);
-    sp_mat_sum_rows(adjacency, &adjacency_row_sum);
-
-    delete adjacency;
-
-    // FORWARD PASS
     CudaHelper cuda_helper;
     float learning_rate = 0.0003;
     long num_hidden_channels = 256;
     long num_classes = get_dataset_num_classes(dataset);
+    if (config.channels.empty()) {
+        config.channels = {num_features, num_hidden_channels, num_hidden_channels, num_classes};
+    }
+
+    ModelGraph graph(config);
+    graph.optimize();
+    graph.print();
+
+    // full mode, the mean baked into the adjacency like in alzheimer
+    SparseMatrix<float> adjacency_normalized;
+    SparseMatrix<float> adjacency_normalized_transposed;
+    // chunked and pipelined mode
+    std::vector<long> boundaries;
+    std::vector<Matrix<float>> features_chunked;
+    std::vector<SparseMatrix<float>> adjacencies;
+    Matrix<float> adjacency_row_sum;
+
+    Model *model;
+    if (config.mode == model_full) {
+        SparseMatrix<float> adjacency;
+        load_sp_matrix<float>(get_adjacency_path(dataset_path), &adjacency);
+        sanitize_graph(&adjacency, false, true, mean_normalization, &adjacency_normalized);
+        sanitize_graph(&adjacency_normalized, false, false, &adjacency_normalized_transposed);
+        transpose_csr_matrix_cpu(&adjacency_normalized_transposed);
+
+        model = new Model(&cuda_helper, &graph, &adjacency_normalized, &adjacency_normalized_transposed, "sum", NULL);
+    } else {
+        get_dataset_boundaries(dataset_path, num_nodes, num_features, chunk_size, &boundaries);
+        long num_chunks = boundaries.size() - 1;
+        print_boundaries(&boundaries);
+
+        features_chunked.resize(num_chunks);
+        chunk_up(features, &features_chunked, &boundaries);
+
+        // read chunked adjacency, reuse the tiles cached next to the dataset if they are up to date
+        adjacencies.resize(num_chunks * num_chunks);
+        double_chunk_up_sp_cached(get_adjacency_path(dataset_path), &adjacencies, &boundaries);
+        TileIndex tile_index;
+        index_tiles(&adjacencies, &tile_index);
+        print_tile_index(&tile_index);
+
+        // both come in first-touched by a single thread. the features get the layout of the model input first,
+        // Model::forward would convert them on this thread again
+        if (config.numa_placement != numa_none) {
+            for (Matrix<float> &chunk : features_chunked) {
+                to_layout_inplace(&chunk, !graph.is_input_column_major());
+            }
+        }
+        NumaTopology numa_topology;
+        get_numa_topology(&numa_topology);
+        place_chunks(&numa_topology, config.numa_placement, &features_chunked);
+        place_tiles(&numa_topology, config.numa_placement, &adjacencies);
+
+        // get sums of adjacency rows
+        adjacency_row_sum.set(num_nodes, 1, true);
+        sp_mat_sum_rows(&adjacencies, &adjacency_row_sum);
+
+        model = new Model(&cuda_helper, &graph, &adjacencies, &adjacency_row_sum, "mean", &boundaries);
+    }
 
-    // layers
     NLLLoss loss_layer(num_nodes, num_classes);
-    AddPipelined add_1(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    AddPipelined add_2(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    DropoutPipelined dropout_0(&cuda_helper, chunk_size, num_nodes, num_features);
-    FeatureAggregationPipelined graph_convolution_0(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_features, chunk_size, num_nodes);
-    SageLinearPipelined linear_0(&cuda_helper, num_features, num_hidden_channels, chunk_size, num_nodes);
-    ReluPipelined relu_0(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    DropoutPipelined dropout_1(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    FeatureAggregationPipelined graph_convolution_1(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_hidden_channels, chunk_size, num_nodes);
-    SageLinearPipelined linear_1(&cuda_helper, num_hidden_channels, num_hidden_channels, chunk_size, num_nodes);
-    ReluPipelined relu_1(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    DropoutPipelined dropout_2(&cuda_helper, chunk_size, num_nodes, num_hidden_channels);
-    FeatureAggregationPipelined graph_convolution_2(&cuda_helper, &adjacencies, &adjacency_row_sum, "mean", num_hidden_channels, chunk_size, num_nodes);
-    SageLinearPipelined linear_2(&cuda_helper, num_hidden_channels, num_classes, chunk_size, num_nodes);
-    LogSoftmaxPipelined log_softmax(&cuda_helper, chunk_size, num_nodes, num_classes);
+    Adam adam(&cuda_helper, learning_rate, model->get_parameters(), model->get_gradients());
 
-    // optimizer
-    long num_parameters = 6;
-    std::vector<Matrix<float> *> parameters(num_parameters);
-    std::vector<Matrix<float> *> params = linear_0.get_parameters();
-    parameters[0] = params[0];
-    parameters[1] = params[1];
-    params = linear_1.get_parameters();
-    parameters[2] = params[0];
-    parameters[3] = params[1];
-    params = linear_2.get_parameters();
-    parameters[4] = params[0];
-    parameters[5] = params[1];
-    std::vector<Matrix<float> *> parameter_gradients(num_parameters);
-    std::vector<Matrix<float> *> grads = linear_0.get_gradients();
-    parameter_gradients[0] = grads[0];
-    parameter_gradients[1] = grads[1];
-    grads = linear_1.get_gradients();
-    parameter_gradients[2] = grads[0];
-    parameter_gradients[3] = grads[1];
-    grads = linear_2.get_gradients();
-    parameter_gradients[4] = grads[0];
-    parameter_gradients[5] = grads[1];
-    Adam adam(&cuda_helper, learning_rate, parameters, parameter_gradients);
+    // checkpoint all SageLinear parameters
+    std::vector<Matrix<float> *> checkpoint_parameters = model->get_parameters();
+    std::string checkpoint_path = get_checkpoint_path(dataset, "model_" + get_model_mode_name(config.mode));
+    Checkpoint checkpoint;
 
-    std::vector<Matrix<float>> *signals;
-    std::vector<Matrix<float>> *signals_dropout;
-    std::vector<Matrix<float>> *gradients;
-    SageLinearGradientsChunked *sage_linear_gradients;
     Matrix<float> *loss_gradients;
-    std::vector<Matrix<float>> loss_gradients_chunked(num_chunks);
+    std::vector<Matrix<float>> loss_gradients_chunked(boundaries.size() - 1);
     float loss;
 
-    path = "/tmp/benchmark/loss_" + get_dataset_name(dataset) + "_" + std::to_string(chunk_size)  + ".csv";
+    path = "/tmp/benchmark/loss_" + get_dataset_name(dataset) + "_" + get_model_mode_name(config.mode) + "_" +
+           std::to_string(chunk_size) + ".csv";
     std::ofstream loss_file;
     loss_file.open(path, std::ios::trunc);
     loss_file << "epoch,loss\n";
 
     int num_epochs = 10;
     for (int i = 0; i < num_epochs; ++i) {
+        if (config.mode == model_full) {
+            loss = loss_layer.forward(model->forward(features), &classes);
+        } else {
+            loss = loss_layer.forward(model->forward(&features_chunked), &classes);
+        }
+        loss_file << i << "," << loss << "\n";
 
-        // dropout 0
-        signals_dropout = dropout_0.forward(&features_chunked);
+        // BACKPROPAGATION
+        loss_gradients = loss_layer.backward();
+        if (config.mode == model_full) {
+            model->backward(loss_gradients);
+        } else {
+            chunk_up(loss_gradients, &loss_gradients_chunked, &boundaries);
+            model->backward(&loss_gradients_chunked);
+        }
 
-        // graph convolution 0
-        signals = graph_convolution_0.forward(signals_dropout);
+        // optimiser
+        adam.step();
 
-        // linear layer 0
-        signals = linear_0.forward(signals_dropout, signals);
+        // written in the background during the next epoch
+        checkpoint.save(checkpoint_path, i, &checkpoint_parameters, &adam);
+    }// end training loop
 
-        // ReLU 0
-        signals = relu_0.forward(signals);
+    checkpoint.wait();
+    loss_file.close();
 
-        // dropout 1
-        signals_dropout = dropout_1.forward(signals);
+    delete model;
+    delete features;
+}
 
-        // graph convolution 1
-        signals = graph_convolution_1.forward(signals_dropout);
+void alzheimer_inference(Dataset dataset, std::string checkpoint_path, long chunk_size, bool spill) {
+    // read tensors
+    // set path to directory
+    std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
 
-        // linear layer 1
-        signals = linear_1.forward(signals_dropout, signals);
+    // read features
+    std::string path = dataset_path + "/features.npy";
+    Matrix<float> *features = new Matrix<float>();
+    load_npy_matrix<float>(path, features);
 
-        // ReLU 1
-        signals = relu_1.forward(signals);
+    long num_nodes = features->num_rows_;
+    long num_features = features->num_columns_;
 
-        // dropout 2
-        signals_dropout = dropout_2.forward(signals);
+    CudaHelper cuda_helper;
+    long num_hidden_channels = 256;
+    long num_classes = get_dataset_num_classes(dataset);
+    std::vector<long> channels = {num_features, num_hidden_channels, num_hidden_channels, num_classes};
+
+    // the parameters of the training checkpoint
+    long num_layers = channels.size() - 1;
+    std::vector<Matrix<float>> parameters(4 * num_layers);
+    std::vector<Matrix<float> *> parameter_pointers;
+    for (long l = 0; l < num_layers; ++l) {
+        parameters.at(4 * l).set(channels.at(l), channels.at(l + 1), false);
+        parameters.at(4 * l + 1).set(channels.at(l + 1), 1, false);
+        parameters.at(4 * l + 2).set(channels.at(l), channels.at(l + 1), false);
+        parameters.at(4 * l + 3).set(channels.at(l + 1), 1, false);
+    }
+    for (long i = 0; i < (long) parameters.size(); ++i) {
+        parameter_pointers.push_back(&parameters.at(i));
+    }
+    restore_checkpoint(checkpoint_path, &parameter_pointers, NULL);
+
+    std::vector<long> boundaries;
+    get_dataset_boundaries(dataset_path, num_nodes, num_features, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
 
-        // graph convolution 2
-        signals = graph_convolution_2.forward(signals_dropout);
+    std::vector<Matrix<float>> features_chunked(num_chunks);
+    chunk_up(features, &features_chunked, &boundaries);
+    delete features;
 
-        // linear layer 2
-        signals = linear_2.forward(signals_dropout, signals);
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp_cached(get_adjacency_path(dataset_path), &adjacencies, &boundaries);
+    Matrix<float> adjacency_row_sum(num_nodes, 1, true);
+    sp_mat_sum_rows(&adjacencies, &adjacency_row_sum);
+
+    Inference inference(&cuda_helper, &adjacencies, &adjacency_row_sum, &boundaries, parameter_pointers);
+    if (spill) {
+        inference.set_spill_dir("/tmp/benchmark");
+    }
+    inference.set_embeddings_path("/tmp/benchmark/embeddings_" + get_dataset_name(dataset) + ".npy");
+    // a dataset of the reorder tool, the outputs go back to the ids of the original one
+    std::vector<int> new_ids;
+    std::string permutation_path = dataset_path + "/permutation.npy";
+    if (std::ifstream(permutation_path).good()) {
+        cnpy::NpyArray permutation = cnpy::npy_load(permutation_path);
+        new_ids.assign(permutation.data<int>(), permutation.data<int>() + permutation.shape.at(0));
+        inference.set_permutation(&new_ids);
+    }
+    inference.run(&features_chunked, "/tmp/benchmark/predictions_" + get_dataset_name(dataset) + ".npy");
+}
+
+// rank 0 loads the dataset into a named segment, the other processes attach to it
+void alzheimer_data_parallel_process(Dataset dataset, long chunk_size, long rank, long num_processes, SharedBarrier *barrier,
+                                     std::string segment_name) {
+    std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
+    long num_hidden_channels = 256;
+    long num_classes = get_dataset_num_classes(dataset);
+    float learning_rate = 0.0003;
+
+    SharedSegment *segment = NULL;
+    SharedGraph shared;
+    if (rank == 0) {
+        Matrix<float> *features = new Matrix<float>();
+        load_npy_matrix<float>(dataset_path + "/features.npy", features);
+        to_row_major_inplace(features);
+        Matrix<int> classes = load_npy_matrix<int>(dataset_path + "/classes.npy");
+        SparseMatrix<float> *adjacency = new SparseMatrix<float>();
+        load_sp_matrix<float>(get_adjacency_path(dataset_path), adjacency);
+
+        SharedGraphHeader header;
+        header.num_processes = num_processes;
+        header.num_nodes = features->num_rows_;
+        header.num_features = features->num_columns_;
+        header.nnz = adjacency->nnz_;
+        std::vector<long> channels = {header.num_features, num_hidden_channels, num_hidden_channels, num_classes};
+        long num_parameters = 0;
+        for (long l = 0; l < (long) channels.size() - 1; ++l) {
+            num_parameters = num_parameters + 2 * (channels.at(l) * channels.at(l + 1) + channels.at(l + 1));
+        }
+        header.slots_size = SharedAllreduce::get_slots_size(num_processes, num_parameters);
+
+        segment = new SharedSegment(segment_name, get_shared_graph_size(&header));
+        std::memcpy(segment->get_data(), &header, sizeof(SharedGraphHeader));
+        map_shared_graph(segment->get_data(), &shared);
+        std::copy(features->values_, features->values_ + features->size_, shared.features);
+        std::copy(adjacency->csr_row_ptr_, adjacency->csr_row_ptr_ + header.num_nodes + 1, shared.row_ptr);
+        std::copy(adjacency->csr_col_ind_, adjacency->csr_col_ind_ + header.nnz, shared.col_ind);
+        std::copy(adjacency->csr_val_, adjacency->csr_val_ + header.nnz, shared.values);
+        std::copy(classes.values_, classes.values_ + header.num_nodes, shared.classes);
+        delete features;
+        delete adjacency;
+    }
+    barrier->wait();
+    if (rank != 0) {
+        segment = new SharedSegment(segment_name);
+        map_shared_graph(segment->get_data(), &shared);
+    }
+    long num_nodes = shared.header->num_nodes;
+    long num_features = shared.header->num_features;
+
+    // every process computes the same row chunks and owns consecutive ones
+    long num_chunks = ceil((float) num_nodes / (float) chunk_size);
+    std::vector<long> boundaries;
+    get_balanced_boundaries(shared.row_ptr, num_nodes, num_features, num_chunks, &boundaries);
+    cap_boundaries(&boundaries, chunk_size);
+    num_chunks = boundaries.size() - 1;
+    if (num_chunks < num_processes) {
+        throw "Fewer row chunks than processes";
+    }
+    long first_chunk = rank * num_chunks / num_processes;
+    long last_chunk = (rank + 1) * num_chunks / num_processes;
+    long first_row = boundaries.at(first_chunk);
+    long num_rows = boundaries.at(last_chunk) - first_row;
+
+    // the rows of the process and a halo one hop deep, every aggregation gets the halo rows of its input from their
+    // owners and passes their gradients back to them, so the rows come out as on the whole graph
+    std::vector<long> channels = {num_features, num_hidden_channels, num_hidden_channels, num_classes};
+    std::vector<long> nodes;
+    SparseMatrix<float> adjacency;
+    get_partition_graph(shared.row_ptr, shared.col_ind, shared.values, num_nodes, first_row, first_row + num_rows, 1,
+                        &nodes, &adjacency);
+    long num_local_nodes = nodes.size();
+    std::cout << "Process " << rank << ": " << num_rows << " rows, " << num_local_nodes - num_rows << " halo nodes"
+              << std::endl;
+    Matrix<float> features(num_local_nodes, num_features, true);
+    for (long i = 0; i < num_local_nodes; ++i) {
+        std::copy(shared.features + nodes.at(i) * num_features, shared.features + (nodes.at(i) + 1) * num_features,
+                  features.values_ + i * num_features);
+    }
+    // only the rows of the process are in its loss
+    Matrix<int> classes(num_rows, 1, true);
+    std::copy(shared.classes + first_row, shared.classes + first_row + num_rows, classes.values_);
+    std::vector<long> local_boundaries;
+    for (long c = first_chunk; c < last_chunk; ++c) {
+        local_boundaries.push_back(boundaries.at(c) - first_row);
+    }
+    for (long row = num_rows; row < num_local_nodes; row = row + chunk_size) {
+        local_boundaries.push_back(row);
+    }
+    local_boundaries.push_back(num_local_nodes);
+    long num_local_chunks = local_boundaries.size() - 1;
+
+    std::vector<Matrix<float>> features_chunked(num_local_chunks);
+    chunk_up(&features, &features_chunked, &local_boundaries);
+    std::vector<SparseMatrix<float>> adjacencies(num_local_chunks * num_local_chunks);
+    double_chunk_up_sp(&adjacency, &adjacencies, &local_boundaries);
+    Matrix<float> adjacency_row_sum(num_local_nodes, 1, true);
+    sp_mat_sum_rows(&adjacencies, &adjacency_row_sum);
+
+    CudaHelper cuda_helper;
+    ModelConfig config;
+    config.mode = model_chunked;
+    config.channels = channels;
+    ModelGraph graph(config);
+    graph.optimize();
+    Model model(&cuda_helper, &graph, &adjacencies, &adjacency_row_sum, "mean", &local_boundaries);
+    std::vector<Matrix<float> *> parameters = model.get_parameters();
+    std::vector<Matrix<float> *> gradients = model.get_gradients();
+    SharedHaloExchange halo_exchange(barrier, shared.num_halo_nodes, segment_name + "_halo", rank, num_processes, &nodes,
+                                     num_rows, *std::max_element(channels.begin(), channels.end()), &local_boundaries);
+    model.set_aggregation_hooks([&halo_exchange](std::vector<Matrix<float>> *x) { halo_exchange.exchange(x); },
+                                [&halo_exchange](std::vector<Matrix<float>> *gradients) { halo_exchange.reduce(gradients); });
+
+    // the same initial weights everywhere
+    SharedAllreduce allreduce(barrier, shared.slots, rank, num_processes,
+                              shared.header->slots_size / (num_processes + 1));
+    allreduce.broadcast(&parameters, 0);
+
+    NLLLoss loss_layer(num_rows, num_classes);
+    Adam adam(&cuda_helper, learning_rate, parameters, gradients);
+    Matrix<float> *loss_gradients;
+    // the halo rows get no gradient, their owners do
+    Matrix<float> local_loss_gradients(num_local_nodes, num_classes, true);
+    local_loss_gradients.set_values(0.0);
+    std::vector<Matrix<float>> loss_gradients_chunked(num_local_chunks);
+    // the allreduce takes the mean over the processes, weighted by their rows it is the mean over all nodes
+    float weight = (float) (num_rows * num_processes) / (float) num_nodes;
+    Matrix<float> loss(1, 1, true);
+    std::vector<Matrix<float> *> losses = {&loss};
+
+    std::ofstream loss_file;
+    if (rank == 0) {
+        loss_file.open("/tmp/benchmark/loss_" + get_dataset_name(dataset) + "_data_parallel_" +
+                       std::to_string(num_processes) + ".csv", std::ios::trunc);
+        loss_file << "epoch,loss\n";
+    }
+
+    int num_epochs = 10;
+    for (int i = 0; i < num_epochs; ++i) {
+        loss.values_[0] = weight * loss_layer.forward(model.forward(&features_chunked), &classes);
+
+        // BACKPROPAGATION
+        // the halo nodes are in the loss of the process that owns them
+        loss_gradients = loss_layer.backward();
+        to_row_major_inplace(loss_gradients);
+        for (long k = 0; k < loss_gradients->size_; ++k) {
+            local_loss_gradients.values_[k] = weight * loss_gradients->values_[k];
+        }
+        chunk_up(&local_loss_gradients, &loss_gradients_chunked, &local_boundaries);
+        model.backward(&loss_gradients_chunked);
+
+        // optimiser, on the same gradients in every process
+        allreduce.allreduce(&gradients);
+        adam.step();
+
+        allreduce.allreduce(&losses);
+        if (rank == 0) {
+            loss_file << i << "," << loss.values_[0] << "\n";
+        }
+    }// end training loop
+
+    // the segment stays until every process is done with it
+    barrier->wait();
+    delete segment;
+}
+
+void alzheimer_data_parallel(Dataset dataset, long chunk_size, long num_processes) {
+    SharedSegment control(sizeof(SharedBarrierState));
+    SharedBarrierState *barrier_state = reinterpret_cast<SharedBarrierState *>(control.get_data());
+    SharedBarrier::init(barrier_state);
+    std::string segment_name = "/alzheimer_" + std::to_string(getpid());
+
+    std::vector<pid_t> pids;
+    for (long rank = 0; rank < num_processes; ++rank) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            barrier_state->is_aborted.store(true);
+            break;
+        }
+        if (pid == 0) {
+            SharedBarrier barrier(barrier_state, num_processes);
+            int status = 0;
+            try {
+                alzheimer_data_parallel_process(dataset, chunk_size, rank, num_processes, &barrier, segment_name);
+            } catch (const char *e) {
+                std::cerr << "Process " << rank << ": " << e << std::endl;
+                barrier.abort();
+                status = 1;
+            } catch (...) {
+                std::cerr << "Process " << rank << " failed" << std::endl;
+                barrier.abort();
+                status = 1;
+            }
+            _exit(status);
+        }
+        pids.push_back(pid);
+    }
+
+    bool is_failed = (long) pids.size() != num_processes;
+    for (pid_t pid : pids) {
+        int status;
+        if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            barrier_state->is_aborted.store(true);
+            is_failed = true;
+        }
+    }
+    if (is_failed) {
+        // the segment of a rank 0 that died before it cleaned up
+        shm_unlink(segment_name.c_str());
+        throw "A training process failed";
+    }
+}
+
+void alzheimer_sampled(Dataset dataset, long batch_size, std::vector<long> *fanouts, long num_cached_nodes) {
+    // read tensors
+    // set path to directory
+    std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
+
+    // read features
+    std::string path = dataset_path + "/features.npy";
+    Matrix<float> features = load_npy_matrix<float>(path);
+
+    // read classes
+    path = dataset_path + "/classes.npy";
+    Matrix<int> classes = load_npy_matrix<int>(path);
+
+    // read adjacency
+    path = get_adjacency_path(dataset_path);
+    SparseMatrix<float> adjacency;
+    load_sp_matrix<float>(path, &adjacency);
+
+    CudaHelper cuda_helper;
+    long num_nodes = features.num_rows_;
+    float learning_rate = 0.0003;
+    long num_hidden_channels = 256;
+    long num_classes = get_dataset_num_classes(dataset);
+    long num_layers = 3;
+    long seed = 0;
+    if ((long) fanouts->size() != num_layers) {
+        throw "Need one fanout per layer";
+    }
+
+    // layers, resized to the blocks of every mini-batch
+    std::vector<Dropout> dropout_layers(num_layers);
+    std::vector<FeatureAggregation> graph_convolutions(num_layers);
+    // a new block every mini-batch, no time for the hybrid conversion on the compute thread
+    for (FeatureAggregation &graph_convolution : graph_convolutions) {
+        graph_convolution.set_hybrid(false);
+    }
+    std::vector<SageLinear> linear_layers(num_layers);
+    std::vector<Relu> relu_layers(num_layers - 1);
+    LogSoftmax log_softmax;
+    linear_layers.at(0).set(&cuda_helper, features.num_columns_, num_hidden_channels, batch_size);
+    linear_layers.at(1).set(&cuda_helper, num_hidden_channels, num_hidden_channels, batch_size);
+    linear_layers.at(2).set(&cuda_helper, num_hidden_channels, num_classes, batch_size);
+    // linear layers keep a pointer to their input for the backward pass
+    std::vector<Matrix<float>> self_features(num_layers);
+
+    // optimizer
+    std::vector<Matrix<float> *> parameters;
+    std::vector<Matrix<float> *> parameter_gradients;
+    for (long i = 0; i < num_layers; ++i) {
+        std::vector<Matrix<float> *> params = linear_layers.at(i).get_parameters();
+        parameters.insert(parameters.end(), params.begin(), params.end());
+        std::vector<Matrix<float> *> grads = linear_layers.at(i).get_gradients();
+        parameter_gradients.insert(parameter_gradients.end(), grads.begin(), grads.end());
+    }
+    Adam adam(&cuda_helper, learning_rate, parameters, parameter_gradients);
+
+    // batch k + 1 is sampled while batch k is computed
+    NeighbourSampler sampler(&adjacency, &features, &classes, fanouts, seed);
+    FeatureCache feature_cache;
+    if (num_cached_nodes > 0) {
+        feature_cache.set(&adjacency, &features, num_cached_nodes);
+        sampler.set_feature_cache(&feature_cache);
+    }
+    std::vector<MiniBatch> mini_batches(2);
+    std::vector<int> order;
+    std::vector<int> seeds;
+
+    Matrix<float> *signals;
+    Matrix<float> *signals_dropout;
+    Matrix<float> *gradients;
+    SageLinearGradients *sage_linear_gradients;
+    float loss;
+    float epoch_loss = 0.0;
+    long num_cache_hits = 0;
+    long num_cache_misses = 0;
+
+    path = "/tmp/benchmark/loss_sampled_" + get_dataset_name(dataset) + ".csv";
+    std::ofstream loss_file;
+    loss_file.open(path, std::ios::trunc);
+    loss_file << "epoch,loss,seconds,cache_hit_rate\n";
+
+    int num_epochs = 10;
+    std::chrono::steady_clock::time_point epoch_start = std::chrono::steady_clock::now();
+    long num_batches = get_num_batches(num_nodes, batch_size);
+    long num_steps = num_epochs * num_batches;
+    get_batch_order(num_nodes, seed, 0, &order);
+    get_batch_seeds(&order, 0, batch_size, &seeds);
+    sampler.sample_async(&seeds, 0, &mini_batches.at(0));
+    for (long step = 0; step < num_steps; ++step) {
+        sampler.wait();
+        MiniBatch *mini_batch = &mini_batches.at(step % 2);
+        num_cache_hits = num_cache_hits + mini_batch->num_cache_hits;
+        num_cache_misses = num_cache_misses + mini_batch->num_cache_misses;
+
+        long next_step = step + 1;
+        if (next_step < num_steps) {
+            // the seeds of the current epoch are all taken by now
+            if (next_step % num_batches == 0) {
+                get_batch_order(num_nodes, seed, next_step / num_batches, &order);
+            }
+            get_batch_seeds(&order, next_step % num_batches, batch_size, &seeds);
+            sampler.sample_async(&seeds, next_step, &mini_batches.at(next_step % 2));
+        }
+
+        // FORWARD PASS
+        signals = &mini_batch->features;
+        for (long i = 0; i < num_layers; ++i) {
+            SampledBlock *block = &mini_batch->blocks.at(i);
+
+            // dropout
+            dropout_layers.at(i).set(&cuda_helper, block->num_src, signals->num_columns_);
+            signals_dropout = dropout_layers.at(i).forward(signals);
+
+            // graph convolution
+            graph_convolutions.at(i).set(&cuda_helper, &block->adjacency, &block->adjacency_transposed, "mean",
+                                         signals_dropout->num_columns_, &block->row_sum);
+            signals = graph_convolutions.at(i).forward(signals_dropout);
+
+            // linear layer on the dst nodes
+            get_dst_rows(signals_dropout, block->num_dst, &self_features.at(i));
+            linear_layers.at(i).set_num_nodes(block->num_dst);
+            signals = linear_layers.at(i).forward(&self_features.at(i), signals);
+
+            // ReLU
+            if (i < num_layers - 1) {
+                relu_layers.at(i).set(&cuda_helper, block->num_dst, signals->num_columns_);
+                signals = relu_layers.at(i).forward(signals);
+            }
+        }
 
         // log-softmax
+        long num_seeds = mini_batch->nodes.back().size();
+        log_softmax.set(&cuda_helper, num_seeds, num_classes);
         signals = log_softmax.forward(signals);
 
         // loss
-        loss = loss_layer.forward(signals, &classes);
-        loss_file << i << "," << loss << "\n";
+        NLLLoss loss_layer(num_seeds, num_classes);
+        loss = loss_layer.forward(signals, &mini_batch->classes);
+        epoch_loss = epoch_loss + loss * num_seeds;
 
         // BACKPROPAGATION
         //loss
-        loss_gradients = loss_layer.backward();
-
-        chunk_up(loss_gradients, &loss_gradients_chunked, chunk_size);
+        gradients = loss_layer.backward();
 
         // log-softmax
-        gradients = log_softmax.backward(&loss_gradients_chunked);
+        gradients = log_softmax.backward(gradients);
 
-        // linear layer 2
-        sage_linear_gradients = linear_2.backward(gradients);
+        for (long i = num_layers - 1; i >= 0; --i) {
+            // ReLU
+            if (i < num_layers - 1) {
+                gradients = relu_layers.at(i).backward(gradients);
+            }
 
-        // graph convolution 2
-        gradients = graph_convolution_2.backward(sage_linear_gradients->neighbourhood_gradients);
+            // linear layer
+            sage_linear_gradients = linear_layers.at(i).backward(gradients);
 
-        // add sage_linear_gradients.self_grads + gradients
-        gradients = add_2.forward(sage_linear_gradients->self_gradients, gradients);
+            // no need for graph convolution 0 and dropout 0
+            if (i == 0) {
+                break;
+            }
 
-        // dropout 2
-        gradients = dropout_2.backward(gradients);
+            // graph convolution
+            gradients = graph_convolutions.at(i).backward(sage_linear_gradients->neighbourhood_gradients);
 
-        // relu 1
-        gradients = relu_1.backward(gradients);
+            // the dst nodes are the first src nodes, add their self gradients
+            add_dst_rows(sage_linear_gradients->self_gradients, gradients);
 
-        // linear layer 1
-        sage_linear_gradients = linear_1.backward(gradients);
+            // dropout
+            gradients = dropout_layers.at(i).backward(gradients);
+        }
 
-        // graph convolution 1
-        gradients = graph_convolution_1.backward(gradients);
+        // optimiser
+        adam.step();
 
-        // add sage_linear_gradients.self_grads + gradients
-        gradients = add_1.forward(sage_linear_gradients->self_gradients, gradients);
+        if (next_step % num_batches == 0) {
+            loss_file << step / num_batches << "," << epoch_loss / num_nodes << "," << get_seconds_since(epoch_start) << ","
+                      << (double) num_cache_hits / (double) (num_cache_hits + num_cache_misses) << "\n";
+            epoch_loss = 0.0;
+            num_cache_hits = 0;
+            num_cache_misses = 0;
+            epoch_start = std::chrono::steady_clock::now();
+        }
+    }// end training loop
 
-        // dropout 1
-        gradients = dropout_1.backward(gradients);
+    loss_file.close();
+}
 
-        // relu 0
-        gradients = relu_0.backward(gradients);
+void alzheimer_clustered(Dataset dataset, long chunk_size, long clusters_per_batch) {
+    // read tensors
+    // set path to directory
+    std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
 
-        // linear layer 0
-        sage_linear_gradients = linear_0.backward(gradients);
+    // read features
+    std::string path = dataset_path + "/features.npy";
+    Matrix<float> *features = new Matrix<float>();
+    load_npy_matrix<float>(path, features);
 
-        // no need for graph conv 0 and dropout 0
+    long num_nodes = features->num_rows_;
+    long num_features = features->num_columns_;
 
-        // optimiser
-        adam.step();
+    // the parts of the partition tool are the clusters if there are any, else chunks of the chunk size
+    std::vector<long> boundaries;
+    get_dataset_boundaries(dataset_path, num_nodes, num_features, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    print_boundaries(&boundaries);
+
+    // chunk features
+    std::vector<Matrix<float>> features_chunked(num_chunks);
+    chunk_up(features, &features_chunked, &boundaries);
+
+    delete features;
+
+    // read classes
+    path = dataset_path + "/classes.npy";
+    Matrix<int> classes = load_npy_matrix<int>(path);
+
+    // read chunked adjacency, only the tiles between the clusters of a batch are used
+    path = get_adjacency_path(dataset_path);
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp_cached(path, &adjacencies, &boundaries);
+
+    CudaHelper cuda_helper;
+    float learning_rate = 0.0003;
+    long num_hidden_channels = 256;
+    long num_classes = get_dataset_num_classes(dataset);
+    long num_layers = 3;
+    long seed = 0;
+    long max_batch_size = 0;
+    for (long i = 0; i < num_chunks; i = i + clusters_per_batch) {
+        max_batch_size = std::max(max_batch_size, boundaries.at(std::min(i + clusters_per_batch, num_chunks)) - boundaries.at(i));
+    }
+
+    // layers, resized to the subgraph of every batch
+    std::vector<Dropout> dropout_layers(num_layers);
+    std::vector<FeatureAggregation> graph_convolutions(num_layers);
+    for (FeatureAggregation &graph_convolution : graph_convolutions) {
+        graph_convolution.set_hybrid(false);
+    }
+    std::vector<SageLinear> linear_layers(num_layers);
+    std::vector<Relu> relu_layers(num_layers - 1);
+    std::vector<Add> add_layers(num_layers - 1);
+    LogSoftmax log_softmax;
+    linear_layers.at(0).set(&cuda_helper, num_features, num_hidden_channels, max_batch_size);
+    linear_layers.at(1).set(&cuda_helper, num_hidden_channels, num_hidden_channels, max_batch_size);
+    linear_layers.at(2).set(&cuda_helper, num_hidden_channels, num_classes, max_batch_size);
+
+    // optimizer
+    std::vector<Matrix<float> *> parameters;
+    std::vector<Matrix<float> *> parameter_gradients;
+    for (long i = 0; i < num_layers; ++i) {
+        std::vector<Matrix<float> *> params = linear_layers.at(i).get_parameters();
+        parameters.insert(parameters.end(), params.begin(), params.end());
+        std::vector<Matrix<float> *> grads = linear_layers.at(i).get_gradients();
+        parameter_gradients.insert(parameter_gradients.end(), grads.begin(), grads.end());
+    }
+    Adam adam(&cuda_helper, learning_rate, parameters, parameter_gradients);
+
+    std::vector<std::vector<long>> batches;
+    std::vector<int> nodes;
+    SparseMatrix<float> subgraph;
+    Matrix<float> subgraph_row_sum;
+    Matrix<float> subgraph_features;
+    Matrix<int> subgraph_classes;
+
+    Matrix<float> *signals;
+    Matrix<float> *signals_dropout;
+    Matrix<float> *gradients;
+    SageLinearGradients *sage_linear_gradients;
+    float loss;
+    float epoch_loss;
+
+    path = "/tmp/benchmark/loss_clustered_" + get_dataset_name(dataset) + "_" + std::to_string(clusters_per_batch) + ".csv";
+    std::ofstream loss_file;
+    loss_file.open(path, std::ios::trunc);
+    loss_file << "epoch,loss,seconds\n";
+
+    int num_epochs = 10;
+    for (int epoch = 0; epoch < num_epochs; ++epoch) {
+        std::chrono::steady_clock::time_point epoch_start = std::chrono::steady_clock::now();
+        epoch_loss = 0.0;
+
+        get_cluster_batches(num_chunks, clusters_per_batch, seed, epoch, &batches);
+        for (long b = 0; b < (long) batches.size(); ++b) {
+            std::vector<long> *clusters = &batches.at(b);
+
+            // subgraph of the batch
+            get_cluster_subgraph(&adjacencies, &boundaries, clusters, &subgraph);
+            long num_batch_nodes = subgraph.num_rows_;
+            subgraph_row_sum.set(num_batch_nodes, 1, true);
+            sp_mat_sum_rows(&subgraph, &subgraph_row_sum);
+            // nodes without neighbours in the batch aggregate to zero instead of nan
+            for (long i = 0; i < num_batch_nodes; ++i) {
+                if (subgraph_row_sum.values_[i] == 0.0) {
+                    subgraph_row_sum.values_[i] = 1.0;
+                }
+            }
+            stitch(&features_chunked, clusters, &subgraph_features);
+            get_cluster_nodes(&boundaries, clusters, &nodes);
+            subgraph_classes.set(num_batch_nodes, 1, true);
+            for (long i = 0; i < num_batch_nodes; ++i) {
+                subgraph_classes.values_[i] = classes.values_[nodes.at(i)];
+            }
+
+            // FORWARD PASS
+            signals = &subgraph_features;
+            for (long i = 0; i < num_layers; ++i) {
+                // dropout
+                dropout_layers.at(i).set(&cuda_helper, num_batch_nodes, signals->num_columns_);
+                signals_dropout = dropout_layers.at(i).forward(signals);
+
+                // graph convolution
+                graph_convolutions.at(i).set(&cuda_helper, &subgraph, "mean", num_batch_nodes, signals_dropout->num_columns_,
+                                             &subgraph_row_sum);
+                signals = graph_convolutions.at(i).forward(signals_dropout);
+
+                // linear layer
+                linear_layers.at(i).set_num_nodes(num_batch_nodes);
+                signals = linear_layers.at(i).forward(signals_dropout, signals);
+
+                // ReLU
+                if (i < num_layers - 1) {
+                    relu_layers.at(i).set(&cuda_helper, num_batch_nodes, signals->num_columns_);
+                    signals = relu_layers.at(i).forward(signals);
+                }
+            }
+
+            // log-softmax
+            log_softmax.set(&cuda_helper, num_batch_nodes, num_classes);
+            signals = log_softmax.forward(signals);
+
+            // loss
+            NLLLoss loss_layer(num_batch_nodes, num_classes);
+            loss = loss_layer.forward(signals, &subgraph_classes);
+            epoch_loss = epoch_loss + loss * num_batch_nodes;
+
+            // BACKPROPAGATION
+            //loss
+            gradients = loss_layer.backward();
+
+            // log-softmax
+            gradients = log_softmax.backward(gradients);
+
+            for (long i = num_layers - 1; i >= 0; --i) {
+                // ReLU
+                if (i < num_layers - 1) {
+                    gradients = relu_layers.at(i).backward(gradients);
+                }
+
+                // linear layer
+                sage_linear_gradients = linear_layers.at(i).backward(gradients);
+
+                // no need for graph convolution 0 and dropout 0
+                if (i == 0) {
+                    break;
+                }
+
+                // graph convolution
+                gradients = graph_convolutions.at(i).backward(sage_linear_gradients->neighbourhood_gradients);
+
+                // add sage_linear_gradients.self_grads + gradients
+                add_layers.at(i - 1).set(&cuda_helper, num_batch_nodes, gradients->num_columns_);
+                gradients = add_layers.at(i - 1).forward(sage_linear_gradients->self_gradients, gradients);
+
+                // dropout
+                gradients = dropout_layers.at(i).backward(gradients);
+            }
+
+            // optimiser
+            adam.step();
+        }
+
+        loss_file << epoch << "," << epoch_loss / num_nodes << "," << get_seconds_since(epoch_start) << "\n";
     }// end training loop
 
     loss_file.close();
 }
+
+// forward and backward pass of the chunked or pipelined model, without loss and optimiser. the first pass warms up
+double time_chunked_epoch(SparseMatrix<float> *adjacency, Matrix<float> *features, std::vector<long> *boundaries, long num_classes,
+                          ModelMode mode) {
+    long num_chunks = boundaries->size() - 1;
+    long num_nodes = features->num_rows_;
+    long num_features = features->num_columns_;
+    long num_hidden_channels = 256;
+
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp(adjacency, &adjacencies, boundaries);
+    Matrix<float> adjacency_row_sum(num_nodes, 1, true);
+    sp_mat_sum_rows(&adjacencies, &adjacency_row_sum);
+    std::vector<Matrix<float>> features_chunked(num_chunks);
+    chunk_up(features, &features_chunked, boundaries);
+    std::vector<Matrix<float>> incoming_gradients(num_chunks);
+    init_set_random_values(&incoming_gradients, boundaries, num_classes, true);
+
+    ModelConfig config;
+    config.mode = mode;
+    config.channels = {num_features, num_hidden_channels, num_hidden_channels, num_classes};
+    ModelGraph graph(config);
+    graph.optimize();
+
+    CudaHelper cuda_helper;
+    Model model(&cuda_helper, &graph, &adjacencies, &adjacency_row_sum, "mean", boundaries);
+
+    double seconds = 0.0;
+    for (int i = 0; i < 2; ++i) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        model.forward(&features_chunked);
+        model.backward(&incoming_gradients);
+
+        seconds = get_seconds_since(start);
+    }
+
+    return seconds;
+}
+
+long tune_chunk_size(Dataset dataset, long memory_budget, bool pipelined) {
+    std::string dataset_path = dir_path + "/" + get_dataset_name(dataset);
+    Matrix<float> features = load_npy_matrix<float>(dataset_path + "/features.npy");
+    to_row_major_inplace(&features);
+    SparseMatrix<float> adjacency;
+    load_sp_matrix<float>(get_adjacency_path(dataset_path), &adjacency);
+
+    long num_nodes = features.num_rows_;
+    long num_features = features.num_columns_;
+    long num_hidden_channels = 256;
+    long num_classes = get_dataset_num_classes(dataset);
+    std::vector<long> channels = {num_features, num_hidden_channels, num_hidden_channels, num_classes};
+    long num_buffers = 1;
+    if (pipelined) {
+        num_buffers = 2;
+    }
+    ChunkTuner chunk_tuner(memory_budget, channels, num_buffers);
+
+    // an eighth of the chunks, spread over the graph, stand in for all of them. the sample only keeps the tiles between
+    // its own chunks, so the epoch of its diagonal scales with the chunks and the rest with the tiles off the diagonal
+    auto trial = [&](std::vector<long> *boundaries) {
+        long num_chunks = boundaries->size() - 1;
+        long num_samples = std::min(num_chunks, std::max(2l, num_chunks / 8));
+        std::vector<long> samples(num_samples);
+        std::vector<long> sample_boundaries(num_samples + 1, 0);
+        for (long k = 0; k < num_samples; ++k) {
+            samples.at(k) = k * num_chunks / num_samples;
+            sample_boundaries.at(k + 1) = sample_boundaries.at(k) + boundaries->at(samples.at(k) + 1) - boundaries->at(samples.at(k));
+        }
+
+        SparseMatrix<float> subgraph;
+        get_chunks_subgraph(&adjacency, boundaries, &samples, &subgraph);
+        Matrix<float> sample_features(sample_boundaries.back(), num_features, true);
+        for (long k = 0; k < num_samples; ++k) {
+            std::copy(&features.values_[boundaries->at(samples.at(k)) * num_features],
+                      &features.values_[boundaries->at(samples.at(k) + 1) * num_features],
+                      &sample_features.values_[sample_boundaries.at(k) * num_features]);
+        }
+
+        ModelMode mode = model_chunked;
+        if (pipelined) {
+            mode = model_pipelined;
+        }
+        SparseMatrix<float> diagonal;
+        get_diagonal_subgraph(&subgraph, &sample_boundaries, &diagonal);
+        double seconds = time_chunked_epoch(&subgraph, &sample_features, &sample_boundaries, num_classes, mode);
+        double diagonal_seconds = time_chunked_epoch(&diagonal, &sample_features, &sample_boundaries, num_classes, mode);
+
+        double epoch_seconds = diagonal_seconds * num_chunks / num_samples;
+        long num_sample_tiles = get_num_off_diagonal_tiles(&subgraph, &sample_boundaries);
+        if (num_sample_tiles > 0) {
+            long num_tiles = get_num_off_diagonal_tiles(&adjacency, boundaries);
+            epoch_seconds = epoch_seconds + std::max(seconds - diagonal_seconds, 0.0) * num_tiles / num_sample_tiles;
+        }
+        return epoch_seconds;
+    };
+
+    long chunk_size = chunk_tuner.tune_cached(dataset_path, adjacency.csr_row_ptr_, num_nodes, 1 << 14, 1 << 21, trial);
+    chunk_tuner.print();
+    std::cout << "Tuned chunk size: " << chunk_size << std::endl;
+
+    return chunk_size;
+}
+
+void alzheimer_tuned(Dataset dataset, long memory_budget, bool pipelined) {
+    long chunk_size = tune_chunk_size(dataset, memory_budget, pipelined);
+    // the model the trial epochs timed
+    ModelConfig config;
+    config.mode = model_chunked;
+    if (pipelined) {
+        config.mode = model_pipelined;
+    }
+    alzheimer_model(dataset, config, chunk_size);
+}
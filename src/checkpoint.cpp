@@ -0,0 +1,184 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "checkpoint.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+const char checkpoint_magic[8] = {'A', 'L', 'Z', 'C', 'K', 'P', 'T', '1'};
+const long checkpoint_version = 1;
+const long checkpoint_alignment = 64;
+
+
+long align_checkpoint(long offset) {
+    return (offset + checkpoint_alignment - 1) / checkpoint_alignment * checkpoint_alignment;
+}
+
+// FNV-1a over 8 byte words, the size is a multiple of 8
+unsigned long get_checksum(const char *data, long size) {
+    unsigned long hash = 14695981039346656037ul;
+    for (long i = 0; i + 8 <= size; i = i + 8) {
+        unsigned long word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ul;
+    }
+    return hash;
+}
+
+std::vector<Matrix<float> *> get_checkpoint_matrices(std::vector<Matrix<float> *> *parameters, Adam *adam) {
+    std::vector<Matrix<float> *> matrices = *parameters;
+    if (adam == NULL) {
+        return matrices;
+    }
+    std::vector<Matrix<float>> *momentum_ms = adam->get_momentum_ms();
+    std::vector<Matrix<float>> *momentum_vs = adam->get_momentum_vs();
+    for (long i = 0; i < (long) momentum_ms->size(); ++i) {
+        matrices.push_back(&momentum_ms->at(i));
+    }
+    for (long i = 0; i < (long) momentum_vs->size(); ++i) {
+        matrices.push_back(&momentum_vs->at(i));
+    }
+    return matrices;
+}
+
+void snapshot_checkpoint(std::vector<char> *buffer, long epoch, std::vector<Matrix<float> *> *parameters, Adam *adam) {
+    std::vector<Matrix<float> *> matrices = get_checkpoint_matrices(parameters, adam);
+    long num_matrices = matrices.size();
+
+    long offset = align_checkpoint(sizeof(CheckpointHeader) + num_matrices * sizeof(CheckpointEntry));
+    std::vector<CheckpointEntry> entries(num_matrices);
+    for (long i = 0; i < num_matrices; ++i) {
+        entries.at(i).num_rows = matrices.at(i)->num_rows_;
+        entries.at(i).num_columns = matrices.at(i)->num_columns_;
+        entries.at(i).is_row_major = matrices.at(i)->is_row_major_;
+        entries.at(i).offset = offset;
+        offset = align_checkpoint(offset + matrices.at(i)->size_ * sizeof(float));
+    }
+
+    // values are copied as they are, no layout conversion
+    buffer->assign(offset, 0);
+    std::memcpy(buffer->data() + sizeof(CheckpointHeader), entries.data(), num_matrices * sizeof(CheckpointEntry));
+    for (long i = 0; i < num_matrices; ++i) {
+        std::memcpy(buffer->data() + entries.at(i).offset, matrices.at(i)->values_, matrices.at(i)->size_ * sizeof(float));
+    }
+
+    CheckpointHeader header;
+    std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+    header.version = checkpoint_version;
+    header.epoch = epoch;
+    header.t = adam != NULL ? adam->get_t() : 0;
+    header.num_matrices = num_matrices;
+    header.size = offset;
+    header.checksum = get_checksum(buffer->data() + sizeof(CheckpointHeader), offset - sizeof(CheckpointHeader));
+    std::memcpy(buffer->data(), &header, sizeof(CheckpointHeader));
+}
+
+// write to a temporary file first so a crash never leaves a truncated checkpoint behind
+void write_checkpoint(std::vector<char> *buffer, std::string path) {
+    std::string tmp_path = path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(buffer->data(), buffer->size());
+    file.close();
+    if (!file) {
+        throw "Could not write checkpoint";
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw "Could not rename checkpoint";
+    }
+}
+
+long restore_checkpoint(std::string path, std::vector<Matrix<float> *> *parameters, Adam *adam) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw "Could not open checkpoint";
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (long) sizeof(CheckpointHeader)) {
+        close(fd);
+        throw "Checkpoint is too small";
+    }
+    long size = file_stat.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw "Could not map checkpoint";
+    }
+    const char *data = static_cast<const char *>(mapped);
+
+    CheckpointHeader header;
+    std::memcpy(&header, data, sizeof(CheckpointHeader));
+    std::vector<Matrix<float> *> matrices = get_checkpoint_matrices(parameters, adam);
+    const char *error = NULL;
+    if (std::memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0 || header.version != checkpoint_version) {
+        error = "Checkpoint has wrong format";
+    } else if (header.size != size || header.num_matrices < (long) matrices.size() ||
+               (adam != NULL && header.num_matrices != (long) matrices.size())) {
+        error = "Checkpoint does not match model";
+    } else if (header.checksum != get_checksum(data + sizeof(CheckpointHeader), size - sizeof(CheckpointHeader))) {
+        error = "Checkpoint is corrupted";
+    }
+
+    const CheckpointEntry *entries = reinterpret_cast<const CheckpointEntry *>(data + sizeof(CheckpointHeader));
+    for (long i = 0; error == NULL && i < (long) matrices.size(); ++i) {
+        if (entries[i].num_rows != matrices.at(i)->num_rows_ || entries[i].num_columns != matrices.at(i)->num_columns_) {
+            error = "Checkpoint does not match model";
+        }
+    }
+    if (error != NULL) {
+        munmap(mapped, size);
+        throw error;
+    }
+
+    for (long i = 0; i < (long) matrices.size(); ++i) {
+        std::memcpy(matrices.at(i)->values_, data + entries[i].offset, matrices.at(i)->size_ * sizeof(float));
+        matrices.at(i)->is_row_major_ = entries[i].is_row_major;
+    }
+    if (adam != NULL) {
+        adam->set_t(header.t);
+    }
+    munmap(mapped, size);
+
+    return header.epoch;
+}
+
+void write_checkpoint_background(std::vector<char> *buffer, std::string path, const char **error) {
+    try {
+        write_checkpoint(buffer, path);
+    } catch (const char *e) {
+        *error = e;
+    }
+}
+
+// a destructor must not throw, so a failed last write is only reported
+Checkpoint::~Checkpoint() {
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (error_ != NULL) {
+        std::cerr << "Checkpoint: " << error_ << std::endl;
+    }
+}
+
+void Checkpoint::save(std::string path, long epoch, std::vector<Matrix<float> *> *parameters, Adam *adam) {
+    wait();
+    snapshot_checkpoint(&buffer_, epoch, parameters, adam);
+    writer_ = std::thread(write_checkpoint_background, &buffer_, path, &error_);
+}
+
+void Checkpoint::wait() {
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (error_ != NULL) {
+        const char *error = error_;
+        error_ = NULL;
+        throw error;
+    }
+}
@@ -0,0 +1,215 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunk_tuner.hpp"
+#include "chunking.hpp"
+#include "cuda_helper.hpp"
+
+#include "cnpy.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+
+long get_chunk_memory(long chunk_size, long max_chunk_nnz, std::vector<long> *channels, long num_buffers) {
+    if (channels->size() < 2 || num_buffers < 1) {
+        throw "Model needs at least one layer and one buffer";
+    }
+    long rows = chunk_size;
+    long tile = max_chunk_nnz * (sizeof(float) + sizeof(int)) + (rows + 1) * sizeof(int);
+
+    long memory = 0;
+    for (long l = 0; l + 1 < (long) channels->size(); ++l) {
+        long in = channels->at(l);
+        long out = channels->at(l + 1);
+
+        // the backward pass of dropout keeps dy, dx and the reserve space of a chunk
+        long dropout = num_buffers * rows * in * (2 * sizeof(float) + 1);
+        // the output chunk and its row sums, the input chunk and the tile
+        long aggregation = rows * (in + 1) * sizeof(float) + num_buffers * (rows * in * sizeof(float) + tile);
+        // weight and its gradient, the backward pass keeps dy, x and dx of a chunk
+        long linear = 2 * in * out * sizeof(float) + num_buffers * rows * (out + 2 * in) * sizeof(float);
+        memory = std::max(memory, std::max(dropout, std::max(aggregation, linear)));
+
+        if (l + 2 < (long) channels->size()) {
+            // relu keeps x, y, dx and dy, add a, b and c
+            memory = std::max(memory, num_buffers * rows * out * 4 * (long) sizeof(float));
+        } else {
+            // log-softmax keeps y, dy and dx
+            memory = std::max(memory, num_buffers * rows * out * 3 * (long) sizeof(float));
+        }
+    }
+    return memory;
+}
+
+long get_max_chunk_nnz(int *row_ptr, std::vector<long> *boundaries) {
+    long max_nnz = 0;
+    for (long i = 0; i + 1 < (long) boundaries->size(); ++i) {
+        max_nnz = std::max(max_nnz, (long) (row_ptr[boundaries->at(i + 1)] - row_ptr[boundaries->at(i)]));
+    }
+    return max_nnz;
+}
+
+std::string get_hardware_fingerprint() {
+    int device;
+    check_cuda(cudaGetDevice(&device));
+    cudaDeviceProp properties = {};
+    check_cuda(cudaGetDeviceProperties(&properties, device));
+
+    return std::string(properties.name) + "_" + std::to_string(properties.totalGlobalMem) + "_" +
+           std::to_string(properties.major) + "." + std::to_string(properties.minor) + "_" +
+           std::to_string(properties.multiProcessorCount) + "_" + std::to_string(std::thread::hardware_concurrency());
+}
+
+ChunkTuner::ChunkTuner(long memory_budget, std::vector<long> channels, long num_buffers) {
+    if (memory_budget < 1 || channels.size() < 2 || num_buffers < 1) {
+        throw "Tuner needs a positive budget, at least one layer and one buffer";
+    }
+    memory_budget_ = memory_budget;
+    channels_ = channels;
+    num_buffers_ = num_buffers;
+}
+
+ChunkTrial ChunkTuner::get_trial(int *row_ptr, long chunk_size, std::vector<long> *boundaries) {
+    ChunkTrial chunk_trial;
+    chunk_trial.chunk_size = chunk_size;
+    chunk_trial.max_chunk_size = get_max_chunk_size(boundaries);
+    chunk_trial.memory = get_chunk_memory(chunk_trial.max_chunk_size, get_max_chunk_nnz(row_ptr, boundaries),
+                                          &channels_, num_buffers_);
+    chunk_trial.seconds = 0.0;
+    return chunk_trial;
+}
+
+long ChunkTuner::tune(int *row_ptr, long num_nodes, long min_chunk_size, long max_chunk_size,
+                      std::function<double(std::vector<long> *boundaries)> trial) {
+    if (min_chunk_size < 1 || max_chunk_size < min_chunk_size) {
+        throw "Chunk sizes must be positive and ordered";
+    }
+
+    trials_.clear();
+    long best = -1;
+    double best_seconds = 0.0;
+    std::vector<long> boundaries;
+    for (long chunk_size = min_chunk_size; chunk_size <= max_chunk_size; chunk_size = chunk_size * 2) {
+        // like alzheimer_chunked does it
+        long num_chunks = ceil((float) num_nodes / (float) chunk_size);
+        get_balanced_boundaries(row_ptr, num_nodes, channels_.at(0), num_chunks, &boundaries);
+        cap_boundaries(&boundaries, chunk_size);
+
+        ChunkTrial chunk_trial = get_trial(row_ptr, chunk_size, &boundaries);
+        if (chunk_trial.memory <= memory_budget_) {
+            chunk_trial.seconds = trial(&boundaries);
+            if (best < 0 || chunk_trial.seconds < best_seconds) {
+                best = chunk_size;
+                best_seconds = chunk_trial.seconds;
+            }
+        }
+        trials_.push_back(chunk_trial);
+
+        // larger chunk sizes give the same single chunk
+        if (num_chunks == 1) {
+            break;
+        }
+    }
+
+    if (best < 0) {
+        throw "No chunk size fits the memory budget";
+    }
+    return best;
+}
+
+long ChunkTuner::tune(int *row_ptr, std::vector<long> *parts, long min_chunk_size, long max_chunk_size,
+                      std::function<double(std::vector<long> *boundaries)> trial) {
+    if (min_chunk_size < 1 || max_chunk_size < min_chunk_size) {
+        throw "Chunk sizes must be positive and ordered";
+    }
+
+    trials_.clear();
+    long max_part_size = get_max_chunk_size(parts);
+    ChunkTrial parts_trial = get_trial(row_ptr, max_part_size, parts);
+    trials_.push_back(parts_trial);
+    if (parts_trial.memory <= memory_budget_) {
+        return max_part_size;
+    }
+
+    long best = -1;
+    double best_seconds = 0.0;
+    std::vector<long> boundaries;
+    // capping at the largest part or above gives the parts again, which do not fit
+    for (long chunk_size = min_chunk_size; chunk_size <= max_chunk_size && chunk_size < max_part_size; chunk_size = chunk_size * 2) {
+        // like get_dataset_boundaries does it
+        boundaries = *parts;
+        cap_boundaries(&boundaries, chunk_size);
+
+        ChunkTrial chunk_trial = get_trial(row_ptr, chunk_size, &boundaries);
+        if (chunk_trial.memory <= memory_budget_) {
+            chunk_trial.seconds = trial(&boundaries);
+            if (best < 0 || chunk_trial.seconds < best_seconds) {
+                best = chunk_size;
+                best_seconds = chunk_trial.seconds;
+            }
+        }
+        trials_.push_back(chunk_trial);
+    }
+
+    if (best < 0) {
+        throw "No chunk size fits the memory budget";
+    }
+    return best;
+}
+
+std::string ChunkTuner::get_cache_path(std::string dataset_path) {
+    std::string key = get_hardware_fingerprint() + "_" + std::to_string(memory_budget_) + "_" + std::to_string(num_buffers_);
+    for (long channel : channels_) {
+        key = key + "_" + std::to_string(channel);
+    }
+    // the parts of the partition tool change the candidates
+    std::ifstream parts_file(dataset_path + "/boundaries.npy", std::ios::binary);
+    if (parts_file.good()) {
+        key = key + "_" + std::string(std::istreambuf_iterator<char>(parts_file), std::istreambuf_iterator<char>());
+    }
+    return dataset_path + "/chunk_size_" + std::to_string(std::hash<std::string>()(key)) + ".npy";
+}
+
+long ChunkTuner::tune_cached(std::string dataset_path, int *row_ptr, long num_nodes, long min_chunk_size, long max_chunk_size,
+                             std::function<double(std::vector<long> *boundaries)> trial) {
+    std::string path = get_cache_path(dataset_path);
+    std::ifstream file(path);
+    if (file.good()) {
+        cnpy::NpyArray arr = cnpy::npy_load(path);
+        if (arr.word_size == sizeof(long) && arr.num_vals == 1 && arr.data<long>()[0] > 0) {
+            return arr.data<long>()[0];
+        }
+    }
+
+    long chunk_size;
+    std::vector<long> parts;
+    if (load_boundaries(dataset_path + "/boundaries.npy", num_nodes, &parts)) {
+        chunk_size = tune(row_ptr, &parts, min_chunk_size, max_chunk_size, trial);
+    } else {
+        chunk_size = tune(row_ptr, num_nodes, min_chunk_size, max_chunk_size, trial);
+    }
+    cnpy::npy_save<long>(path, &chunk_size, {1}, "w");
+    return chunk_size;
+}
+
+std::vector<ChunkTrial> *ChunkTuner::get_trials() {
+    return &trials_;
+}
+
+void ChunkTuner::print() {
+    for (ChunkTrial &chunk_trial : trials_) {
+        std::cout << "Chunk size " << chunk_trial.chunk_size << ": " << chunk_trial.max_chunk_size << " rows at most, "
+                  << chunk_trial.memory / (1 << 20) << " MB";
+        if (chunk_trial.memory > memory_budget_) {
+            std::cout << ", over budget";
+        } else if (chunk_trial.seconds > 0.0) {
+            std::cout << ", " << chunk_trial.seconds << " s per epoch";
+        } else {
+            std::cout << ", parts of the partition tool";
+        }
+        std::cout << std::endl;
+    }
+}
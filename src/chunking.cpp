@@ -1,57 +1,213 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "chunking.hpp"
+#include "dataset.hpp"
 #include "sparse_computation.hpp"
 
+#include "cnpy.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
 #include <thread>
 
+const char chunk_cache_magic[8] = {'A', 'L', 'Z', 'T', 'I', 'L', 'E', 'S'};
+const long chunk_cache_version = 3;
+
+struct ChunkCacheHeader {
+    char magic[8];
+    long version;
+    long source_size;// size and modification time of the file the tiles were computed from
+    long source_mtime;
+    unsigned long boundaries_checksum;
+    long num_chunks;
+};
+
+const char row_ptr_cache_magic[8] = {'A', 'L', 'Z', 'R', 'O', 'W', 'P', 'T'};
+
+struct RowPtrCacheHeader {
+    char magic[8];
+    long source_size;// size and modification time of the adjacency the row pointers are from
+    long source_mtime;
+    long num_rows;
+};
+
+struct ChunkCacheEntry {
+    long num_rows;
+    long num_columns;
+    long nnz;
+    long offset;// byte offset of row pointers, column indices and values of the tile
+};
+
+
+void get_uniform_boundaries(long num_nodes, long chunk_size, std::vector<long> *boundaries) {
+    if (chunk_size < 1) {
+        throw "Chunk size must be positive";
+    }
+    long num_chunks = ceil((double) num_nodes / (double) chunk_size);
+    boundaries->resize(num_chunks + 1);
+    for (long i = 0; i < num_chunks; ++i) {
+        boundaries->at(i) = i * chunk_size;
+    }
+    boundaries->at(num_chunks) = num_nodes;
+}
+
+void get_balanced_boundaries(int *row_ptr, long num_nodes, long num_features, long num_chunks, std::vector<long> *boundaries) {
+    if (num_nodes < 1 || num_chunks < 1) {
+        throw "Number of nodes and chunks must be positive";
+    }
+    num_chunks = std::min(num_chunks, num_nodes);
+
+    // a row costs its non-zeros in the aggregation and its features in every dense layer
+    double total_cost = (double) (row_ptr[num_nodes] - row_ptr[0]) + (double) num_nodes * (double) num_features;
+    boundaries->assign(num_chunks + 1, 0);
+    boundaries->at(num_chunks) = num_nodes;
+    double cost = 0.0;
+    long row = 0;
+    for (long i = 1; i < num_chunks; ++i) {
+        double target = total_cost * (double) i / (double) num_chunks;
+        // every chunk keeps at least one row
+        long min_row = boundaries->at(i - 1) + 1;
+        long max_row = num_nodes - (num_chunks - i);
+        while (row < max_row) {
+            double row_cost = (double) (row_ptr[row + 1] - row_ptr[row]) + (double) num_features;
+            if (row >= min_row && cost + row_cost / 2.0 > target) {
+                break;
+            }
+            cost = cost + row_cost;
+            row = row + 1;
+        }
+        boundaries->at(i) = row;
+    }
+}
+
+void get_balanced_boundaries(SparseMatrix<float> *sp_mat, long num_features, long num_chunks, std::vector<long> *boundaries) {
+    get_balanced_boundaries(sp_mat->csr_row_ptr_, sp_mat->num_rows_, num_features, num_chunks, boundaries);
+}
+
+long get_max_chunk_size(std::vector<long> *boundaries) {
+    long max_chunk_size = 0;
+    for (long i = 0; i + 1 < (long) boundaries->size(); ++i) {
+        max_chunk_size = std::max(max_chunk_size, boundaries->at(i + 1) - boundaries->at(i));
+    }
+    return max_chunk_size;
+}
+
+void print_boundaries(std::vector<long> *boundaries) {
+    long num_chunks = boundaries->size() - 1;
+    long min_chunk_size = boundaries->back();
+    for (long i = 0; i < num_chunks; ++i) {
+        min_chunk_size = std::min(min_chunk_size, boundaries->at(i + 1) - boundaries->at(i));
+    }
+    std::cout << "Chunks: " << num_chunks << " of " << min_chunk_size << " to " << get_max_chunk_size(boundaries)
+              << " rows" << std::endl;
+}
+
+void save_boundaries(std::string path, std::vector<long> *boundaries) {
+    cnpy::npy_save<long>(path, boundaries->data(), {boundaries->size()}, "w");
+}
+
+bool load_boundaries(std::string path, long num_nodes, std::vector<long> *boundaries) {
+    std::ifstream file(path);
+    if (!file.good()) {
+        return false;
+    }
+    cnpy::NpyArray arr = cnpy::npy_load(path);
+    if (arr.word_size != sizeof(long) || arr.num_vals < 2) {
+        return false;
+    }
+    long *values = arr.data<long>();
+    boundaries->assign(values, values + arr.num_vals);
+    if (boundaries->front() != 0 || boundaries->back() != num_nodes) {
+        return false;
+    }
+    for (long i = 0; i + 1 < (long) boundaries->size(); ++i) {
+        if (boundaries->at(i + 1) <= boundaries->at(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool cap_boundaries(std::vector<long> *boundaries, long max_chunk_size) {
+    if (max_chunk_size < 1) {
+        throw "Chunk size must be positive";
+    }
+    std::vector<long> capped = {boundaries->front()};
+    for (long i = 0; i + 1 < (long) boundaries->size(); ++i) {
+        long chunk_size = boundaries->at(i + 1) - boundaries->at(i);
+        long num_parts = (chunk_size + max_chunk_size - 1) / max_chunk_size;
+        for (long k = 1; k <= num_parts; ++k) {
+            capped.push_back(boundaries->at(i) + chunk_size * k / num_parts);
+        }
+    }
+    bool is_split = capped.size() != boundaries->size();
+    boundaries->swap(capped);
+    return is_split;
+}
+
+void get_dataset_boundaries(std::string dataset_path, long num_nodes, long num_features, long chunk_size, std::vector<long> *boundaries) {
+    if (load_boundaries(dataset_path + "/boundaries.npy", num_nodes, boundaries)) {
+        if (cap_boundaries(boundaries, chunk_size)) {
+            std::cout << "Parts of the partition tool split into chunks of at most " << chunk_size << " rows" << std::endl;
+        }
+        return;
+    }
+    long num_chunks = ceil((float) num_nodes / (float) chunk_size);
+    std::vector<int> adjacency_row_ptr;
+    load_sp_matrix_row_ptr_cached(get_adjacency_path(dataset_path), &adjacency_row_ptr);
+    get_balanced_boundaries(adjacency_row_ptr.data(), num_nodes, num_features, num_chunks, boundaries);
+    cap_boundaries(boundaries, chunk_size);
+}
 
 void init_set_random_values(std::vector<Matrix<float>> *mat, long num_nodes, long num_features, long chunk_size, bool is_row_major) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    init_set_random_values(mat, &boundaries, num_features, is_row_major);
+}
+
+void init_set_random_values(std::vector<Matrix<float>> *mat, std::vector<long> *boundaries, long num_features, bool is_row_major) {
     long num_chunks = mat->size();
-    long last_chunk_size;
-    if (num_chunks * chunk_size > num_nodes) {
-        last_chunk_size = num_nodes - (num_chunks - 1) * chunk_size;
-    } else {
-        last_chunk_size = chunk_size;
+    if (num_chunks + 1 != (long) boundaries->size()) {
+        throw "Vector has wrong number of chunks.";
     }
-    long current_chunk_size = chunk_size;
     for (long i = 0; i < num_chunks; ++i) {
-        if (i == num_chunks - 1) {
-            current_chunk_size = last_chunk_size;
-        }
-        mat->at(i).set(current_chunk_size, num_features, is_row_major);
+        mat->at(i).set(boundaries->at(i + 1) - boundaries->at(i), num_features, is_row_major);
         mat->at(i).set_random_values();
     }
 }
 
 void create_chunk(Matrix<float> *x, std::vector<Matrix<float>> *x_chunked, long i,
-                  long chunk_size, long current_chunk_size, long num_features) {
+                  long start_row, long current_chunk_size, long num_features) {
     x_chunked->at(i).set(current_chunk_size, num_features, true);
-    std::copy(x->values_ + (i * chunk_size * num_features),
-              x->values_ + (i * chunk_size * num_features) + current_chunk_size * num_features,
+    std::copy(x->values_ + (start_row * num_features),
+              x->values_ + (start_row * num_features) + current_chunk_size * num_features,
               x_chunked->at(i).values_);
 }
 
 void chunk_up(Matrix<float> *x, std::vector<Matrix<float>> *x_chunked, long chunk_size) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(x->num_rows_, chunk_size, &boundaries);
+    chunk_up(x, x_chunked, &boundaries);
+}
+
+void chunk_up(Matrix<float> *x, std::vector<Matrix<float>> *x_chunked, std::vector<long> *boundaries) {
     to_row_major_inplace(x);
 
-    long num_nodes = x->num_rows_;
     long num_features = x->num_columns_;
     long num_chunks = x_chunked->size();
-    long last_chunk_size = 0;
-    if (num_chunks * chunk_size > num_nodes) {
-        last_chunk_size = num_nodes - (num_chunks - 1) * chunk_size;
-    } else {
-        last_chunk_size = chunk_size;
+    if (num_chunks + 1 != (long) boundaries->size() || boundaries->back() != x->num_rows_) {
+        throw "Boundaries do not match the chunks";
     }
 
-    long current_chunk_size = chunk_size;
     std::vector<std::thread> threads(num_chunks);
     for (long i = 0; i < num_chunks; ++i) {
-        if (i == num_chunks - 1) {
-            current_chunk_size = last_chunk_size;
-        }
-        threads.at(i) = std::thread(create_chunk, x, x_chunked, i, chunk_size, current_chunk_size, num_features);
+        threads.at(i) = std::thread(create_chunk, x, x_chunked, i, boundaries->at(i),
+                                    boundaries->at(i + 1) - boundaries->at(i), num_features);
     }
     for (long i = 0; i < num_chunks; ++i) {
         threads.at(i).join();
@@ -60,54 +216,590 @@ void chunk_up(Matrix<float> *x, std::vector<Matrix<float>> *x_chunked, long chun
 
 void stitch(std::vector<Matrix<float>> *x_chunked, Matrix<float> *x) {
     long num_chunks = x_chunked->size();
-    long chunk_size = x_chunked->at(0).num_rows_;
-    long num_features = x_chunked->at(0).num_columns_;
+    long offset = 0;
     for (int i = 0; i < num_chunks; ++i) {
         to_row_major_inplace(&x_chunked->at(i));
         std::copy(x_chunked->at(i).values_,
                   x_chunked->at(i).values_ + x_chunked->at(i).size_,
-                  x->values_ + (i * chunk_size * num_features));
+                  x->values_ + offset);
+        offset = offset + x_chunked->at(i).size_;
     }
     x->is_row_major_ = true;
 }
 
+// counts the non-zeros of every row of the row chunk per column chunk
+void count_tile_nnz(SparseMatrix<float> *sp_mat, int *counts, int *column_chunks,
+                    long start_row, long num_rows, long block_start, long block_end) {
+    for (long row = block_start; row < block_end; ++row) {
+        for (long k = sp_mat->csr_row_ptr_[start_row + row]; k < sp_mat->csr_row_ptr_[start_row + row + 1]; ++k) {
+            long column_chunk = column_chunks[sp_mat->csr_col_ind_[k]];
+            counts[column_chunk * (num_rows + 1) + row + 1] += 1;
+        }
+    }
+}
+
+// scatters the non-zeros of every row of the row chunk into the tiles
+void fill_tiles(SparseMatrix<float> *sp_mat, std::vector<SparseMatrix<float> *> *tiles, int *column_chunks,
+                std::vector<long> *boundaries, long start_row, long block_start, long block_end) {
+    long num_chunks = tiles->size();
+    std::vector<int> next(num_chunks);
+    for (long row = block_start; row < block_end; ++row) {
+        bool is_sorted = true;
+        for (long j = 0; j < num_chunks; ++j) {
+            next[j] = tiles->at(j)->csr_row_ptr_[row];
+        }
+        long first_index = sp_mat->csr_row_ptr_[start_row + row];
+        long last_index = sp_mat->csr_row_ptr_[start_row + row + 1];
+        for (long k = first_index; k < last_index; ++k) {
+            int column = sp_mat->csr_col_ind_[k];
+            long column_chunk = column_chunks[column];
+            SparseMatrix<float> *tile = (*tiles)[column_chunk];
+            int dest = next[column_chunk];
+            tile->csr_col_ind_[dest] = column - (*boundaries)[column_chunk];
+            tile->csr_val_[dest] = sp_mat->csr_val_[k];
+            next[column_chunk] = dest + 1;
+            if (k > first_index && sp_mat->csr_col_ind_[k - 1] > column) {
+                is_sorted = false;
+            }
+        }
+
+        // the tiles have sorted column indices, like a CSR matrix after a transpose
+        if (!is_sorted) {
+            for (long j = 0; j < num_chunks; ++j) {
+                SparseMatrix<float> *tile = tiles->at(j);
+                int tile_first_index = tile->csr_row_ptr_[row];
+                int tile_last_index = tile->csr_row_ptr_[row + 1];
+                std::vector<std::pair<int, float>> entries(tile_last_index - tile_first_index);
+                for (int k = tile_first_index; k < tile_last_index; ++k) {
+                    entries.at(k - tile_first_index) = std::make_pair(tile->csr_col_ind_[k], tile->csr_val_[k]);
+                }
+                std::stable_sort(entries.begin(), entries.end(),
+                                 [](const std::pair<int, float> &a, const std::pair<int, float> &b) { return a.first < b.first; });
+                for (int k = tile_first_index; k < tile_last_index; ++k) {
+                    tile->csr_col_ind_[k] = entries.at(k - tile_first_index).first;
+                    tile->csr_val_[k] = entries.at(k - tile_first_index).second;
+                }
+            }
+        }
+    }
+}
+
 void double_chunk_up_sp(SparseMatrix<float> *sp_mat, std::vector<SparseMatrix<float>> *chunks, long chunk_size) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(sp_mat->num_rows_, chunk_size, &boundaries);
+    double_chunk_up_sp(sp_mat, chunks, &boundaries);
+}
+
+void double_chunk_up_sp(SparseMatrix<float> *sp_mat, std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries) {
     long num_nodes = sp_mat->num_rows_;
-    long num_chunks = ceil((double) num_nodes / (double) chunk_size);
+    long num_chunks = boundaries->size() - 1;
     if ((long) chunks->size() != num_chunks * num_chunks) {
         throw "Vector has wrong number of chunks.";
     }
+    if (boundaries->back() != num_nodes || sp_mat->num_columns_ != num_nodes) {
+        throw "Boundaries do not match the matrix";
+    }
 
-    long last_chunk_size;
-    if (num_chunks * chunk_size > num_nodes) {
-        last_chunk_size = num_nodes - (num_chunks - 1) * chunk_size;
-    } else {
-        last_chunk_size = chunk_size;
+    // column chunk of every column, so chunks of any size are found without a search
+    std::vector<int> column_chunks(num_nodes);
+    for (long j = 0; j < num_chunks; ++j) {
+        std::fill(column_chunks.begin() + boundaries->at(j), column_chunks.begin() + boundaries->at(j + 1), j);
     }
-    long current_end_row;// end row is included [start_row, end_row] not [start_row, end_row)
-    for (int i = 0; i < num_chunks; ++i) {
-        if (i == num_chunks - 1) {
-            current_end_row = i * chunk_size + last_chunk_size - 1;
-        } else {
-            current_end_row = (i + 1) * chunk_size - 1;
-        }
-
-        // chunk by row
-        SparseMatrix<float> sp_mat_chunk;
-        get_rows(&sp_mat_chunk, sp_mat, i * chunk_size, current_end_row);
-        // transpose
-        transpose_csr_matrix_cpu(&sp_mat_chunk);
-        // chunk by row (would be by column without transpose
-        for (int j = 0; j < num_chunks; ++j) {
-            if (j == num_chunks - 1) {
-                current_end_row = j * chunk_size + last_chunk_size - 1;
-            } else {
-                current_end_row = (j + 1) * chunk_size - 1;
+
+    long num_threads = std::thread::hardware_concurrency();
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    std::vector<std::thread> threads(num_threads);
+
+    // one counting pass and one scatter pass per row chunk, both split into row blocks across threads
+    std::vector<int> counts;
+    std::vector<SparseMatrix<float> *> tiles(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        long start_row = boundaries->at(i);
+        long num_rows = boundaries->at(i + 1) - start_row;
+        long block_size = ceil((double) num_rows / (double) num_threads);
+
+        counts.assign(num_chunks * (num_rows + 1), 0);
+        for (long t = 0; t < num_threads; ++t) {
+            long block_start = std::min(t * block_size, num_rows);
+            long block_end = std::min((t + 1) * block_size, num_rows);
+            threads.at(t) = std::thread(count_tile_nnz, sp_mat, counts.data(), column_chunks.data(),
+                                        start_row, num_rows, block_start, block_end);
+        }
+        for (long t = 0; t < num_threads; ++t) {
+            threads.at(t).join();
+        }
+
+        for (long j = 0; j < num_chunks; ++j) {
+            int *row_ptr = &counts.at(j * (num_rows + 1));
+            for (long row = 0; row < num_rows; ++row) {
+                row_ptr[row + 1] = row_ptr[row + 1] + row_ptr[row];
+            }
+
+            long num_columns = boundaries->at(j + 1) - boundaries->at(j);
+            tiles.at(j) = &chunks->at(i * num_chunks + j);
+            tiles.at(j)->set(num_rows, num_columns, row_ptr[num_rows]);
+            std::copy(row_ptr, row_ptr + num_rows + 1, tiles.at(j)->csr_row_ptr_);
+        }
+
+        for (long t = 0; t < num_threads; ++t) {
+            long block_start = std::min(t * block_size, num_rows);
+            long block_end = std::min((t + 1) * block_size, num_rows);
+            threads.at(t) = std::thread(fill_tiles, sp_mat, &tiles, column_chunks.data(), boundaries,
+                                        start_row, block_start, block_end);
+        }
+        for (long t = 0; t < num_threads; ++t) {
+            threads.at(t).join();
+        }
+    }
+}
+
+bool get_file_stat(std::string path, long *size, long *mtime) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return false;
+    }
+    *size = file_stat.st_size;
+    *mtime = file_stat.st_mtime;
+    return true;
+}
+
+void index_tiles(std::vector<SparseMatrix<float>> *tiles, TileIndex *index) {
+    long num_chunks = std::lround(std::sqrt((double) tiles->size()));
+    if (num_chunks * num_chunks != (long) tiles->size()) {
+        throw "Tiles are not square";
+    }
+    index->num_chunks = num_chunks;
+    index->num_non_empty = 0;
+    index->nnz = 0;
+    index->max_nnz = 0;
+    index->non_empty = std::vector<std::vector<long>>(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        for (long j = 0; j < num_chunks; ++j) {
+            long nnz = tiles->at(i * num_chunks + j).nnz_;
+            if (nnz > 0) {
+                index->non_empty.at(i).push_back(j);
+                index->num_non_empty = index->num_non_empty + 1;
+                index->nnz = index->nnz + nnz;
+                index->max_nnz = std::max(index->max_nnz, nnz);
+            }
+        }
+    }
+}
+
+// fraction of non-empty tiles
+double get_tile_density(TileIndex *index) {
+    if (index->num_chunks == 0) {
+        return 0.0;
+    }
+    return (double) index->num_non_empty / (double) (index->num_chunks * index->num_chunks);
+}
+
+void print_tile_index(TileIndex *index) {
+    long min_row_tiles = index->num_chunks;
+    long max_row_tiles = 0;
+    for (long i = 0; i < index->num_chunks; ++i) {
+        min_row_tiles = std::min(min_row_tiles, (long) index->non_empty.at(i).size());
+        max_row_tiles = std::max(max_row_tiles, (long) index->non_empty.at(i).size());
+    }
+    std::cout << "Non-empty tiles: " << index->num_non_empty << " of " << index->num_chunks * index->num_chunks
+              << " (density " << get_tile_density(index) << ")" << std::endl;
+    std::cout << "Non-empty tiles per row chunk: " << min_row_tiles << " to " << max_row_tiles << std::endl;
+    if (index->num_non_empty > 0) {
+        std::cout << "Nonzeros per non-empty tile: " << index->nnz / index->num_non_empty << " on average, "
+                  << index->max_nnz << " at most" << std::endl;
+    }
+}
+
+// FNV-1a over the boundaries
+unsigned long get_boundaries_checksum(std::vector<long> *boundaries) {
+    unsigned long hash = 14695981039346656037ul;
+    for (long boundary : *boundaries) {
+        hash = (hash ^ (unsigned long) boundary) * 1099511628211ul;
+    }
+    return hash;
+}
+
+std::string get_chunk_cache_path(std::string path, std::vector<long> *boundaries) {
+    return path + "." + std::to_string(boundaries->size() - 1) + "_" + std::to_string(get_boundaries_checksum(boundaries)) + ".tiles";
+}
+
+void save_double_chunked_sp(std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries, std::string source_path, std::string path) {
+    ChunkCacheHeader header;
+    std::memcpy(header.magic, chunk_cache_magic, sizeof(chunk_cache_magic));
+    header.version = chunk_cache_version;
+    if (!get_file_stat(source_path, &header.source_size, &header.source_mtime)) {
+        throw "Source of chunk cache does not exist";
+    }
+    header.boundaries_checksum = get_boundaries_checksum(boundaries);
+    header.num_chunks = boundaries->size() - 1;
+    if (header.num_chunks * header.num_chunks != (long) chunks->size()) {
+        throw "Vector has wrong number of chunks.";
+    }
+
+    long num_tiles = chunks->size();
+    std::vector<ChunkCacheEntry> index(num_tiles);
+    long offset = sizeof(ChunkCacheHeader) + num_tiles * sizeof(ChunkCacheEntry);
+    for (long i = 0; i < num_tiles; ++i) {
+        SparseMatrix<float> *tile = &chunks->at(i);
+        index.at(i).num_rows = tile->num_rows_;
+        index.at(i).num_columns = tile->num_columns_;
+        index.at(i).nnz = tile->nnz_;
+        index.at(i).offset = offset;
+        offset = offset + (tile->num_rows_ + 1 + tile->nnz_) * sizeof(int) + tile->nnz_ * sizeof(float);
+    }
+
+    // write to a temporary file first so concurrent runs never see a partial cache
+    std::string tmp_path = path + ".tmp";
+    std::ofstream cache_file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!cache_file.is_open()) {
+        std::cout << "Could not write chunk cache " << path << std::endl;
+        return;
+    }
+    cache_file.write(reinterpret_cast<char *>(&header), sizeof(ChunkCacheHeader));
+    cache_file.write(reinterpret_cast<char *>(index.data()), num_tiles * sizeof(ChunkCacheEntry));
+    for (long i = 0; i < num_tiles; ++i) {
+        SparseMatrix<float> *tile = &chunks->at(i);
+        cache_file.write(reinterpret_cast<char *>(tile->csr_row_ptr_), (tile->num_rows_ + 1) * sizeof(int));
+        cache_file.write(reinterpret_cast<char *>(tile->csr_col_ind_), tile->nnz_ * sizeof(int));
+        cache_file.write(reinterpret_cast<char *>(tile->csr_val_), tile->nnz_ * sizeof(float));
+    }
+    cache_file.close();
+
+    if (cache_file.fail() || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        std::cout << "Could not write chunk cache " << path << std::endl;
+    }
+}
+
+bool load_double_chunked_sp(std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries, std::string source_path, std::string path) {
+    std::ifstream cache_file(path, std::ios::binary);
+    if (!cache_file.is_open()) {
+        return false;
+    }
+
+    ChunkCacheHeader header;
+    cache_file.read(reinterpret_cast<char *>(&header), sizeof(ChunkCacheHeader));
+    if (!cache_file) {
+        return false;
+    }
+
+    long source_size;
+    long source_mtime;
+    if (!get_file_stat(source_path, &source_size, &source_mtime)) {
+        return false;
+    }
+    if (std::memcmp(header.magic, chunk_cache_magic, sizeof(chunk_cache_magic)) != 0 ||
+        header.version != chunk_cache_version ||
+        header.source_size != source_size ||
+        header.source_mtime != source_mtime ||
+        header.boundaries_checksum != get_boundaries_checksum(boundaries) ||
+        header.num_chunks != (long) boundaries->size() - 1 ||
+        header.num_chunks * header.num_chunks != (long) chunks->size()) {
+        return false;
+    }
+
+    long num_tiles = chunks->size();
+    std::vector<ChunkCacheEntry> index(num_tiles);
+    cache_file.read(reinterpret_cast<char *>(index.data()), num_tiles * sizeof(ChunkCacheEntry));
+    if (!cache_file) {
+        return false;
+    }
+
+    for (long i = 0; i < num_tiles; ++i) {
+        SparseMatrix<float> *tile = &chunks->at(i);
+        tile->set(index.at(i).num_rows, index.at(i).num_columns, index.at(i).nnz);
+
+        cache_file.seekg(index.at(i).offset);
+        cache_file.read(reinterpret_cast<char *>(tile->csr_row_ptr_), (tile->num_rows_ + 1) * sizeof(int));
+        cache_file.read(reinterpret_cast<char *>(tile->csr_col_ind_), tile->nnz_ * sizeof(int));
+        cache_file.read(reinterpret_cast<char *>(tile->csr_val_), tile->nnz_ * sizeof(float));
+        if (!cache_file) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void double_chunk_up_sp_cached(std::string path, std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries) {
+    std::string cache_path = get_chunk_cache_path(path, boundaries);
+    if (load_double_chunked_sp(chunks, boundaries, path, cache_path)) {
+        return;
+    }
+
+    SparseMatrix<float> *sp_mat = new SparseMatrix<float>();
+    load_sp_matrix<float>(path, sp_mat);
+    double_chunk_up_sp(sp_mat, chunks, boundaries);
+    delete sp_mat;
+
+    save_double_chunked_sp(chunks, boundaries, path, cache_path);
+}
+
+std::string get_row_ptr_cache_path(std::string path) {
+    return path + ".row_ptr";
+}
+
+void save_row_ptr(std::vector<int> *row_ptr, std::string source_path, std::string path) {
+    RowPtrCacheHeader header;
+    std::memcpy(header.magic, row_ptr_cache_magic, sizeof(row_ptr_cache_magic));
+    if (!get_file_stat(source_path, &header.source_size, &header.source_mtime)) {
+        throw "Source of row pointer cache does not exist";
+    }
+    header.num_rows = row_ptr->size() - 1;
+
+    std::string tmp_path = path + ".tmp";
+    std::ofstream cache_file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!cache_file.is_open()) {
+        std::cout << "Could not write row pointer cache " << path << std::endl;
+        return;
+    }
+    cache_file.write(reinterpret_cast<char *>(&header), sizeof(RowPtrCacheHeader));
+    cache_file.write(reinterpret_cast<char *>(row_ptr->data()), row_ptr->size() * sizeof(int));
+    cache_file.close();
+
+    if (cache_file.fail() || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        std::cout << "Could not write row pointer cache " << path << std::endl;
+    }
+}
+
+bool load_row_ptr(std::vector<int> *row_ptr, std::string source_path, std::string path) {
+    std::ifstream cache_file(path, std::ios::binary);
+    if (!cache_file.is_open()) {
+        return false;
+    }
+
+    RowPtrCacheHeader header;
+    cache_file.read(reinterpret_cast<char *>(&header), sizeof(RowPtrCacheHeader));
+    if (!cache_file) {
+        return false;
+    }
+    long source_size;
+    long source_mtime;
+    if (!get_file_stat(source_path, &source_size, &source_mtime)) {
+        return false;
+    }
+    if (std::memcmp(header.magic, row_ptr_cache_magic, sizeof(row_ptr_cache_magic)) != 0 ||
+        header.source_size != source_size ||
+        header.source_mtime != source_mtime ||
+        header.num_rows < 0) {
+        return false;
+    }
+
+    row_ptr->resize(header.num_rows + 1);
+    cache_file.read(reinterpret_cast<char *>(row_ptr->data()), row_ptr->size() * sizeof(int));
+    return (bool) cache_file;
+}
+
+void load_sp_matrix_row_ptr_cached(std::string path, std::vector<int> *row_ptr) {
+    // a CSR file starts with its row pointers, only the mtx is parsed as a whole
+    std::string extension = ".csr";
+    if (path.size() > extension.size() &&
+        path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+        load_sp_matrix_row_ptr(path, row_ptr);
+        return;
+    }
+
+    std::string cache_path = get_row_ptr_cache_path(path);
+    if (load_row_ptr(row_ptr, path, cache_path)) {
+        return;
+    }
+    load_sp_matrix_row_ptr(path, row_ptr);
+    save_row_ptr(row_ptr, path, cache_path);
+}
+
+void get_cluster_batches(long num_chunks, long clusters_per_batch, long seed, long epoch, std::vector<std::vector<long>> *batches) {
+    if (clusters_per_batch < 1) {
+        throw "Need at least one cluster per batch";
+    }
+    std::vector<long> chunks(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        chunks.at(i) = i;
+    }
+    std::seed_seq seq{seed, epoch};
+    std::mt19937_64 generator(seq);
+    std::shuffle(chunks.begin(), chunks.end(), generator);
+
+    batches->clear();
+    for (long i = 0; i < num_chunks; i = i + clusters_per_batch) {
+        std::vector<long> batch(chunks.begin() + i, chunks.begin() + std::min(i + clusters_per_batch, num_chunks));
+        // sorted chunks keep the columns of the subgraph sorted
+        std::sort(batch.begin(), batch.end());
+        batches->push_back(batch);
+    }
+}
+
+void get_cluster_nodes(std::vector<long> *boundaries, std::vector<long> *clusters, std::vector<int> *nodes) {
+    nodes->clear();
+    for (long cluster : *clusters) {
+        for (long node = boundaries->at(cluster); node < boundaries->at(cluster + 1); ++node) {
+            nodes->push_back(node);
+        }
+    }
+}
+
+void get_cluster_subgraph(std::vector<SparseMatrix<float>> *tiles, std::vector<long> *boundaries, std::vector<long> *clusters,
+                          SparseMatrix<float> *subgraph) {
+    long num_chunks = boundaries->size() - 1;
+    if ((long) tiles->size() != num_chunks * num_chunks) {
+        throw "Vector has wrong number of chunks.";
+    }
+    long num_clusters = clusters->size();
+
+    // first row of every cluster in the subgraph
+    std::vector<long> offsets(num_clusters + 1, 0);
+    long nnz = 0;
+    for (long a = 0; a < num_clusters; ++a) {
+        long cluster = clusters->at(a);
+        offsets.at(a + 1) = offsets.at(a) + boundaries->at(cluster + 1) - boundaries->at(cluster);
+        for (long b = 0; b < num_clusters; ++b) {
+            nnz = nnz + tiles->at(cluster * num_chunks + clusters->at(b)).nnz_;
+        }
+    }
+
+    subgraph->set(offsets.back(), offsets.back(), nnz);
+    subgraph->csr_row_ptr_[0] = 0;
+    long dest = 0;
+    for (long a = 0; a < num_clusters; ++a) {
+        long num_rows = offsets.at(a + 1) - offsets.at(a);
+        for (long row = 0; row < num_rows; ++row) {
+            for (long b = 0; b < num_clusters; ++b) {
+                SparseMatrix<float> *tile = &tiles->at(clusters->at(a) * num_chunks + clusters->at(b));
+                if (tile->nnz_ == 0) {
+                    continue;
+                }
+                for (long k = tile->csr_row_ptr_[row]; k < tile->csr_row_ptr_[row + 1]; ++k) {
+                    subgraph->csr_col_ind_[dest] = tile->csr_col_ind_[k] + offsets.at(b);
+                    subgraph->csr_val_[dest] = tile->csr_val_[k];
+                    dest = dest + 1;
+                }
+            }
+            subgraph->csr_row_ptr_[offsets.at(a) + row + 1] = dest;
+        }
+    }
+}
+
+void stitch(std::vector<Matrix<float>> *x_chunked, std::vector<long> *clusters, Matrix<float> *x) {
+    long num_rows = 0;
+    for (long cluster : *clusters) {
+        num_rows = num_rows + x_chunked->at(cluster).num_rows_;
+    }
+    x->set(num_rows, x_chunked->at(clusters->front()).num_columns_, true);
+    long offset = 0;
+    for (long cluster : *clusters) {
+        Matrix<float> *chunk = &x_chunked->at(cluster);
+        to_row_major_inplace(chunk);
+        std::copy(chunk->values_, chunk->values_ + chunk->size_, x->values_ + offset);
+        offset = offset + chunk->size_;
+    }
+}
+
+void get_chunks_subgraph(SparseMatrix<float> *adjacency, std::vector<long> *boundaries, std::vector<long> *chunks,
+                         SparseMatrix<float> *subgraph) {
+    if (boundaries->back() != adjacency->num_rows_) {
+        throw "Boundaries do not match the adjacency";
+    }
+
+    // row of every node in the subgraph, -1 outside of it
+    std::vector<long> rows(adjacency->num_rows_, -1);
+    long num_rows = 0;
+    long nnz = 0;
+    for (long chunk : *chunks) {
+        for (long node = boundaries->at(chunk); node < boundaries->at(chunk + 1); ++node) {
+            rows.at(node) = num_rows;
+            num_rows = num_rows + 1;
+        }
+    }
+    for (long chunk : *chunks) {
+        for (long node = boundaries->at(chunk); node < boundaries->at(chunk + 1); ++node) {
+            for (long k = adjacency->csr_row_ptr_[node]; k < adjacency->csr_row_ptr_[node + 1]; ++k) {
+                if (rows.at(adjacency->csr_col_ind_[k]) >= 0) {
+                    nnz = nnz + 1;
+                }
             }
+        }
+    }
+
+    subgraph->set(num_rows, num_rows, nnz);
+    subgraph->csr_row_ptr_[0] = 0;
+    long dest = 0;
+    for (long chunk : *chunks) {
+        for (long node = boundaries->at(chunk); node < boundaries->at(chunk + 1); ++node) {
+            for (long k = adjacency->csr_row_ptr_[node]; k < adjacency->csr_row_ptr_[node + 1]; ++k) {
+                long column = rows.at(adjacency->csr_col_ind_[k]);
+                if (column >= 0) {
+                    subgraph->csr_col_ind_[dest] = column;
+                    subgraph->csr_val_[dest] = adjacency->csr_val_[k];
+                    dest = dest + 1;
+                }
+            }
+            subgraph->csr_row_ptr_[rows.at(node) + 1] = dest;
+        }
+    }
+}
+
+// chunk of every node
+void get_node_chunks(std::vector<long> *boundaries, std::vector<long> *chunks) {
+    chunks->resize(boundaries->back());
+    for (long i = 0; i + 1 < (long) boundaries->size(); ++i) {
+        std::fill(chunks->begin() + boundaries->at(i), chunks->begin() + boundaries->at(i + 1), i);
+    }
+}
+
+void get_diagonal_subgraph(SparseMatrix<float> *adjacency, std::vector<long> *boundaries, SparseMatrix<float> *subgraph) {
+    if (boundaries->back() != adjacency->num_rows_) {
+        throw "Boundaries do not match the adjacency";
+    }
+    std::vector<long> chunks;
+    get_node_chunks(boundaries, &chunks);
 
-            get_rows(&chunks->at(i * num_chunks + j), &sp_mat_chunk, j * chunk_size, current_end_row);
-            // transpose
-            transpose_csr_matrix_cpu(&chunks->at(i * num_chunks + j));
+    long nnz = 0;
+    for (long node = 0; node < adjacency->num_rows_; ++node) {
+        for (long k = adjacency->csr_row_ptr_[node]; k < adjacency->csr_row_ptr_[node + 1]; ++k) {
+            if (chunks.at(adjacency->csr_col_ind_[k]) == chunks.at(node)) {
+                nnz = nnz + 1;
+            }
+        }
+    }
+
+    subgraph->set(adjacency->num_rows_, adjacency->num_columns_, nnz);
+    subgraph->csr_row_ptr_[0] = 0;
+    long dest = 0;
+    for (long node = 0; node < adjacency->num_rows_; ++node) {
+        for (long k = adjacency->csr_row_ptr_[node]; k < adjacency->csr_row_ptr_[node + 1]; ++k) {
+            if (chunks.at(adjacency->csr_col_ind_[k]) == chunks.at(node)) {
+                subgraph->csr_col_ind_[dest] = adjacency->csr_col_ind_[k];
+                subgraph->csr_val_[dest] = adjacency->csr_val_[k];
+                dest = dest + 1;
+            }
+        }
+        subgraph->csr_row_ptr_[node + 1] = dest;
+    }
+}
+
+long get_num_off_diagonal_tiles(SparseMatrix<float> *adjacency, std::vector<long> *boundaries) {
+    if (boundaries->back() != adjacency->num_rows_) {
+        throw "Boundaries do not match the adjacency";
+    }
+    std::vector<long> chunks;
+    get_node_chunks(boundaries, &chunks);
+
+    // the last row chunk that counted a column chunk
+    long num_chunks = boundaries->size() - 1;
+    std::vector<long> counted(num_chunks, -1);
+    long num_tiles = 0;
+    for (long i = 0; i < num_chunks; ++i) {
+        for (long node = boundaries->at(i); node < boundaries->at(i + 1); ++node) {
+            for (long k = adjacency->csr_row_ptr_[node]; k < adjacency->csr_row_ptr_[node + 1]; ++k) {
+                long j = chunks.at(adjacency->csr_col_ind_[k]);
+                if (j != i && counted.at(j) != i) {
+                    counted.at(j) = i;
+                    num_tiles = num_tiles + 1;
+                }
+            }
         }
     }
+    return num_tiles;
 }
@@ -0,0 +1,402 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "data_parallel.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+static_assert(ATOMIC_LONG_LOCK_FREE == 2 && ATOMIC_BOOL_LOCK_FREE == 2, "Atomics in shared memory need to be lock-free");
+
+
+SharedSegment::SharedSegment(long size) {
+    size_ = size;
+    void *data = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        throw "Could not map shared segment";
+    }
+    data_ = static_cast<char *>(data);
+}
+
+SharedSegment::SharedSegment(std::string name, long size) {
+    name_ = name;
+    size_ = size;
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        throw "Could not create shared segment";
+    }
+    if (ftruncate(fd, size_) != 0) {
+        close(fd);
+        shm_unlink(name_.c_str());
+        throw "Could not size shared segment";
+    }
+    void *data = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        throw "Could not map shared segment";
+    }
+    data_ = static_cast<char *>(data);
+    is_creator_ = true;
+}
+
+SharedSegment::SharedSegment(std::string name) {
+    name_ = name;
+    int fd = shm_open(name_.c_str(), O_RDWR, 0600);
+    if (fd == -1) {
+        throw "Could not open shared segment";
+    }
+    struct stat segment_stat;
+    if (fstat(fd, &segment_stat) != 0) {
+        close(fd);
+        throw "Could not open shared segment";
+    }
+    size_ = segment_stat.st_size;
+    void *data = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw "Could not map shared segment";
+    }
+    data_ = static_cast<char *>(data);
+}
+
+SharedSegment::~SharedSegment() {
+    munmap(data_, size_);
+    // the processes that attached keep their mapping
+    if (is_creator_) {
+        shm_unlink(name_.c_str());
+    }
+}
+
+char *SharedSegment::get_data() {
+    return data_;
+}
+
+long SharedSegment::get_size() {
+    return size_;
+}
+
+SharedBarrier::SharedBarrier(SharedBarrierState *state, long num_processes) {
+    state_ = state;
+    num_processes_ = num_processes;
+}
+
+void SharedBarrier::init(SharedBarrierState *state) {
+    new (&state->counter) std::atomic<long>(0);
+    new (&state->is_aborted) std::atomic<bool>(false);
+}
+
+void SharedBarrier::wait() {
+    num_waits_ = num_waits_ + 1;
+    state_->counter.fetch_add(1);
+    while (state_->counter.load() < num_waits_ * num_processes_) {
+        if (state_->is_aborted.load()) {
+            throw "Another process aborted";
+        }
+        std::this_thread::yield();
+    }
+}
+
+void SharedBarrier::abort() {
+    state_->is_aborted.store(true);
+}
+
+long SharedAllreduce::get_slots_size(long num_processes, long count) {
+    return (num_processes + 1) * count;
+}
+
+SharedAllreduce::SharedAllreduce(SharedBarrier *barrier, float *slots, long rank, long num_processes, long count) {
+    barrier_ = barrier;
+    slots_ = slots;
+    rank_ = rank;
+    num_processes_ = num_processes;
+    count_ = count;
+}
+
+long SharedAllreduce::copy_to_slot(std::vector<Matrix<float> *> *matrices, float *slot) {
+    long offset = 0;
+    for (Matrix<float> *matrix : *matrices) {
+        if (offset + matrix->size_ > count_) {
+            throw "Matrices do not fit the slot";
+        }
+        std::copy(matrix->values_, matrix->values_ + matrix->size_, slot + offset);
+        offset = offset + matrix->size_;
+    }
+    return offset;
+}
+
+void SharedAllreduce::copy_from_slot(float *slot, std::vector<Matrix<float> *> *matrices) {
+    long offset = 0;
+    for (Matrix<float> *matrix : *matrices) {
+        std::copy(slot + offset, slot + offset + matrix->size_, matrix->values_);
+        offset = offset + matrix->size_;
+    }
+}
+
+void SharedAllreduce::allreduce(std::vector<Matrix<float> *> *matrices) {
+    long count = copy_to_slot(matrices, slots_ + rank_ * count_);
+    barrier_->wait();
+
+    // reduce-scatter, the share of this process over every slot
+    float *reduced = slots_ + num_processes_ * count_;
+    long first = rank_ * count / num_processes_;
+    long last = (rank_ + 1) * count / num_processes_;
+    for (long k = first; k < last; ++k) {
+        float sum = 0.0;
+        for (long p = 0; p < num_processes_; ++p) {
+            sum = sum + slots_[p * count_ + k];
+        }
+        reduced[k] = sum / num_processes_;
+    }
+    barrier_->wait();
+
+    // allgather, nobody writes the reduced values before the next allreduce passed its first barrier
+    copy_from_slot(reduced, matrices);
+}
+
+void SharedAllreduce::broadcast(std::vector<Matrix<float> *> *matrices, long root) {
+    float *values = slots_ + num_processes_ * count_;
+    // the reduced values of an allreduce before may still be read
+    barrier_->wait();
+    if (rank_ == root) {
+        copy_to_slot(matrices, values);
+    }
+    barrier_->wait();
+    if (rank_ != root) {
+        copy_from_slot(values, matrices);
+    }
+    barrier_->wait();
+}
+
+long get_shared_graph_size(SharedGraphHeader *header) {
+    return sizeof(SharedGraphHeader) +
+           header->num_processes * sizeof(long) +
+           header->num_nodes * header->num_features * sizeof(float) +
+           (header->num_nodes + 1) * sizeof(int) +
+           header->nnz * (sizeof(int) + sizeof(float)) +
+           header->num_nodes * sizeof(int) +
+           header->slots_size * sizeof(float);
+}
+
+void map_shared_graph(char *data, SharedGraph *graph) {
+    graph->header = reinterpret_cast<SharedGraphHeader *>(data);
+    SharedGraphHeader *header = graph->header;
+    char *next = data + sizeof(SharedGraphHeader);
+    graph->num_halo_nodes = reinterpret_cast<long *>(next);
+    next = next + header->num_processes * sizeof(long);
+    graph->features = reinterpret_cast<float *>(next);
+    next = next + header->num_nodes * header->num_features * sizeof(float);
+    graph->row_ptr = reinterpret_cast<int *>(next);
+    next = next + (header->num_nodes + 1) * sizeof(int);
+    graph->col_ind = reinterpret_cast<int *>(next);
+    next = next + header->nnz * sizeof(int);
+    graph->values = reinterpret_cast<float *>(next);
+    next = next + header->nnz * sizeof(float);
+    graph->classes = reinterpret_cast<int *>(next);
+    next = next + header->num_nodes * sizeof(int);
+    graph->slots = reinterpret_cast<float *>(next);
+}
+
+void get_partition_graph(int *row_ptr, int *col_ind, float *values, long num_nodes, long first_row, long last_row,
+                         long num_hops, std::vector<long> *nodes, SparseMatrix<float> *adjacency) {
+    if (first_row < 0 || last_row > num_nodes || first_row >= last_row) {
+        throw "Partition is out of the graph";
+    }
+    if (num_hops < 1) {
+        throw "Partition needs at least one hop of halo";
+    }
+    long num_rows = last_row - first_row;
+
+    // hops of every node from the rows, -1 if it is further away
+    std::vector<long> hops(num_nodes, -1);
+    std::vector<long> frontier;
+    for (long row = first_row; row < last_row; ++row) {
+        hops.at(row) = 0;
+        frontier.push_back(row);
+    }
+    std::vector<long> halo;
+    std::vector<long> next_frontier;
+    for (long hop = 1; hop <= num_hops; ++hop) {
+        next_frontier.clear();
+        for (long node : frontier) {
+            for (long k = row_ptr[node]; k < row_ptr[node + 1]; ++k) {
+                if (hops.at(col_ind[k]) == -1) {
+                    hops.at(col_ind[k]) = hop;
+                    next_frontier.push_back(col_ind[k]);
+                }
+            }
+        }
+        halo.insert(halo.end(), next_frontier.begin(), next_frontier.end());
+        frontier.swap(next_frontier);
+    }
+    // halo in the order of the global ids
+    std::sort(halo.begin(), halo.end());
+
+    nodes->resize(num_rows + halo.size());
+    for (long i = 0; i < num_rows; ++i) {
+        nodes->at(i) = first_row + i;
+    }
+    std::copy(halo.begin(), halo.end(), nodes->begin() + num_rows);
+
+    // the nodes of the last hop keep their neighbours among the local nodes, or get a self loop without any, the others
+    // keep all their neighbours
+    long num_local_nodes = nodes->size();
+    long nnz = 0;
+    for (long i = 0; i < num_local_nodes; ++i) {
+        long node = nodes->at(i);
+        long num_entries = 0;
+        for (long k = row_ptr[node]; k < row_ptr[node + 1]; ++k) {
+            num_entries = num_entries + (hops.at(col_ind[k]) != -1);
+        }
+        nnz = nnz + std::max(num_entries, 1l);
+    }
+    adjacency->set(num_local_nodes, num_local_nodes, nnz);
+    std::vector<std::pair<int, float>> row_entries;
+    long index = 0;
+    for (long i = 0; i < num_local_nodes; ++i) {
+        adjacency->csr_row_ptr_[i] = index;
+        long node = nodes->at(i);
+        row_entries.clear();
+        for (long k = row_ptr[node]; k < row_ptr[node + 1]; ++k) {
+            long column = col_ind[k];
+            if (hops.at(column) == -1) {
+                continue;
+            } else if (column >= first_row && column < last_row) {
+                column = column - first_row;
+            } else {
+                column = num_rows + (std::lower_bound(halo.begin(), halo.end(), column) - halo.begin());
+            }
+            row_entries.push_back(std::make_pair((int) column, values[k]));
+        }
+        if (row_entries.empty()) {
+            row_entries.push_back(std::make_pair((int) i, 1.0f));
+        }
+        // the halo ids do not keep the order of the global ones
+        std::sort(row_entries.begin(), row_entries.end());
+        for (std::pair<int, float> &entry : row_entries) {
+            adjacency->csr_col_ind_[index] = entry.first;
+            adjacency->csr_val_[index] = entry.second;
+            index = index + 1;
+        }
+    }
+    adjacency->csr_row_ptr_[num_local_nodes] = index;
+}
+
+SharedHaloExchange::SharedHaloExchange(SharedBarrier *barrier, long *num_halo_nodes, std::string segment_name, long rank,
+                                       long num_processes, std::vector<long> *nodes, long num_rows, long max_features,
+                                       std::vector<long> *boundaries) {
+    barrier_ = barrier;
+    rank_ = rank;
+    num_rows_ = num_rows;
+    max_features_ = max_features;
+    num_halo_nodes_ = nodes->size() - num_rows;
+    boundaries_ = *boundaries;
+    if (boundaries_.back() != (long) nodes->size()) {
+        throw "Boundaries do not match the local nodes";
+    }
+
+    // the ids of every halo, then a row per halo node
+    num_halo_nodes[rank_] = num_halo_nodes_;
+    barrier_->wait();
+    std::vector<long> offsets(num_processes + 1, 0);
+    for (long p = 0; p < num_processes; ++p) {
+        offsets.at(p + 1) = offsets.at(p) + num_halo_nodes[p];
+    }
+    long num_buffer_rows = offsets.back();
+    long size = num_buffer_rows * (sizeof(long) + max_features_ * sizeof(float));
+    if (rank_ == 0) {
+        segment_ = new SharedSegment(segment_name, std::max(size, 1l));
+    }
+    barrier_->wait();
+    if (rank_ != 0) {
+        segment_ = new SharedSegment(segment_name);
+    }
+    long *ids = reinterpret_cast<long *>(segment_->get_data());
+    buffers_ = reinterpret_cast<float *>(ids + num_buffer_rows);
+    offset_ = offsets.at(rank_);
+    std::copy(nodes->begin() + num_rows_, nodes->end(), ids + offset_);
+    barrier_->wait();
+
+    long first_row = nodes->at(0);
+    for (long p = 0; p < num_processes; ++p) {
+        if (p == rank_) {
+            continue;
+        }
+        for (long k = offsets.at(p); k < offsets.at(p + 1); ++k) {
+            if (ids[k] >= first_row && ids[k] < first_row + num_rows_) {
+                send_rows_.push_back(ids[k] - first_row);
+                send_offsets_.push_back(k);
+            }
+        }
+    }
+}
+
+SharedHaloExchange::~SharedHaloExchange() {
+    delete segment_;
+}
+
+float *SharedHaloExchange::get_value(std::vector<Matrix<float>> *x, long row, long column) {
+    long chunk = std::upper_bound(boundaries_.begin(), boundaries_.end(), row) - boundaries_.begin() - 1;
+    Matrix<float> *mat = &x->at(chunk);
+    row = row - boundaries_.at(chunk);
+    if (mat->is_row_major_) {
+        return &mat->values_[row * mat->num_columns_ + column];
+    } else {
+        return &mat->values_[column * mat->num_rows_ + row];
+    }
+}
+
+// the first barrier keeps the buffers until every process read the last exchange
+void SharedHaloExchange::exchange(std::vector<Matrix<float>> *x) {
+    long num_features = x->at(0).num_columns_;
+    if (num_features > max_features_) {
+        throw "Halo exchange has too many features";
+    }
+    barrier_->wait();
+    for (long i = 0; i < (long) send_rows_.size(); ++i) {
+        float *buffer = buffers_ + send_offsets_.at(i) * max_features_;
+        for (long column = 0; column < num_features; ++column) {
+            buffer[column] = *get_value(x, send_rows_.at(i), column);
+        }
+    }
+    barrier_->wait();
+    for (long k = 0; k < num_halo_nodes_; ++k) {
+        float *buffer = buffers_ + (offset_ + k) * max_features_;
+        for (long column = 0; column < num_features; ++column) {
+            *get_value(x, num_rows_ + k, column) = buffer[column];
+        }
+    }
+}
+
+void SharedHaloExchange::reduce(std::vector<Matrix<float>> *gradients) {
+    long num_features = gradients->at(0).num_columns_;
+    if (num_features > max_features_) {
+        throw "Halo exchange has too many features";
+    }
+    barrier_->wait();
+    for (long k = 0; k < num_halo_nodes_; ++k) {
+        float *buffer = buffers_ + (offset_ + k) * max_features_;
+        for (long column = 0; column < num_features; ++column) {
+            float *value = get_value(gradients, num_rows_ + k, column);
+            buffer[column] = *value;
+            *value = 0.0;
+        }
+    }
+    barrier_->wait();
+    for (long i = 0; i < (long) send_rows_.size(); ++i) {
+        float *buffer = buffers_ + send_offsets_.at(i) * max_features_;
+        for (long column = 0; column < num_features; ++column) {
+            float *value = get_value(gradients, send_rows_.at(i), column);
+            *value = *value + buffer[column];
+        }
+    }
+}
+
+long SharedHaloExchange::get_num_halo_nodes() {
+    return num_halo_nodes_;
+}
@@ -0,0 +1,182 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "dataflow.hpp"
+
+#include <thread>
+
+
+Dataflow::Dataflow(long num_chunks, TileIndex *tile_index) {
+    if (num_chunks < 1) {
+        throw "Dataflow needs at least one chunk";
+    }
+    num_chunks_ = num_chunks;
+    tile_index_ = tile_index;
+
+    if (tile_index_ != NULL) {
+        if (tile_index_->num_chunks != num_chunks_) {
+            throw "Tile index has a different number of chunks";
+        }
+        readers_ = std::vector<std::vector<long>>(num_chunks_);
+        for (long i = 0; i < num_chunks_; ++i) {
+            for (long j : tile_index_->non_empty.at(i)) {
+                readers_.at(j).push_back(i);
+            }
+        }
+    }
+}
+
+long Dataflow::add_node(std::string name, std::function<void(long chunk)> run, std::function<void()> end,
+                        std::vector<long> inputs, std::vector<DataflowEdge> edges) {
+    long id = nodes_.size();
+    if (inputs.size() != edges.size()) {
+        throw "Every input needs an edge";
+    }
+    for (long i = 0; i < (long) inputs.size(); ++i) {
+        if (inputs.at(i) < 0 || inputs.at(i) >= id) {
+            throw "Input is not an earlier node";
+        }
+        if (edges.at(i) == tile_edge && tile_index_ == NULL) {
+            throw "Tile edge without tile index";
+        }
+    }
+
+    DataflowNode node;
+    node.name = name;
+    node.run = run;
+    node.end = end;
+    node.inputs = inputs;
+    node.edges = edges;
+    nodes_.push_back(node);
+
+    consumers_.push_back(std::vector<long>());
+    for (long input : inputs) {
+        if (consumers_.at(input).empty() || consumers_.at(input).back() != id) {
+            consumers_.at(input).push_back(id);
+        }
+    }
+
+    return id;
+}
+
+long Dataflow::get_num_nodes() {
+    return nodes_.size();
+}
+
+// the previous chunk of the node itself counts as well
+long Dataflow::get_num_dependencies(long node, long chunk) {
+    long num_dependencies = 0;
+    if (chunk > 0) {
+        num_dependencies = 1;
+    }
+    for (DataflowEdge edge : nodes_.at(node).edges) {
+        if (edge == chunk_edge) {
+            num_dependencies = num_dependencies + 1;
+        } else if (edge == tile_edge) {
+            num_dependencies = num_dependencies + tile_index_->non_empty.at(chunk).size();
+        } else {
+            num_dependencies = num_dependencies + num_chunks_;
+        }
+    }
+    return num_dependencies;
+}
+
+// holding the lock
+void Dataflow::done(long node, long chunk) {
+    std::vector<long> tasks;
+    if (chunk + 1 < num_chunks_) {
+        tasks.push_back(node * num_chunks_ + chunk + 1);
+    }
+    for (long consumer : consumers_.at(node)) {
+        for (long k = 0; k < (long) nodes_.at(consumer).inputs.size(); ++k) {
+            if (nodes_.at(consumer).inputs.at(k) != node) {
+                continue;
+            }
+            DataflowEdge edge = nodes_.at(consumer).edges.at(k);
+            if (edge == chunk_edge) {
+                tasks.push_back(consumer * num_chunks_ + chunk);
+            } else if (edge == tile_edge) {
+                for (long i : readers_.at(chunk)) {
+                    tasks.push_back(consumer * num_chunks_ + i);
+                }
+            } else {
+                for (long i = 0; i < num_chunks_; ++i) {
+                    tasks.push_back(consumer * num_chunks_ + i);
+                }
+            }
+        }
+    }
+
+    for (long task : tasks) {
+        num_missing_.at(task) = num_missing_.at(task) - 1;
+        if (num_missing_.at(task) == 0) {
+            ready_.push(std::make_pair(-(task % num_chunks_), task / num_chunks_));
+        }
+    }
+    num_left_ = num_left_ - 1;
+}
+
+void Dataflow::run_worker() {
+    try {
+        while (true) {
+            long node;
+            long chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [this] { return !ready_.empty() || num_left_ == 0 || error_; });
+                if (num_left_ == 0 || error_) {
+                    return;
+                }
+                chunk = -ready_.top().first;
+                node = ready_.top().second;
+                ready_.pop();
+            }
+
+            nodes_.at(node).run(chunk);
+            if (chunk == num_chunks_ - 1 && nodes_.at(node).end) {
+                nodes_.at(node).end();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            done(node, chunk);
+            changed_.notify_all();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+        changed_.notify_all();
+    }
+}
+
+void Dataflow::run(long num_threads) {
+    long num_nodes = nodes_.size();
+    if (num_threads < 1) {
+        throw "Dataflow needs at least one thread";
+    }
+
+    error_ = nullptr;
+    ready_ = std::priority_queue<std::pair<long, long>>();
+    num_left_ = num_nodes * num_chunks_;
+    num_missing_ = std::vector<long>(num_nodes * num_chunks_);
+    for (long n = 0; n < num_nodes; ++n) {
+        for (long c = 0; c < num_chunks_; ++c) {
+            num_missing_.at(n * num_chunks_ + c) = get_num_dependencies(n, c);
+            if (num_missing_.at(n * num_chunks_ + c) == 0) {
+                ready_.push(std::make_pair(-c, n));
+            }
+        }
+    }
+
+    std::vector<std::thread> workers(num_threads);
+    for (long t = 0; t < num_threads; ++t) {
+        workers.at(t) = std::thread(&Dataflow::run_worker, this);
+    }
+    for (long t = 0; t < num_threads; ++t) {
+        workers.at(t).join();
+    }
+
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
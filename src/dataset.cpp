@@ -2,6 +2,9 @@
 
 #include "dataset.hpp"
 
+#include <fstream>
+
+
 std::string get_dataset_name(Dataset dataset) {
     if (dataset == flickr) {
         return "flickr";
@@ -29,3 +32,13 @@ long get_dataset_num_classes(Dataset dataset) {
         throw "Unkown dataset";
     }
 }
+
+// binary CSR written by the ingest tool is preferred over MatrixMarket
+std::string get_adjacency_path(std::string dataset_path) {
+    std::string path = dataset_path + "/adjacency.csr";
+    std::ifstream csr_file(path);
+    if (csr_file.good()) {
+        return path;
+    }
+    return dataset_path + "/adjacency.mtx";
+}
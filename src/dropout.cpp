@@ -1,6 +1,7 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "dropout.hpp"
+#include "chunking.hpp"
 #include "cuda_helper.hpp"
 #include "tensors.hpp"
 
@@ -34,7 +35,11 @@ void Dropout::set(CudaHelper *helper, long num_nodes, long num_features) {
 }
 
 Matrix<float> *Dropout::forward(Matrix<float> *x) {
-    to_row_major_inplace(x);
+    if (!keep_layout_) {
+        to_row_major_inplace(x);
+    }
+    x_ = x;
+    y_.allocate();
 
     void *d_states;
     check_cuda(cudaMalloc(&d_states, state_size_));
@@ -75,7 +80,8 @@ Matrix<float> *Dropout::forward(Matrix<float> *x) {
     check_cuda(cudaMemcpy(y_.values_, d_y, y_.size_ * sizeof(float),
                           cudaMemcpyDeviceToHost));
 
-    y_.is_row_major_ = true;
+    y_.is_row_major_ = x->is_row_major_;
+    is_row_major_mask_ = x->is_row_major_;
 
     if (reserve_space_ == NULL) {
         check_cuda(cudaMallocHost(&reserve_space_, reserve_space_size_));
@@ -97,7 +103,7 @@ Matrix<float> *Dropout::backward(Matrix<float> *incoming_gradients) {
     if (y_.num_rows_ != incoming_gradients->num_rows_ || y_.num_columns_ != incoming_gradients->num_columns_) {
         throw "Matrix shapes are unequal";
     }
-    to_row_major_inplace(incoming_gradients);
+    to_layout_inplace(incoming_gradients, is_row_major_mask_);
 
     void *d_states;
     check_cuda(cudaMalloc(&d_states, state_size_));
@@ -116,7 +122,7 @@ Matrix<float> *Dropout::backward(Matrix<float> *incoming_gradients) {
     float *d_dy;
     check_cuda(cudaMalloc(&d_dy, incoming_gradients->size_ * sizeof(float)));
     check_cuda(cudaMemcpy(d_dy, incoming_gradients->values_,
-                          incoming_gradients->size_,
+                          incoming_gradients->size_ * sizeof(float),
                           cudaMemcpyHostToDevice));
     cudnnTensorDescriptor_t dx_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&dx_desc));
@@ -142,6 +148,7 @@ Matrix<float> *Dropout::backward(Matrix<float> *incoming_gradients) {
     check_cuda(cudaMemcpy(gradients_.values_, d_dx,
                           gradients_.size_ * sizeof(float),
                           cudaMemcpyDeviceToHost));
+    gradients_.is_row_major_ = is_row_major_mask_;
 
     // free
     check_cuda(cudaFree(d_states));
@@ -152,6 +159,71 @@ Matrix<float> *Dropout::backward(Matrix<float> *incoming_gradients) {
     return &gradients_;
 }
 
+void Dropout::set_keep_layout(bool keep_layout) {
+    keep_layout_ = keep_layout;
+}
+
+void Dropout::release_y() {
+    y_.release();
+}
+
+void Dropout::recompute_y() {
+    if (y_.values_ != NULL) {
+        return;
+    }
+    if (x_ == NULL || reserve_space_ == NULL) {
+        throw "Forward pass is missing";
+    }
+    to_layout_inplace(x_, is_row_major_mask_);
+    y_.allocate();
+
+    void *d_states;
+    check_cuda(cudaMalloc(&d_states, state_size_));
+
+    cudnnDropoutDescriptor_t dropout_desc;
+    check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc));
+    check_cudnn(cudnnSetDropoutDescriptor(dropout_desc,
+                                          cuda_helper_->cudnn_handle, probability_,
+                                          d_states, state_size_, seed_));
+
+    cudnnTensorDescriptor_t x_desc;
+    check_cudnn(cudnnCreateTensorDescriptor(&x_desc));
+    check_cudnn(cudnnSetTensor4dDescriptor(x_desc,
+                                           CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           x_->num_rows_, 1, 1, x_->num_columns_));
+    float *d_x;
+    check_cuda(cudaMalloc(&d_x, x_->size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_x, x_->values_, x_->size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    float *d_y;
+    check_cuda(cudaMalloc(&d_y, y_.size_ * sizeof(float)));
+
+    void *d_reserve_space;
+    check_cuda(cudaMalloc(&d_reserve_space, reserve_space_size_));
+    check_cuda(cudaMemcpy(d_reserve_space, reserve_space_,
+                          reserve_space_size_,
+                          cudaMemcpyHostToDevice));
+
+    // the backward pass scales by the mask of the forward pass, applied to the input it gives the output again
+    check_cudnn(cudnnDropoutBackward(cuda_helper_->cudnn_handle,
+                                     dropout_desc,
+                                     x_desc, d_x,
+                                     x_desc, d_y,
+                                     d_reserve_space, reserve_space_size_));
+
+    check_cuda(cudaMemcpy(y_.values_, d_y, y_.size_ * sizeof(float),
+                          cudaMemcpyDeviceToHost));
+    y_.is_row_major_ = x_->is_row_major_;
+
+    // free
+    check_cuda(cudaFree(d_states));
+    check_cudnn(cudnnDestroyDropoutDescriptor(dropout_desc));
+    check_cudnn(cudnnDestroyTensorDescriptor(x_desc));
+    check_cuda(cudaFree(d_x));
+    check_cuda(cudaFree(d_y));
+    check_cuda(cudaFree(d_reserve_space));
+}
+
 // CHUNKED --- CHUNKED -- CHUNKED
 
 DropoutChunked::DropoutChunked() {}
@@ -160,6 +232,10 @@ DropoutChunked::DropoutChunked(CudaHelper *helper, int chunk_size, int num_nodes
     set(helper, chunk_size, num_nodes, num_features);
 }
 
+DropoutChunked::DropoutChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    set(helper, boundaries, num_features);
+}
+
 DropoutChunked::~DropoutChunked() {
     for (long i = 0; i < num_chunks_; ++i) {
         check_cuda(cudaFreeHost(reserve_space_.at(i)));
@@ -167,102 +243,122 @@ DropoutChunked::~DropoutChunked() {
 }
 
 void DropoutChunked::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_features);
+}
+
+void DropoutChunked::set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
     name_ = "dropout_chunked";
     cuda_helper_ = helper;
-    chunk_size_ = chunk_size;
+    chunk_size_ = get_max_chunk_size(boundaries);
     probability_ = 0.2;
     seed_ = rand();
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size_);
-
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
-    }
+    num_chunks_ = boundaries->size() - 1;
 
     reserve_space_ = std::vector<char *>(num_chunks_);
     y_ = std::vector<Matrix<float>>(num_chunks_);
     gradients_ = std::vector<Matrix<float>>(num_chunks_);
-    long current_chunk_size = chunk_size_;
     for (int i = 0; i < num_chunks_; ++i) {
-        if (i == num_chunks_ - 1) {
-            current_chunk_size = last_chunk_size_;
-        }
+        long current_chunk_size = boundaries->at(i + 1) - boundaries->at(i);
         y_.at(i).set(current_chunk_size, num_features, true);
         gradients_.at(i).set(current_chunk_size, num_features, true);
     }
+    is_row_major_mask_ = std::vector<bool>(num_chunks_, true);
 
     check_cudnn(cudnnDropoutGetStatesSize(cuda_helper_->cudnn_handle, &state_size_));
 }
 
-std::vector<Matrix<float>> *DropoutChunked::forward(std::vector<Matrix<float>> *x) {
-    for (int i = 0; i < num_chunks_; ++i) {
-        to_row_major_inplace(&x->at(i));
+std::vector<Matrix<float>> *DropoutChunked::forward_begin(std::vector<Matrix<float>> *x) {
+    if ((long) x->size() != num_chunks_) {
+        throw "Input has wrong number of chunks";
     }
+    x_ = x;
 
-    void *d_states;
-    check_cuda(cudaMalloc(&d_states, state_size_));
+    return &y_;
+}
 
-    cudnnDropoutDescriptor_t dropout_desc;
-    check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc));
-    check_cudnn(cudnnSetDropoutDescriptor(dropout_desc,
-                                          cuda_helper_->cudnn_handle, probability_,
-                                          d_states, state_size_, seed_));
+void DropoutChunked::forward_chunk(long chunk) {
+    if (!keep_layout_) {
+        to_row_major_inplace(&x_->at(chunk));
+    }
+    y_.at(chunk).allocate();
+
+    // the random states are initialised once per pass
+    if (d_states_forward_ == NULL) {
+        check_cuda(cudaMalloc(&d_states_forward_, state_size_));
+        check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc_forward_));
+        check_cudnn(cudnnSetDropoutDescriptor(dropout_desc_forward_,
+                                              cuda_helper_->cudnn_handle, probability_,
+                                              d_states_forward_, state_size_, seed_));
+
+        check_cuda(cudaMalloc(&d_x_forward_, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+        check_cudnn(cudnnCreateTensorDescriptor(&x_desc_forward_));
+        check_cudnn(cudnnSetTensor4dDescriptor(x_desc_forward_,
+                                               CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                               chunk_size_, 1, 1, x_->at(0).num_columns_));
 
-    void *d_x;
-    check_cuda(cudaMalloc(&d_x, x->at(0).size_ * sizeof(float)));
-    cudnnTensorDescriptor_t x_desc;
-    check_cudnn(cudnnCreateTensorDescriptor(&x_desc));
-    check_cudnn(cudnnSetTensor4dDescriptor(x_desc,
-                                           CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                           x->at(0).num_rows_, 1, 1, x->at(0).num_columns_));
+        check_cuda(cudaMalloc(&d_y_forward_, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
+        check_cudnn(cudnnCreateTensorDescriptor(&y_desc_forward_));
 
-    void *d_y;
-    check_cuda(cudaMalloc(&d_y, y_.at(0).size_ * sizeof(float)));
-    cudnnTensorDescriptor_t y_desc;
-    check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
+        check_cudnn(cudnnDropoutGetReserveSpaceSize(x_desc_forward_, &reserve_space_size_));
+        check_cuda(cudaMalloc(&d_reserve_space_forward_, reserve_space_size_));
+    }
 
-    void *d_reserve_space;
-    check_cudnn(cudnnDropoutGetReserveSpaceSize(x_desc, &reserve_space_size_));
-    check_cuda(cudaMalloc(&d_reserve_space, reserve_space_size_));
+    check_cuda(cudaMemcpy(d_x_forward_, x_->at(chunk).values_, x_->at(chunk).size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    check_cudnn(cudnnSetTensor4dDescriptor(x_desc_forward_,
+                                           CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           x_->at(chunk).num_rows_, 1, 1, x_->at(chunk).num_columns_));
+    check_cudnn(cudnnSetTensor4dDescriptor(y_desc_forward_,
+                                           CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           y_.at(chunk).num_rows_, 1, 1, y_.at(chunk).num_columns_));
 
-    for (int i = 0; i < num_chunks_; ++i) {
-        check_cuda(cudaMemcpy(d_x, x->at(i).values_, x->at(i).size_ * sizeof(float),
-                              cudaMemcpyHostToDevice));
-        check_cudnn(cudnnSetTensor4dDescriptor(x_desc,
-                                               CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                               x->at(i).num_rows_, 1, 1, x->at(i).num_columns_));
-        check_cudnn(cudnnSetTensor4dDescriptor(y_desc,
-                                               CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                               y_.at(i).num_rows_, 1, 1, y_.at(i).num_columns_));
+    check_cudnn(cudnnDropoutForward(cuda_helper_->cudnn_handle,
+                                    dropout_desc_forward_, x_desc_forward_, d_x_forward_,
+                                    y_desc_forward_, d_y_forward_,
+                                    d_reserve_space_forward_, reserve_space_size_));
 
-        check_cudnn(cudnnDropoutForward(cuda_helper_->cudnn_handle,
-                                        dropout_desc, x_desc, d_x,
-                                        y_desc, d_y,
-                                        d_reserve_space, reserve_space_size_));
+    check_cuda(cudaMemcpy(y_.at(chunk).values_, d_y_forward_, y_.at(chunk).size_ * sizeof(float),
+                          cudaMemcpyDeviceToHost));
+    y_.at(chunk).is_row_major_ = x_->at(chunk).is_row_major_;
+    is_row_major_mask_.at(chunk) = x_->at(chunk).is_row_major_;
 
-        check_cuda(cudaMemcpy(y_.at(i).values_, d_y, y_.at(i).size_ * sizeof(float),
-                              cudaMemcpyDeviceToHost));
-        y_.at(i).is_row_major_ = true;
+    if (reserve_space_.at(chunk) == NULL) {
+        check_cuda(cudaMallocHost(&reserve_space_.at(chunk), reserve_space_size_));
+    }
+    check_cuda(cudaMemcpy(reserve_space_.at(chunk), d_reserve_space_forward_, reserve_space_size_, cudaMemcpyDeviceToHost));
+}
 
-        if (reserve_space_.at(i) == NULL) {
-            check_cuda(cudaMallocHost(&reserve_space_.at(i), reserve_space_size_));
-        }
-        check_cuda(cudaMemcpy(reserve_space_.at(i), d_reserve_space, reserve_space_size_, cudaMemcpyDeviceToHost));
+void DropoutChunked::forward_end() {
+    if (d_states_forward_ == NULL) {
+        return;
     }
 
     // free
-    check_cuda(cudaFree(d_states));
-    check_cuda(cudaFree(d_reserve_space));
-    check_cuda(cudaFree(d_x));
-    check_cuda(cudaFree(d_y));
+    check_cuda(cudaFree(d_states_forward_));
+    check_cudnn(cudnnDestroyDropoutDescriptor(dropout_desc_forward_));
+    check_cuda(cudaFree(d_reserve_space_forward_));
+    check_cuda(cudaFree(d_x_forward_));
+    check_cudnn(cudnnDestroyTensorDescriptor(x_desc_forward_));
+    check_cuda(cudaFree(d_y_forward_));
+    check_cudnn(cudnnDestroyTensorDescriptor(y_desc_forward_));
+    d_states_forward_ = NULL;
+}
+
+std::vector<Matrix<float>> *DropoutChunked::forward(std::vector<Matrix<float>> *x) {
+    forward_begin(x);
+    for (long i = 0; i < num_chunks_; ++i) {
+        forward_chunk(i);
+    }
+    forward_end();
 
     return &y_;
 }
 
 std::vector<Matrix<float>> *DropoutChunked::backward(std::vector<Matrix<float>> *incoming_gradients) {
     for (int i = 0; i < num_chunks_; ++i) {
-        to_row_major_inplace(&incoming_gradients->at(i));
+        to_layout_inplace(&incoming_gradients->at(i), is_row_major_mask_.at(i));
     }
 
     void *d_states;
@@ -274,12 +370,12 @@ std::vector<Matrix<float>> *DropoutChunked::backward(std::vector<Matrix<float>>
                                           d_states, state_size_, seed_));
 
     float *d_dy;
-    check_cuda(cudaMalloc(&d_dy, incoming_gradients->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dy, chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t dy_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&dy_desc));
 
     float *d_dx;
-    check_cuda(cudaMalloc(&d_dx, incoming_gradients->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dx, chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t dx_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&dx_desc));
 
@@ -287,7 +383,7 @@ std::vector<Matrix<float>> *DropoutChunked::backward(std::vector<Matrix<float>>
     check_cuda(cudaMalloc(&d_reserve_space, reserve_space_size_));
 
     for (int i = 0; i < num_chunks_; ++i) {
-        check_cuda(cudaMemcpy(d_dy, incoming_gradients->at(i).values_, incoming_gradients->at(i).size_, cudaMemcpyHostToDevice));
+        check_cuda(cudaMemcpy(d_dy, incoming_gradients->at(i).values_, incoming_gradients->at(i).size_ * sizeof(float), cudaMemcpyHostToDevice));
         check_cuda(cudaMemcpy(d_reserve_space, reserve_space_.at(i), reserve_space_size_, cudaMemcpyHostToDevice));
         check_cudnn(cudnnSetTensor4dDescriptor(dy_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
                                                incoming_gradients->at(i).num_rows_, 1, 1, incoming_gradients->at(i).num_columns_));
@@ -298,6 +394,7 @@ std::vector<Matrix<float>> *DropoutChunked::backward(std::vector<Matrix<float>>
                                          dy_desc, d_dy, dx_desc, d_dx, d_reserve_space, reserve_space_size_));
 
         check_cuda(cudaMemcpy(gradients_.at(i).values_, d_dx, gradients_.at(i).size_ * sizeof(float), cudaMemcpyDeviceToHost));
+        gradients_.at(i).is_row_major_ = is_row_major_mask_.at(i);
     }
 
     // free
@@ -309,6 +406,72 @@ std::vector<Matrix<float>> *DropoutChunked::backward(std::vector<Matrix<float>>
     return &gradients_;
 }
 
+void DropoutChunked::set_keep_layout(bool keep_layout) {
+    keep_layout_ = keep_layout;
+}
+
+std::vector<Matrix<float>> *DropoutChunked::get_input_gradients() {
+    return &gradients_;
+}
+
+void DropoutChunked::release_y() {
+    for (long i = 0; i < num_chunks_; ++i) {
+        y_.at(i).release();
+    }
+}
+
+void DropoutChunked::recompute_y() {
+    if (y_.at(0).values_ != NULL) {
+        return;
+    }
+    if (x_ == NULL || reserve_space_.at(0) == NULL) {
+        throw "Forward pass is missing";
+    }
+
+    void *d_states;
+    check_cuda(cudaMalloc(&d_states, state_size_));
+
+    cudnnDropoutDescriptor_t dropout_desc;
+    check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc));
+    check_cudnn(cudnnSetDropoutDescriptor(dropout_desc, cuda_helper_->cudnn_handle, probability_,
+                                          d_states, state_size_, seed_));
+
+    float *d_x;
+    check_cuda(cudaMalloc(&d_x, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+    float *d_y;
+    check_cuda(cudaMalloc(&d_y, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
+    cudnnTensorDescriptor_t x_desc;
+    check_cudnn(cudnnCreateTensorDescriptor(&x_desc));
+
+    void *d_reserve_space;
+    check_cuda(cudaMalloc(&d_reserve_space, reserve_space_size_));
+
+    // the backward pass scales by the mask of the forward pass, applied to the input it gives the output again
+    for (long i = 0; i < num_chunks_; ++i) {
+        to_layout_inplace(&x_->at(i), is_row_major_mask_.at(i));
+        y_.at(i).allocate();
+
+        check_cuda(cudaMemcpy(d_x, x_->at(i).values_, x_->at(i).size_ * sizeof(float), cudaMemcpyHostToDevice));
+        check_cuda(cudaMemcpy(d_reserve_space, reserve_space_.at(i), reserve_space_size_, cudaMemcpyHostToDevice));
+        check_cudnn(cudnnSetTensor4dDescriptor(x_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                               x_->at(i).num_rows_, 1, 1, x_->at(i).num_columns_));
+
+        check_cudnn(cudnnDropoutBackward(cuda_helper_->cudnn_handle, dropout_desc,
+                                         x_desc, d_x, x_desc, d_y, d_reserve_space, reserve_space_size_));
+
+        check_cuda(cudaMemcpy(y_.at(i).values_, d_y, y_.at(i).size_ * sizeof(float), cudaMemcpyDeviceToHost));
+        y_.at(i).is_row_major_ = x_->at(i).is_row_major_;
+    }
+
+    // free
+    check_cuda(cudaFree(d_states));
+    check_cudnn(cudnnDestroyDropoutDescriptor(dropout_desc));
+    check_cuda(cudaFree(d_x));
+    check_cuda(cudaFree(d_y));
+    check_cudnn(cudnnDestroyTensorDescriptor(x_desc));
+    check_cuda(cudaFree(d_reserve_space));
+}
+
 // PIPELINED -- PIPELINED -- PIPELINED
 
 DropoutPipelined::DropoutPipelined() {}
@@ -317,8 +480,18 @@ DropoutPipelined::DropoutPipelined(CudaHelper *helper, long chunk_size, long num
     set(helper, chunk_size, num_nodes, num_features);
 }
 
+DropoutPipelined::DropoutPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    set(helper, boundaries, num_features);
+}
+
 void DropoutPipelined::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
-    DropoutChunked::set(helper, chunk_size, num_nodes, num_features);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_features);
+}
+
+void DropoutPipelined::set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    DropoutChunked::set(helper, boundaries, num_features);
 
     name_ = "dropout_pipelined";
     num_steps_ = 2;
@@ -347,6 +520,7 @@ void DropoutPipelined::forward_in(long chunk, long buffer) {
 }
 
 void DropoutPipelined::forward_out(long chunk, long buffer) {
+    y_.at(chunk).allocate();
     if (reserve_space_.at(chunk) == NULL) {
         check_cuda(cudaMallocHost(&reserve_space_.at(chunk), reserve_space_size_));
     }
@@ -355,7 +529,8 @@ void DropoutPipelined::forward_out(long chunk, long buffer) {
 
     check_cuda(cudaMemcpyAsync(y_.at(chunk).values_, d_y_.at(buffer), y_.at(chunk).size_ * sizeof(float),
                                cudaMemcpyDeviceToHost, cuda_helper_->stream_out_));
-    y_.at(chunk).is_row_major_ = true;
+    y_.at(chunk).is_row_major_ = x_->at(chunk).is_row_major_;
+    is_row_major_mask_.at(chunk) = x_->at(chunk).is_row_major_;
 }
 
 void DropoutPipelined::forward_compute(long chunk, long buffer) {
@@ -366,7 +541,7 @@ void DropoutPipelined::forward_compute(long chunk, long buffer) {
 }
 
 void DropoutPipelined::backward_in(long chunk, long buffer) {
-    check_cuda(cudaMemcpyAsync(d_dy_.at(buffer), incoming_gradients_->at(chunk).values_, incoming_gradients_->at(chunk).size_,
+    check_cuda(cudaMemcpyAsync(d_dy_.at(buffer), incoming_gradients_->at(chunk).values_, incoming_gradients_->at(chunk).size_ * sizeof(float),
                                cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
     check_cuda(cudaMemcpyAsync(d_reserve_space_.at(buffer), reserve_space_.at(chunk), reserve_space_size_,
                                cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
@@ -379,6 +554,7 @@ void DropoutPipelined::backward_in(long chunk, long buffer) {
 void DropoutPipelined::backward_out(long chunk, long buffer) {
     check_cuda(cudaMemcpyAsync(gradients_.at(chunk).values_, d_dx_.at(buffer), gradients_.at(chunk).size_ * sizeof(float),
                                cudaMemcpyDeviceToHost, cuda_helper_->stream_out_));
+    gradients_.at(chunk).is_row_major_ = is_row_major_mask_.at(chunk);
 }
 
 void DropoutPipelined::backward_compute(long chunk, long buffer) {
@@ -390,7 +566,9 @@ void DropoutPipelined::backward_compute(long chunk, long buffer) {
 std::vector<Matrix<float>> *DropoutPipelined::forward(std::vector<Matrix<float>> *x) {
     x_ = x;
     for (int i = 0; i < num_chunks_; ++i) {
-        to_row_major_inplace(&x->at(i));
+        if (!keep_layout_) {
+            to_row_major_inplace(&x->at(i));
+        }
     }
 
     // allocate
@@ -401,19 +579,19 @@ std::vector<Matrix<float>> *DropoutPipelined::forward(std::vector<Matrix<float>>
         check_cudnn(cudnnSetDropoutDescriptor(dropout_desc_.at(i), cuda_helper_->cudnn_handle, probability_,
                                               d_states_.at(i), state_size_, seed_));
 
-        check_cuda(cudaMalloc(&d_x_.at(i), x->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_x_.at(i), chunk_size_ * x->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&x_desc_.at(i)));
         check_cudnn(cudnnSetTensor4dDescriptor(x_desc_.at(i), CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                               x->at(0).num_rows_, 1, 1, x->at(0).num_columns_));
+                                               chunk_size_, 1, 1, x->at(0).num_columns_));
 
-        check_cuda(cudaMalloc(&d_y_.at(i), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_.at(i), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&y_desc_.at(i)));
 
         check_cudnn(cudnnDropoutGetReserveSpaceSize(x_desc_.at(i), &reserve_space_size_));
         check_cuda(cudaMalloc(&d_reserve_space_.at(i), reserve_space_size_));
     }
 
-    pipeline(true, num_chunks_);
+    pipeline(cuda_helper_, true, num_chunks_, num_steps_);
 
     // free
     for (long i = 0; i < num_steps_; ++i) {
@@ -436,7 +614,7 @@ std::vector<Matrix<float>> *DropoutPipelined::forward(std::vector<Matrix<float>>
 std::vector<Matrix<float>> *DropoutPipelined::backward(std::vector<Matrix<float>> *incoming_gradients) {
     incoming_gradients_ = incoming_gradients;
     for (int i = 0; i < num_chunks_; ++i) {
-        to_row_major_inplace(&incoming_gradients->at(i));
+        to_layout_inplace(&incoming_gradients->at(i), is_row_major_mask_.at(i));
     }
 
     for (long i = 0; i < num_steps_; ++i) {
@@ -446,16 +624,16 @@ std::vector<Matrix<float>> *DropoutPipelined::backward(std::vector<Matrix<float>
         check_cudnn(cudnnSetDropoutDescriptor(dropout_desc_.at(i), cuda_helper_->cudnn_handle, probability_,
                                               d_states_.at(i), state_size_, seed_));
 
-        check_cuda(cudaMalloc(&d_dy_.at(i), incoming_gradients->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dy_.at(i), chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&dy_desc_.at(i)));
 
-        check_cuda(cudaMalloc(&d_dx_.at(i), x_->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dx_.at(i), chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&dx_desc_.at(i)));
 
         check_cuda(cudaMalloc(&d_reserve_space_.at(i), reserve_space_size_));
     }
 
-    pipeline(false, num_chunks_);
+    pipeline(cuda_helper_, false, num_chunks_, num_steps_);
 
     for (long i = 0; i < num_steps_; ++i) {
         check_cuda(cudaFree(d_states_.at(i)));
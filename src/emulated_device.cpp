@@ -0,0 +1,253 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "emulated_device.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+EmulatedStream::EmulatedStream(EmulatedDevice *device) {
+    device_ = device;
+    worker_ = std::thread(&EmulatedStream::run, this);
+}
+
+EmulatedStream::~EmulatedStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        changed_.notify_all();
+    }
+    worker_.join();
+}
+
+void EmulatedStream::run() {
+    while (true) {
+        std::function<void()> operation;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this] { return !queue_.empty() || stop_; });
+            if (queue_.empty()) {
+                return;
+            }
+            operation = queue_.front();
+            queue_.pop_front();
+        }
+
+        try {
+            operation();
+        } catch (...) {
+            device_->set_error(std::current_exception());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_done_ = num_done_ + 1;
+        changed_.notify_all();
+    }
+}
+
+void EmulatedStream::enqueue(std::function<void()> operation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(operation);
+    num_enqueued_ = num_enqueued_ + 1;
+    changed_.notify_all();
+}
+
+void EmulatedStream::synchronize() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    long num_enqueued = num_enqueued_;
+    changed_.wait(lock, [this, num_enqueued] { return num_done_ >= num_enqueued; });
+}
+
+EmulatedDevice::EmulatedDevice(long capacity, double bandwidth, double flop_rate) {
+    if (capacity < 1 || bandwidth <= 0.0 || flop_rate <= 0.0) {
+        throw "Emulated device needs a positive capacity, bandwidth and flop rate";
+    }
+    capacity_ = capacity;
+    bandwidth_ = bandwidth;
+    flop_rate_ = flop_rate;
+
+    stream_in_ = new EmulatedStream(this);
+    stream_compute_ = new EmulatedStream(this);
+    stream_out_ = new EmulatedStream(this);
+    clocks_[stream_in_] = 0.0;
+    clocks_[stream_compute_] = 0.0;
+    clocks_[stream_out_] = 0.0;
+}
+
+EmulatedDevice::EmulatedDevice(long capacity, double bandwidth) : EmulatedDevice(capacity, bandwidth, 10e12) {}
+
+EmulatedDevice::~EmulatedDevice() {
+    delete stream_in_;
+    delete stream_compute_;
+    delete stream_out_;
+
+    for (auto allocation : allocations_) {
+        delete[] (char *) allocation.first;
+    }
+}
+
+// only the worker of the stream calls it
+void EmulatedDevice::advance(EmulatedStream *stream, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    double start = clocks_.at(stream);
+    clocks_.at(stream) = start + seconds;
+    busy_.push_back(std::make_pair(start, start + seconds));
+}
+
+void *EmulatedDevice::allocate(long size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (memory_used_ + size > capacity_) {
+        throw "Out of emulated device memory";
+    }
+    void *ptr = new char[std::max(size, 1l)];
+    allocations_[ptr] = size;
+    memory_used_ = memory_used_ + size;
+    stats_.peak_memory = std::max(stats_.peak_memory, memory_used_);
+    return ptr;
+}
+
+void EmulatedDevice::deallocate(void *ptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto allocation = allocations_.find(ptr);
+    if (allocation == allocations_.end()) {
+        throw "Pointer not allocated on the emulated device";
+    }
+    memory_used_ = memory_used_ - allocation->second;
+    allocations_.erase(allocation);
+    delete[] (char *) ptr;
+}
+
+long EmulatedDevice::get_memory_used() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_used_;
+}
+
+double EmulatedDevice::get_copy_time(long size) {
+    return size / bandwidth_;
+}
+
+double EmulatedDevice::get_compute_time(double num_flops) {
+    return num_flops / flop_rate_;
+}
+
+void EmulatedDevice::memcpy_async(void *dst, const void *src, long size, EmulatedStream *stream) {
+    double seconds = get_copy_time(size);
+    stream->enqueue([this, dst, src, size, seconds, stream]() {
+        std::memcpy(dst, src, size);
+        advance(stream, seconds);
+    });
+}
+
+void EmulatedDevice::launch(std::function<void()> kernel, double seconds, EmulatedStream *stream) {
+    stream->enqueue([this, kernel, seconds, stream]() {
+        kernel();
+        advance(stream, seconds);
+    });
+}
+
+void EmulatedDevice::record(EmulatedEvent *event, EmulatedStream *stream) {
+    long record;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        event->num_recorded = event->num_recorded + 1;
+        event->times.push_back(0.0);
+        record = event->num_recorded;
+    }
+    stream->enqueue([this, event, record, stream]() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        event->times.at(record - 1) = clocks_.at(stream);
+        event->num_reached = std::max(event->num_reached, record);
+        reached_.notify_all();
+    });
+}
+
+// the stream goes on at the virtual time of the record, if that is later
+void EmulatedDevice::wait(EmulatedStream *stream, EmulatedEvent *event) {
+    long record;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        record = event->num_recorded;
+    }
+    if (record == 0) {
+        return;
+    }
+    stream->enqueue([this, event, record, stream]() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        reached_.wait(lock, [event, record] { return event->num_reached >= record; });
+        double time = event->times.at(record - 1);
+        if (time > clocks_.at(stream)) {
+            stats_.stall_time = stats_.stall_time + (time - clocks_.at(stream));
+            clocks_.at(stream) = time;
+        }
+    });
+}
+
+void EmulatedDevice::synchronize(EmulatedEvent *event) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    long record = event->num_recorded;
+    reached_.wait(lock, [event, record] { return event->num_reached >= record; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void EmulatedDevice::synchronize() {
+    stream_in_->synchronize();
+    stream_compute_->synchronize();
+    stream_out_->synchronize();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void EmulatedDevice::set_error(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+        error_ = error;
+    }
+}
+
+EmulatedDeviceStats EmulatedDevice::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EmulatedDeviceStats stats = stats_;
+    for (auto clock : clocks_) {
+        stats.time = std::max(stats.time, clock.second - start_time_);
+    }
+
+    // union of the busy intervals of all streams
+    std::vector<std::pair<double, double>> busy = busy_;
+    std::sort(busy.begin(), busy.end());
+    double busy_sum = 0.0;
+    double busy_end = start_time_;
+    for (auto interval : busy) {
+        busy_sum = busy_sum + (interval.second - interval.first);
+        if (interval.first >= busy_end) {
+            stats.busy_time = stats.busy_time + (interval.second - interval.first);
+            busy_end = interval.second;
+        } else if (interval.second > busy_end) {
+            stats.busy_time = stats.busy_time + (interval.second - busy_end);
+            busy_end = interval.second;
+        }
+    }
+    if (stats.busy_time > 0.0) {
+        stats.overlap_ratio = busy_sum / stats.busy_time;
+    }
+
+    return stats;
+}
+
+// the streams start again together where the last one is done, events recorded earlier stay in the past
+void EmulatedDevice::reset_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto clock : clocks_) {
+        start_time_ = std::max(start_time_, clock.second);
+    }
+    for (auto &clock : clocks_) {
+        clock.second = start_time_;
+    }
+    busy_.clear();
+    stats_ = EmulatedDeviceStats();
+    stats_.peak_memory = memory_used_;
+}
@@ -1,12 +1,18 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "feature_aggregation.hpp"
+#include "chunking.hpp"
 #include "cuda_helper.hpp"
 #include "divmv.h"
+#include "emulated_device.hpp"
+#include "hybrid.hpp"
 #include "sparse_computation.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <string>
+#include <thread>
 
 
 FeatureAggregation::FeatureAggregation() {}
@@ -18,9 +24,31 @@ FeatureAggregation::FeatureAggregation(CudaHelper *helper, SparseMatrix<float> *
 
 void FeatureAggregation::set(CudaHelper *helper, SparseMatrix<float> *adjacency, std::string reduction,
                              long num_nodes, long num_features, Matrix<float> *sum) {
+    if (num_nodes != adjacency->num_rows_) {
+        throw "Number of nodes does not match the adjacency";
+    }
+    // the adjacency is symmetric, so it is its own transpose
+    set(helper, adjacency, adjacency, reduction, num_features, sum);
+}
+
+void FeatureAggregation::set(CudaHelper *helper, SparseMatrix<float> *adjacency, SparseMatrix<float> *adjacency_transposed,
+                             std::string reduction, long num_features, Matrix<float> *sum) {
     name_ = "feature-aggregation";
     cuda_helper_ = helper;
     adjacency_ = adjacency;
+    adjacency_transposed_ = adjacency_transposed;
+    // the in-degrees of the transpose can be skewed where the out-degrees are not, a symmetric adjacency is converted once
+    if (!use_hybrid_) {
+        is_hybrid_ = false;
+        is_hybrid_transposed_ = false;
+    } else {
+        is_hybrid_ = to_hybrid_if_skewed(adjacency_, &hybrid_);
+        if (adjacency_transposed_ == adjacency_) {
+            is_hybrid_transposed_ = false;
+        } else {
+            is_hybrid_transposed_ = to_hybrid_if_skewed(adjacency_transposed_, &hybrid_transposed_);
+        }
+    }
     reduction_ = reduction;
     if (reduction_.compare("mean") == 0) {
         mean_ = true;
@@ -30,22 +58,23 @@ void FeatureAggregation::set(CudaHelper *helper, SparseMatrix<float> *adjacency,
         throw "Reduction not supported";
     }
 
-    y_.set(num_nodes, num_features, false);
-    gradients_.set(num_nodes, num_features, false);
-
-    if (mean_) {
-        sum_.set(num_nodes, 1, false);
-        sp_mat_sum_rows(cuda_helper_, adjacency_, &sum_);
-    }
+    y_.set(adjacency_->num_rows_, num_features, false);
+    gradients_.set(adjacency_->num_columns_, num_features, false);
 
     adjacency_row_sum_ = sum;
 }
 
+void FeatureAggregation::set_hybrid(bool use_hybrid) {
+    use_hybrid_ = use_hybrid;
+}
+
 Matrix<float> *FeatureAggregation::forward(Matrix<float> *x) {
     to_column_major_inplace(x);
 
     float *d_y;
     check_cuda(cudaMalloc(&d_y, y_.size_ * sizeof(float)));
+    // sampled blocks can be empty, which leaves the result untouched
+    check_cuda(cudaMemset(d_y, 0, y_.size_ * sizeof(float)));
 
     float *d_sum;
     if (mean_) {
@@ -55,12 +84,17 @@ Matrix<float> *FeatureAggregation::forward(Matrix<float> *x) {
     float *d_x;
     check_cuda(cudaMalloc(&d_x, x->size_ * sizeof(float)));
 
-    SparseMatrixCuda<float> d_adj;
-    malloc_memcpy_sp_mat(&d_adj, adjacency_);
-
     check_cuda(cudaMemcpy(d_x, x->values_, x->size_ * sizeof(float), cudaMemcpyHostToDevice));
 
-    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj, d_x, d_y, x->num_columns_, false);
+    if (is_hybrid_) {
+        HybridSparseMatrixCuda d_hybrid;
+        malloc_memcpy_hybrid(&d_hybrid, &hybrid_);
+        hybrid_mat_mat_multi_cuda(cuda_helper_, &d_hybrid, d_x, d_y, x->num_columns_, false);
+    } else {
+        SparseMatrixCuda<float> d_adj;
+        malloc_memcpy_sp_mat(&d_adj, adjacency_);
+        sp_mat_mat_multi_cuda(cuda_helper_, &d_adj, d_x, d_y, x->num_columns_, false);
+    }
 
     if (mean_) {
         check_cuda(cudaMemcpy(d_sum, adjacency_row_sum_->values_, y_.num_rows_ * sizeof(float),
@@ -87,6 +121,7 @@ Matrix<float> *FeatureAggregation::backward(Matrix<float> *incoming_gradients) {
 
     float *d_gradients;
     check_cuda(cudaMalloc(&d_gradients, gradients_.size_ * sizeof(float)));
+    check_cuda(cudaMemset(d_gradients, 0, gradients_.size_ * sizeof(float)));
 
     float *d_sum;
     if (mean_) {
@@ -96,9 +131,6 @@ Matrix<float> *FeatureAggregation::backward(Matrix<float> *incoming_gradients) {
     float *d_incoming_gradients;
     check_cuda(cudaMalloc(&d_incoming_gradients, incoming_gradients->size_ * sizeof(float)));
 
-    SparseMatrixCuda<float> d_adj;
-    malloc_memcpy_sp_mat(&d_adj, adjacency_);
-
     check_cuda(cudaMemcpy(d_incoming_gradients, incoming_gradients->values_, incoming_gradients->size_ * sizeof(float), cudaMemcpyHostToDevice));
 
     if (mean_) {
@@ -108,7 +140,19 @@ Matrix<float> *FeatureAggregation::backward(Matrix<float> *incoming_gradients) {
         div_mat_vec(d_incoming_gradients, d_sum, incoming_gradients->num_rows_, incoming_gradients->num_columns_);
     }
 
-    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj, d_incoming_gradients, d_gradients, incoming_gradients->num_columns_, true);
+    if (adjacency_transposed_ == adjacency_ && is_hybrid_) {
+        HybridSparseMatrixCuda d_hybrid;
+        malloc_memcpy_hybrid(&d_hybrid, &hybrid_);
+        hybrid_mat_mat_multi_cuda(cuda_helper_, &d_hybrid, d_incoming_gradients, d_gradients, incoming_gradients->num_columns_, true);
+    } else if (is_hybrid_transposed_) {
+        HybridSparseMatrixCuda d_hybrid;
+        malloc_memcpy_hybrid(&d_hybrid, &hybrid_transposed_);
+        hybrid_mat_mat_multi_cuda(cuda_helper_, &d_hybrid, d_incoming_gradients, d_gradients, incoming_gradients->num_columns_, true);
+    } else {
+        SparseMatrixCuda<float> d_adj;
+        malloc_memcpy_sp_mat(&d_adj, adjacency_transposed_);
+        sp_mat_mat_multi_cuda(cuda_helper_, &d_adj, d_incoming_gradients, d_gradients, incoming_gradients->num_columns_, true);
+    }
 
     check_cuda(cudaMemcpy(gradients_.values_, d_gradients, gradients_.size_ * sizeof(float),
                           cudaMemcpyDeviceToHost));
@@ -123,21 +167,116 @@ Matrix<float> *FeatureAggregation::backward(Matrix<float> *incoming_gradients) {
     return &gradients_;
 }
 
+Matrix<float> *FeatureAggregation::get_y() {
+    return &y_;
+}
+
+Matrix<float> *FeatureAggregation::get_input_gradients() {
+    return &gradients_;
+}
+
 // CHUNKED --- CHUNKED --- CHUNKED
 
+// adds the off-diagonal tiles of the row chunks from first_chunk up to last_chunk
+void get_halo_aggregates_range(std::vector<SparseMatrix<float>> *tiles, TileIndex *tile_index, std::vector<Matrix<float>> *x,
+                               std::vector<Matrix<float>> *aggregates, long first_chunk, long last_chunk) {
+    long num_chunks = tile_index->num_chunks;
+    for (long i = first_chunk; i < last_chunk; ++i) {
+        Matrix<float> *aggregate = &aggregates->at(i);
+        aggregate->set_values(0.0);
+        aggregate->is_row_major_ = false;
+        for (long k = 0; k < (long) tile_index->non_empty.at(i).size(); ++k) {
+            long j = tile_index->non_empty.at(i).at(k);
+            if (j == i) {
+                continue;
+            }
+            SparseMatrix<float> *tile = &tiles->at(i * num_chunks + j);
+            Matrix<float> *x_j = &x->at(j);
+            for (long column = 0; column < aggregate->num_columns_; ++column) {
+                float *result = aggregate->values_ + column * aggregate->num_rows_;
+                float *mat = x_j->values_ + column * x_j->num_rows_;
+                for (long row = 0; row < tile->num_rows_; ++row) {
+                    float sum = 0.0;
+                    for (long l = tile->csr_row_ptr_[row]; l < tile->csr_row_ptr_[row + 1]; ++l) {
+                        sum = sum + tile->csr_val_[l] * mat[tile->csr_col_ind_[l]];
+                    }
+                    result[row] = result[row] + sum;
+                }
+            }
+        }
+    }
+}
+
+void get_halo_aggregates(std::vector<SparseMatrix<float>> *tiles, TileIndex *tile_index, std::vector<Matrix<float>> *x,
+                         std::vector<Matrix<float>> *aggregates) {
+    long num_chunks = tile_index->num_chunks;
+    for (long i = 0; i < num_chunks; ++i) {
+        to_column_major_inplace(&x->at(i));
+    }
+
+    long num_threads = std::max(std::min((long) std::thread::hardware_concurrency(), num_chunks), 1l);
+    std::vector<std::thread> threads(num_threads);
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t) = std::thread(get_halo_aggregates_range, tiles, tile_index, x, aggregates,
+                                    t * num_chunks / num_threads, (t + 1) * num_chunks / num_threads);
+    }
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t).join();
+    }
+}
+
+void get_halo_aggregates(std::vector<SparseMatrix<float>> *tiles, TileIndex *tile_index, std::vector<Matrix<float>> *x,
+                         std::vector<Matrix<float>> *aggregates, NumaTopology *topology, NumaPlacement placement) {
+    if (placement == numa_none) {
+        get_halo_aggregates(tiles, tile_index, x, aggregates);
+        return;
+    }
+    // chunks still in row-major order are converted on the threads of their node, so they stay there
+    run_on_numa_nodes(topology, placement, tile_index->num_chunks, [x](long i) {
+        to_column_major_inplace(&x->at(i));
+    });
+    run_on_numa_nodes(topology, placement, tile_index->num_chunks, [tiles, tile_index, x, aggregates](long i) {
+        get_halo_aggregates_range(tiles, tile_index, x, aggregates, i, i + 1);
+    });
+}
+
 FeatureAggregationChunked::FeatureAggregationChunked() {}
 
+FeatureAggregationChunked::~FeatureAggregationChunked() {
+    if (history_thread_.joinable()) {
+        history_thread_.join();
+    }
+}
+
 FeatureAggregationChunked::FeatureAggregationChunked(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies,
                                                      Matrix<float> *sum, std::string reduction,
                                                      long num_features, long chunk_size, long num_nodes) {
     set(helper, adjacencies, sum, reduction, num_features, chunk_size, num_nodes);
 }
 
+FeatureAggregationChunked::FeatureAggregationChunked(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies,
+                                                     Matrix<float> *sum, std::string reduction,
+                                                     long num_features, std::vector<long> *boundaries) {
+    set(helper, adjacencies, sum, reduction, num_features, boundaries);
+}
+
 void FeatureAggregationChunked::set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
                                     std::string reduction, long num_features, long chunk_size, long num_nodes) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, adjacencies, sum, reduction, num_features, &boundaries);
+}
+
+void FeatureAggregationChunked::set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+                                    std::string reduction, long num_features, std::vector<long> *boundaries) {
     name_ = "feature-aggregation_chunked";
     cuda_helper_ = helper;
-    chunk_size_ = chunk_size;
+    wait_history();
+    use_history_ = false;
+    history_ready_ = false;
+    history_used_ = false;
+    boundaries_ = *boundaries;
+    chunk_size_ = get_max_chunk_size(boundaries);
     if (reduction.compare("mean") == 0) {
         mean_ = true;
     } else if (reduction.compare("sum") == 0) {
@@ -147,118 +286,221 @@ void FeatureAggregationChunked::set(CudaHelper *helper, std::vector<SparseMatrix
     }
 
     adjacencies_ = adjacencies;
+    index_tiles(adjacencies_, &tile_index_);
     adjacency_row_sum_ = sum;
 
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size_);
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
+    num_chunks_ = boundaries->size() - 1;
+    if (tile_index_.num_chunks != num_chunks_) {
+        throw "Tiles do not match the boundaries";
     }
 
+    // converted on first use unless another layer on the same tiles shares its hybrids
+    hybrid_tiles_ = NULL;
+    own_hybrid_tiles_ = HybridTiles();
+
     y_ = std::vector<Matrix<float>>(num_chunks_);
     gradients_ = std::vector<Matrix<float>>(num_chunks_);
-    long current_chunk_size = chunk_size_;
     for (int i = 0; i < num_chunks_; ++i) {
-        if (i == num_chunks_ - 1) {
-            current_chunk_size = last_chunk_size_;
-        }
-
+        long current_chunk_size = boundaries->at(i + 1) - boundaries->at(i);
         y_.at(i).set(current_chunk_size, num_features, false);
         gradients_.at(i).set(current_chunk_size, num_features, false);
     }
 }
 
+void FeatureAggregationChunked::wait_history() {
+    if (history_thread_.joinable()) {
+        history_thread_.join();
+    }
+}
+
+void FeatureAggregationChunked::set_history(bool use_history) {
+    wait_history();
+    use_history_ = use_history;
+    history_ready_ = false;
+    if (use_history_) {
+        history_ = std::vector<Matrix<float>>(num_chunks_);
+        halo_aggregates_ = std::vector<Matrix<float>>(num_chunks_);
+        for (long i = 0; i < num_chunks_; ++i) {
+            history_.at(i).set(y_.at(i).num_rows_, y_.at(i).num_columns_, false);
+            halo_aggregates_.at(i).set(y_.at(i).num_rows_, y_.at(i).num_columns_, false);
+        }
+    } else {
+        history_.clear();
+        halo_aggregates_.clear();
+    }
+}
+
+void FeatureAggregationChunked::set_numa_placement(NumaPlacement placement) {
+    wait_history();
+    numa_placement_ = placement;
+    if (numa_placement_ != numa_none) {
+        get_numa_topology(&numa_topology_);
+        place_chunks(&numa_topology_, numa_placement_, &history_);
+        place_chunks(&numa_topology_, numa_placement_, &halo_aggregates_);
+    }
+}
+
 std::vector<Matrix<float>> *FeatureAggregationChunked::forward(std::vector<Matrix<float>> *x) {
-    for (int i = 0; i < num_chunks_; ++i) {
-        to_column_major_inplace(&x->at(i));
+    forward_begin(x);
+    for (long i = 0; i < num_chunks_; ++i) {
+        forward_chunk(i);
     }
+    forward_end();
 
-    float *d_y;
-    check_cuda(cudaMalloc(&d_y, y_.at(0).size_ * sizeof(float)));
+    return &y_;
+}
 
-    float *d_sum;
-    if (mean_) {
-        check_cuda(cudaMalloc(&d_sum, y_.at(0).num_rows_ * sizeof(float)));
+std::vector<Matrix<float>> *FeatureAggregationChunked::forward_begin(std::vector<Matrix<float>> *x) {
+    if ((long) x->size() != num_chunks_) {
+        throw "Input has a wrong number of chunks";
     }
+    x_ = x;
+    get_hybrid_tiles();
 
-    float *d_x;
-    check_cuda(cudaMalloc(&d_x, x->at(0).size_ * sizeof(float)));
+    // the halo aggregates of the last forward pass stand in for the tiles off the diagonal
+    wait_history();
+    history_used_ = use_history_ && history_ready_;
 
-    // row chunk
-    for (int i = 0; i < num_chunks_; ++i) {
-        // column chunk of row chunk
-        check_cuda(cudaMemset(d_y, 0, y_.at(i).size_ * sizeof(float)));
+    return &y_;
+}
 
-        for (int j = 0; j < num_chunks_; ++j) {
-            SparseMatrixCuda<float> d_adj_i;
-            SparseMatrix<float> *adj = &adjacencies_->at(i * num_chunks_ + j);
-            if (adj->nnz_ > 0) {
-                malloc_memcpy_sp_mat(&d_adj_i, adj);
+// row chunk i, reads every chunk of x with a non-empty tile in row chunk i
+void FeatureAggregationChunked::forward_chunk(long i) {
+    if (d_y_forward_ == NULL) {
+        check_cuda(cudaMalloc(&d_y_forward_, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
+        if (mean_) {
+            check_cuda(cudaMalloc(&d_sum_chunk_, chunk_size_ * sizeof(float)));
+        }
+        check_cuda(cudaMalloc(&d_x_forward_, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+    }
 
-                check_cuda(cudaMemcpy(d_x, x->at(j).values_, x->at(j).size_ * sizeof(float), cudaMemcpyHostToDevice));
+    if (history_used_) {
+        check_cuda(cudaMemcpy(d_y_forward_, halo_aggregates_.at(i).values_, y_.at(i).size_ * sizeof(float), cudaMemcpyHostToDevice));
+    } else {
+        check_cuda(cudaMemset(d_y_forward_, 0, y_.at(i).size_ * sizeof(float)));
+    }
 
-                sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_i, d_x, d_y, x->at(j).num_columns_, true);
-            }
+    // column chunk of row chunk
+    for (long k = 0; k < (long) tile_index_.non_empty.at(i).size(); ++k) {
+        long j = tile_index_.non_empty.at(i).at(k);
+        if (history_used_ && j != i) {
+            continue;
+        }
+        to_column_major_inplace(&x_->at(j));
+        check_cuda(cudaMemcpy(d_x_forward_, x_->at(j).values_, x_->at(j).size_ * sizeof(float), cudaMemcpyHostToDevice));
+
+        if (hybrid_tiles_->is_hybrid_.at(i * num_chunks_ + j)) {
+            HybridSparseMatrixCuda d_hybrid_i;
+            malloc_memcpy_hybrid(&d_hybrid_i, &hybrid_tiles_->hybrids_.at(i * num_chunks_ + j));
+            hybrid_mat_mat_multi_cuda(cuda_helper_, &d_hybrid_i, d_x_forward_, d_y_forward_, x_->at(j).num_columns_, true);
+        } else {
+            SparseMatrixCuda<float> d_adj_i;
+            malloc_memcpy_sp_mat(&d_adj_i, &adjacencies_->at(i * num_chunks_ + j));
+            sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_i, d_x_forward_, d_y_forward_, x_->at(j).num_columns_, true);
         }
+    }
+
+    if (mean_) {
+        check_cuda(cudaMemcpy(d_sum_chunk_, &adjacency_row_sum_->values_[boundaries_.at(i)], y_.at(i).num_rows_ * sizeof(float),
+                              cudaMemcpyHostToDevice));
+
+        div_mat_vec(d_y_forward_, d_sum_chunk_, y_.at(i).num_rows_, y_.at(i).num_columns_);
+    }
+
+    check_cuda(cudaMemcpy(y_.at(i).values_, d_y_forward_, y_.at(i).size_ * sizeof(float),
+                          cudaMemcpyDeviceToHost));
+}
 
+void FeatureAggregationChunked::forward_end() {
+    // free GPU memory
+    if (d_y_forward_ != NULL) {
         if (mean_) {
-            check_cuda(cudaMemcpy(d_sum, &adjacency_row_sum_->values_[i * chunk_size_], y_.at(i).num_rows_ * sizeof(float),
-                                  cudaMemcpyHostToDevice));
+            check_cuda(cudaFree(d_sum_chunk_));
+        }
+        check_cuda(cudaFree(d_y_forward_));
+        check_cuda(cudaFree(d_x_forward_));
+        d_sum_chunk_ = NULL;
+        d_y_forward_ = NULL;
+        d_x_forward_ = NULL;
+    }
 
-            div_mat_vec(d_y, d_sum, y_.at(i).num_rows_, y_.at(i).num_columns_);
+    // the input becomes the history of the next forward pass, its halo aggregates are computed in the background
+    if (use_history_) {
+        for (long i = 0; i < num_chunks_; ++i) {
+            to_column_major_inplace(&x_->at(i));
+            std::copy(x_->at(i).values_, x_->at(i).values_ + x_->at(i).size_, history_.at(i).values_);
         }
+        history_thread_ = std::thread([this]() {
+            get_halo_aggregates(adjacencies_, &tile_index_, &history_, &halo_aggregates_, &numa_topology_, numa_placement_);
+        });
+        history_ready_ = true;
+    }
+}
 
-        check_cuda(cudaMemcpy(y_.at(i).values_, d_y, y_.at(i).size_ * sizeof(float),
-                              cudaMemcpyDeviceToHost));
+HybridTiles *FeatureAggregationChunked::get_hybrid_tiles() {
+    if (hybrid_tiles_ == NULL) {
+        to_hybrid_tiles(adjacencies_, &own_hybrid_tiles_);
+        hybrid_tiles_ = &own_hybrid_tiles_;
     }
+    return hybrid_tiles_;
+}
 
-    // free GPU memory
-    if (mean_) {
-        check_cuda(cudaFree(d_sum));
+void FeatureAggregationChunked::set_hybrid_tiles(HybridTiles *hybrid_tiles) {
+    if ((long) hybrid_tiles->is_hybrid_.size() != num_chunks_ * num_chunks_) {
+        throw "Hybrid tiles do not match the tiles";
     }
-    check_cuda(cudaFree(d_y));
-    check_cuda(cudaFree(d_x));
+    own_hybrid_tiles_ = HybridTiles();
+    hybrid_tiles_ = hybrid_tiles;
+}
 
-    return &y_;
+bool FeatureAggregationChunked::is_history_used() {
+    return history_used_;
 }
 
 std::vector<Matrix<float>> *FeatureAggregationChunked::backward(std::vector<Matrix<float>> *incoming_gradients) {
+    get_hybrid_tiles();
     for (int i = 0; i < num_chunks_; ++i) {
         to_column_major_inplace(&incoming_gradients->at(i));
     }
 
     float *d_gradients;
-    check_cuda(cudaMalloc(&d_gradients, gradients_.at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_gradients, chunk_size_ * gradients_.at(0).num_columns_ * sizeof(float)));
 
     float *d_sum;
     if (mean_) {
-        check_cuda(cudaMalloc(&d_sum, incoming_gradients->at(0).num_rows_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_sum, chunk_size_ * sizeof(float)));
     }
 
     float *d_incoming_gradients;
-    check_cuda(cudaMalloc(&d_incoming_gradients, incoming_gradients->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_incoming_gradients, chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
 
     // row chunk
     for (int i = 0; i < num_chunks_; ++i) {
         // column chunk of row chunk
         check_cuda(cudaMemset(d_gradients, 0, gradients_.at(i).size_ * sizeof(float)));
 
-        for (int j = 0; j < num_chunks_; ++j) {
-            SparseMatrixCuda<float> d_adj_i;
-            SparseMatrix<float> *adj = &adjacencies_->at(i * num_chunks_ + j);
-            if (adj->nnz_ > 0) {
-                malloc_memcpy_sp_mat(&d_adj_i, &adjacencies_->at(i * num_chunks_ + j));
-
-                check_cuda(cudaMemcpy(d_incoming_gradients, incoming_gradients->at(j).values_, incoming_gradients->at(j).size_ * sizeof(float), cudaMemcpyHostToDevice));
+        for (long k = 0; k < (long) tile_index_.non_empty.at(i).size(); ++k) {
+            long j = tile_index_.non_empty.at(i).at(k);
+            // the history is a constant, no gradients flow to the other chunks
+            if (history_used_ && j != i) {
+                continue;
+            }
+            check_cuda(cudaMemcpy(d_incoming_gradients, incoming_gradients->at(j).values_, incoming_gradients->at(j).size_ * sizeof(float), cudaMemcpyHostToDevice));
 
-                if (mean_) {
-                    check_cuda(cudaMemcpy(d_sum, &adjacency_row_sum_->values_[j * chunk_size_], incoming_gradients->at(j).num_rows_ * sizeof(float),
-                                          cudaMemcpyHostToDevice));
+            if (mean_) {
+                check_cuda(cudaMemcpy(d_sum, &adjacency_row_sum_->values_[boundaries_.at(j)], incoming_gradients->at(j).num_rows_ * sizeof(float),
+                                      cudaMemcpyHostToDevice));
 
-                    div_mat_vec(d_incoming_gradients, d_sum, incoming_gradients->at(j).num_rows_, incoming_gradients->at(j).num_columns_);
-                }
+                div_mat_vec(d_incoming_gradients, d_sum, incoming_gradients->at(j).num_rows_, incoming_gradients->at(j).num_columns_);
+            }
 
+            if (hybrid_tiles_->is_hybrid_.at(i * num_chunks_ + j)) {
+                HybridSparseMatrixCuda d_hybrid_i;
+                malloc_memcpy_hybrid(&d_hybrid_i, &hybrid_tiles_->hybrids_.at(i * num_chunks_ + j));
+                hybrid_mat_mat_multi_cuda(cuda_helper_, &d_hybrid_i, d_incoming_gradients, d_gradients, incoming_gradients->at(j).num_columns_, true);
+            } else {
+                SparseMatrixCuda<float> d_adj_i;
+                malloc_memcpy_sp_mat(&d_adj_i, &adjacencies_->at(i * num_chunks_ + j));
                 sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_i, d_incoming_gradients, d_gradients, incoming_gradients->at(j).num_columns_, true);
             }
         }
@@ -277,6 +519,10 @@ std::vector<Matrix<float>> *FeatureAggregationChunked::backward(std::vector<Matr
     return &gradients_;
 }
 
+std::vector<Matrix<float>> *FeatureAggregationChunked::get_input_gradients() {
+    return &gradients_;
+}
+
 // PIPELINED --- PIPELINED --- PIPELINED
 
 FeatureAggregationPipelined::FeatureAggregationPipelined() {}
@@ -287,31 +533,201 @@ FeatureAggregationPipelined::FeatureAggregationPipelined(CudaHelper *helper, std
     set(helper, adjacencies, sum, reduction, num_features, chunk_size, num_nodes);
 }
 
+FeatureAggregationPipelined::FeatureAggregationPipelined(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies,
+                                                         Matrix<float> *sum, std::string reduction, long num_features,
+                                                         std::vector<long> *boundaries) {
+    set(helper, adjacencies, sum, reduction, num_features, boundaries);
+}
+
 void FeatureAggregationPipelined::set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
                                       std::string reduction, long num_features, long chunk_size, long num_nodes) {
-    FeatureAggregationChunked::set(helper, adjacencies, sum, reduction, num_features, chunk_size, num_nodes);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, adjacencies, sum, reduction, num_features, &boundaries);
+}
+
+void FeatureAggregationPipelined::set(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+                                      std::string reduction, long num_features, std::vector<long> *boundaries) {
+    FeatureAggregationChunked::set(helper, adjacencies, sum, reduction, num_features, boundaries);
 
     name_ = "feature-aggregation_pipelined";
     num_steps_ = 2;
     d_x_ = std::vector<float *>(num_steps_);
     d_adj_ = std::vector<SparseMatrixCuda<float>>(num_steps_);
+    d_hybrid_ = std::vector<HybridSparseMatrixCuda>(num_steps_);
     d_incoming_gradients_ = std::vector<float *>(num_steps_);
     d_sum_backward_ = std::vector<float *>(num_steps_);
 }
 
+void FeatureAggregationPipelined::set_emulated_device(EmulatedDevice *device) {
+    emulated_device_ = device;
+}
+
+// y += tile x on the host, x and y are column-major
+void emulated_sp_mat_mat_multi(long num_rows, int *row_ptr, int *col_ind, float *val, float *x, long num_x_rows,
+                               float *y, long num_columns) {
+    for (long column = 0; column < num_columns; ++column) {
+        float *mat = x + column * num_x_rows;
+        float *result = y + column * num_rows;
+        for (long row = 0; row < num_rows; ++row) {
+            float sum = 0.0;
+            for (long l = row_ptr[row]; l < row_ptr[row + 1]; ++l) {
+                sum = sum + val[l] * mat[col_ind[l]];
+            }
+            result[row] = result[row] + sum;
+        }
+    }
+}
+
+// divides the rows of a column-major matrix by the sums
+void emulated_div_mat_vec(float *mat, float *sum, long num_rows, long num_columns) {
+    for (long column = 0; column < num_columns; ++column) {
+        for (long row = 0; row < num_rows; ++row) {
+            mat[column * num_rows + row] = mat[column * num_rows + row] / sum[row];
+        }
+    }
+}
+
+// the same schedule as on the GPU with the hybrid tiles in CSR. the forward pass divides the result by the sums of its
+// row chunk, the backward pass divides every chunk of x by the sums of its column chunk
+void FeatureAggregationPipelined::run_emulated(std::vector<Matrix<float>> *x, std::vector<Matrix<float>> *y, bool forward) {
+    EmulatedDevice *device = emulated_device_;
+    long num_columns = x->at(0).num_columns_;
+    long max_nnz = tile_index_.max_nnz;
+
+    float *e_y = (float *) device->allocate(chunk_size_ * num_columns * sizeof(float));
+    std::vector<float *> e_sum_row(num_steps_, NULL);
+    std::vector<int *> e_row_ptr(num_steps_);
+    std::vector<int *> e_col_ind(num_steps_);
+    std::vector<float *> e_val(num_steps_);
+    std::vector<float *> e_x(num_steps_);
+    std::vector<float *> e_sum_column(num_steps_, NULL);
+    for (long i = 0; i < num_steps_; ++i) {
+        if (mean_ && forward) {
+            e_sum_row.at(i) = (float *) device->allocate(chunk_size_ * sizeof(float));
+        }
+        e_row_ptr.at(i) = (int *) device->allocate((chunk_size_ + 1) * sizeof(int));
+        e_col_ind.at(i) = (int *) device->allocate(max_nnz * sizeof(int));
+        e_val.at(i) = (float *) device->allocate(max_nnz * sizeof(float));
+        e_x.at(i) = (float *) device->allocate(chunk_size_ * num_columns * sizeof(float));
+        if (mean_ && !forward) {
+            e_sum_column.at(i) = (float *) device->allocate(chunk_size_ * sizeof(float));
+        }
+    }
+
+    // a buffer is refilled once the stream that reads it is done with it
+    std::vector<EmulatedEvent> tile_in(num_steps_);
+    std::vector<EmulatedEvent> tile_done(num_steps_);
+    std::vector<EmulatedEvent> sum_in(num_steps_);
+    std::vector<EmulatedEvent> row_done(num_steps_);
+    EmulatedEvent y_out;
+    long step = 0;
+    for (long row = 0; row < num_chunks_; ++row) {
+        long num_rows = y->at(row).num_rows_;
+        long row_buffer = row % num_steps_;
+        if (mean_ && forward) {
+            device->wait(device->stream_in_, &row_done.at(row_buffer));
+            device->memcpy_async(e_sum_row.at(row_buffer), &adjacency_row_sum_->values_[boundaries_.at(row)],
+                                 num_rows * sizeof(float), device->stream_in_);
+            device->record(&sum_in.at(row_buffer), device->stream_in_);
+        }
+
+        device->wait(device->stream_compute_, &y_out);
+        device->launch([e_y, num_rows, num_columns]() {
+            std::memset(e_y, 0, num_rows * num_columns * sizeof(float));
+        }, 0.0, device->stream_compute_);
+
+        // tile k is copied in while tile k - 1 is multiplied, empty tiles are never scheduled
+        std::vector<long> *columns = &tile_index_.non_empty.at(row);
+        for (long k = 0; k < (long) columns->size(); ++k) {
+            long column = columns->at(k);
+            long buffer = step % num_steps_;
+            step = step + 1;
+            SparseMatrix<float> *tile = &adjacencies_->at(row * num_chunks_ + column);
+            Matrix<float> *x_column = &x->at(column);
+
+            device->wait(device->stream_in_, &tile_done.at(buffer));
+            device->memcpy_async(e_row_ptr.at(buffer), tile->csr_row_ptr_, (tile->num_rows_ + 1) * sizeof(int), device->stream_in_);
+            device->memcpy_async(e_col_ind.at(buffer), tile->csr_col_ind_, tile->nnz_ * sizeof(int), device->stream_in_);
+            device->memcpy_async(e_val.at(buffer), tile->csr_val_, tile->nnz_ * sizeof(float), device->stream_in_);
+            device->memcpy_async(e_x.at(buffer), x_column->values_, x_column->size_ * sizeof(float), device->stream_in_);
+            if (mean_ && !forward) {
+                device->memcpy_async(e_sum_column.at(buffer), &adjacency_row_sum_->values_[boundaries_.at(column)],
+                                     x_column->num_rows_ * sizeof(float), device->stream_in_);
+            }
+            device->record(&tile_in.at(buffer), device->stream_in_);
+
+            device->wait(device->stream_compute_, &tile_in.at(buffer));
+            double num_flops = 2.0 * tile->nnz_ * num_columns;
+            if (mean_ && !forward) {
+                num_flops = num_flops + x_column->size_;
+            }
+            float *e_x_buffer = e_x.at(buffer);
+            float *e_sum_buffer = e_sum_column.at(buffer);
+            int *row_ptr = e_row_ptr.at(buffer);
+            int *col_ind = e_col_ind.at(buffer);
+            float *val = e_val.at(buffer);
+            long num_x_rows = x_column->num_rows_;
+            device->launch([e_y, e_x_buffer, e_sum_buffer, row_ptr, col_ind, val, num_rows, num_x_rows, num_columns]() {
+                if (e_sum_buffer != NULL) {
+                    emulated_div_mat_vec(e_x_buffer, e_sum_buffer, num_x_rows, num_columns);
+                }
+                emulated_sp_mat_mat_multi(num_rows, row_ptr, col_ind, val, e_x_buffer, num_x_rows, e_y, num_columns);
+            }, device->get_compute_time(num_flops), device->stream_compute_);
+            device->record(&tile_done.at(buffer), device->stream_compute_);
+        }
+
+        if (mean_ && forward) {
+            device->wait(device->stream_compute_, &sum_in.at(row_buffer));
+            float *e_sum_buffer = e_sum_row.at(row_buffer);
+            device->launch([e_y, e_sum_buffer, num_rows, num_columns]() {
+                emulated_div_mat_vec(e_y, e_sum_buffer, num_rows, num_columns);
+            }, device->get_compute_time(num_rows * num_columns), device->stream_compute_);
+        }
+        device->record(&row_done.at(row_buffer), device->stream_compute_);
+
+        device->wait(device->stream_out_, &row_done.at(row_buffer));
+        device->memcpy_async(y->at(row).values_, e_y, y->at(row).size_ * sizeof(float), device->stream_out_);
+        device->record(&y_out, device->stream_out_);
+    }
+
+    device->synchronize();
+
+    device->deallocate(e_y);
+    for (long i = 0; i < num_steps_; ++i) {
+        if (e_sum_row.at(i) != NULL) {
+            device->deallocate(e_sum_row.at(i));
+        }
+        device->deallocate(e_row_ptr.at(i));
+        device->deallocate(e_col_ind.at(i));
+        device->deallocate(e_val.at(i));
+        device->deallocate(e_x.at(i));
+        if (e_sum_column.at(i) != NULL) {
+            device->deallocate(e_sum_column.at(i));
+        }
+    }
+}
+
 std::vector<Matrix<float>> *FeatureAggregationPipelined::forward(std::vector<Matrix<float>> *x) {
     for (int i = 0; i < num_chunks_; ++i) {
         to_column_major_inplace(&x->at(i));
     }
+    if (emulated_device_ != NULL) {
+        run_emulated(x, &y_, true);
+        return &y_;
+    }
+    get_hybrid_tiles();
 
-    check_cuda(cudaMalloc(&d_y_, y_.at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_y_, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
     if (mean_) {
-        check_cuda(cudaMalloc(&d_sum_forward_, y_.at(0).num_rows_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_sum_forward_, chunk_size_ * sizeof(float)));
     }
-    long adj_max_nnz = max_nnz(adjacencies_);
     for (int i = 0; i < num_steps_; ++i) {
-        d_adj_.at(i).set(chunk_size_, chunk_size_, adj_max_nnz);
-        check_cuda(cudaMalloc(&d_x_.at(i), x->at(0).size_ * sizeof(float)));
+        d_adj_.at(i).set(chunk_size_, chunk_size_, tile_index_.max_nnz);
+        if (hybrid_tiles_->max_num_slices_ > 0) {
+            d_hybrid_.at(i).set(chunk_size_, chunk_size_, hybrid_tiles_->max_slice_size_, hybrid_tiles_->max_num_slices_, hybrid_tiles_->max_sell_size_, hybrid_tiles_->max_hub_nnz_);
+        }
+        check_cuda(cudaMalloc(&d_x_.at(i), chunk_size_ * x->at(0).num_columns_ * sizeof(float)));
     }
 
     for (long row = 0; row < num_chunks_; ++row) {
@@ -319,45 +735,34 @@ std::vector<Matrix<float>> *FeatureAggregationPipelined::forward(std::vector<Mat
                                    cuda_helper_->stream_in_));
 
         if (mean_) {
-            check_cuda(cudaMemcpyAsync(d_sum_forward_, &adjacency_row_sum_->values_[row * chunk_size_],
+            check_cuda(cudaMemcpyAsync(d_sum_forward_, &adjacency_row_sum_->values_[boundaries_.at(row)],
                                        y_.at(row).num_rows_ * sizeof(float), cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
         }
 
-        for (long column = 0; column < num_chunks_ + 1; ++column) {
-            long column_a = (column / 2) * 2;
-            long column_b = ((column - 1) / 2) * 2 + 1;
-            SparseMatrix<float> *adj_a;
-            SparseMatrix<float> *adj_b;
-            if (column_a < num_chunks_)
-                adj_a = &adjacencies_->at(row * num_chunks_ + column_a);
-            if (column_b < num_chunks_)
-                adj_b = &adjacencies_->at(row * num_chunks_ + column_b);
-
-            if (column % 2 == 0) {
-                // a in, b compute
-                if (column_a < num_chunks_ && adj_a->nnz_ > 0) {
-                    memcpy_sp_mat_async(&d_adj_.at(0), adj_a, cuda_helper_->stream_in_);
-
-                    check_cuda(cudaMemcpyAsync(d_x_.at(0), x->at(column_a).values_, x->at(column_a).size_ * sizeof(float),
-                                               cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
-                }
-
-                if (column > 0 && adj_b->nnz_ > 0) {
-                    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_.at(1), d_x_.at(1), d_y_,
-                                          x->at(column_b).num_columns_, true);
+        // tile k is copied in while tile k - 1 is multiplied, empty tiles are never scheduled
+        std::vector<long> *columns = &tile_index_.non_empty.at(row);
+        long num_tiles = columns->size();
+        for (long k = 0; k < num_tiles + 1; ++k) {
+            if (k < num_tiles) {
+                long column = columns->at(k);
+                if (hybrid_tiles_->is_hybrid_.at(row * num_chunks_ + column)) {
+                    memcpy_hybrid_async(&d_hybrid_.at(k % 2), &hybrid_tiles_->hybrids_.at(row * num_chunks_ + column), cuda_helper_->stream_in_);
+                } else {
+                    memcpy_sp_mat_async(&d_adj_.at(k % 2), &adjacencies_->at(row * num_chunks_ + column), cuda_helper_->stream_in_);
                 }
-            } else {
-                // b in, a compute
-                if (column_b < num_chunks_ && adj_b->nnz_ > 0) {
-                    memcpy_sp_mat_async(&d_adj_.at(1), adj_b, cuda_helper_->stream_in_);
 
-                    check_cuda(cudaMemcpyAsync(d_x_.at(1), x->at(column_b).values_, x->at(column_b).size_ * sizeof(float),
-                                               cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
-                }
+                check_cuda(cudaMemcpyAsync(d_x_.at(k % 2), x->at(column).values_, x->at(column).size_ * sizeof(float),
+                                           cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
+            }
 
-                if (adj_a->nnz_ > 0) {
-                    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_.at(0), d_x_.at(0), d_y_,
-                                          x->at(column_a).num_columns_, true);
+            if (k > 0) {
+                long column = columns->at(k - 1);
+                if (hybrid_tiles_->is_hybrid_.at(row * num_chunks_ + column)) {
+                    hybrid_mat_mat_multi_cuda(cuda_helper_, &d_hybrid_.at((k - 1) % 2), d_x_.at((k - 1) % 2), d_y_,
+                                              x->at(column).num_columns_, true);
+                } else {
+                    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_.at((k - 1) % 2), d_x_.at((k - 1) % 2), d_y_,
+                                          x->at(column).num_columns_, true);
                 }
             }
 
@@ -382,6 +787,7 @@ std::vector<Matrix<float>> *FeatureAggregationPipelined::forward(std::vector<Mat
     for (long i = 0; i < num_steps_; ++i) {
         check_cuda(cudaFree(d_x_.at(i)));
         d_adj_.at(i).free();
+        d_hybrid_.at(i).free();
     }
 
     return &y_;
@@ -391,80 +797,63 @@ std::vector<Matrix<float>> *FeatureAggregationPipelined::backward(std::vector<Ma
     for (long i = 0; i < num_chunks_; ++i) {
         to_column_major_inplace(&incoming_gradients->at(i));
     }
+    if (emulated_device_ != NULL) {
+        run_emulated(incoming_gradients, &gradients_, false);
+        return &gradients_;
+    }
+    get_hybrid_tiles();
 
-    check_cuda(cudaMalloc(&d_gradients_, gradients_.at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_gradients_, chunk_size_ * gradients_.at(0).num_columns_ * sizeof(float)));
 
-    long adj_max_nnz = max_nnz(adjacencies_);
     for (long i = 0; i < num_steps_; ++i) {
-        d_adj_.at(i).set(chunk_size_, chunk_size_, adj_max_nnz);
-        check_cuda(cudaMalloc(&d_incoming_gradients_.at(i), incoming_gradients->at(0).size_ * sizeof(float)));
+        d_adj_.at(i).set(chunk_size_, chunk_size_, tile_index_.max_nnz);
+        if (hybrid_tiles_->max_num_slices_ > 0) {
+            d_hybrid_.at(i).set(chunk_size_, chunk_size_, hybrid_tiles_->max_slice_size_, hybrid_tiles_->max_num_slices_, hybrid_tiles_->max_sell_size_, hybrid_tiles_->max_hub_nnz_);
+        }
+        check_cuda(cudaMalloc(&d_incoming_gradients_.at(i), chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
         if (mean_) {
-            check_cuda(cudaMalloc(&d_sum_backward_.at(i), incoming_gradients->at(0).num_rows_ * sizeof(float)));
+            check_cuda(cudaMalloc(&d_sum_backward_.at(i), chunk_size_ * sizeof(float)));
         }
     }
 
     for (long row = 0; row < num_chunks_; ++row) {
         check_cuda(cudaMemsetAsync(d_gradients_, 0, gradients_.at(row).size_ * sizeof(float), cuda_helper_->stream_in_));
 
-        for (long column = 0; column < num_chunks_ + 1; ++column) {
-            long column_a = (column / 2) * 2;
-            long column_b = ((column - 1) / 2) * 2 + 1;
-            SparseMatrix<float> *adj_a;
-            SparseMatrix<float> *adj_b;
-            if (column_a < num_chunks_)
-                adj_a = &adjacencies_->at(row * num_chunks_ + column_a);
-            if (column_b < num_chunks_)
-                adj_b = &adjacencies_->at(row * num_chunks_ + column_b);
-
-            if (column % 2 == 0) {
-                // a in, b compute
-                if (column_a < num_chunks_ && adj_a->nnz_ > 0) {
-                    memcpy_sp_mat_async(&d_adj_.at(0), adj_a, cuda_helper_->stream_in_);
-
-                    check_cuda(cudaMemcpyAsync(d_incoming_gradients_.at(0), incoming_gradients->at(column_a).values_,
-                                               incoming_gradients->at(column_a).size_ * sizeof(float), cudaMemcpyHostToDevice,
-                                               cuda_helper_->stream_in_));
-
-                    if (mean_) {
-                        check_cuda(cudaMemcpyAsync(d_sum_backward_.at(0), &adjacency_row_sum_->values_[column_a * chunk_size_],
-                                                   incoming_gradients->at(column_a).num_rows_ * sizeof(float),
-                                                   cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
-                    }
+        std::vector<long> *columns = &tile_index_.non_empty.at(row);
+        long num_tiles = columns->size();
+        for (long k = 0; k < num_tiles + 1; ++k) {
+            if (k < num_tiles) {
+                long column = columns->at(k);
+                if (hybrid_tiles_->is_hybrid_.at(row * num_chunks_ + column)) {
+                    memcpy_hybrid_async(&d_hybrid_.at(k % 2), &hybrid_tiles_->hybrids_.at(row * num_chunks_ + column), cuda_helper_->stream_in_);
+                } else {
+                    memcpy_sp_mat_async(&d_adj_.at(k % 2), &adjacencies_->at(row * num_chunks_ + column), cuda_helper_->stream_in_);
                 }
 
-                if (column > 0 && adj_b->nnz_ > 0) {
-                    if (mean_) {
-                        div_mat_vec(d_incoming_gradients_.at(1), d_sum_backward_.at(1), incoming_gradients->at(column_b).num_rows_,
-                                    incoming_gradients->at(column_b).num_columns_);
-                    }
+                check_cuda(cudaMemcpyAsync(d_incoming_gradients_.at(k % 2), incoming_gradients->at(column).values_,
+                                           incoming_gradients->at(column).size_ * sizeof(float), cudaMemcpyHostToDevice,
+                                           cuda_helper_->stream_in_));
 
-                    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_.at(1), d_incoming_gradients_.at(1), d_gradients_,
-                                          incoming_gradients->at(column_b).num_columns_, true);
-                }
-            } else {
-                // b in, a compute
-                if (column_b < num_chunks_ && adj_b->nnz_ > 0) {
-                    memcpy_sp_mat_async(&d_adj_.at(1), adj_b, cuda_helper_->stream_in_);
-
-                    check_cuda(cudaMemcpyAsync(d_incoming_gradients_.at(1), incoming_gradients->at(column_b).values_,
-                                               incoming_gradients->at(column_b).size_ * sizeof(float), cudaMemcpyHostToDevice,
-                                               cuda_helper_->stream_in_));
-
-                    if (mean_) {
-                        check_cuda(cudaMemcpyAsync(d_sum_backward_.at(1), &adjacency_row_sum_->values_[column_b * chunk_size_],
-                                                   incoming_gradients->at(column_b).num_rows_ * sizeof(float),
-                                                   cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
-                    }
+                if (mean_) {
+                    check_cuda(cudaMemcpyAsync(d_sum_backward_.at(k % 2), &adjacency_row_sum_->values_[boundaries_.at(column)],
+                                               incoming_gradients->at(column).num_rows_ * sizeof(float),
+                                               cudaMemcpyHostToDevice, cuda_helper_->stream_in_));
                 }
+            }
 
-                if (column > 0 && adj_a->nnz_ > 0) {
-                    if (mean_) {
-                        div_mat_vec(d_incoming_gradients_.at(0), d_sum_backward_.at(0), incoming_gradients->at(column_a).num_rows_,
-                                    incoming_gradients->at(column_a).num_columns_);
-                    }
+            if (k > 0) {
+                long column = columns->at(k - 1);
+                if (mean_) {
+                    div_mat_vec(d_incoming_gradients_.at((k - 1) % 2), d_sum_backward_.at((k - 1) % 2),
+                                incoming_gradients->at(column).num_rows_, incoming_gradients->at(column).num_columns_);
+                }
 
-                    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_.at(0), d_incoming_gradients_.at(0), d_gradients_,
-                                          incoming_gradients->at(column_a).num_columns_, true);
+                if (hybrid_tiles_->is_hybrid_.at(row * num_chunks_ + column)) {
+                    hybrid_mat_mat_multi_cuda(cuda_helper_, &d_hybrid_.at((k - 1) % 2), d_incoming_gradients_.at((k - 1) % 2), d_gradients_,
+                                              incoming_gradients->at(column).num_columns_, true);
+                } else {
+                    sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_.at((k - 1) % 2), d_incoming_gradients_.at((k - 1) % 2), d_gradients_,
+                                          incoming_gradients->at(column).num_columns_, true);
                 }
             }
 
@@ -481,6 +870,7 @@ std::vector<Matrix<float>> *FeatureAggregationPipelined::backward(std::vector<Ma
     check_cuda(cudaFree(d_gradients_));
     for (long i = 0; i < num_steps_; ++i) {
         d_adj_.at(i).free();
+        d_hybrid_.at(i).free();
         check_cuda(cudaFree(d_incoming_gradients_.at(i)));
         if (mean_) {
             check_cuda(cudaFree(d_sum_backward_.at(i)));
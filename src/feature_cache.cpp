@@ -0,0 +1,67 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "feature_cache.hpp"
+
+#include <algorithm>
+
+
+void get_in_degrees(SparseMatrix<float> *adjacency, std::vector<long> *in_degrees) {
+    in_degrees->assign(adjacency->num_columns_, 0);
+    for (long k = 0; k < adjacency->nnz_; ++k) {
+        in_degrees->at(adjacency->csr_col_ind_[k]) = in_degrees->at(adjacency->csr_col_ind_[k]) + 1;
+    }
+}
+
+void get_hot_nodes(std::vector<long> *in_degrees, long num_nodes, std::vector<int> *nodes) {
+    num_nodes = std::min(num_nodes, (long) in_degrees->size());
+    nodes->resize(in_degrees->size());
+    for (long i = 0; i < (long) in_degrees->size(); ++i) {
+        nodes->at(i) = i;
+    }
+    std::partial_sort(nodes->begin(), nodes->begin() + num_nodes, nodes->end(), [in_degrees](int a, int b) {
+        return in_degrees->at(a) > in_degrees->at(b) || (in_degrees->at(a) == in_degrees->at(b) && a < b);
+    });
+    nodes->resize(num_nodes);
+}
+
+FeatureCache::FeatureCache() {}
+
+FeatureCache::FeatureCache(SparseMatrix<float> *adjacency, Matrix<float> *features, long num_cached) {
+    set(adjacency, features, num_cached);
+}
+
+void FeatureCache::set(SparseMatrix<float> *adjacency, Matrix<float> *features, long num_cached) {
+    if (adjacency->num_columns_ != features->num_rows_) {
+        throw "Adjacency and features do not match";
+    }
+    num_nodes_ = features->num_rows_;
+    num_features_ = features->num_columns_;
+
+    std::vector<long> in_degrees;
+    get_in_degrees(adjacency, &in_degrees);
+    get_hot_nodes(&in_degrees, num_cached, &nodes_);
+
+    // written by the thread that builds the cache, so first touch puts the buffer on its NUMA node
+    slots_.assign(num_nodes_, -1);
+    values_.resize(nodes_.size() * num_features_);
+    for (long slot = 0; slot < (long) nodes_.size(); ++slot) {
+        long node = nodes_.at(slot);
+        slots_.at(node) = slot;
+        float *row = values_.data() + slot * num_features_;
+        if (features->is_row_major_) {
+            std::copy(features->values_ + node * num_features_, features->values_ + (node + 1) * num_features_, row);
+        } else {
+            for (long column = 0; column < num_features_; ++column) {
+                row[column] = features->values_[column * num_nodes_ + node];
+            }
+        }
+    }
+}
+
+float *FeatureCache::get_row(long node) {
+    int slot = slots_[node];
+    if (slot == -1) {
+        return NULL;
+    }
+    return values_.data() + slot * num_features_;
+}
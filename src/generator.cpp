@@ -0,0 +1,190 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "generator.hpp"
+
+#include "cnpy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <thread>
+
+
+// every batch has its own generator, so the output does not depend on the number of threads
+std::mt19937_64 get_generator(long seed, long stream, long batch) {
+    std::seed_seq seq{seed, stream, batch};
+    return std::mt19937_64(seq);
+}
+
+// uniform in [0, 1), cheaper than uniform_real_distribution in the per-level loop
+double next_uniform(std::mt19937_64 *generator) {
+    return ((*generator)() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+long rmat_node(std::mt19937_64 *generator, GeneratorOptions *options, long scale, long *destination) {
+    long source = 0;
+    *destination = 0;
+    for (long level = 0; level < scale; ++level) {
+        double r = next_uniform(generator);
+        source = source << 1;
+        *destination = *destination << 1;
+        // quadrants a, b, c and d are top left, top right, bottom left and bottom right
+        if (r >= options->a + options->b) {
+            source = source + 1;
+        }
+        if ((r >= options->a && r < options->a + options->b) || r >= options->a + options->b + options->c) {
+            *destination = *destination + 1;
+        }
+    }
+    return source;
+}
+
+// inverse transform sampling of node ranks with probability proportional to (rank + 1)^(-1 / (exponent - 1))
+long power_law_node(std::mt19937_64 *generator, GeneratorOptions *options) {
+    double alpha = 1.0 - 1.0 / (options->exponent - 1.0);
+    double max_mass = std::pow((double) options->num_nodes + 1.0, alpha) - 1.0;
+    long node = std::pow(next_uniform(generator) * max_mass + 1.0, 1.0 / alpha) - 1.0;
+    return std::min(std::max(node, 0l), options->num_nodes - 1);
+}
+
+void generate_edges(GeneratorOptions *options, std::vector<int> *permutation, long batch, std::vector<Edge> *edges) {
+    std::mt19937_64 generator = get_generator(options->seed, 0, batch);
+    long scale = std::ceil(std::log2((double) options->num_nodes));
+    long num_edges = std::min(options->batch_size, options->num_edges - batch * options->batch_size);
+
+    edges->clear();
+    for (long i = 0; i < num_edges; ++i) {
+        long source;
+        long destination;
+        if (options->model == rmat) {
+            // ids outside of the graph are redrawn when the number of nodes is not a power of two
+            do {
+                source = rmat_node(&generator, options, scale, &destination);
+            } while (source >= options->num_nodes || destination >= options->num_nodes);
+        } else {
+            source = power_law_node(&generator, options);
+            destination = power_law_node(&generator, options);
+        }
+        if (options->permute) {
+            source = permutation->at(source);
+            destination = permutation->at(destination);
+        }
+        edges->push_back(Edge(source, destination));
+    }
+}
+
+void generate_edges_symmetric(GeneratorOptions *options, std::vector<int> *permutation, long batch, bool symmetrize,
+                              std::vector<Edge> *edges) {
+    generate_edges(options, permutation, batch, edges);
+    if (symmetrize) {
+        long num_edges = edges->size();
+        for (long i = 0; i < num_edges; ++i) {
+            if (edges->at(i).first != edges->at(i).second) {
+                edges->push_back(Edge(edges->at(i).second, edges->at(i).first));
+            }
+        }
+    }
+}
+
+long generate_graph(std::string csr_path, GeneratorOptions *options, IngestOptions *ingest_options) {
+    if (options->num_nodes < 1 || options->num_nodes > 2147483647) {
+        throw "Number of nodes does not fit into int";
+    }
+    if (options->model == rmat && options->a + options->b + options->c > 1.0) {
+        throw "R-MAT probabilities sum up to more than one";
+    }
+    if (options->model == power_law && options->exponent <= 2.0) {
+        throw "Power-law exponent has to be larger than two";
+    }
+    long num_threads = get_num_threads(ingest_options);
+
+    std::vector<int> permutation;
+    if (options->permute) {
+        permutation.resize(options->num_nodes);
+        for (long i = 0; i < options->num_nodes; ++i) {
+            permutation.at(i) = i;
+        }
+        std::mt19937_64 generator = get_generator(options->seed, 3, 0);
+        std::shuffle(permutation.begin(), permutation.end(), generator);
+    }
+
+    long num_batches = (options->num_edges + options->batch_size - 1) / options->batch_size;
+    std::vector<Edge> edges;
+    std::vector<std::string> run_paths;
+    std::vector<std::vector<Edge>> thread_edges(num_threads);
+    std::vector<std::thread> threads(num_threads);
+    for (long batch = 0; batch < num_batches; batch = batch + num_threads) {
+        long num_round_batches = std::min(num_threads, num_batches - batch);
+        for (long t = 0; t < num_round_batches; ++t) {
+            threads.at(t) = std::thread(generate_edges_symmetric, options, &permutation, batch + t,
+                                        ingest_options->symmetrize, &thread_edges.at(t));
+        }
+        for (long t = 0; t < num_round_batches; ++t) {
+            threads.at(t).join();
+            buffer_edges(&edges, &thread_edges.at(t), &run_paths, ingest_options);
+        }
+    }
+
+    return write_sorted_csr(&edges, &run_paths, csr_path, options->num_nodes, ingest_options);
+}
+
+void generate_feature_block(GeneratorOptions *options, long block, long num_rows, std::vector<float> *values) {
+    std::mt19937_64 generator = get_generator(options->seed, 1, block);
+    std::normal_distribution<float> normal(0.0, 1.0);
+    values->resize(num_rows * options->num_features);
+    for (long i = 0; i < (long) values->size(); ++i) {
+        values->at(i) = normal(generator);
+    }
+}
+
+void generate_label_block(GeneratorOptions *options, long block, long num_rows, std::vector<int> *values) {
+    std::mt19937_64 generator = get_generator(options->seed, 2, block);
+    std::uniform_int_distribution<int> uniform(0, options->num_classes - 1);
+    values->resize(num_rows);
+    for (long i = 0; i < num_rows; ++i) {
+        values->at(i) = uniform(generator);
+    }
+}
+
+// draws blocks of rows in parallel and appends them to the npy file in order
+template<typename T>
+long generate_table(std::string npy_path, GeneratorOptions *options, IngestOptions *ingest_options,
+                    long num_columns, bool is_vector,
+                    void (*generate_block)(GeneratorOptions *, long, long, std::vector<T> *)) {
+    long num_threads = get_num_threads(ingest_options);
+    long block_rows = std::max(options->batch_size / num_columns, 1l);
+    long num_blocks = (options->num_nodes + block_rows - 1) / block_rows;
+
+    std::vector<std::vector<T>> thread_values(num_threads);
+    std::vector<std::thread> threads(num_threads);
+    for (long block = 0; block < num_blocks; block = block + num_threads) {
+        long num_round_blocks = std::min(num_threads, num_blocks - block);
+        for (long t = 0; t < num_round_blocks; ++t) {
+            long num_rows = std::min(block_rows, options->num_nodes - (block + t) * block_rows);
+            threads.at(t) = std::thread(generate_block, options, block + t, num_rows, &thread_values.at(t));
+        }
+        for (long t = 0; t < num_round_blocks; ++t) {
+            threads.at(t).join();
+            std::vector<size_t> shape;
+            shape.push_back(thread_values.at(t).size() / num_columns);
+            if (!is_vector) {
+                shape.push_back(num_columns);
+            }
+            if (block + t == 0) {
+                cnpy::npy_save<T>(npy_path, thread_values.at(t).data(), shape, "w");
+            } else {
+                cnpy::npy_save<T>(npy_path, thread_values.at(t).data(), shape, "a");
+            }
+        }
+    }
+
+    return options->num_nodes;
+}
+
+long generate_features(std::string npy_path, GeneratorOptions *options, IngestOptions *ingest_options) {
+    return generate_table<float>(npy_path, options, ingest_options, options->num_features, false, generate_feature_block);
+}
+
+long generate_labels(std::string npy_path, GeneratorOptions *options, IngestOptions *ingest_options) {
+    return generate_table<int>(npy_path, options, ingest_options, 1, true, generate_label_block);
+}
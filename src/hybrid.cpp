@@ -0,0 +1,375 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "hybrid.hpp"
+#include "sellmm.h"
+#include "sparse_computation.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <thread>
+
+
+HybridSparseMatrixCuda::HybridSparseMatrixCuda() {}
+
+HybridSparseMatrixCuda::~HybridSparseMatrixCuda() {
+    free();
+}
+
+void HybridSparseMatrixCuda::set(long num_rows, long num_columns, long slice_size, long num_slices, long sell_size, long hub_nnz) {
+    free();
+    num_rows_ = num_rows;
+    num_columns_ = num_columns;
+    slice_size_ = slice_size;
+    num_slices_ = num_slices;
+
+    check_cuda(cudaMalloc(&slice_ptr_, (num_slices + 1) * sizeof(int)));
+    check_cuda(cudaMalloc(&slice_rows_, num_slices * slice_size * sizeof(int)));
+    check_cuda(cudaMalloc(&sell_col_ind_, sell_size * sizeof(int)));
+    check_cuda(cudaMalloc(&sell_val_, sell_size * sizeof(float)));
+    hubs_.set(num_rows, num_columns, hub_nnz);
+    freed_ = false;
+}
+
+void HybridSparseMatrixCuda::free() {
+    if (!freed_) {
+        check_cuda(cudaFree(slice_ptr_));
+        check_cuda(cudaFree(slice_rows_));
+        check_cuda(cudaFree(sell_col_ind_));
+        check_cuda(cudaFree(sell_val_));
+        hubs_.free();
+
+        slice_ptr_ = NULL;
+        slice_rows_ = NULL;
+        sell_col_ind_ = NULL;
+        sell_val_ = NULL;
+        freed_ = true;
+    }
+}
+
+void get_degree_histogram(SparseMatrix<float> *sp_mat, std::vector<long> *histogram) {
+    histogram->assign(33, 0);
+    for (long row = 0; row < sp_mat->num_rows_; ++row) {
+        long degree = sp_mat->csr_row_ptr_[row + 1] - sp_mat->csr_row_ptr_[row];
+        long bucket = 0;
+        while (degree > 0) {
+            degree = degree >> 1;
+            bucket = bucket + 1;
+        }
+        histogram->at(bucket) = histogram->at(bucket) + 1;
+    }
+}
+
+long get_hub_degree(SparseMatrix<float> *sp_mat) {
+    if (sp_mat->num_rows_ == 0 || sp_mat->nnz_ == 0) {
+        return 0;
+    }
+    double mean_degree = (double) sp_mat->nnz_ / (double) sp_mat->num_rows_;
+    // long rows are already efficient in CSR
+    if (mean_degree > 32.0) {
+        return 0;
+    }
+
+    std::vector<long> histogram;
+    get_degree_histogram(sp_mat, &histogram);
+
+    // hubs are the buckets from eight times the mean degree on
+    long hub_bucket = 1;
+    while ((double) (1l << (hub_bucket - 1)) < 8.0 * std::max(mean_degree, 1.0)) {
+        hub_bucket = hub_bucket + 1;
+    }
+    // lower bound of the non-zeros in hub rows, a few hubs with few non-zeros do not unbalance the threads
+    double hub_nnz = 0.0;
+    for (long bucket = hub_bucket; bucket < (long) histogram.size(); ++bucket) {
+        hub_nnz = hub_nnz + (double) histogram.at(bucket) * (double) (1l << (bucket - 1));
+    }
+    if (hub_nnz < 0.1 * (double) sp_mat->nnz_) {
+        return 0;
+    }
+
+    return (1l << (hub_bucket - 1)) - 1;
+}
+
+void to_hybrid(SparseMatrix<float> *sp_mat, long hub_degree, long slice_size, long sort_window, HybridSparseMatrix *hybrid) {
+    long num_rows = sp_mat->num_rows_;
+    hybrid->num_rows_ = num_rows;
+    hybrid->num_columns_ = sp_mat->num_columns_;
+    hybrid->nnz_ = sp_mat->nnz_;
+    hybrid->hub_degree_ = hub_degree;
+    hybrid->slice_size_ = slice_size;
+    hybrid->num_slices_ = ceil((double) num_rows / (double) slice_size);
+
+    // hubs have no entries in the slices
+    std::vector<int> degrees(num_rows);
+    hybrid->hub_rows_.clear();
+    hybrid->hub_row_ptr_.assign(num_rows + 1, 0);
+    for (long row = 0; row < num_rows; ++row) {
+        long degree = sp_mat->csr_row_ptr_[row + 1] - sp_mat->csr_row_ptr_[row];
+        if (degree > hub_degree) {
+            hybrid->hub_rows_.push_back(row);
+            degrees.at(row) = 0;
+            hybrid->hub_row_ptr_.at(row + 1) = degree;
+        } else {
+            degrees.at(row) = degree;
+        }
+    }
+    for (long row = 0; row < num_rows; ++row) {
+        hybrid->hub_row_ptr_.at(row + 1) = hybrid->hub_row_ptr_.at(row + 1) + hybrid->hub_row_ptr_.at(row);
+    }
+    hybrid->hub_nnz_ = hybrid->hub_row_ptr_.at(num_rows);
+    hybrid->hub_col_ind_.resize(hybrid->hub_nnz_);
+    hybrid->hub_val_.resize(hybrid->hub_nnz_);
+    for (long i = 0; i < (long) hybrid->hub_rows_.size(); ++i) {
+        long row = hybrid->hub_rows_.at(i);
+        std::copy(sp_mat->csr_col_ind_ + sp_mat->csr_row_ptr_[row], sp_mat->csr_col_ind_ + sp_mat->csr_row_ptr_[row + 1],
+                  hybrid->hub_col_ind_.begin() + hybrid->hub_row_ptr_.at(row));
+        std::copy(sp_mat->csr_val_ + sp_mat->csr_row_ptr_[row], sp_mat->csr_val_ + sp_mat->csr_row_ptr_[row + 1],
+                  hybrid->hub_val_.begin() + hybrid->hub_row_ptr_.at(row));
+    }
+
+    // rows sorted by degree within windows of sigma rows, so the rows of a slice have similar lengths
+    std::vector<int> order(num_rows);
+    for (long row = 0; row < num_rows; ++row) {
+        order.at(row) = row;
+    }
+    sort_window = std::max(sort_window / slice_size, 1l) * slice_size;
+    for (long start = 0; start < num_rows; start = start + sort_window) {
+        std::stable_sort(order.begin() + start, order.begin() + std::min(start + sort_window, num_rows), [&degrees](int a, int b) {
+            return degrees.at(a) > degrees.at(b);
+        });
+    }
+
+    // slices are as wide as their longest row
+    hybrid->slice_ptr_.assign(hybrid->num_slices_ + 1, 0);
+    hybrid->slice_rows_.assign(hybrid->num_slices_ * slice_size, -1);
+    long sell_size = 0;
+    for (long slice = 0; slice < hybrid->num_slices_; ++slice) {
+        long width = 0;
+        for (long lane = 0; lane < slice_size && slice * slice_size + lane < num_rows; ++lane) {
+            int row = order.at(slice * slice_size + lane);
+            hybrid->slice_rows_.at(slice * slice_size + lane) = row;
+            width = std::max(width, (long) degrees.at(row));
+        }
+        sell_size = sell_size + width * slice_size;
+        if (sell_size > INT_MAX) {
+            throw "Padded matrix is too large for int indices";
+        }
+        hybrid->slice_ptr_.at(slice + 1) = sell_size;
+    }
+
+    hybrid->sell_col_ind_.assign(sell_size, 0);
+    hybrid->sell_val_.assign(sell_size, 0.0);
+    for (long slice = 0; slice < hybrid->num_slices_; ++slice) {
+        for (long lane = 0; lane < slice_size; ++lane) {
+            int row = hybrid->slice_rows_.at(slice * slice_size + lane);
+            if (row < 0) {
+                continue;
+            }
+            for (long k = 0; k < degrees.at(row); ++k) {
+                long position = hybrid->slice_ptr_.at(slice) + k * slice_size + lane;
+                hybrid->sell_col_ind_.at(position) = sp_mat->csr_col_ind_[sp_mat->csr_row_ptr_[row] + k];
+                hybrid->sell_val_.at(position) = sp_mat->csr_val_[sp_mat->csr_row_ptr_[row] + k];
+            }
+        }
+    }
+}
+
+bool to_hybrid_if_skewed(SparseMatrix<float> *sp_mat, HybridSparseMatrix *hybrid) {
+    long hub_degree = get_hub_degree(sp_mat);
+    if (hub_degree == 0) {
+        return false;
+    }
+    // a slice is a warp, a sort window a few slices
+    to_hybrid(sp_mat, hub_degree, 32, 1024, hybrid);
+    return true;
+}
+
+void sell_mat_mat_multi_range(HybridSparseMatrix *sp_mat, Matrix<float> *mat, Matrix<float> *result, bool add_to_result,
+                              long start_slice, long end_slice) {
+    long slice_size = sp_mat->slice_size_;
+    std::vector<float> sums(slice_size);
+    for (long slice = start_slice; slice < end_slice; ++slice) {
+        int *rows = &sp_mat->slice_rows_.at(slice * slice_size);
+        for (long column = 0; column < mat->num_columns_; ++column) {
+            float *mat_column = &mat->values_[column * mat->num_rows_];
+            std::fill(sums.begin(), sums.end(), 0.0);
+            // the lanes of a slice are independent, the inner loop vectorizes
+            for (long position = sp_mat->slice_ptr_.at(slice); position < sp_mat->slice_ptr_.at(slice + 1); position = position + slice_size) {
+                int *col_ind = &sp_mat->sell_col_ind_.at(position);
+                float *val = &sp_mat->sell_val_.at(position);
+                for (long lane = 0; lane < slice_size; ++lane) {
+                    sums[lane] = sums[lane] + val[lane] * mat_column[col_ind[lane]];
+                }
+            }
+            float *result_column = &result->values_[column * result->num_rows_];
+            for (long lane = 0; lane < slice_size; ++lane) {
+                if (rows[lane] < 0) {
+                    continue;
+                }
+                if (add_to_result) {
+                    result_column[rows[lane]] = result_column[rows[lane]] + sums[lane];
+                } else {
+                    result_column[rows[lane]] = sums[lane];
+                }
+            }
+        }
+    }
+}
+
+// hub non-zeros from start to end, partial sums of the touched hub rows go to sums
+void hub_mat_mat_multi_range(HybridSparseMatrix *sp_mat, Matrix<float> *mat, long start, long end,
+                             std::vector<int> *rows, std::vector<float> *sums) {
+    long num_hubs = sp_mat->hub_rows_.size();
+    long hub = std::upper_bound(sp_mat->hub_rows_.begin(), sp_mat->hub_rows_.end(), start, [sp_mat](long position, int row) {
+                   return position < sp_mat->hub_row_ptr_.at(row + 1);
+               })
+               - sp_mat->hub_rows_.begin();
+    rows->clear();
+    sums->clear();
+    for (; hub < num_hubs && sp_mat->hub_row_ptr_.at(sp_mat->hub_rows_.at(hub)) < end; ++hub) {
+        int row = sp_mat->hub_rows_.at(hub);
+        long row_start = std::max((long) sp_mat->hub_row_ptr_.at(row), start);
+        long row_end = std::min((long) sp_mat->hub_row_ptr_.at(row + 1), end);
+        rows->push_back(row);
+        for (long column = 0; column < mat->num_columns_; ++column) {
+            float *mat_column = &mat->values_[column * mat->num_rows_];
+            float sum = 0.0;
+            for (long j = row_start; j < row_end; ++j) {
+                sum = sum + sp_mat->hub_val_.at(j) * mat_column[sp_mat->hub_col_ind_.at(j)];
+            }
+            sums->push_back(sum);
+        }
+    }
+}
+
+void to_hybrid_tiles(std::vector<SparseMatrix<float>> *tiles, HybridTiles *hybrid_tiles) {
+    long num_tiles = tiles->size();
+    hybrid_tiles->is_hybrid_ = std::vector<bool>(num_tiles, false);
+    hybrid_tiles->hybrids_ = std::vector<HybridSparseMatrix>(num_tiles);
+    hybrid_tiles->max_slice_size_ = 0;
+    hybrid_tiles->max_num_slices_ = 0;
+    hybrid_tiles->max_sell_size_ = 0;
+    hybrid_tiles->max_hub_nnz_ = 0;
+    for (long i = 0; i < num_tiles; ++i) {
+        HybridSparseMatrix *hybrid = &hybrid_tiles->hybrids_.at(i);
+        if (tiles->at(i).nnz_ == 0 || !to_hybrid_if_skewed(&tiles->at(i), hybrid)) {
+            continue;
+        }
+        hybrid_tiles->is_hybrid_.at(i) = true;
+        hybrid_tiles->max_slice_size_ = std::max(hybrid_tiles->max_slice_size_, hybrid->slice_size_);
+        hybrid_tiles->max_num_slices_ = std::max(hybrid_tiles->max_num_slices_, hybrid->num_slices_);
+        hybrid_tiles->max_sell_size_ = std::max(hybrid_tiles->max_sell_size_, (long) hybrid->sell_val_.size());
+        hybrid_tiles->max_hub_nnz_ = std::max(hybrid_tiles->max_hub_nnz_, hybrid->hub_nnz_);
+    }
+}
+
+void hybrid_mat_mat_multi(HybridSparseMatrix *sp_mat, Matrix<float> *mat, Matrix<float> *result, bool add_to_result) {
+    if (mat->num_rows_ != sp_mat->num_columns_ || result->num_rows_ != sp_mat->num_rows_ || result->num_columns_ != mat->num_columns_) {
+        throw "Matrix shapes do not match";
+    }
+    to_column_major_inplace(mat);
+    if (add_to_result) {
+        to_column_major_inplace(result);
+    }
+    result->is_row_major_ = false;
+
+    long num_threads = std::max((long) std::thread::hardware_concurrency(), 1l);
+    std::vector<std::thread> threads;
+
+    // short rows, every row is in exactly one lane
+    long slices_per_thread = ceil((double) sp_mat->num_slices_ / (double) num_threads);
+    for (long start = 0; start < sp_mat->num_slices_; start = start + slices_per_thread) {
+        threads.push_back(std::thread(sell_mat_mat_multi_range, sp_mat, mat, result, add_to_result,
+                                      start, std::min(start + slices_per_thread, sp_mat->num_slices_)));
+    }
+    for (long t = 0; t < (long) threads.size(); ++t) {
+        threads.at(t).join();
+    }
+
+    // hubs, every thread takes an equal share of non-zeros regardless of the rows they belong to
+    if (sp_mat->hub_nnz_ == 0) {
+        return;
+    }
+    threads.clear();
+    long nnz_per_thread = ceil((double) sp_mat->hub_nnz_ / (double) num_threads);
+    long num_ranges = ceil((double) sp_mat->hub_nnz_ / (double) nnz_per_thread);
+    std::vector<std::vector<int>> rows(num_ranges);
+    std::vector<std::vector<float>> sums(num_ranges);
+    for (long i = 0; i < num_ranges; ++i) {
+        threads.push_back(std::thread(hub_mat_mat_multi_range, sp_mat, mat, i * nnz_per_thread,
+                                      std::min((i + 1) * nnz_per_thread, sp_mat->hub_nnz_), &rows.at(i), &sums.at(i)));
+    }
+    for (long t = 0; t < (long) threads.size(); ++t) {
+        threads.at(t).join();
+    }
+    for (long i = 0; i < num_ranges; ++i) {
+        for (long k = 0; k < (long) rows.at(i).size(); ++k) {
+            for (long column = 0; column < mat->num_columns_; ++column) {
+                float *value = &result->values_[column * result->num_rows_ + rows.at(i).at(k)];
+                *value = *value + sums.at(i).at(k * mat->num_columns_ + column);
+            }
+        }
+    }
+}
+
+void copy_hybrid_sizes(HybridSparseMatrixCuda *d_sp_mat, HybridSparseMatrix *sp_mat) {
+    d_sp_mat->num_rows_ = sp_mat->num_rows_;
+    d_sp_mat->num_columns_ = sp_mat->num_columns_;
+    d_sp_mat->slice_size_ = sp_mat->slice_size_;
+    d_sp_mat->num_slices_ = sp_mat->num_slices_;
+    d_sp_mat->hubs_.num_rows_ = sp_mat->num_rows_;
+    d_sp_mat->hubs_.num_columns_ = sp_mat->num_columns_;
+    d_sp_mat->hubs_.nnz_ = sp_mat->hub_nnz_;
+}
+
+void malloc_memcpy_hybrid(HybridSparseMatrixCuda *d_sp_mat, HybridSparseMatrix *sp_mat) {
+    d_sp_mat->set(sp_mat->num_rows_, sp_mat->num_columns_, sp_mat->slice_size_, sp_mat->num_slices_,
+                  sp_mat->sell_val_.size(), sp_mat->hub_nnz_);
+    copy_hybrid_sizes(d_sp_mat, sp_mat);
+
+    check_cuda(cudaMemcpy(d_sp_mat->slice_ptr_, sp_mat->slice_ptr_.data(), sp_mat->slice_ptr_.size() * sizeof(int),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMemcpy(d_sp_mat->slice_rows_, sp_mat->slice_rows_.data(), sp_mat->slice_rows_.size() * sizeof(int),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMemcpy(d_sp_mat->sell_col_ind_, sp_mat->sell_col_ind_.data(), sp_mat->sell_col_ind_.size() * sizeof(int),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMemcpy(d_sp_mat->sell_val_, sp_mat->sell_val_.data(), sp_mat->sell_val_.size() * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMemcpy(d_sp_mat->hubs_.csr_row_ptr_, sp_mat->hub_row_ptr_.data(), sp_mat->hub_row_ptr_.size() * sizeof(int),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMemcpy(d_sp_mat->hubs_.csr_col_ind_, sp_mat->hub_col_ind_.data(), sp_mat->hub_nnz_ * sizeof(int),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMemcpy(d_sp_mat->hubs_.csr_val_, sp_mat->hub_val_.data(), sp_mat->hub_nnz_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+}
+
+void memcpy_hybrid_async(HybridSparseMatrixCuda *d_sp_mat, HybridSparseMatrix *sp_mat, cudaStream_t stream) {
+    copy_hybrid_sizes(d_sp_mat, sp_mat);
+
+    check_cuda(cudaMemcpyAsync(d_sp_mat->slice_ptr_, sp_mat->slice_ptr_.data(), sp_mat->slice_ptr_.size() * sizeof(int),
+                               cudaMemcpyHostToDevice, stream));
+    check_cuda(cudaMemcpyAsync(d_sp_mat->slice_rows_, sp_mat->slice_rows_.data(), sp_mat->slice_rows_.size() * sizeof(int),
+                               cudaMemcpyHostToDevice, stream));
+    check_cuda(cudaMemcpyAsync(d_sp_mat->sell_col_ind_, sp_mat->sell_col_ind_.data(), sp_mat->sell_col_ind_.size() * sizeof(int),
+                               cudaMemcpyHostToDevice, stream));
+    check_cuda(cudaMemcpyAsync(d_sp_mat->sell_val_, sp_mat->sell_val_.data(), sp_mat->sell_val_.size() * sizeof(float),
+                               cudaMemcpyHostToDevice, stream));
+    check_cuda(cudaMemcpyAsync(d_sp_mat->hubs_.csr_row_ptr_, sp_mat->hub_row_ptr_.data(), sp_mat->hub_row_ptr_.size() * sizeof(int),
+                               cudaMemcpyHostToDevice, stream));
+    check_cuda(cudaMemcpyAsync(d_sp_mat->hubs_.csr_col_ind_, sp_mat->hub_col_ind_.data(), sp_mat->hub_nnz_ * sizeof(int),
+                               cudaMemcpyHostToDevice, stream));
+    check_cuda(cudaMemcpyAsync(d_sp_mat->hubs_.csr_val_, sp_mat->hub_val_.data(), sp_mat->hub_nnz_ * sizeof(float),
+                               cudaMemcpyHostToDevice, stream));
+}
+
+void hybrid_mat_mat_multi_cuda(CudaHelper *cuda_helper, HybridSparseMatrixCuda *d_sp_mat, float *d_mat, float *d_result,
+                               long mat_columns, bool add_to_result) {
+    if (d_sp_mat->num_slices_ > 0) {
+        sell_mat_mat_multi(d_sp_mat->slice_ptr_, d_sp_mat->slice_rows_, d_sp_mat->sell_col_ind_, d_sp_mat->sell_val_,
+                           d_sp_mat->num_slices_, d_sp_mat->slice_size_, d_mat, d_result,
+                           d_sp_mat->num_rows_, d_sp_mat->num_columns_, mat_columns, add_to_result,
+                           cuda_helper->stream_compute_);
+    }
+    // cuSPARSE balances the long hub rows, its rows that are no hubs are empty
+    sp_mat_mat_multi_cuda(cuda_helper, &d_sp_mat->hubs_, d_mat, d_result, mat_columns, true);
+}
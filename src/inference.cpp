@@ -0,0 +1,381 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "inference.hpp"
+#include "divmv.h"
+#include "reordering.hpp"
+#include "sparse_computation.hpp"
+
+#include "cnpy.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+
+Inference::Inference(CudaHelper *helper, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+                     std::vector<long> *boundaries, std::vector<Matrix<float> *> parameters) {
+    if (parameters.empty() || parameters.size() % 4 != 0) {
+        throw "Parameters are not the ones of SAGE layers";
+    }
+    cuda_helper_ = helper;
+    adjacencies_ = adjacencies;
+    adjacency_row_sum_ = sum;
+    boundaries_ = *boundaries;
+    parameters_ = parameters;
+    num_chunks_ = boundaries_.size() - 1;
+    num_layers_ = parameters_.size() / 4;
+    if ((long) adjacencies_->size() != num_chunks_ * num_chunks_) {
+        throw "Adjacency has a wrong number of tiles";
+    }
+
+    // self weight, self bias, neighbourhood weight, neighbourhood bias
+    for (long l = 0; l < num_layers_; ++l) {
+        Matrix<float> *weight_self = parameters_.at(4 * l);
+        Matrix<float> *weight_neighbourhood = parameters_.at(4 * l + 2);
+        if (weight_self->num_rows_ != weight_neighbourhood->num_rows_ || weight_self->num_columns_ != weight_neighbourhood->num_columns_ ||
+            parameters_.at(4 * l + 1)->size_ != weight_self->num_columns_ || parameters_.at(4 * l + 3)->size_ != weight_self->num_columns_) {
+            throw "Parameters are not the ones of SAGE layers";
+        }
+        if (l > 0 && weight_self->num_rows_ != parameters_.at(4 * (l - 1))->num_columns_) {
+            throw "Layers have unequal features";
+        }
+    }
+
+    chunk_size_ = 0;
+    for (long i = 0; i < num_chunks_; ++i) {
+        chunk_size_ = std::max(chunk_size_, boundaries_.at(i + 1) - boundaries_.at(i));
+    }
+    index_tiles(adjacencies_, &tile_index_);
+
+    check_cudnn(cudnnCreateActivationDescriptor(&relu_desc_));
+    double coef = std::numeric_limits<double>::max();
+    check_cudnn(cudnnSetActivationDescriptor(relu_desc_,
+                                             CUDNN_ACTIVATION_RELU,
+                                             CUDNN_PROPAGATE_NAN,
+                                             coef));
+}
+
+void Inference::set_spill_dir(std::string path) {
+    spill_dir_ = path;
+}
+
+void Inference::set_embeddings_path(std::string path) {
+    embeddings_path_ = path;
+}
+
+void Inference::set_permutation(std::vector<int> *new_ids) {
+    if ((long) new_ids->size() != boundaries_.back()) {
+        throw "Permutation does not match the graph";
+    }
+    new_ids_ = new_ids;
+    old_ids_.resize(new_ids_->size());
+    for (long i = 0; i < (long) new_ids_->size(); ++i) {
+        old_ids_.at(new_ids_->at(i)) = i;
+    }
+}
+
+// one file for the odd and one for the even layers, a layer reads the one its predecessor wrote
+std::string Inference::get_spill_path(long layer) {
+    return spill_dir_ + "/inference_" + std::to_string(layer % 2) + ".bin";
+}
+
+// of the input of the layer
+long Inference::get_num_features(long layer) {
+    return parameters_.at(4 * layer)->num_rows_;
+}
+
+// column-major chunk of the input of the layer, only valid until the next call if it comes from a spill file
+Matrix<float> *Inference::get_input(long layer, long chunk) {
+    if (layer == 0) {
+        to_column_major_inplace(&features_->at(chunk));
+        return &features_->at(chunk);
+    }
+    if (spill_dir_.empty()) {
+        to_column_major_inplace(&previous_.at(chunk));
+        return &previous_.at(chunk);
+    }
+
+    long num_rows = boundaries_.at(chunk + 1) - boundaries_.at(chunk);
+    long num_features = get_num_features(layer);
+    if (spill_chunk_.num_rows_ != num_rows || spill_chunk_.num_columns_ != num_features) {
+        spill_chunk_.set(num_rows, num_features, false);
+    }
+    spill_chunk_.allocate();
+    spill_in_.seekg(boundaries_.at(chunk) * num_features * sizeof(float));
+    spill_in_.read(reinterpret_cast<char *>(spill_chunk_.values_), spill_chunk_.size_ * sizeof(float));
+    if (!spill_in_) {
+        throw "Could not read spilled embeddings";
+    }
+
+    return &spill_chunk_;
+}
+
+void Inference::forward_layer_init(long layer) {
+    Matrix<float> *weight_self = parameters_.at(4 * layer);
+    Matrix<float> *weight_neighbourhood = parameters_.at(4 * layer + 2);
+    to_column_major_inplace(weight_self);
+    to_column_major_inplace(weight_neighbourhood);
+    check_cuda(cudaMalloc(&d_weight_self_, weight_self->size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_weight_self_, weight_self->values_, weight_self->size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    check_cuda(cudaMalloc(&d_weight_neighbourhood_, weight_neighbourhood->size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_weight_neighbourhood_, weight_neighbourhood->values_, weight_neighbourhood->size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+
+    // both linear parts add their bias to the same output
+    std::vector<float> bias(weight_self->num_columns_);
+    for (long k = 0; k < (long) bias.size(); ++k) {
+        bias.at(k) = parameters_.at(4 * layer + 1)->values_[k] + parameters_.at(4 * layer + 3)->values_[k];
+    }
+    check_cuda(cudaMalloc(&d_bias_, bias.size() * sizeof(float)));
+    check_cuda(cudaMemcpy(d_bias_, bias.data(), bias.size() * sizeof(float), cudaMemcpyHostToDevice));
+}
+
+// aggregation, both linear parts and the ReLU of one row chunk in a single round trip to the device
+void Inference::forward_chunk(long layer, long chunk, Matrix<float> *y) {
+    long num_rows = boundaries_.at(chunk + 1) - boundaries_.at(chunk);
+    long num_in_features = get_num_features(layer);
+    long num_out_features = parameters_.at(4 * layer)->num_columns_;
+
+    check_cuda(cudaMemset(d_aggregation_, 0, num_rows * num_in_features * sizeof(float)));
+    bool is_self_loaded = false;
+    for (long k = 0; k < (long) tile_index_.non_empty.at(chunk).size(); ++k) {
+        long j = tile_index_.non_empty.at(chunk).at(k);
+        Matrix<float> *x = get_input(layer, j);
+        check_cuda(cudaMemcpy(d_x_, x->values_, x->size_ * sizeof(float), cudaMemcpyHostToDevice));
+        if (j == chunk) {
+            check_cuda(cudaMemcpy(d_self_, d_x_, x->size_ * sizeof(float), cudaMemcpyDeviceToDevice));
+            is_self_loaded = true;
+        }
+
+        SparseMatrixCuda<float> d_adj_i;
+        malloc_memcpy_sp_mat(&d_adj_i, &adjacencies_->at(chunk * num_chunks_ + j));
+        sp_mat_mat_multi_cuda(cuda_helper_, &d_adj_i, d_x_, d_aggregation_, num_in_features, true);
+    }
+    // nodes without a self loop
+    if (!is_self_loaded) {
+        Matrix<float> *x = get_input(layer, chunk);
+        check_cuda(cudaMemcpy(d_self_, x->values_, x->size_ * sizeof(float), cudaMemcpyHostToDevice));
+    }
+
+    if (adjacency_row_sum_ != NULL) {
+        check_cuda(cudaMemcpy(d_sum_, &adjacency_row_sum_->values_[boundaries_.at(chunk)], num_rows * sizeof(float),
+                              cudaMemcpyHostToDevice));
+        div_mat_vec(d_aggregation_, d_sum_, num_rows, num_in_features);
+    }
+
+    // the bias as the outer product of ones and the bias, then both weights on top of it
+    float alpha = 1.0;
+    float beta = 0.0;
+    check_cublas(cublasSgemm(cuda_helper_->cublas_handle,
+                             CUBLAS_OP_N, CUBLAS_OP_N,
+                             num_rows, num_out_features, 1,
+                             &alpha,
+                             d_ones_, num_rows,
+                             d_bias_, 1,
+                             &beta,
+                             d_y_, num_rows));
+    beta = 1.0;
+    check_cublas(cublasSgemm(cuda_helper_->cublas_handle,
+                             CUBLAS_OP_N, CUBLAS_OP_N,
+                             num_rows, num_out_features, num_in_features,
+                             &alpha,
+                             d_self_, num_rows,
+                             d_weight_self_, num_in_features,
+                             &beta,
+                             d_y_, num_rows));
+    check_cublas(cublasSgemm(cuda_helper_->cublas_handle,
+                             CUBLAS_OP_N, CUBLAS_OP_N,
+                             num_rows, num_out_features, num_in_features,
+                             &alpha,
+                             d_aggregation_, num_rows,
+                             d_weight_neighbourhood_, num_in_features,
+                             &beta,
+                             d_y_, num_rows));
+
+    // element-wise, so the column-major output works as is. the log-softmax of the last layer keeps the argmax
+    if (layer < num_layers_ - 1) {
+        cudnnTensorDescriptor_t y_desc;
+        check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
+        check_cudnn(cudnnSetTensor4dDescriptor(y_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                               num_rows, 1, 1, num_out_features));
+        alpha = 1.0;
+        beta = 0.0;
+        check_cudnn(cudnnActivationForward(cuda_helper_->cudnn_handle, relu_desc_,
+                                           &alpha, y_desc, d_y_,
+                                           &beta, y_desc, d_y_));
+        check_cudnn(cudnnDestroyTensorDescriptor(y_desc));
+    }
+
+    if (y->num_rows_ != num_rows || y->num_columns_ != num_out_features) {
+        y->set(num_rows, num_out_features, false);
+    }
+    y->allocate();
+    check_cuda(cudaMemcpy(y->values_, d_y_, y->size_ * sizeof(float), cudaMemcpyDeviceToHost));
+    y->is_row_major_ = false;
+}
+
+void Inference::forward_layer_free() {
+    check_cuda(cudaFree(d_weight_self_));
+    check_cuda(cudaFree(d_weight_neighbourhood_));
+    check_cuda(cudaFree(d_bias_));
+    d_weight_self_ = NULL;
+    d_weight_neighbourhood_ = NULL;
+    d_bias_ = NULL;
+}
+
+long Inference::run(std::vector<Matrix<float>> *features, std::string predictions_path) {
+    if ((long) features->size() != num_chunks_) {
+        throw "Input has a wrong number of chunks";
+    }
+    if (features->at(0).num_columns_ != get_num_features(0)) {
+        throw "Input has a wrong number of features";
+    }
+    if (!embeddings_path_.empty() && num_layers_ < 2) {
+        throw "Model has no hidden layer";
+    }
+    features_ = features;
+
+    long max_in_features = 0;
+    long max_out_features = 0;
+    for (long l = 0; l < num_layers_; ++l) {
+        max_in_features = std::max(max_in_features, get_num_features(l));
+        max_out_features = std::max(max_out_features, parameters_.at(4 * l)->num_columns_);
+    }
+    check_cuda(cudaMalloc(&d_x_, chunk_size_ * max_in_features * sizeof(float)));
+    check_cuda(cudaMalloc(&d_self_, chunk_size_ * max_in_features * sizeof(float)));
+    check_cuda(cudaMalloc(&d_aggregation_, chunk_size_ * max_in_features * sizeof(float)));
+    check_cuda(cudaMalloc(&d_y_, chunk_size_ * max_out_features * sizeof(float)));
+    if (adjacency_row_sum_ != NULL) {
+        check_cuda(cudaMalloc(&d_sum_, chunk_size_ * sizeof(float)));
+    }
+    std::vector<float> ones(chunk_size_, 1.0);
+    check_cuda(cudaMalloc(&d_ones_, chunk_size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_ones_, ones.data(), chunk_size_ * sizeof(float), cudaMemcpyHostToDevice));
+
+    bool spill = !spill_dir_.empty();
+    Matrix<float> y_chunk;// if the output is not kept in host memory
+    std::vector<int> predictions;
+    long num_nodes = 0;
+    // a reordered graph gets all predictions back in the old order at once and every row of the embeddings written
+    // to the place of its old id
+    Matrix<int> predictions_permuted;
+    std::ofstream embeddings_out;
+    std::vector<char> embeddings_header;
+    if (new_ids_ != NULL) {
+        predictions_permuted.set(boundaries_.back(), 1, true);
+        if (!embeddings_path_.empty()) {
+            embeddings_header = cnpy::create_npy_header<float>({(size_t) boundaries_.back(), (size_t) get_num_features(num_layers_ - 1)});
+            embeddings_out.open(embeddings_path_, std::ios::binary | std::ios::trunc);
+            embeddings_out.write(embeddings_header.data(), embeddings_header.size());
+        }
+    }
+    for (long l = 0; l < num_layers_; ++l) {
+        bool is_last = l == num_layers_ - 1;
+        forward_layer_init(l);
+        if (spill && l > 0) {
+            spill_in_.open(get_spill_path(l - 1), std::ios::binary);
+        }
+        if (spill && !is_last) {
+            spill_out_.open(get_spill_path(l), std::ios::binary | std::ios::trunc);
+        }
+        if (!spill && !is_last) {
+            current_ = std::vector<Matrix<float>>(num_chunks_);
+        }
+
+        for (long i = 0; i < num_chunks_; ++i) {
+            Matrix<float> *y = &y_chunk;
+            if (!spill && !is_last) {
+                y = &current_.at(i);
+            }
+            forward_chunk(l, i, y);
+
+            if (is_last) {
+                // class with the highest score
+                predictions.resize(y->num_rows_);
+                for (long r = 0; r < y->num_rows_; ++r) {
+                    long max_class = 0;
+                    for (long c = 1; c < y->num_columns_; ++c) {
+                        if (y->values_[c * y->num_rows_ + r] > y->values_[max_class * y->num_rows_ + r]) {
+                            max_class = c;
+                        }
+                    }
+                    predictions.at(r) = max_class;
+                }
+                if (new_ids_ != NULL) {
+                    std::copy(predictions.begin(), predictions.end(), predictions_permuted.values_ + num_nodes);
+                } else {
+                    std::vector<size_t> shape = {(size_t) y->num_rows_};
+                    cnpy::npy_save<int>(predictions_path, predictions.data(), shape, num_nodes == 0 ? "w" : "a");
+                }
+                num_nodes = num_nodes + y->num_rows_;
+                continue;
+            }
+
+            if (spill) {
+                spill_out_.write(reinterpret_cast<char *>(y->values_), y->size_ * sizeof(float));
+                if (!spill_out_) {
+                    throw "Could not spill embeddings";
+                }
+            }
+            if (l == num_layers_ - 2 && !embeddings_path_.empty()) {
+                to_row_major_inplace(y);
+                if (new_ids_ != NULL) {
+                    long row_size = y->num_columns_ * sizeof(float);
+                    for (long r = 0; r < y->num_rows_; ++r) {
+                        embeddings_out.seekp(embeddings_header.size() + old_ids_.at(boundaries_.at(i) + r) * row_size);
+                        embeddings_out.write(reinterpret_cast<char *>(&y->values_[r * y->num_columns_]), row_size);
+                    }
+                    if (!embeddings_out) {
+                        throw "Could not write embeddings";
+                    }
+                } else {
+                    std::vector<size_t> shape = {(size_t) y->num_rows_, (size_t) y->num_columns_};
+                    cnpy::npy_save<float>(embeddings_path_, y->values_, shape, i == 0 ? "w" : "a");
+                }
+            }
+        }
+
+        // the previous layer is not read anymore
+        if (spill) {
+            spill_in_.close();
+            spill_out_.close();
+        } else {
+            previous_.swap(current_);
+            current_.clear();
+        }
+        forward_layer_free();
+    }
+
+    if (new_ids_ != NULL) {
+        embeddings_out.close();
+        Matrix<int> predictions_unpermuted;
+        unpermute_rows<int>(&predictions_permuted, new_ids_, &predictions_unpermuted);
+        std::vector<size_t> shape = {(size_t) num_nodes};
+        cnpy::npy_save<int>(predictions_path, predictions_unpermuted.values_, shape, "w");
+    }
+
+    // free memory
+    previous_.clear();
+    spill_chunk_.release();
+    if (spill) {
+        std::remove(get_spill_path(0).c_str());
+        std::remove(get_spill_path(1).c_str());
+    }
+    check_cuda(cudaFree(d_x_));
+    check_cuda(cudaFree(d_self_));
+    check_cuda(cudaFree(d_aggregation_));
+    check_cuda(cudaFree(d_y_));
+    if (adjacency_row_sum_ != NULL) {
+        check_cuda(cudaFree(d_sum_));
+    }
+    check_cuda(cudaFree(d_ones_));
+    d_x_ = NULL;
+    d_self_ = NULL;
+    d_aggregation_ = NULL;
+    d_y_ = NULL;
+    d_sum_ = NULL;
+    d_ones_ = NULL;
+
+    return num_nodes;
+}
@@ -0,0 +1,536 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "ingest.hpp"
+#include "tensors.hpp"
+
+#include "cnpy.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <thread>
+
+
+long get_num_threads(IngestOptions *options) {
+    long num_threads = options->num_threads;
+    if (num_threads < 1) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    return num_threads;
+}
+
+// reads the next block of whole lines, the partial last line is carried over to the next block
+bool read_block(std::ifstream *file, std::vector<char> *block, std::vector<char> *carry, long block_size) {
+    block->assign(carry->begin(), carry->end());
+    carry->clear();
+    if (file->eof()) {
+        return !block->empty();
+    }
+
+    long carry_size = block->size();
+    block->resize(carry_size + block_size);
+    file->read(block->data() + carry_size, block_size);
+    block->resize(carry_size + file->gcount());
+
+    if (!file->eof()) {
+        long last_newline = block->size() - 1;
+        while (last_newline >= 0 && block->at(last_newline) != '\n') {
+            last_newline = last_newline - 1;
+        }
+        carry->assign(block->begin() + last_newline + 1, block->end());
+        block->resize(last_newline + 1);
+    }
+    return true;
+}
+
+// splits a block into ranges of whole lines, one per thread
+void split_lines(std::vector<char> *block, long num_threads, std::vector<const char *> *bounds) {
+    const char *begin = block->data();
+    const char *end = block->data() + block->size();
+    long range_size = block->size() / num_threads + 1;
+    bounds->assign(num_threads + 1, end);
+    bounds->at(0) = begin;
+    for (long t = 1; t < num_threads; ++t) {
+        const char *bound = std::max(bounds->at(t - 1), std::min(begin + t * range_size, end));
+        while (bound < end && *(bound - 1) != '\n') {
+            bound = bound + 1;
+        }
+        bounds->at(t) = bound;
+    }
+}
+
+// joins every thread before the first error of the parsers is thrown on
+void join_threads(std::vector<std::thread> *threads, std::vector<std::exception_ptr> *errors) {
+    for (std::thread &thread : *threads) {
+        thread.join();
+    }
+    for (std::exception_ptr &error : *errors) {
+        if (error) {
+            std::exception_ptr first = error;
+            std::fill(errors->begin(), errors->end(), std::exception_ptr());
+            std::rethrow_exception(first);
+        }
+    }
+}
+
+bool is_comment(const char *line, const char *line_end) {
+    while (line < line_end && (*line == ' ' || *line == '\t')) {
+        line = line + 1;
+    }
+    return line < line_end && (*line == '#' || *line == '%');
+}
+
+// parses the next non-negative integer of the line, returns false if there is none
+bool next_int(const char **pos, const char *line_end, long *value) {
+    const char *p = *pos;
+    while (p < line_end && (*p < '0' || *p > '9')) {
+        if (*p == '-' && p + 1 < line_end && p[1] >= '0' && p[1] <= '9') {
+            throw "Node id is negative";
+        }
+        p = p + 1;
+    }
+    if (p == line_end) {
+        return false;
+    }
+    long v = 0;
+    while (p < line_end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        p = p + 1;
+    }
+    *pos = p;
+    *value = v;
+    return true;
+}
+
+void parse_edges(const char *begin, const char *end, std::vector<Edge> *edges, bool symmetrize, long *max_node) {
+    const char *line = begin;
+    while (line < end) {
+        const char *line_end = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        if (line_end == NULL) {
+            line_end = end;
+        }
+
+        long source;
+        long destination;
+        const char *pos = line;
+        // lines without two ids, like a header, are skipped
+        if (!is_comment(line, line_end) && next_int(&pos, line_end, &source) && next_int(&pos, line_end, &destination)) {
+            if (source > 2147483646 || destination > 2147483646) {
+                throw "Node id does not fit into int";
+            }
+            edges->push_back(Edge(source, destination));
+            if (symmetrize && source != destination) {
+                edges->push_back(Edge(destination, source));
+            }
+            *max_node = std::max(*max_node, std::max(source, destination));
+        }
+
+        line = line_end + 1;
+    }
+}
+
+void parse_values(const char *begin, const char *end, std::vector<float> *values, long *num_rows, long *num_columns) {
+    char number[64];
+    const char *line = begin;
+    while (line < end) {
+        const char *line_end = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        if (line_end == NULL) {
+            line_end = end;
+        }
+
+        if (!is_comment(line, line_end)) {
+            long columns = 0;
+            const char *pos = line;
+            while (pos < line_end) {
+                while (pos < line_end && (*pos == ',' || *pos == ' ' || *pos == '\t' || *pos == ';' || *pos == '\r')) {
+                    pos = pos + 1;
+                }
+                const char *number_end = pos;
+                while (number_end < line_end && *number_end != ',' && *number_end != ' ' && *number_end != '\t' &&
+                       *number_end != ';' && *number_end != '\r') {
+                    number_end = number_end + 1;
+                }
+                if (number_end == pos || number_end - pos >= (long) sizeof(number)) {
+                    break;
+                }
+                std::memcpy(number, pos, number_end - pos);
+                number[number_end - pos] = '\0';
+                char *parsed_end;
+                float value = std::strtof(number, &parsed_end);
+                if (parsed_end == number) {
+                    break;// not a number, e.g. a header
+                }
+                values->push_back(value);
+                columns = columns + 1;
+                pos = number_end;
+            }
+
+            if (columns > 0) {
+                if (*num_columns == 0) {
+                    *num_columns = columns;
+                } else if (*num_columns != columns) {
+                    throw "Rows of the table have a different number of columns";
+                }
+                *num_rows = *num_rows + 1;
+            }
+        }
+
+        line = line_end + 1;
+    }
+}
+
+void sort_range(std::vector<Edge> *edges, long start, long end) {
+    std::sort(edges->begin() + start, edges->begin() + end);
+}
+
+void sort_unique_edges(std::vector<Edge> *edges, long num_threads) {
+    long num_edges = edges->size();
+    long range_size = num_edges / num_threads + 1;
+
+    // sort ranges in parallel, then merge them pairwise
+    std::vector<long> bounds;
+    for (long start = 0; start < num_edges; start = start + range_size) {
+        bounds.push_back(start);
+    }
+    bounds.push_back(num_edges);
+    std::vector<std::thread> threads;
+    for (long t = 0; t < (long) bounds.size() - 1; ++t) {
+        threads.push_back(std::thread(sort_range, edges, bounds.at(t), bounds.at(t + 1)));
+    }
+    for (long t = 0; t < (long) threads.size(); ++t) {
+        threads.at(t).join();
+    }
+    while (bounds.size() > 2) {
+        std::vector<long> merged_bounds;
+        for (long t = 0; t + 2 < (long) bounds.size(); t = t + 2) {
+            std::inplace_merge(edges->begin() + bounds.at(t), edges->begin() + bounds.at(t + 1), edges->begin() + bounds.at(t + 2));
+            merged_bounds.push_back(bounds.at(t));
+        }
+        if (bounds.size() % 2 == 0) {
+            merged_bounds.push_back(bounds.at(bounds.size() - 2));
+        }
+        merged_bounds.push_back(num_edges);
+        bounds = merged_bounds;
+    }
+
+    edges->erase(std::unique(edges->begin(), edges->end()), edges->end());
+}
+
+struct CsrStream {
+    std::ofstream column_file;
+    std::vector<int> row_counts;
+    long nnz = 0;
+    bool has_last = false;
+    Edge last;
+};
+
+// appends sorted edges, duplicates of the last appended edge are dropped
+void write_edges(CsrStream *stream, const Edge *edges, long num_edges) {
+    std::vector<int> columns;
+    columns.reserve(num_edges);
+    for (long i = 0; i < num_edges; ++i) {
+        if (stream->has_last && edges[i] == stream->last) {
+            continue;
+        }
+        if ((long) edges[i].first >= (long) stream->row_counts.size() - 1) {
+            throw "Node id is larger than number of nodes";
+        }
+        stream->row_counts.at(edges[i].first + 1) += 1;
+        columns.push_back(edges[i].second);
+        stream->last = edges[i];
+        stream->has_last = true;
+    }
+    stream->column_file.write(reinterpret_cast<char *>(columns.data()), columns.size() * sizeof(int));
+    stream->nnz = stream->nnz + columns.size();
+}
+
+void write_csr(CsrStream *stream, std::string column_path, std::string csr_path, long num_nodes) {
+    stream->column_file.close();
+
+    CsrFileHeader header;
+    std::memcpy(header.magic, csr_file_magic, sizeof(csr_file_magic));
+    header.num_rows = num_nodes;
+    header.num_columns = num_nodes;
+    header.nnz = stream->nnz;
+
+    for (long i = 0; i < num_nodes; ++i) {
+        stream->row_counts.at(i + 1) += stream->row_counts.at(i);
+    }
+
+    std::ofstream csr_file(csr_path, std::ios::binary | std::ios::trunc);
+    csr_file.write(reinterpret_cast<char *>(&header), sizeof(CsrFileHeader));
+    csr_file.write(reinterpret_cast<char *>(stream->row_counts.data()), (num_nodes + 1) * sizeof(int));
+
+    std::ifstream column_file(column_path, std::ios::binary);
+    std::vector<char> buffer(1 << 24);
+    while (column_file) {
+        column_file.read(buffer.data(), buffer.size());
+        csr_file.write(buffer.data(), column_file.gcount());
+    }
+    column_file.close();
+    std::remove(column_path.c_str());
+
+    // unweighted edges
+    std::vector<float> values(1 << 22, 1.0);
+    for (long written = 0; written < stream->nnz; written = written + values.size()) {
+        long num_values = std::min((long) values.size(), stream->nnz - written);
+        csr_file.write(reinterpret_cast<char *>(values.data()), num_values * sizeof(float));
+    }
+
+    if (!csr_file) {
+        throw "Could not write CSR file";
+    }
+}
+
+struct RunReader {
+    std::ifstream file;
+    std::vector<Edge> buffer;
+    long position = 0;
+    long length = 0;
+};
+
+bool next_edge(RunReader *reader, Edge *edge) {
+    if (reader->position == reader->length) {
+        reader->file.read(reinterpret_cast<char *>(reader->buffer.data()), reader->buffer.size() * sizeof(Edge));
+        reader->length = reader->file.gcount() / sizeof(Edge);
+        reader->position = 0;
+        if (reader->length == 0) {
+            return false;
+        }
+    }
+    *edge = reader->buffer.at(reader->position);
+    reader->position = reader->position + 1;
+    return true;
+}
+
+// k-way merge of the sorted runs into the CSR stream, the buffers of the runs and the merged one share the memory limit,
+// the columns written from the merged buffer take half of it again
+void merge_runs(std::vector<std::string> *run_paths, CsrStream *stream, long memory_limit) {
+    long num_runs = run_paths->size();
+    long buffer_size = std::max(memory_limit / ((num_runs + 2) * (long) sizeof(Edge)), 1l);
+
+    std::vector<RunReader> readers(num_runs);
+    typedef std::pair<Edge, long> HeapEntry;
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+    for (long i = 0; i < num_runs; ++i) {
+        readers.at(i).file.open(run_paths->at(i), std::ios::binary);
+        readers.at(i).buffer.resize(buffer_size);
+        Edge edge;
+        if (next_edge(&readers.at(i), &edge)) {
+            heap.push(HeapEntry(edge, i));
+        }
+    }
+
+    std::vector<Edge> merged;
+    merged.reserve(buffer_size);
+    while (!heap.empty()) {
+        HeapEntry entry = heap.top();
+        heap.pop();
+        merged.push_back(entry.first);
+        if ((long) merged.size() == buffer_size) {
+            write_edges(stream, merged.data(), merged.size());
+            merged.clear();
+        }
+
+        Edge edge;
+        if (next_edge(&readers.at(entry.second), &edge)) {
+            heap.push(HeapEntry(edge, entry.second));
+        }
+    }
+    write_edges(stream, merged.data(), merged.size());
+
+    for (long i = 0; i < num_runs; ++i) {
+        readers.at(i).file.close();
+        std::remove(run_paths->at(i).c_str());
+    }
+}
+
+// the merges of the sort take a temporary buffer as large as the edges
+long get_max_buffered_edges(IngestOptions *options) {
+    return std::max(options->memory_limit / (2 * (long) sizeof(Edge)), 1l);
+}
+
+void spill_edges(std::vector<Edge> *edges, std::vector<std::string> *run_paths, IngestOptions *options, bool force) {
+    if (edges->empty() || (!force && (long) edges->size() < get_max_buffered_edges(options))) {
+        return;
+    }
+    sort_unique_edges(edges, get_num_threads(options));
+    std::string run_path = options->tmp_dir + "/ingest_run_" + std::to_string(run_paths->size()) + ".bin";
+    std::ofstream run_file(run_path, std::ios::binary | std::ios::trunc);
+    run_file.write(reinterpret_cast<char *>(edges->data()), edges->size() * sizeof(Edge));
+    if (!run_file) {
+        throw "Could not write sorted run";
+    }
+    run_paths->push_back(run_path);
+    edges->clear();
+    edges->shrink_to_fit();
+}
+
+void buffer_edges(std::vector<Edge> *edges, std::vector<Edge> *new_edges, std::vector<std::string> *run_paths,
+                  IngestOptions *options) {
+    long max_edges = get_max_buffered_edges(options);
+    long num_edges = edges->size() + new_edges->size();
+    if (num_edges > max_edges) {
+        spill_edges(edges, run_paths, options, true);
+        num_edges = new_edges->size();
+    }
+    // grow like the vector would, but not past the limit
+    if (num_edges > (long) edges->capacity()) {
+        edges->reserve(std::max(std::min(2 * (long) edges->capacity(), max_edges), num_edges));
+    }
+    edges->insert(edges->end(), new_edges->begin(), new_edges->end());
+    spill_edges(edges, run_paths, options, false);
+}
+
+long write_sorted_csr(std::vector<Edge> *edges, std::vector<std::string> *run_paths, std::string csr_path, long num_nodes,
+                      IngestOptions *options) {
+    CsrStream stream;
+    std::string column_path = csr_path + ".columns.tmp";
+    stream.column_file.open(column_path, std::ios::binary | std::ios::trunc);
+    stream.row_counts = std::vector<int>(num_nodes + 1, 0);
+    if (run_paths->empty()) {
+        sort_unique_edges(edges, get_num_threads(options));
+        write_edges(&stream, edges->data(), edges->size());
+    } else {
+        spill_edges(edges, run_paths, options, true);
+        merge_runs(run_paths, &stream, options->memory_limit);
+    }
+    write_csr(&stream, column_path, csr_path, num_nodes);
+
+    return stream.nnz;
+}
+
+long ingest_edge_list(std::string path, std::string csr_path, IngestOptions *options) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw "Could not open edge list";
+    }
+    long num_threads = get_num_threads(options);
+
+    std::vector<Edge> edges;
+    std::vector<std::string> run_paths;
+    std::vector<char> block;
+    std::vector<char> carry;
+    std::vector<const char *> bounds;
+    std::vector<std::vector<Edge>> thread_edges(num_threads);
+    std::vector<long> thread_max_node(num_threads, -1);
+    std::vector<std::thread> threads(num_threads);
+    std::vector<std::exception_ptr> errors(num_threads);
+    long max_node = -1;
+    while (read_block(&file, &block, &carry, options->block_size)) {
+        split_lines(&block, num_threads, &bounds);
+        for (long t = 0; t < num_threads; ++t) {
+            thread_edges.at(t).clear();
+            threads.at(t) = std::thread([&bounds, &thread_edges, &thread_max_node, &errors, options, t]() {
+                try {
+                    parse_edges(bounds.at(t), bounds.at(t + 1), &thread_edges.at(t), options->symmetrize, &thread_max_node.at(t));
+                } catch (...) {
+                    errors.at(t) = std::current_exception();
+                }
+            });
+        }
+        join_threads(&threads, &errors);
+        for (long t = 0; t < num_threads; ++t) {
+            buffer_edges(&edges, &thread_edges.at(t), &run_paths, options);
+            max_node = std::max(max_node, thread_max_node.at(t));
+        }
+    }
+
+    long num_nodes = max_node + 1;
+    if (options->num_nodes > 0) {
+        if (num_nodes > options->num_nodes) {
+            throw "Node id is larger than number of nodes";
+        }
+        num_nodes = options->num_nodes;
+    }
+
+    return write_sorted_csr(&edges, &run_paths, csr_path, num_nodes, options);
+}
+
+// parses a table block by block and hands every block of rows to the writer
+template<typename T>
+long ingest_table(std::string path, std::string npy_path, IngestOptions *options, bool is_vector) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw "Could not open table";
+    }
+    long num_threads = get_num_threads(options);
+
+    std::vector<char> block;
+    std::vector<char> carry;
+    std::vector<const char *> bounds;
+    std::vector<std::vector<float>> thread_values(num_threads);
+    std::vector<long> thread_rows(num_threads);
+    std::vector<long> thread_columns(num_threads);
+    std::vector<std::thread> threads(num_threads);
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<T> rows;
+    long num_rows = 0;
+    long num_columns = 0;
+    while (read_block(&file, &block, &carry, options->block_size)) {
+        split_lines(&block, num_threads, &bounds);
+        for (long t = 0; t < num_threads; ++t) {
+            thread_values.at(t).clear();
+            thread_rows.at(t) = 0;
+            thread_columns.at(t) = num_columns;
+            threads.at(t) = std::thread([&bounds, &thread_values, &thread_rows, &thread_columns, &errors, t]() {
+                try {
+                    parse_values(bounds.at(t), bounds.at(t + 1), &thread_values.at(t), &thread_rows.at(t), &thread_columns.at(t));
+                } catch (...) {
+                    errors.at(t) = std::current_exception();
+                }
+            });
+        }
+        join_threads(&threads, &errors);
+        rows.clear();
+        long block_rows = 0;
+        for (long t = 0; t < num_threads; ++t) {
+            if (thread_rows.at(t) == 0) {
+                continue;
+            }
+            if (num_columns == 0) {
+                num_columns = thread_columns.at(t);
+            } else if (thread_columns.at(t) != num_columns) {
+                throw "Rows of the table have a different number of columns";
+            }
+            rows.insert(rows.end(), thread_values.at(t).begin(), thread_values.at(t).end());
+            block_rows = block_rows + thread_rows.at(t);
+        }
+        if (block_rows == 0) {
+            continue;
+        }
+
+        std::vector<size_t> shape;
+        shape.push_back(block_rows);
+        if (!is_vector) {
+            shape.push_back(num_columns);
+        } else if (num_columns != 1) {
+            throw "Table has more than one column";
+        }
+        // the npy file grows along the first axis
+        if (num_rows == 0) {
+            cnpy::npy_save<T>(npy_path, rows.data(), shape, "w");
+        } else {
+            cnpy::npy_save<T>(npy_path, rows.data(), shape, "a");
+        }
+        num_rows = num_rows + block_rows;
+    }
+
+    return num_rows;
+}
+
+long ingest_feature_table(std::string path, std::string npy_path, IngestOptions *options) {
+    return ingest_table<float>(path, npy_path, options, false);
+}
+
+long ingest_label_table(std::string path, std::string npy_path, IngestOptions *options) {
+    return ingest_table<int>(path, npy_path, options, true);
+}
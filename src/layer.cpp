@@ -0,0 +1,16 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "layer.hpp"
+
+
+Matrix<float> *Layer::get_y() {
+    return &y_;
+}
+
+Matrix<float> *Layer::get_input_gradients() {
+    return &gradients_;
+}
+
+Layer::~Layer() {}
+
+LayerChunked::~LayerChunked() {}
@@ -1,6 +1,7 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "linear.hpp"
+#include "chunking.hpp"
 #include "cuda_helper.hpp"
 #include "dense_computation.hpp"
 #include "tensors.hpp"
@@ -42,6 +43,20 @@ void Linear::set(CudaHelper *helper, long in_features, long out_features, long n
     gradients_.set(num_nodes, in_features, false);
 }
 
+// keeps the weights, for inputs with a different number of rows like sampled mini-batches
+void Linear::set_num_nodes(long num_nodes) {
+    num_nodes_ = num_nodes;
+
+    bias_expanded_.set(num_nodes, bias_.num_rows_, false);
+    expand_bias();
+
+    y_.set(num_nodes, num_out_features_, false);
+
+    ones_ = std::vector<float>(num_nodes, 1.0);
+
+    gradients_.set(num_nodes, num_in_features_, false);
+}
+
 void Linear::init_weight_bias() {
     double k = 1.0 / static_cast<double>(num_in_features_);
     k = sqrt(k);
@@ -99,6 +114,8 @@ void Linear::expand_bias() {
 void Linear::forward_init() {
     to_column_major_inplace(&weight_);
     to_column_major_inplace(&bias_);
+    // the optimiser updates the bias between the passes
+    expand_bias();
 
     check_cuda(cudaMalloc(&d_weight_, weight_.size_ * sizeof(float)));
     check_cuda(cudaMemcpy(d_weight_, weight_.values_, weight_.size_ * sizeof(float),
@@ -107,8 +124,11 @@ void Linear::forward_init() {
 
 void Linear::forward_compute(float *d_x, long num_rows, float *d_y) {
     // needs to be reset at every call because it's overwritten with the result
-    check_cuda(cudaMemcpy(d_y, bias_expanded_.values_, bias_expanded_.size_ * sizeof(float),
-                          cudaMemcpyHostToDevice));
+    // chunks can be shorter than the expanded bias, so copy with the leading dimension of the chunk
+    check_cuda(cudaMemcpy2D(d_y, num_rows * sizeof(float),
+                            bias_expanded_.values_, bias_expanded_.num_rows_ * sizeof(float),
+                            num_rows * sizeof(float), bias_expanded_.num_columns_,
+                            cudaMemcpyHostToDevice));
 
     float alpha = 1.0;
     float beta = 1.0;
@@ -252,6 +272,14 @@ Matrix<float> *Linear::backward(Matrix<float> *incoming_gradients) {
     return &gradients_;
 }
 
+Matrix<float> *Linear::get_y() {
+    return &y_;
+}
+
+Matrix<float> *Linear::get_input_gradients() {
+    return &gradients_;
+}
+
 // CHUNKED --- CHUNKED -- CHUNKED
 
 LinearChunked::LinearChunked() {}
@@ -260,33 +288,31 @@ LinearChunked::LinearChunked(CudaHelper *helper, long chunk_size, long num_nodes
     set(helper, chunk_size, num_nodes, num_in_features, num_out_features);
 }
 
+LinearChunked::LinearChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features) {
+    set(helper, boundaries, num_in_features, num_out_features);
+}
+
 void LinearChunked::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_in_features, long num_out_features) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_in_features, num_out_features);
+}
+
+void LinearChunked::set(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features) {
     name_ = "linear_chunked";
     cuda_helper_ = helper;
-    chunk_size_ = chunk_size;
+    chunk_size_ = get_max_chunk_size(boundaries);
     num_in_features_ = num_in_features;
     num_out_features_ = num_out_features;
 
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size_);
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
-    }
+    num_chunks_ = boundaries->size() - 1;
 
-    if (num_chunks_ == 1) {
-        linear_.set(cuda_helper_, num_in_features_, num_out_features_, last_chunk_size_);
-    } else {
-        linear_.set(cuda_helper_, num_in_features_, num_out_features_, chunk_size_);
-    }
+    linear_.set(cuda_helper_, num_in_features_, num_out_features_, chunk_size_);
 
     y_ = std::vector<Matrix<float>>(num_chunks_);
     gradients_ = std::vector<Matrix<float>>(num_chunks_);
-    long current_chunk_size = chunk_size_;
     for (int i = 0; i < num_chunks_; ++i) {
-        if (i == (num_chunks_ - 1)) {
-            current_chunk_size = last_chunk_size_;
-        }
+        long current_chunk_size = boundaries->at(i + 1) - boundaries->at(i);
         y_.at(i).set(current_chunk_size, num_out_features, false);
         gradients_.at(i).set(current_chunk_size, num_in_features, false);
     }
@@ -300,40 +326,56 @@ std::vector<Matrix<float> *> LinearChunked::get_gradients() {
     return linear_.get_gradients();
 }
 
-std::vector<Matrix<float>> *LinearChunked::forward(std::vector<Matrix<float>> *x) {
-    x_ = x;
-
+std::vector<Matrix<float>> *LinearChunked::forward_begin(std::vector<Matrix<float>> *x) {
     if ((long) x->size() != num_chunks_) {
         throw "Input has wrong number of chunks";
     }
-    for (int i = 0; i < num_chunks_; ++i) {
-        to_column_major_inplace(&x->at(i));
+    x_ = x;
+
+    return &y_;
+}
+
+void LinearChunked::forward_chunk(long chunk) {
+    to_column_major_inplace(&x_->at(chunk));
+
+    if (d_x_forward_ == NULL) {
+        linear_.forward_init();
+        check_cuda(cudaMalloc(&d_x_forward_, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_forward_, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
     }
 
-    linear_.forward_init();
-    float *d_x;
-    check_cuda(cudaMalloc(&d_x, x->at(0).size_ * sizeof(float)));
-    float *d_y;
-    check_cuda(cudaMalloc(&d_y, y_.at(0).size_ * sizeof(float)));
+    // in
+    check_cuda(cudaMemcpy(d_x_forward_, x_->at(chunk).values_, x_->at(chunk).size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
 
-    for (int i = 0; i < num_chunks_; ++i) {
-        // in
-        check_cuda(cudaMemcpy(d_x, x->at(i).values_, x->at(i).size_ * sizeof(float),
-                              cudaMemcpyHostToDevice));
+    // compute
+    linear_.forward_compute(d_x_forward_, x_->at(chunk).num_rows_, d_y_forward_);
 
-        // compute
-        linear_.forward_compute(d_x, x->at(i).num_rows_, d_y);
+    // out
+    check_cuda(cudaMemcpy(y_.at(chunk).values_, d_y_forward_, y_.at(chunk).size_ * sizeof(float),
+                          cudaMemcpyDeviceToHost));
+    y_.at(chunk).is_row_major_ = false;
+}
 
-        // out
-        check_cuda(cudaMemcpy(y_.at(i).values_, d_y, y_.at(i).size_ * sizeof(float),
-                              cudaMemcpyDeviceToHost));
-        y_.at(i).is_row_major_ = false;
+void LinearChunked::forward_end() {
+    if (d_x_forward_ == NULL) {
+        return;
     }
 
     // free
     linear_.forward_free();
-    check_cuda(cudaFree(d_x));
-    check_cuda(cudaFree(d_y));
+    check_cuda(cudaFree(d_x_forward_));
+    check_cuda(cudaFree(d_y_forward_));
+    d_x_forward_ = NULL;
+    d_y_forward_ = NULL;
+}
+
+std::vector<Matrix<float>> *LinearChunked::forward(std::vector<Matrix<float>> *x) {
+    forward_begin(x);
+    for (long i = 0; i < num_chunks_; ++i) {
+        forward_chunk(i);
+    }
+    forward_end();
 
     return &y_;
 }
@@ -347,11 +389,11 @@ std::vector<Matrix<float>> *LinearChunked::backward(std::vector<Matrix<float>> *
     }
 
     float *d_dy;
-    check_cuda(cudaMalloc(&d_dy, incoming_gradients->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dy, chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
     float *d_x;
-    check_cuda((cudaMalloc(&d_x, x_->at(0).size_ * sizeof(float))));
+    check_cuda((cudaMalloc(&d_x, chunk_size_ * x_->at(0).num_columns_ * sizeof(float))));
     float *d_dx;
-    check_cuda(cudaMalloc(&d_dx, x_->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dx, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
 
     linear_.backward_init();
     for (int i = 0; i < num_chunks_; ++i) {
@@ -386,8 +428,18 @@ LinearPipelined::LinearPipelined(CudaHelper *helper, long chunk_size, long num_n
     set(helper, chunk_size, num_nodes, num_in_features, num_out_features);
 }
 
+LinearPipelined::LinearPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features) {
+    set(helper, boundaries, num_in_features, num_out_features);
+}
+
 void LinearPipelined::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_in_features, long num_out_features) {
-    LinearChunked::set(helper, chunk_size, num_nodes, num_in_features, num_out_features);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_in_features, num_out_features);
+}
+
+void LinearPipelined::set(CudaHelper *helper, std::vector<long> *boundaries, long num_in_features, long num_out_features) {
+    LinearChunked::set(helper, boundaries, num_in_features, num_out_features);
 
     name_ = "linear_pipelined";
     num_steps_ = 2;
@@ -425,11 +477,11 @@ std::vector<Matrix<float>> *LinearPipelined::forward(std::vector<Matrix<float>>
 
     linear_.forward_init();
     for (long i = 0; i < num_steps_; ++i) {
-        check_cuda(cudaMalloc(&d_x_.at(i), x->at(0).size_ * sizeof(float)));
-        check_cuda(cudaMalloc(&d_y_.at(i), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_x_.at(i), chunk_size_ * x->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_.at(i), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
     }
 
-    pipeline(true, num_chunks_);
+    pipeline(cuda_helper_, true, num_chunks_, num_steps_);
 
     // free
     linear_.forward_free();
@@ -457,6 +509,20 @@ void LinearPipelined::backward_compute(long chunk, long buffer) {
     linear_.backward_compute(d_dy_.at(buffer), d_x_.at(buffer), incoming_gradients_->at(chunk).num_rows_, d_dx_.at(buffer));
 }
 
+// the backward pass computes the gradients of the weight and of the input
+void LinearPipelined::get_chunk_costs(bool forward, long chunk, long *in_size, double *num_flops, long *out_size) {
+    long num_rows = x_->at(chunk).num_rows_;
+    *num_flops = 2.0 * num_rows * num_in_features_ * num_out_features_;
+    if (forward) {
+        *in_size = x_->at(chunk).size_ * sizeof(float);
+        *out_size = y_.at(chunk).size_ * sizeof(float);
+    } else {
+        *num_flops = 2.0 * *num_flops;
+        *in_size = (incoming_gradients_->at(chunk).size_ + x_->at(chunk).size_) * sizeof(float);
+        *out_size = gradients_.at(chunk).size_ * sizeof(float);
+    }
+}
+
 std::vector<Matrix<float>> *LinearPipelined::backward(std::vector<Matrix<float>> *incoming_gradients) {
     incoming_gradients_ = incoming_gradients;
 
@@ -468,14 +534,14 @@ std::vector<Matrix<float>> *LinearPipelined::backward(std::vector<Matrix<float>>
     }
 
     for (long i = 0; i < num_steps_; ++i) {
-        check_cuda(cudaMalloc(&d_dy_.at(i), incoming_gradients->at(0).size_ * sizeof(float)));
-        check_cuda(cudaMalloc(&d_x_.at(i), x_->at(0).size_ * sizeof(float)));
-        check_cuda(cudaMalloc(&d_dx_.at(i), x_->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dy_.at(i), chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_x_.at(i), chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dx_.at(i), chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
     }
 
     linear_.backward_init();
 
-    pipeline(false, num_chunks_);
+    pipeline(cuda_helper_, false, num_chunks_, num_steps_);
 
     linear_.backward_free();
     for (long i = 0; i < num_steps_; ++i) {
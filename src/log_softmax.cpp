@@ -1,6 +1,7 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "log_softmax.hpp"
+#include "chunking.hpp"
 
 
 LogSoftmax::LogSoftmax() {}
@@ -134,71 +135,88 @@ LogSoftmaxChunked::LogSoftmaxChunked(CudaHelper *helper, long chunk_size, long n
     set(helper, chunk_size, num_nodes, num_features);
 }
 
+LogSoftmaxChunked::LogSoftmaxChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    set(helper, boundaries, num_features);
+}
+
 void LogSoftmaxChunked::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_features);
+}
+
+void LogSoftmaxChunked::set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
     name_ = "log-softmax_chunked";
-    chunk_size_ = chunk_size;
+    chunk_size_ = get_max_chunk_size(boundaries);
     cuda_helper_ = helper;
     alpha_ = 1.0;
     beta_ = 0.0;
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size_);
-
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
-    }
+    num_chunks_ = boundaries->size() - 1;
 
     y_ = std::vector<Matrix<float>>(num_chunks_);
     gradients_ = std::vector<Matrix<float>>(num_chunks_);
-    long current_chunk_size = chunk_size_;
     for (int i = 0; i < num_chunks_; ++i) {
-        if (i == num_chunks_ - 1) {
-            current_chunk_size = last_chunk_size_;
-        }
+        long current_chunk_size = boundaries->at(i + 1) - boundaries->at(i);
         y_.at(i).set(current_chunk_size, num_features, true);
         gradients_.at(i).set(current_chunk_size, num_features, true);
     }
 }
 
-std::vector<Matrix<float>> *LogSoftmaxChunked::forward(std::vector<Matrix<float>> *x) {
+std::vector<Matrix<float>> *LogSoftmaxChunked::forward_begin(std::vector<Matrix<float>> *x) {
     if ((long) x->size() != num_chunks_) {
         throw "Input has wrong number of chunks";
     }
-    for (int i = 0; i < num_chunks_; ++i) {
-        to_row_major_inplace(&x->at(i));
-    }
+    x_ = x;
 
-    float *d_x;
-    check_cuda(cudaMalloc(&d_x, x->at(0).size_ * sizeof(float)));
-    cudnnTensorDescriptor_t x_desc;
-    check_cudnn(cudnnCreateTensorDescriptor(&x_desc));
+    return &y_;
+}
 
-    float *d_y;
-    check_cuda(cudaMalloc(&d_y, y_.at(0).size_ * sizeof(float)));
-    cudnnTensorDescriptor_t y_desc;
-    check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
+void LogSoftmaxChunked::forward_chunk(long chunk) {
+    to_row_major_inplace(&x_->at(chunk));
 
+    if (d_x_forward_ == NULL) {
+        check_cuda(cudaMalloc(&d_x_forward_, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+        check_cudnn(cudnnCreateTensorDescriptor(&x_desc_forward_));
+        check_cuda(cudaMalloc(&d_y_forward_, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
+        check_cudnn(cudnnCreateTensorDescriptor(&y_desc_forward_));
+    }
 
-    for (int i = 0; i < num_chunks_; ++i) {
-        check_cuda(cudaMemcpy(d_x, x->at(i).values_, x->at(i).size_ * sizeof(float), cudaMemcpyHostToDevice));
-        check_cudnn(cudnnSetTensor4dDescriptor(x_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                               x->at(i).num_rows_, 1, 1, x->at(i).num_columns_));
-        check_cudnn(cudnnSetTensor4dDescriptor(y_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                               y_.at(i).num_rows_, 1, 1, y_.at(i).num_columns_));
+    check_cuda(cudaMemcpy(d_x_forward_, x_->at(chunk).values_, x_->at(chunk).size_ * sizeof(float), cudaMemcpyHostToDevice));
+    check_cudnn(cudnnSetTensor4dDescriptor(x_desc_forward_, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           x_->at(chunk).num_rows_, 1, 1, x_->at(chunk).num_columns_));
+    check_cudnn(cudnnSetTensor4dDescriptor(y_desc_forward_, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           y_.at(chunk).num_rows_, 1, 1, y_.at(chunk).num_columns_));
 
-        check_cudnn(cudnnSoftmaxForward(cuda_helper_->cudnn_handle,
-                                        CUDNN_SOFTMAX_LOG,
-                                        CUDNN_SOFTMAX_MODE_INSTANCE,
-                                        &alpha_, x_desc, d_x,
-                                        &beta_, y_desc, d_y));
+    check_cudnn(cudnnSoftmaxForward(cuda_helper_->cudnn_handle,
+                                    CUDNN_SOFTMAX_LOG,
+                                    CUDNN_SOFTMAX_MODE_INSTANCE,
+                                    &alpha_, x_desc_forward_, d_x_forward_,
+                                    &beta_, y_desc_forward_, d_y_forward_));
 
-        check_cuda(cudaMemcpy(y_.at(i).values_, d_y, y_.at(i).size_ * sizeof(float), cudaMemcpyDeviceToHost));
-        y_.at(i).is_row_major_ = true;
+    check_cuda(cudaMemcpy(y_.at(chunk).values_, d_y_forward_, y_.at(chunk).size_ * sizeof(float), cudaMemcpyDeviceToHost));
+    y_.at(chunk).is_row_major_ = true;
+}
+
+void LogSoftmaxChunked::forward_end() {
+    if (d_x_forward_ == NULL) {
+        return;
     }
 
     // free GPU memory
-    check_cuda(cudaFree(d_x));
-    check_cuda(cudaFree(d_y));
+    check_cuda(cudaFree(d_x_forward_));
+    check_cudnn(cudnnDestroyTensorDescriptor(x_desc_forward_));
+    check_cuda(cudaFree(d_y_forward_));
+    check_cudnn(cudnnDestroyTensorDescriptor(y_desc_forward_));
+    d_x_forward_ = NULL;
+    d_y_forward_ = NULL;
+}
+
+std::vector<Matrix<float>> *LogSoftmaxChunked::forward(std::vector<Matrix<float>> *x) {
+    forward_begin(x);
+    for (long i = 0; i < num_chunks_; ++i) {
+        forward_chunk(i);
+    }
+    forward_end();
 
     return &y_;
 }
@@ -213,17 +231,17 @@ std::vector<Matrix<float>> *LogSoftmaxChunked::backward(std::vector<Matrix<float
     }
 
     float *d_y;
-    check_cuda(cudaMalloc(&d_y, y_.at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_y, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t y_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
 
     float *d_dy;
-    check_cuda(cudaMalloc(&d_dy, incoming_gradients->at(0).num_rows_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dy, chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t dy_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&dy_desc));
 
     float *d_dx;
-    check_cuda(cudaMalloc(&d_dx, y_.at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dx, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t dx_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&dx_desc));
 
@@ -264,8 +282,18 @@ LogSoftmaxPipelined::LogSoftmaxPipelined(CudaHelper *helper, long chunk_size, lo
     set(helper, chunk_size, num_nodes, num_features);
 }
 
+LogSoftmaxPipelined::LogSoftmaxPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    set(helper, boundaries, num_features);
+}
+
 void LogSoftmaxPipelined::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
-    LogSoftmaxChunked::set(helper, chunk_size, num_nodes, num_features);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_features);
+}
+
+void LogSoftmaxPipelined::set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    LogSoftmaxChunked::set(helper, boundaries, num_features);
 
     name_ = "log-softmax_pipelined";
     num_steps_ = 2;
@@ -339,14 +367,14 @@ std::vector<Matrix<float>> *LogSoftmaxPipelined::forward(std::vector<Matrix<floa
 
     // allocate
     for (long j = 0; j < num_steps_; ++j) {
-        check_cuda(cudaMalloc(&d_x_.at(j), x->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_x_.at(j), chunk_size_ * x->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&x_desc_.at(j)));
 
-        check_cuda(cudaMalloc(&d_y_.at(j), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_.at(j), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&y_desc_.at(j)));
     }
 
-    pipeline(true, num_chunks_);
+    pipeline(cuda_helper_, true, num_chunks_, num_steps_);
 
     // free
     for (long j = 0; j < num_steps_; ++j) {
@@ -373,17 +401,17 @@ std::vector<Matrix<float>> *LogSoftmaxPipelined::backward(std::vector<Matrix<flo
 
     // allocate
     for (long j = 0; j < num_steps_; ++j) {
-        check_cuda(cudaMalloc(&d_y_.at(j), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_.at(j), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&y_desc_.at(j)));
 
-        check_cuda(cudaMalloc(&d_dx_.at(j), x_->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dx_.at(j), chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&dx_desc_.at(j)));
 
-        check_cuda(cudaMalloc(&d_dy_.at(j), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dy_.at(j), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&dy_desc_.at(j)));
     }
 
-    pipeline(false, num_chunks_);
+    pipeline(cuda_helper_, false, num_chunks_, num_steps_);
 
     // free
     for (long j = 0; j < num_steps_; ++j) {
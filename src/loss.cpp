@@ -29,13 +29,13 @@ float NLLLoss::forward(std::vector<Matrix<float>> *x, Matrix<int> *labels) {
         to_row_major_inplace(&x->at(i));
     }
 
+    // rows past the labels, like the halo of a partition, are not in the loss
     double loss = 0.0;
     long row = 0;
-    long chunk_size = x->at(0).num_rows_;
     for (int i = 0; i < num_chunks; ++i) {
-        for (int j = 0; j < x->at(i).num_rows_; ++j) {
-            row = i * chunk_size + j;
+        for (int j = 0; j < x->at(i).num_rows_ && row < labels->num_rows_; ++j) {
             loss = loss + x->at(i).values_[j * x->at(i).num_columns_ + labels->values_[row]];
+            row = row + 1;
         }
     }
 
@@ -56,3 +56,7 @@ Matrix<float> *NLLLoss::backward() {
 
     return &gradients_;
 }
+
+Matrix<float> *NLLLoss::get_input_gradients() {
+    return &gradients_;
+}
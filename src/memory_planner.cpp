@@ -0,0 +1,132 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "memory_planner.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+
+// 256 bytes, like cudaMalloc
+const long planner_alignment = 64;
+
+MemoryPlanner::~MemoryPlanner() {
+    if (arena_ != NULL) {
+        check_cuda(cudaFreeHost(arena_));
+    }
+}
+
+void MemoryPlanner::add_step(std::vector<Matrix<float> *> reads, std::vector<Matrix<float> *> writes) {
+    if (arena_ != NULL) {
+        throw "Memory plan is already applied";
+    }
+
+    for (Matrix<float> *matrix : reads) {
+        auto id = ids_.find(matrix);
+        if (id == ids_.end()) {
+            external_.insert(matrix);
+        } else {
+            tensors_.at(id->second).last_step = num_steps_;
+        }
+    }
+    for (Matrix<float> *matrix : writes) {
+        if (external_.count(matrix) > 0) {
+            throw "Tensor is read before it is written";
+        }
+        auto id = ids_.find(matrix);
+        if (id == ids_.end()) {
+            PlannedTensor tensor;
+            tensor.matrix = matrix;
+            tensor.size = (matrix->size_ + planner_alignment - 1) / planner_alignment * planner_alignment;
+            tensor.first_step = num_steps_;
+            tensor.last_step = num_steps_;
+            tensor.offset = -1;
+            ids_[matrix] = tensors_.size();
+            tensors_.push_back(tensor);
+        } else {
+            tensors_.at(id->second).last_step = num_steps_;
+        }
+    }
+    num_steps_ = num_steps_ + 1;
+}
+
+void MemoryPlanner::plan() {
+    std::vector<long> order(tensors_.size());
+    for (long i = 0; i < (long) order.size(); ++i) {
+        order.at(i) = i;
+        tensors_.at(i).offset = -1;
+    }
+    std::sort(order.begin(), order.end(), [this](long a, long b) {
+        if (tensors_.at(a).size != tensors_.at(b).size) {
+            return tensors_.at(a).size > tensors_.at(b).size;
+        }
+        return tensors_.at(a).first_step < tensors_.at(b).first_step;
+    });
+
+    arena_size_ = 0;
+    std::vector<std::pair<long, long>> used;// offset and size of the placed tensors live at the same time
+    for (long i : order) {
+        PlannedTensor *tensor = &tensors_.at(i);
+        used.clear();
+        for (PlannedTensor &other : tensors_) {
+            if (other.offset >= 0 && other.first_step <= tensor->last_step && tensor->first_step <= other.last_step) {
+                used.push_back(std::make_pair(other.offset, other.size));
+            }
+        }
+        std::sort(used.begin(), used.end());
+
+        long offset = 0;
+        for (auto range : used) {
+            if (range.first - offset >= tensor->size) {
+                break;
+            }
+            offset = std::max(offset, range.first + range.second);
+        }
+        tensor->offset = offset;
+        arena_size_ = std::max(arena_size_, offset + tensor->size);
+    }
+}
+
+void MemoryPlanner::apply() {
+    if (arena_ != NULL) {
+        throw "Memory plan is already applied";
+    }
+    for (PlannedTensor &tensor : tensors_) {
+        if (tensor.offset < 0) {
+            throw "Memory is not planned";
+        }
+    }
+
+    check_cuda(cudaMallocHost(&arena_, std::max(arena_size_, 1l) * sizeof(float)));
+    for (PlannedTensor &tensor : tensors_) {
+        tensor.matrix->set_view(&arena_[tensor.offset]);
+    }
+}
+
+long MemoryPlanner::get_num_tensors() {
+    return tensors_.size();
+}
+
+long MemoryPlanner::get_offset(Matrix<float> *matrix) {
+    auto id = ids_.find(matrix);
+    if (id == ids_.end()) {
+        throw "Matrix is not planned";
+    }
+    return tensors_.at(id->second).offset;
+}
+
+long MemoryPlanner::get_size_before() {
+    long size = 0;
+    for (PlannedTensor &tensor : tensors_) {
+        size = size + tensor.matrix->size_;
+    }
+    return size * sizeof(float);
+}
+
+long MemoryPlanner::get_size_after() {
+    return arena_size_ * sizeof(float);
+}
+
+void MemoryPlanner::print() {
+    std::cout << "Memory plan: " << tensors_.size() << " tensors over " << num_steps_ << " steps, "
+              << get_size_before() / (1 << 20) << " MB before, " << get_size_after() / (1 << 20) << " MB after" << std::endl;
+}
@@ -0,0 +1,709 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "model.hpp"
+#include "dense_computation.hpp"
+#include "dropout.hpp"
+#include "log_softmax.hpp"
+#include "relu.hpp"
+#include "relu_dropout.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+
+std::string get_model_mode_name(ModelMode mode) {
+    if (mode == model_full) {
+        return "full";
+    } else if (mode == model_chunked) {
+        return "chunked";
+    } else if (mode == model_pipelined) {
+        return "pipelined";
+    } else {
+        throw "Unknown model mode";
+    }
+}
+
+std::string get_model_op_name(ModelOp op) {
+    if (op == op_dropout) {
+        return "dropout";
+    } else if (op == op_aggregation) {
+        return "aggregation";
+    } else if (op == op_sage_linear) {
+        return "sage_linear";
+    } else if (op == op_relu) {
+        return "relu";
+    } else if (op == op_log_softmax) {
+        return "log_softmax";
+    } else if (op == op_relu_dropout) {
+        return "relu_dropout";
+    } else {
+        throw "Unknown model op";
+    }
+}
+
+// GRAPH --- GRAPH --- GRAPH
+
+ModelGraph::ModelGraph(ModelConfig config) {
+    if (config.channels.size() < 2) {
+        throw "Model needs at least one layer";
+    }
+    config_ = config;
+
+    long num_layers = config_.channels.size() - 1;
+    long x = -1;
+    for (long l = 0; l < num_layers; ++l) {
+        std::string layer = std::to_string(l);
+        long dropout = add_node(op_dropout, "dropout_" + layer, {x}, config_.channels.at(l));
+        long aggregation = add_node(op_aggregation, "graph_convolution_" + layer, {dropout}, config_.channels.at(l));
+        x = add_node(op_sage_linear, "linear_" + layer, {dropout, aggregation}, config_.channels.at(l + 1));
+        if (l < num_layers - 1) {
+            x = add_node(op_relu, "relu_" + layer, {x}, config_.channels.at(l + 1));
+        }
+    }
+    output_ = add_node(op_log_softmax, "log_softmax", {x}, config_.channels.back());
+}
+
+long ModelGraph::add_node(ModelOp op, std::string name, std::vector<long> inputs, long num_features) {
+    ModelNode node;
+    node.op = op;
+    node.name = name;
+    node.inputs = inputs;
+    node.num_features = num_features;
+    nodes_.push_back(node);
+
+    return nodes_.size() - 1;
+}
+
+void ModelGraph::optimize() {
+    if (config_.fuse_relu_dropout && config_.mode != model_pipelined) {
+        fuse_relu_dropout();
+    }
+    if (config_.fuse_sage_linear_add) {
+        fuse_sage_linear_add();
+    }
+    if (config_.elide_layout_changes) {
+        elide_layout_changes();
+    }
+    if (config_.eliminate_dead_buffers) {
+        eliminate_dead_buffers();
+    }
+}
+
+void ModelGraph::fuse_relu_dropout() {
+    if (config_.mode == model_pipelined) {
+        throw "ReLU and dropout are not fused in pipelined mode";
+    }
+
+    for (long i = 0; i < (long) nodes_.size(); ++i) {
+        if (nodes_.at(i).is_removed || nodes_.at(i).op != op_relu) {
+            continue;
+        }
+        std::vector<long> consumers = get_consumers(i);
+        if (consumers.size() != 1 || nodes_.at(consumers.at(0)).op != op_dropout) {
+            continue;
+        }
+
+        // the dropout takes the place of both, the relu comes before it anyway
+        ModelNode *dropout = &nodes_.at(consumers.at(0));
+        dropout->op = op_relu_dropout;
+        dropout->name = "relu_" + dropout->name;
+        dropout->inputs = nodes_.at(i).inputs;
+        nodes_.at(i).is_removed = true;
+    }
+}
+
+void ModelGraph::fuse_sage_linear_add() {
+    for (long i = -1; i < (long) nodes_.size(); ++i) {
+        if (i >= 0 && nodes_.at(i).is_removed) {
+            continue;
+        }
+        std::vector<long> consumers = get_consumers(i);
+        if (consumers.size() < 2) {
+            continue;
+        }
+
+        // the SageLinear layer passes its self gradients back first, they are not read by anyone else
+        for (long consumer : consumers) {
+            ModelNode *node = &nodes_.at(consumer);
+            if (node->op == op_sage_linear && node->inputs.at(0) == i && i >= 0) {
+                nodes_.at(i).gradient_sum = sum_in_place;
+            }
+        }
+    }
+}
+
+void ModelGraph::elide_layout_changes() {
+    // the input is the same in every pass, it is transposed once if only dropouts read it
+    bool is_column_major_input = true;
+    for (long consumer : get_consumers(-1)) {
+        if (nodes_.at(consumer).op != op_dropout) {
+            is_column_major_input = false;
+        }
+        for (long next : get_consumers(consumer)) {
+            if (is_row_major_input(next)) {
+                is_column_major_input = false;
+            }
+        }
+    }
+    is_input_column_major_ = is_column_major_input;
+
+    for (long i = 0; i < (long) nodes_.size(); ++i) {
+        ModelNode *node = &nodes_.at(i);
+        if (node->is_removed || (node->op != op_dropout && node->op != op_relu_dropout)) {
+            continue;
+        }
+        if (is_row_major_output(node->inputs.at(0))) {
+            continue;
+        }
+        bool keep_layout = true;
+        for (long consumer : get_consumers(i)) {
+            if (is_row_major_input(consumer)) {
+                keep_layout = false;
+            }
+        }
+        node->keep_layout = keep_layout;
+    }
+}
+
+void ModelGraph::eliminate_dead_buffers() {
+    // a node has gradients if a node with parameters comes before it
+    std::vector<bool> has_gradients(nodes_.size(), false);
+    for (long i = 0; i < (long) nodes_.size(); ++i) {
+        ModelNode *node = &nodes_.at(i);
+        if (node->is_removed) {
+            continue;
+        }
+        node->needs_input_gradients = false;
+        for (long input : node->inputs) {
+            if (input >= 0 && has_gradients.at(input)) {
+                node->needs_input_gradients = true;
+            }
+        }
+        has_gradients.at(i) = node->needs_input_gradients || node->op == op_sage_linear;
+    }
+}
+
+bool ModelGraph::is_row_major_output(long node) {
+    if (node < 0) {
+        return !is_input_column_major_;
+    }
+    ModelNode *model_node = &nodes_.at(node);
+    if (model_node->op == op_aggregation || model_node->op == op_sage_linear) {
+        return false;
+    } else if (model_node->keep_layout) {
+        return is_row_major_output(model_node->inputs.at(0));
+    } else {
+        return true;
+    }
+}
+
+bool ModelGraph::is_row_major_input(long node) {
+    ModelNode *model_node = &nodes_.at(node);
+    if (model_node->op == op_aggregation || model_node->op == op_sage_linear) {
+        return false;
+    } else if (model_node->keep_layout) {
+        return is_row_major_output(model_node->inputs.at(0));
+    } else {
+        return true;
+    }
+}
+
+ModelConfig *ModelGraph::get_config() {
+    return &config_;
+}
+
+std::vector<ModelNode> *ModelGraph::get_nodes() {
+    return &nodes_;
+}
+
+std::vector<long> ModelGraph::get_consumers(long node) {
+    std::vector<long> consumers;
+    for (long i = 0; i < (long) nodes_.size(); ++i) {
+        if (!nodes_.at(i).is_removed &&
+            std::find(nodes_.at(i).inputs.begin(), nodes_.at(i).inputs.end(), node) != nodes_.at(i).inputs.end()) {
+            consumers.push_back(i);
+        }
+    }
+    return consumers;
+}
+
+long ModelGraph::get_output() {
+    return output_;
+}
+
+long ModelGraph::get_num_nodes() {
+    long num_nodes = 0;
+    for (ModelNode &node : nodes_) {
+        if (!node.is_removed) {
+            num_nodes = num_nodes + 1;
+        }
+    }
+    return num_nodes;
+}
+
+long ModelGraph::get_num_layout_changes() {
+    // transpositions are in place, a later consumer of the same tensor finds it in the new layout
+    std::vector<bool> is_row_major(nodes_.size() + 1);
+    is_row_major.at(0) = !is_input_column_major_;
+    long num_layout_changes = 0;
+    for (long i = 0; i < (long) nodes_.size(); ++i) {
+        ModelNode *node = &nodes_.at(i);
+        if (node->is_removed) {
+            continue;
+        }
+        bool is_row_major_in = true;
+        if (node->op == op_aggregation || node->op == op_sage_linear) {
+            is_row_major_in = false;
+        } else if (node->keep_layout) {
+            is_row_major_in = is_row_major.at(node->inputs.at(0) + 1);
+        }
+        for (long input : node->inputs) {
+            if (is_row_major.at(input + 1) != is_row_major_in) {
+                is_row_major.at(input + 1) = is_row_major_in;
+                num_layout_changes = num_layout_changes + 1;
+            }
+        }
+        is_row_major.at(i + 1) = is_row_major_output(i);
+    }
+    return num_layout_changes;
+}
+
+bool ModelGraph::is_input_column_major() {
+    return is_input_column_major_;
+}
+
+void ModelGraph::print() {
+    std::cout << "Model graph, " << get_model_mode_name(config_.mode) << ", " << get_num_nodes() << " nodes, "
+              << get_num_layout_changes() << " layout changes per forward pass" << std::endl;
+    for (ModelNode &node : nodes_) {
+        if (node.is_removed) {
+            continue;
+        }
+        std::cout << node.name << " (" << get_model_op_name(node.op) << ", " << node.num_features << " features)";
+        if (node.gradient_sum == sum_in_place) {
+            std::cout << ", sums gradients in place";
+        }
+        if (node.keep_layout) {
+            std::cout << ", keeps layout";
+        }
+        if (!node.needs_input_gradients) {
+            std::cout << ", no input gradients";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// MODEL --- MODEL --- MODEL
+
+// consumers that pass gradients back to the node, an Add layer sums them if there are several
+long get_num_gradient_consumers(ModelGraph *graph, long node) {
+    long num_consumers = 0;
+    for (long consumer : graph->get_consumers(node)) {
+        if (graph->get_nodes()->at(consumer).needs_input_gradients) {
+            num_consumers = num_consumers + 1;
+        }
+    }
+    return num_consumers;
+}
+
+Model::Model(CudaHelper *helper, ModelGraph *graph, SparseMatrix<float> *adjacency, SparseMatrix<float> *adjacency_transposed,
+             std::string reduction, Matrix<float> *sum) {
+    if (graph->get_config()->mode != model_full) {
+        throw "Graph is chunked";
+    }
+    cuda_helper_ = helper;
+    graph_ = graph;
+    std::vector<ModelNode> *nodes = graph_->get_nodes();
+    long num_nodes = adjacency->num_rows_;
+    set_layers(nodes->size());
+
+    for (long i = 0; i < (long) nodes->size(); ++i) {
+        ModelNode *node = &nodes->at(i);
+        if (node->is_removed) {
+            continue;
+        }
+        if (node->op == op_dropout) {
+            Dropout *dropout = new Dropout(cuda_helper_, num_nodes, node->num_features);
+            dropout->set_keep_layout(node->keep_layout);
+            layers_.at(i) = dropout;
+        } else if (node->op == op_relu) {
+            layers_.at(i) = new Relu(cuda_helper_, num_nodes, node->num_features);
+        } else if (node->op == op_relu_dropout) {
+            ReluDropout *relu_dropout = new ReluDropout(cuda_helper_, num_nodes, node->num_features);
+            relu_dropout->set_keep_layout(node->keep_layout);
+            layers_.at(i) = relu_dropout;
+        } else if (node->op == op_log_softmax) {
+            layers_.at(i) = new LogSoftmax(cuda_helper_, num_nodes, node->num_features);
+        } else if (node->op == op_aggregation) {
+            aggregations_.at(i) = new FeatureAggregation();
+            aggregations_.at(i)->set(cuda_helper_, adjacency, adjacency_transposed, reduction, node->num_features, sum);
+        } else if (node->op == op_sage_linear) {
+            long num_in_features = graph_->get_config()->channels.at(0);
+            if (node->inputs.at(0) >= 0) {
+                num_in_features = nodes->at(node->inputs.at(0)).num_features;
+            }
+            linears_.at(i) = new SageLinear(cuda_helper_, num_in_features, node->num_features, num_nodes);
+        }
+
+        if (node->gradient_sum == sum_add && get_num_gradient_consumers(graph_, i) > 1) {
+            adds_.at(i) = new Add(cuda_helper_, num_nodes, node->num_features);
+        }
+    }
+    release_dead_buffers();
+}
+
+Model::Model(CudaHelper *helper, ModelGraph *graph, std::vector<SparseMatrix<float>> *adjacencies, Matrix<float> *sum,
+             std::string reduction, std::vector<long> *boundaries) {
+    ModelMode mode = graph->get_config()->mode;
+    if (mode == model_full) {
+        throw "Graph is not chunked";
+    }
+    cuda_helper_ = helper;
+    graph_ = graph;
+    std::vector<ModelNode> *nodes = graph_->get_nodes();
+    set_layers(nodes->size());
+
+    for (long i = 0; i < (long) nodes->size(); ++i) {
+        ModelNode *node = &nodes->at(i);
+        if (node->is_removed) {
+            continue;
+        }
+        if (node->op == op_dropout) {
+            DropoutChunked *dropout;
+            if (mode == model_pipelined) {
+                dropout = new DropoutPipelined(cuda_helper_, boundaries, node->num_features);
+            } else {
+                dropout = new DropoutChunked(cuda_helper_, boundaries, node->num_features);
+            }
+            dropout->set_keep_layout(node->keep_layout);
+            layers_chunked_.at(i) = dropout;
+        } else if (node->op == op_relu) {
+            if (mode == model_pipelined) {
+                layers_chunked_.at(i) = new ReluPipelined(cuda_helper_, boundaries, node->num_features);
+            } else {
+                layers_chunked_.at(i) = new ReluChunked(cuda_helper_, boundaries, node->num_features);
+            }
+        } else if (node->op == op_relu_dropout) {
+            if (mode == model_pipelined) {
+                throw "ReLU and dropout are not fused in pipelined mode";
+            }
+            ReluDropoutChunked *relu_dropout = new ReluDropoutChunked(cuda_helper_, boundaries, node->num_features);
+            relu_dropout->set_keep_layout(node->keep_layout);
+            layers_chunked_.at(i) = relu_dropout;
+        } else if (node->op == op_log_softmax) {
+            if (mode == model_pipelined) {
+                layers_chunked_.at(i) = new LogSoftmaxPipelined(cuda_helper_, boundaries, node->num_features);
+            } else {
+                layers_chunked_.at(i) = new LogSoftmaxChunked(cuda_helper_, boundaries, node->num_features);
+            }
+        } else if (node->op == op_aggregation) {
+            if (mode == model_pipelined) {
+                aggregations_chunked_.at(i) = new FeatureAggregationPipelined(cuda_helper_, adjacencies, sum, reduction,
+                                                                              node->num_features, boundaries);
+            } else {
+                aggregations_chunked_.at(i) = new FeatureAggregationChunked(cuda_helper_, adjacencies, sum, reduction,
+                                                                            node->num_features, boundaries);
+            }
+        } else if (node->op == op_sage_linear) {
+            long num_in_features = graph_->get_config()->channels.at(0);
+            if (node->inputs.at(0) >= 0) {
+                num_in_features = nodes->at(node->inputs.at(0)).num_features;
+            }
+            if (mode == model_pipelined) {
+                linears_chunked_.at(i) = new SageLinearPipelined(cuda_helper_, num_in_features, node->num_features, boundaries);
+            } else {
+                linears_chunked_.at(i) = new SageLinearChunked(cuda_helper_, num_in_features, node->num_features, boundaries);
+            }
+        }
+
+        if (node->gradient_sum == sum_add && get_num_gradient_consumers(graph_, i) > 1) {
+            if (mode == model_pipelined) {
+                adds_chunked_.at(i) = new AddPipelined(cuda_helper_, boundaries, node->num_features);
+            } else {
+                adds_chunked_.at(i) = new AddChunked(cuda_helper_, boundaries, node->num_features);
+            }
+        }
+    }
+
+    // all aggregations read the same tiles, the first one converts them for the others
+    HybridTiles *hybrid_tiles = NULL;
+    for (long i = 0; i < (long) aggregations_chunked_.size(); ++i) {
+        if (aggregations_chunked_.at(i) == NULL) {
+            continue;
+        }
+        if (hybrid_tiles == NULL) {
+            hybrid_tiles = aggregations_chunked_.at(i)->get_hybrid_tiles();
+        } else {
+            aggregations_chunked_.at(i)->set_hybrid_tiles(hybrid_tiles);
+        }
+    }
+    release_dead_buffers();
+}
+
+Model::~Model() {
+    for (long i = 0; i < (long) y_.size(); ++i) {
+        delete layers_.at(i);
+        delete aggregations_.at(i);
+        delete linears_.at(i);
+        delete adds_.at(i);
+        delete layers_chunked_.at(i);
+        delete aggregations_chunked_.at(i);
+        delete linears_chunked_.at(i);
+        delete adds_chunked_.at(i);
+    }
+}
+
+void Model::set_layers(long num_nodes) {
+    layers_ = std::vector<Layer *>(num_nodes, NULL);
+    aggregations_ = std::vector<FeatureAggregation *>(num_nodes, NULL);
+    linears_ = std::vector<SageLinear *>(num_nodes, NULL);
+    adds_ = std::vector<Add *>(num_nodes, NULL);
+    layers_chunked_ = std::vector<LayerChunked *>(num_nodes, NULL);
+    aggregations_chunked_ = std::vector<FeatureAggregationChunked *>(num_nodes, NULL);
+    linears_chunked_ = std::vector<SageLinearChunkedParent *>(num_nodes, NULL);
+    adds_chunked_ = std::vector<AddChunked *>(num_nodes, NULL);
+    y_ = std::vector<Matrix<float> *>(num_nodes, NULL);
+    gradients_ = std::vector<Matrix<float> *>(num_nodes, NULL);
+    y_chunked_ = std::vector<std::vector<Matrix<float>> *>(num_nodes, NULL);
+    gradients_chunked_ = std::vector<std::vector<Matrix<float>> *>(num_nodes, NULL);
+}
+
+// the backward pass never reaches these layers, their input gradients are not kept
+void Model::release_dead_buffers() {
+    std::vector<ModelNode> *nodes = graph_->get_nodes();
+    for (long i = 0; i < (long) nodes->size(); ++i) {
+        ModelNode *node = &nodes->at(i);
+        if (node->is_removed || node->needs_input_gradients) {
+            continue;
+        }
+        if (node->op == op_dropout && layers_.at(i) != NULL) {
+            layers_.at(i)->get_input_gradients()->release();
+        } else if (node->op == op_dropout) {
+            for (Matrix<float> &chunk : *((DropoutChunked *) layers_chunked_.at(i))->get_input_gradients()) {
+                chunk.release();
+            }
+        } else if (node->op == op_aggregation && aggregations_.at(i) != NULL) {
+            aggregations_.at(i)->get_input_gradients()->release();
+        } else if (node->op == op_aggregation) {
+            for (Matrix<float> &chunk : *aggregations_chunked_.at(i)->get_input_gradients()) {
+                chunk.release();
+            }
+        }
+    }
+}
+
+std::vector<Matrix<float> *> Model::get_inputs(ModelNode *node, Matrix<float> *x) {
+    std::vector<Matrix<float> *> inputs;
+    for (long input : node->inputs) {
+        if (input < 0) {
+            inputs.push_back(x);
+        } else {
+            inputs.push_back(y_.at(input));
+        }
+    }
+    return inputs;
+}
+
+std::vector<std::vector<Matrix<float>> *> Model::get_inputs(ModelNode *node, std::vector<Matrix<float>> *x) {
+    std::vector<std::vector<Matrix<float>> *> inputs;
+    for (long input : node->inputs) {
+        if (input < 0) {
+            inputs.push_back(x);
+        } else {
+            inputs.push_back(y_chunked_.at(input));
+        }
+    }
+    return inputs;
+}
+
+Matrix<float> *Model::forward(Matrix<float> *x) {
+    if (graph_->get_config()->mode != model_full) {
+        throw "Model is chunked";
+    }
+    if (graph_->is_input_column_major()) {
+        to_column_major_inplace(x);
+    }
+
+    std::vector<ModelNode> *nodes = graph_->get_nodes();
+    for (long i = 0; i < (long) nodes->size(); ++i) {
+        ModelNode *node = &nodes->at(i);
+        if (node->is_removed) {
+            continue;
+        }
+        std::vector<Matrix<float> *> inputs = get_inputs(node, x);
+        if (node->op == op_aggregation) {
+            y_.at(i) = aggregations_.at(i)->forward(inputs.at(0));
+        } else if (node->op == op_sage_linear) {
+            y_.at(i) = linears_.at(i)->forward(inputs.at(0), inputs.at(1));
+        } else {
+            y_.at(i) = layers_.at(i)->forward(inputs.at(0));
+        }
+    }
+
+    return y_.at(graph_->get_output());
+}
+
+std::vector<Matrix<float>> *Model::forward(std::vector<Matrix<float>> *x) {
+    if (graph_->get_config()->mode == model_full) {
+        throw "Model is not chunked";
+    }
+    if (graph_->is_input_column_major()) {
+        for (Matrix<float> &chunk : *x) {
+            to_column_major_inplace(&chunk);
+        }
+    }
+
+    std::vector<ModelNode> *nodes = graph_->get_nodes();
+    for (long i = 0; i < (long) nodes->size(); ++i) {
+        ModelNode *node = &nodes->at(i);
+        if (node->is_removed) {
+            continue;
+        }
+        std::vector<std::vector<Matrix<float>> *> inputs = get_inputs(node, x);
+        if (node->op == op_aggregation) {
+            if (aggregation_input_hook_) {
+                aggregation_input_hook_(inputs.at(0));
+            }
+            y_chunked_.at(i) = aggregations_chunked_.at(i)->forward(inputs.at(0));
+        } else if (node->op == op_sage_linear) {
+            y_chunked_.at(i) = linears_chunked_.at(i)->forward(inputs.at(0), inputs.at(1));
+        } else {
+            y_chunked_.at(i) = layers_chunked_.at(i)->forward(inputs.at(0));
+        }
+    }
+
+    return y_chunked_.at(graph_->get_output());
+}
+
+void Model::add_gradients(long node, Matrix<float> *gradients) {
+    if (node < 0) {
+        return;
+    }
+    if (gradients_.at(node) == NULL) {
+        gradients_.at(node) = gradients;
+    } else if (graph_->get_nodes()->at(node).gradient_sum == sum_in_place) {
+        mat_mat_add(cuda_helper_, gradients_.at(node), gradients, gradients_.at(node));
+    } else {
+        gradients_.at(node) = adds_.at(node)->forward(gradients_.at(node), gradients);
+    }
+}
+
+void Model::add_gradients(long node, std::vector<Matrix<float>> *gradients) {
+    if (node < 0) {
+        return;
+    }
+    if (gradients_chunked_.at(node) == NULL) {
+        gradients_chunked_.at(node) = gradients;
+    } else if (graph_->get_nodes()->at(node).gradient_sum == sum_in_place) {
+        for (long i = 0; i < (long) gradients->size(); ++i) {
+            mat_mat_add(cuda_helper_, &gradients_chunked_.at(node)->at(i), &gradients->at(i), &gradients_chunked_.at(node)->at(i));
+        }
+    } else {
+        gradients_chunked_.at(node) = adds_chunked_.at(node)->forward(gradients_chunked_.at(node), gradients);
+    }
+}
+
+void Model::backward(Matrix<float> *incoming_gradients) {
+    if (graph_->get_config()->mode != model_full) {
+        throw "Model is chunked";
+    }
+    std::fill(gradients_.begin(), gradients_.end(), (Matrix<float> *) NULL);
+    gradients_.at(graph_->get_output()) = incoming_gradients;
+
+    // the consumers of a node come after it, so its gradients are complete once the loop reaches it
+    std::vector<ModelNode> *nodes = graph_->get_nodes();
+    for (long i = nodes->size() - 1; i >= 0; --i) {
+        ModelNode *node = &nodes->at(i);
+        if (node->is_removed || gradients_.at(i) == NULL) {
+            continue;
+        }
+        if (node->op == op_sage_linear) {
+            SageLinearGradients *sage_linear_gradients = linears_.at(i)->backward(gradients_.at(i));
+            if (node->needs_input_gradients) {
+                add_gradients(node->inputs.at(0), sage_linear_gradients->self_gradients);
+                add_gradients(node->inputs.at(1), sage_linear_gradients->neighbourhood_gradients);
+            }
+        } else if (!node->needs_input_gradients) {
+            continue;
+        } else if (node->op == op_aggregation) {
+            add_gradients(node->inputs.at(0), aggregations_.at(i)->backward(gradients_.at(i)));
+        } else {
+            add_gradients(node->inputs.at(0), layers_.at(i)->backward(gradients_.at(i)));
+        }
+    }
+}
+
+void Model::backward(std::vector<Matrix<float>> *incoming_gradients) {
+    if (graph_->get_config()->mode == model_full) {
+        throw "Model is not chunked";
+    }
+    std::fill(gradients_chunked_.begin(), gradients_chunked_.end(), (std::vector<Matrix<float>> *) NULL);
+    gradients_chunked_.at(graph_->get_output()) = incoming_gradients;
+
+    std::vector<ModelNode> *nodes = graph_->get_nodes();
+    for (long i = nodes->size() - 1; i >= 0; --i) {
+        ModelNode *node = &nodes->at(i);
+        if (node->is_removed || gradients_chunked_.at(i) == NULL) {
+            continue;
+        }
+        if (aggregation_gradients_hook_) {
+            std::vector<long> consumers = graph_->get_consumers(i);
+            for (long consumer : consumers) {
+                if (nodes->at(consumer).op == op_aggregation) {
+                    aggregation_gradients_hook_(gradients_chunked_.at(i));
+                    break;
+                }
+            }
+        }
+        if (node->op == op_sage_linear) {
+            SageLinearGradientsChunked *sage_linear_gradients = linears_chunked_.at(i)->backward(gradients_chunked_.at(i));
+            if (node->needs_input_gradients) {
+                add_gradients(node->inputs.at(0), sage_linear_gradients->self_gradients);
+                add_gradients(node->inputs.at(1), sage_linear_gradients->neighbourhood_gradients);
+            }
+        } else if (!node->needs_input_gradients) {
+            continue;
+        } else if (node->op == op_aggregation) {
+            add_gradients(node->inputs.at(0), aggregations_chunked_.at(i)->backward(gradients_chunked_.at(i)));
+        } else {
+            add_gradients(node->inputs.at(0), layers_chunked_.at(i)->backward(gradients_chunked_.at(i)));
+        }
+    }
+}
+
+std::vector<Matrix<float> *> Model::get_parameters() {
+    std::vector<Matrix<float> *> parameters;
+    for (long i = 0; i < (long) y_.size(); ++i) {
+        std::vector<Matrix<float> *> params;
+        if (linears_.at(i) != NULL) {
+            params = linears_.at(i)->get_parameters();
+        } else if (linears_chunked_.at(i) != NULL) {
+            params = linears_chunked_.at(i)->get_parameters();
+        }
+        parameters.insert(parameters.end(), params.begin(), params.end());
+    }
+    return parameters;
+}
+
+std::vector<Matrix<float> *> Model::get_gradients() {
+    std::vector<Matrix<float> *> gradients;
+    for (long i = 0; i < (long) y_.size(); ++i) {
+        std::vector<Matrix<float> *> grads;
+        if (linears_.at(i) != NULL) {
+            grads = linears_.at(i)->get_gradients();
+        } else if (linears_chunked_.at(i) != NULL) {
+            grads = linears_chunked_.at(i)->get_gradients();
+        }
+        gradients.insert(gradients.end(), grads.begin(), grads.end());
+    }
+    return gradients;
+}
+
+void Model::set_aggregation_hooks(std::function<void(std::vector<Matrix<float>> *x)> input_hook,
+                                  std::function<void(std::vector<Matrix<float>> *gradients)> gradients_hook) {
+    if (graph_->get_config()->mode == model_full) {
+        throw "Model is not chunked";
+    }
+    aggregation_input_hook_ = input_hook;
+    aggregation_gradients_hook_ = gradients_hook;
+}
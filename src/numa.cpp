@@ -0,0 +1,244 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "numa.hpp"
+#include "chunking.hpp"
+#include "cuda_helper.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <dirent.h>
+#include <exception>
+#include <fstream>
+#include <numeric>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+
+const std::string numa_sysfs_path = "/sys/devices/system/node";
+// like MPOL_PREFERRED of numaif.h, without linking libnuma
+const int numa_policy_preferred = 1;
+const long numa_max_nodes = 1024;
+
+
+// cpus of a list like 0-3,8-11
+void parse_cpu_list(std::string list, std::vector<int> *cpus) {
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        long dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = first;
+        if (dash != (long) std::string::npos) {
+            last = std::stoi(range.substr(dash + 1));
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus->push_back(cpu);
+        }
+    }
+}
+
+void get_numa_topology(NumaTopology *topology) {
+    topology->nodes.clear();
+    topology->cpus.clear();
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) {
+        throw "Could not get the cpus of the process";
+    }
+
+    // node directories can have gaps in their ids
+    std::vector<long> node_ids;
+    DIR *dir = opendir(numa_sysfs_path.c_str());
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+                node_ids.push_back(std::stol(name.substr(4)));
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(node_ids.begin(), node_ids.end());
+
+    for (long node : node_ids) {
+        std::ifstream file(numa_sysfs_path + "/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> node_cpus;
+        parse_cpu_list(list, &node_cpus);
+        std::vector<int> usable_cpus;
+        for (int cpu : node_cpus) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                usable_cpus.push_back(cpu);
+            }
+        }
+        // memory-only nodes and nodes outside the cpuset of the process
+        if (!usable_cpus.empty()) {
+            topology->nodes.push_back(node);
+            topology->cpus.push_back(usable_cpus);
+        }
+    }
+
+    if (topology->nodes.empty()) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        topology->nodes.push_back(0);
+        topology->cpus.push_back(cpus);
+    }
+}
+
+long get_numa_node(long chunk, long num_chunks, long num_nodes, NumaPlacement placement) {
+    if (placement == numa_interleaved) {
+        return chunk % num_nodes;
+    } else if (placement == numa_blocked) {
+        return chunk * num_nodes / num_chunks;
+    } else {
+        return 0;
+    }
+}
+
+void bind_thread_to_numa_node(NumaTopology *topology, long node) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : topology->cpus.at(node)) {
+        CPU_SET(cpu, &cpus);
+    }
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) != 0) {
+        throw "Could not pin thread to its node";
+    }
+
+    // the kernel may refuse the policy, for example in a container. the first touch by the pinned thread still
+    // gets memory of the node as long as it has free pages
+    std::vector<unsigned long> mask(numa_max_nodes / (8 * sizeof(unsigned long)), 0);
+    long id = topology->nodes.at(node);
+    if (id < numa_max_nodes) {
+        mask.at(id / (8 * sizeof(unsigned long))) = 1ul << (id % (8 * sizeof(unsigned long)));
+        syscall(SYS_set_mempolicy, numa_policy_preferred, mask.data(), numa_max_nodes);
+    }
+}
+
+// chunks of the node, every num_threads-th starting at thread. stops at the first error, which the caller rethrows
+void run_numa_thread(NumaTopology *topology, long node, std::vector<long> *chunks, long thread, long num_threads,
+                     std::function<void(long chunk)> *function, std::exception_ptr *error) {
+    try {
+        if (topology != NULL) {
+            bind_thread_to_numa_node(topology, node);
+        }
+        for (long k = thread; k < (long) chunks->size(); k = k + num_threads) {
+            (*function)(chunks->at(k));
+        }
+    } catch (...) {
+        *error = std::current_exception();
+    }
+}
+
+void run_on_numa_nodes(NumaTopology *topology, NumaPlacement placement, long num_chunks, std::function<void(long chunk)> function) {
+    long num_nodes = 1;
+    if (placement != numa_none) {
+        num_nodes = topology->nodes.size();
+    }
+    std::vector<std::vector<long>> node_chunks(num_nodes);
+    for (long i = 0; i < num_chunks; ++i) {
+        node_chunks.at(get_numa_node(i, num_chunks, num_nodes, placement)).push_back(i);
+    }
+
+    std::vector<long> num_threads(num_nodes);
+    for (long node = 0; node < num_nodes; ++node) {
+        long num_cpus = std::thread::hardware_concurrency();
+        if (placement != numa_none) {
+            num_cpus = topology->cpus.at(node).size();
+        }
+        num_threads.at(node) = std::max(std::min(num_cpus, (long) node_chunks.at(node).size()), 1l);
+    }
+    // the errors do not move while the threads write them
+    std::vector<std::exception_ptr> errors(std::accumulate(num_threads.begin(), num_threads.end(), 0l));
+    std::vector<std::thread> threads;
+    for (long node = 0; node < num_nodes; ++node) {
+        for (long t = 0; t < num_threads.at(node); ++t) {
+            threads.push_back(std::thread(run_numa_thread, placement == numa_none ? NULL : topology, node,
+                                          &node_chunks.at(node), t, num_threads.at(node), &function, &errors.at(threads.size())));
+        }
+    }
+    for (long t = 0; t < (long) threads.size(); ++t) {
+        threads.at(t).join();
+    }
+    for (std::exception_ptr error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// allocated by the calling thread, so the pages come from its node
+template<typename T>
+T *copy_to_local_memory(T *values, long size) {
+    T *local_values;
+    check_cuda(cudaMallocHost(&local_values, size * sizeof(T)));
+    std::copy(values, values + size, local_values);
+    return local_values;
+}
+
+void place_chunks(NumaTopology *topology, NumaPlacement placement, std::vector<Matrix<float>> *chunks) {
+    if (placement == numa_none) {
+        return;
+    }
+    run_on_numa_nodes(topology, placement, chunks->size(), [chunks](long i) {
+        Matrix<float> *chunk = &chunks->at(i);
+        if (chunk->values_ == NULL) {
+            return;
+        }
+        float *values = copy_to_local_memory(chunk->values_, chunk->size_);
+        chunk->set(chunk->num_rows_, chunk->num_columns_, values, chunk->is_row_major_);
+    });
+}
+
+void place_tiles(NumaTopology *topology, NumaPlacement placement, std::vector<SparseMatrix<float>> *tiles) {
+    if (placement == numa_none) {
+        return;
+    }
+    long num_chunks = std::lround(std::sqrt((double) tiles->size()));
+    if (num_chunks * num_chunks != (long) tiles->size()) {
+        throw "Tiles are not square";
+    }
+    run_on_numa_nodes(topology, placement, num_chunks, [tiles, num_chunks](long i) {
+        for (long j = 0; j < num_chunks; ++j) {
+            SparseMatrix<float> *tile = &tiles->at(i * num_chunks + j);
+            if (tile->csr_row_ptr_ == NULL) {
+                continue;
+            }
+            float *csr_val = copy_to_local_memory(tile->csr_val_, tile->nnz_);
+            int *csr_row_ptr = copy_to_local_memory(tile->csr_row_ptr_, tile->num_rows_ + 1);
+            int *csr_col_ind = copy_to_local_memory(tile->csr_col_ind_, tile->nnz_);
+            check_cuda(cudaFreeHost(tile->csr_val_));
+            check_cuda(cudaFreeHost(tile->csr_row_ptr_));
+            check_cuda(cudaFreeHost(tile->csr_col_ind_));
+            tile->csr_val_ = csr_val;
+            tile->csr_row_ptr_ = csr_row_ptr;
+            tile->csr_col_ind_ = csr_col_ind;
+        }
+    });
+}
+
+long get_numa_node_of(void *address) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *page = reinterpret_cast<void *>(reinterpret_cast<unsigned long>(address) & ~(page_size - 1));
+    int status = -1;
+    // without target nodes move_pages only reports where the pages are
+    if (syscall(SYS_move_pages, 0, 1, &page, NULL, &status, 0) != 0 || status < 0) {
+        return -1;
+    }
+    return status;
+}
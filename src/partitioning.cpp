@@ -0,0 +1,419 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "partitioning.hpp"
+#include "reordering.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <queue>
+#include <utility>
+
+
+void get_weighted_graph(SparseMatrix<float> *adjacency, WeightedGraph *graph) {
+    get_undirected(adjacency, &graph->offsets, &graph->neighbours);
+    graph->edge_weights.assign(graph->neighbours.size(), 1);
+    graph->node_weights.assign(adjacency->num_rows_, 1);
+}
+
+long get_total_weight(WeightedGraph *graph) {
+    long total_weight = 0;
+    for (long i = 0; i < (long) graph->node_weights.size(); ++i) {
+        total_weight = total_weight + graph->node_weights.at(i);
+    }
+    return total_weight;
+}
+
+long match_heavy_edges(WeightedGraph *graph, long max_node_weight, std::mt19937_64 *generator, std::vector<int> *coarse_ids) {
+    long num_nodes = graph->node_weights.size();
+    std::vector<int> order(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        order.at(i) = i;
+    }
+    // random visiting order, otherwise low ids take all the heavy edges
+    std::shuffle(order.begin(), order.end(), *generator);
+
+    coarse_ids->assign(num_nodes, -1);
+    long num_coarse_nodes = 0;
+    for (long i = 0; i < num_nodes; ++i) {
+        int node = order.at(i);
+        if (coarse_ids->at(node) != -1) {
+            continue;
+        }
+        int match = node;
+        long match_weight = 0;
+        for (long j = graph->offsets.at(node); j < graph->offsets.at(node + 1); ++j) {
+            int neighbour = graph->neighbours.at(j);
+            if (coarse_ids->at(neighbour) == -1 && neighbour != node && graph->edge_weights.at(j) > match_weight
+                && graph->node_weights.at(node) + graph->node_weights.at(neighbour) <= max_node_weight) {
+                match = neighbour;
+                match_weight = graph->edge_weights.at(j);
+            }
+        }
+        coarse_ids->at(node) = num_coarse_nodes;
+        coarse_ids->at(match) = num_coarse_nodes;
+        num_coarse_nodes = num_coarse_nodes + 1;
+    }
+
+    return num_coarse_nodes;
+}
+
+void contract_graph(WeightedGraph *graph, std::vector<int> *coarse_ids, long num_coarse_nodes, WeightedGraph *coarse) {
+    long num_nodes = graph->node_weights.size();
+
+    // fine nodes of every coarse node
+    std::vector<long> member_offsets(num_coarse_nodes + 1, 0);
+    for (long node = 0; node < num_nodes; ++node) {
+        member_offsets.at(coarse_ids->at(node) + 1) = member_offsets.at(coarse_ids->at(node) + 1) + 1;
+    }
+    for (long i = 0; i < num_coarse_nodes; ++i) {
+        member_offsets.at(i + 1) = member_offsets.at(i + 1) + member_offsets.at(i);
+    }
+    std::vector<int> members(num_nodes);
+    std::vector<long> next = member_offsets;
+    for (long node = 0; node < num_nodes; ++node) {
+        members.at(next.at(coarse_ids->at(node))) = node;
+        next.at(coarse_ids->at(node)) = next.at(coarse_ids->at(node)) + 1;
+    }
+
+    coarse->offsets.assign(num_coarse_nodes + 1, 0);
+    coarse->node_weights.assign(num_coarse_nodes, 0);
+    coarse->neighbours.clear();
+    coarse->edge_weights.clear();
+    // position of a coarse neighbour in the current neighbourhood, positions of earlier ones are smaller than its start
+    std::vector<long> positions(num_coarse_nodes, -1);
+    for (long coarse_node = 0; coarse_node < num_coarse_nodes; ++coarse_node) {
+        long start = coarse->neighbours.size();
+        for (long i = member_offsets.at(coarse_node); i < member_offsets.at(coarse_node + 1); ++i) {
+            int node = members.at(i);
+            coarse->node_weights.at(coarse_node) = coarse->node_weights.at(coarse_node) + graph->node_weights.at(node);
+            for (long j = graph->offsets.at(node); j < graph->offsets.at(node + 1); ++j) {
+                int coarse_neighbour = coarse_ids->at(graph->neighbours.at(j));
+                if (coarse_neighbour == coarse_node) {
+                    continue;
+                }
+                if (positions.at(coarse_neighbour) < start) {
+                    positions.at(coarse_neighbour) = coarse->neighbours.size();
+                    coarse->neighbours.push_back(coarse_neighbour);
+                    coarse->edge_weights.push_back(graph->edge_weights.at(j));
+                } else {
+                    long position = positions.at(coarse_neighbour);
+                    coarse->edge_weights.at(position) = coarse->edge_weights.at(position) + graph->edge_weights.at(j);
+                }
+            }
+        }
+        coarse->offsets.at(coarse_node + 1) = coarse->neighbours.size();
+    }
+}
+
+void get_initial_partition(WeightedGraph *graph, long num_parts, std::vector<int> *parts) {
+    long num_nodes = graph->node_weights.size();
+    std::vector<int> order;
+    order.reserve(num_nodes);
+    std::vector<bool> visited(num_nodes, false);
+    for (long root = 0; root < num_nodes; ++root) {
+        if (visited.at(root)) {
+            continue;
+        }
+        visited.at(root) = true;
+        long head = order.size();
+        order.push_back(root);
+        while (head < (long) order.size()) {
+            int node = order.at(head);
+            head = head + 1;
+            for (long j = graph->offsets.at(node); j < graph->offsets.at(node + 1); ++j) {
+                int neighbour = graph->neighbours.at(j);
+                if (!visited.at(neighbour)) {
+                    visited.at(neighbour) = true;
+                    order.push_back(neighbour);
+                }
+            }
+        }
+    }
+
+    // a node goes to the part its weight midpoint falls into
+    double total_weight = (double) get_total_weight(graph);
+    double weight = 0.0;
+    parts->resize(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        int node = order.at(i);
+        double midpoint = weight + (double) graph->node_weights.at(node) / 2.0;
+        parts->at(node) = std::min((long) (midpoint * (double) num_parts / total_weight), num_parts - 1);
+        weight = weight + (double) graph->node_weights.at(node);
+    }
+}
+
+long get_cut_weight(WeightedGraph *graph, std::vector<int> *parts) {
+    long num_nodes = graph->node_weights.size();
+    long cut_weight = 0;
+    for (long node = 0; node < num_nodes; ++node) {
+        for (long j = graph->offsets.at(node); j < graph->offsets.at(node + 1); ++j) {
+            if (parts->at(graph->neighbours.at(j)) != parts->at(node)) {
+                cut_weight = cut_weight + graph->edge_weights.at(j);
+            }
+        }
+    }
+    return cut_weight / 2;
+}
+
+// neighbouring part with room that reduces the cut the most, -1 if there is none
+int get_best_move(WeightedGraph *graph, std::vector<int> *parts, std::vector<long> *part_weights, long max_part_weight,
+                  std::vector<long> *connectivity, std::vector<int> *touched, int node, long *gain) {
+    touched->clear();
+    for (long j = graph->offsets.at(node); j < graph->offsets.at(node + 1); ++j) {
+        int part = parts->at(graph->neighbours.at(j));
+        if (connectivity->at(part) == 0) {
+            touched->push_back(part);
+        }
+        connectivity->at(part) = connectivity->at(part) + graph->edge_weights.at(j);
+    }
+
+    int own_part = parts->at(node);
+    long internal = connectivity->at(own_part);
+    int target = -1;
+    *gain = LONG_MIN;
+    for (long i = 0; i < (long) touched->size(); ++i) {
+        int part = touched->at(i);
+        if (part == own_part || part_weights->at(part) + graph->node_weights.at(node) > max_part_weight) {
+            continue;
+        }
+        long part_gain = connectivity->at(part) - internal;
+        if (part_gain > *gain || (target != -1 && part_gain == *gain && part_weights->at(part) < part_weights->at(target))) {
+            target = part;
+            *gain = part_gain;
+        }
+    }
+
+    for (long i = 0; i < (long) touched->size(); ++i) {
+        connectivity->at(touched->at(i)) = 0;
+    }
+    return target;
+}
+
+// moves nodes out of overweight parts, to a neighbouring part if possible and to the lightest part otherwise
+void balance_partition(WeightedGraph *graph, long num_parts, long max_part_weight, std::vector<int> *parts,
+                       std::vector<long> *part_weights) {
+    long num_nodes = graph->node_weights.size();
+    std::vector<long> connectivity(num_parts, 0);
+    std::vector<int> touched;
+    for (long round = 0; round < 4; ++round) {
+        if (*std::max_element(part_weights->begin(), part_weights->end()) <= max_part_weight) {
+            return;
+        }
+        for (long node = 0; node < num_nodes; ++node) {
+            int part = parts->at(node);
+            if (part_weights->at(part) <= max_part_weight) {
+                continue;
+            }
+            long gain;
+            int target = get_best_move(graph, parts, part_weights, max_part_weight, &connectivity, &touched, node, &gain);
+            if (target == -1) {
+                target = std::min_element(part_weights->begin(), part_weights->end()) - part_weights->begin();
+            }
+            if (target == part || part_weights->at(target) + graph->node_weights.at(node) > max_part_weight) {
+                continue;
+            }
+            part_weights->at(part) = part_weights->at(part) - graph->node_weights.at(node);
+            part_weights->at(target) = part_weights->at(target) + graph->node_weights.at(node);
+            parts->at(node) = target;
+        }
+    }
+}
+
+long refine_partition(WeightedGraph *graph, long num_parts, long max_part_weight, long num_passes, std::vector<int> *parts) {
+    long num_nodes = graph->node_weights.size();
+    std::vector<long> part_weights(num_parts, 0);
+    for (long node = 0; node < num_nodes; ++node) {
+        part_weights.at(parts->at(node)) = part_weights.at(parts->at(node)) + graph->node_weights.at(node);
+    }
+    balance_partition(graph, num_parts, max_part_weight, parts, &part_weights);
+
+    std::vector<long> connectivity(num_parts, 0);
+    std::vector<int> touched;
+    std::vector<bool> locked(num_nodes);
+    std::vector<long> queued_gains(num_nodes);
+    std::vector<std::pair<int, int>> moves;// node and the part it came from
+    // a pass gives up after this many moves without improvement
+    long max_bad_moves = std::max(num_nodes / 100, 64l);
+    long max_eager_degree = std::max(8 * (long) graph->neighbours.size() / std::max(num_nodes, 1l), 64l);
+    for (long pass = 0; pass < num_passes; ++pass) {
+        // entries whose gain differs from the queued gain of their node are outdated duplicates
+        std::priority_queue<std::pair<long, int>> queue;
+        std::fill(queued_gains.begin(), queued_gains.end(), LONG_MIN);
+        for (long node = 0; node < num_nodes; ++node) {
+            long gain;
+            if (get_best_move(graph, parts, &part_weights, max_part_weight, &connectivity, &touched, node, &gain) != -1) {
+                queue.push(std::make_pair(gain, node));
+                queued_gains.at(node) = gain;
+            }
+        }
+
+        std::fill(locked.begin(), locked.end(), false);
+        moves.clear();
+        long cumulative_gain = 0;
+        long best_gain = 0;
+        long best_num_moves = 0;
+        while (!queue.empty()) {
+            long gain = queue.top().first;
+            int node = queue.top().second;
+            queue.pop();
+            if (locked.at(node) || gain != queued_gains.at(node)) {
+                continue;
+            }
+            queued_gains.at(node) = LONG_MIN;
+            // the target may have filled up since the node was queued
+            long current_gain;
+            int target = get_best_move(graph, parts, &part_weights, max_part_weight, &connectivity, &touched, node, &current_gain);
+            if (target == -1) {
+                continue;
+            }
+            if (current_gain != gain) {
+                queue.push(std::make_pair(current_gain, node));
+                queued_gains.at(node) = current_gain;
+                continue;
+            }
+
+            int part = parts->at(node);
+            part_weights.at(part) = part_weights.at(part) - graph->node_weights.at(node);
+            part_weights.at(target) = part_weights.at(target) + graph->node_weights.at(node);
+            parts->at(node) = target;
+            locked.at(node) = true;
+            moves.push_back(std::make_pair(node, part));
+            cumulative_gain = cumulative_gain + gain;
+            if (cumulative_gain > best_gain) {
+                best_gain = cumulative_gain;
+                best_num_moves = moves.size();
+            } else if ((long) moves.size() - best_num_moves > max_bad_moves) {
+                break;
+            }
+
+            for (long j = graph->offsets.at(node); j < graph->offsets.at(node + 1); ++j) {
+                int neighbour = graph->neighbours.at(j);
+                // hubs are only re-evaluated when they are popped, they neighbour most moves
+                if (locked.at(neighbour) || graph->offsets.at(neighbour + 1) - graph->offsets.at(neighbour) > max_eager_degree) {
+                    continue;
+                }
+                long neighbour_gain;
+                if (get_best_move(graph, parts, &part_weights, max_part_weight, &connectivity, &touched, neighbour, &neighbour_gain) != -1
+                    && neighbour_gain != queued_gains.at(neighbour)) {
+                    queue.push(std::make_pair(neighbour_gain, neighbour));
+                    queued_gains.at(neighbour) = neighbour_gain;
+                }
+            }
+        }
+
+        // roll back to the best prefix of moves
+        for (long i = moves.size() - 1; i >= best_num_moves; --i) {
+            int node = moves.at(i).first;
+            int part = moves.at(i).second;
+            part_weights.at(parts->at(node)) = part_weights.at(parts->at(node)) - graph->node_weights.at(node);
+            part_weights.at(part) = part_weights.at(part) + graph->node_weights.at(node);
+            parts->at(node) = part;
+        }
+
+        if (best_gain == 0) {
+            break;
+        }
+    }
+
+    return get_cut_weight(graph, parts);
+}
+
+void partition_graph(SparseMatrix<float> *adjacency, PartitionOptions *options, std::vector<int> *parts) {
+    long num_nodes = adjacency->num_rows_;
+    long num_parts = options->num_parts;
+    if (num_parts < 1 || num_parts > num_nodes) {
+        throw "Number of parts must be between one and the number of nodes";
+    }
+    if (num_parts == 1) {
+        parts->assign(num_nodes, 0);
+        return;
+    }
+    std::mt19937_64 generator(options->seed);
+
+    // coarsening, graphs.at(i + 1) merges the nodes of graphs.at(i) according to coarse_ids.at(i)
+    std::vector<WeightedGraph> graphs(1);
+    get_weighted_graph(adjacency, &graphs.at(0));
+    std::vector<std::vector<int>> coarse_ids;
+    long coarsen_to = options->coarsen_to > 0 ? options->coarsen_to : 20 * num_parts;
+    long total_weight = get_total_weight(&graphs.at(0));
+    // coarse nodes stay light enough to balance the parts
+    long max_node_weight = std::max((long) (1.5 * (double) total_weight / (double) coarsen_to), 1l);
+    while ((long) graphs.back().node_weights.size() > coarsen_to) {
+        long num_level_nodes = graphs.back().node_weights.size();
+        std::vector<int> level_coarse_ids;
+        long num_coarse_nodes = match_heavy_edges(&graphs.back(), max_node_weight, &generator, &level_coarse_ids);
+        // matching stalls on stars and isolated nodes
+        if ((double) num_coarse_nodes > 0.95 * (double) num_level_nodes) {
+            break;
+        }
+        WeightedGraph coarse;
+        contract_graph(&graphs.back(), &level_coarse_ids, num_coarse_nodes, &coarse);
+        coarse_ids.push_back(std::move(level_coarse_ids));
+        graphs.push_back(std::move(coarse));
+    }
+
+    long max_part_weight = ceil((double) total_weight / (double) num_parts * (1.0 + options->imbalance));
+    std::vector<int> level_parts;
+    get_initial_partition(&graphs.back(), num_parts, &level_parts);
+    refine_partition(&graphs.back(), num_parts, max_part_weight, options->num_refinement_passes, &level_parts);
+
+    // uncoarsening, project the parts to the finer graph and refine there
+    std::vector<int> fine_parts;
+    for (long level = coarse_ids.size() - 1; level >= 0; --level) {
+        fine_parts.resize(coarse_ids.at(level).size());
+        for (long node = 0; node < (long) fine_parts.size(); ++node) {
+            fine_parts.at(node) = level_parts.at(coarse_ids.at(level).at(node));
+        }
+        level_parts.swap(fine_parts);
+        graphs.pop_back();
+        refine_partition(&graphs.at(level), num_parts, max_part_weight, options->num_refinement_passes, &level_parts);
+    }
+
+    parts->swap(level_parts);
+}
+
+long count_cut_edges(SparseMatrix<float> *adjacency, std::vector<int> *parts) {
+    long num_cut = 0;
+    for (long row = 0; row < adjacency->num_rows_; ++row) {
+        for (long j = adjacency->csr_row_ptr_[row]; j < adjacency->csr_row_ptr_[row + 1]; ++j) {
+            if (parts->at(adjacency->csr_col_ind_[j]) != parts->at(row)) {
+                num_cut = num_cut + 1;
+            }
+        }
+    }
+    return num_cut;
+}
+
+void get_boundary_parts(std::vector<long> *boundaries, std::vector<int> *parts) {
+    long num_chunks = boundaries->size() - 1;
+    parts->resize(boundaries->back());
+    for (long i = 0; i < num_chunks; ++i) {
+        std::fill(parts->begin() + boundaries->at(i), parts->begin() + boundaries->at(i + 1), i);
+    }
+}
+
+void get_partition_permutation(std::vector<int> *parts, long num_parts, std::vector<int> *new_ids, std::vector<long> *boundaries) {
+    long num_nodes = parts->size();
+    std::vector<long> part_sizes(num_parts, 0);
+    for (long node = 0; node < num_nodes; ++node) {
+        part_sizes.at(parts->at(node)) = part_sizes.at(parts->at(node)) + 1;
+    }
+
+    // empty parts are dropped, chunks hold at least one row
+    std::vector<long> next(num_parts);
+    boundaries->assign(1, 0);
+    for (long i = 0; i < num_parts; ++i) {
+        next.at(i) = boundaries->back();
+        if (part_sizes.at(i) > 0) {
+            boundaries->push_back(boundaries->back() + part_sizes.at(i));
+        }
+    }
+
+    // nodes keep their relative order within a part
+    new_ids->resize(num_nodes);
+    for (long node = 0; node < num_nodes; ++node) {
+        new_ids->at(node) = next.at(parts->at(node));
+        next.at(parts->at(node)) = next.at(parts->at(node)) + 1;
+    }
+}
@@ -1,115 +1,231 @@
 // Copyright 2020 Marcel Wagenländer
 
+#include "pipeline.hpp"
 #include "layer.hpp"
 
+#include <thread>
 
-void LayerPipelined::pipeline(bool forward, long num_chunks) {
-    long chunk_zero = 0;
-    long chunk_one = 1;
-    long chunk_two = 2;
-    for (int i = 0; i < num_chunks + 2; ++i) {
-        // update chunk offsets
-        chunk_zero = (i / 3) * 3;         // every three steps jump by 3
-        chunk_one = ((i - 1) / 3) * 3 + 1;// one tick behind and one number higher
-        chunk_two = ((i - 2) / 3) * 3 + 2;// two ticks behind and two number higher
 
+Pipeline::Pipeline(long num_buffers) {
+    if (num_buffers < 1) {
+        throw "Pipeline needs at least one buffer";
+    }
+    num_buffers_ = num_buffers;
+}
 
-        if (i % 3 == 0) {
-            // zero in, one out, two compute
-            // zero in
-            if (chunk_zero < num_chunks) {
-                long buffer = chunk_zero % 2;
-                if (forward) {
-                    forward_in(chunk_zero, buffer);
-                } else {
-                    backward_in(chunk_zero, buffer);
-                }
-            }
+Pipeline::Pipeline(long num_buffers, EmulatedDevice *device) : Pipeline(num_buffers) {
+    device_ = device;
+}
 
-            // one out
-            if (chunk_one < num_chunks && i > 2) {
-                long buffer = chunk_one % 2;
-                if (forward) {
-                    forward_out(chunk_one, buffer);
-                } else {
-                    backward_out(chunk_one, buffer);
-                }
-            }
+void Pipeline::add_stage(std::function<void(long chunk, long buffer)> run, cudaStream_t stream) {
+    if (device_ != NULL && stream != NULL) {
+        throw "Pipeline on an emulated device needs emulated streams";
+    }
+    PipelineStage stage;
+    stage.run = run;
+    stage.stream = stream;
+    stage.emulated_stream = NULL;
+    stages_.push_back(stage);
+}
 
-            // two computation
-            if (chunk_two < num_chunks && i > 2) {
-                long buffer = chunk_two % 2;
-                if (forward) {
-                    forward_compute(chunk_two, buffer);
-                } else {
-                    backward_compute(chunk_two, buffer);
-                }
+void Pipeline::add_emulated_stage(std::function<void(long chunk, long buffer)> run, EmulatedStream *stream) {
+    if (device_ == NULL) {
+        throw "Pipeline has no emulated device";
+    }
+    PipelineStage stage;
+    stage.run = run;
+    stage.stream = NULL;
+    stage.emulated_stream = stream;
+    stages_.push_back(stage);
+}
+
+// false if another stage failed
+bool Pipeline::wait_for(long stage, long chunk, long waiting_stage) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this, stage, chunk] { return num_done_.at(stage) > chunk || error_; });
+        if (error_) {
+            return false;
+        }
+    }
+
+    // the calls of a GPU stage are only issued, wait for them on the stream or, for CPU stages, on the host
+    if (device_ != NULL) {
+        EmulatedStream *stream = stages_.at(stage).emulated_stream;
+        EmulatedStream *waiting_stream = stages_.at(waiting_stage).emulated_stream;
+        if (stream == NULL || stream == waiting_stream) {
+            return true;
+        }
+        EmulatedEvent *event = &emulated_events_.at(stage).at(chunk % num_buffers_);
+        if (waiting_stream == NULL) {
+            device_->synchronize(event);
+        } else {
+            device_->wait(waiting_stream, event);
+        }
+        return true;
+    }
+    cudaStream_t stream = stages_.at(stage).stream;
+    cudaStream_t waiting_stream = stages_.at(waiting_stage).stream;
+    if (stream == NULL || stream == waiting_stream) {
+        return true;
+    }
+    cudaEvent_t event = events_.at(stage).at(chunk % num_buffers_);
+    if (waiting_stream == NULL) {
+        check_cuda(cudaEventSynchronize(event));
+    } else {
+        check_cuda(cudaStreamWaitEvent(waiting_stream, event, 0));
+    }
+    return true;
+}
+
+void Pipeline::run_stage(long stage, long num_chunks) {
+    long num_stages = stages_.size();
+    try {
+        for (long chunk = 0; chunk < num_chunks; ++chunk) {
+            long buffer = chunk % num_buffers_;
+            if (stage > 0 && !wait_for(stage - 1, chunk, stage)) {
+                return;
             }
-        } else if (i % 3 == 1) {
-            // one in, two out, zero compute
-            // one in
-            if (chunk_one < num_chunks && i > 0) {
-                long buffer = chunk_one % 2;
-                if (forward) {
-                    forward_in(chunk_one, buffer);
-                } else {
-                    backward_in(chunk_one, buffer);
-                }
+            // the next stage still reads what this stage wrote to the buffer for an earlier chunk
+            if (stage < num_stages - 1 && chunk >= num_buffers_ && !wait_for(stage + 1, chunk - num_buffers_, stage)) {
+                return;
             }
 
-            // two out
-            if (chunk_two < num_chunks && i > 3) {
-                long buffer = chunk_two % 2;
-                if (forward) {
-                    forward_out(chunk_two, buffer);
-                } else {
-                    backward_out(chunk_two, buffer);
-                }
+            stages_.at(stage).run(chunk, buffer);
+            if (stages_.at(stage).stream != NULL) {
+                check_cuda(cudaEventRecord(events_.at(stage).at(buffer), stages_.at(stage).stream));
+            } else if (stages_.at(stage).emulated_stream != NULL) {
+                device_->record(&emulated_events_.at(stage).at(buffer), stages_.at(stage).emulated_stream);
             }
 
-            // zero compute
-            if (chunk_zero < num_chunks && i > 0) {
-                long buffer = chunk_zero % 2;
-                if (forward) {
-                    forward_compute(chunk_zero, buffer);
-                } else {
-                    backward_compute(chunk_zero, buffer);
-                }
+            std::lock_guard<std::mutex> lock(mutex_);
+            num_done_.at(stage) = chunk + 1;
+            done_.notify_all();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+        done_.notify_all();
+    }
+}
+
+void Pipeline::run(long num_chunks) {
+    long num_stages = stages_.size();
+    error_ = nullptr;
+    num_done_.assign(num_stages, 0);
+    events_ = std::vector<std::vector<cudaEvent_t>>(num_stages);
+    emulated_events_ = std::vector<std::vector<EmulatedEvent>>(num_stages, std::vector<EmulatedEvent>(num_buffers_));
+    for (long i = 0; i < num_stages; ++i) {
+        if (stages_.at(i).stream != NULL) {
+            events_.at(i).resize(num_buffers_);
+            for (long j = 0; j < num_buffers_; ++j) {
+                check_cuda(cudaEventCreateWithFlags(&events_.at(i).at(j), cudaEventDisableTiming));
+            }
+        }
+    }
+
+    std::vector<std::thread> workers(num_stages);
+    for (long i = 0; i < num_stages; ++i) {
+        workers.at(i) = std::thread(&Pipeline::run_stage, this, i, num_chunks);
+    }
+    for (long i = 0; i < num_stages; ++i) {
+        workers.at(i).join();
+    }
+
+    // the streams may still use the buffers of the stages, even after an error
+    if (device_ != NULL) {
+        try {
+            device_->synchronize();
+        } catch (...) {
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+    }
+    for (long i = 0; i < num_stages; ++i) {
+        if (stages_.at(i).stream != NULL) {
+            check_cuda(cudaStreamSynchronize(stages_.at(i).stream));
+            for (long j = 0; j < num_buffers_; ++j) {
+                check_cuda(cudaEventDestroy(events_.at(i).at(j)));
             }
-        } else if (i % 3 == 2) {
-            // two in, zero out, one compute
-            // two in
-            if (chunk_two < num_chunks && i > 0) {
-                long buffer = chunk_two % 2;
+        }
+    }
+
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void LayerPipelined::get_chunk_costs(bool forward, long chunk, long *in_size, double *num_flops, long *out_size) {
+    throw "Layer has no chunk costs";
+}
+
+void LayerPipelined::set_emulated_device(EmulatedDevice *device) {
+    emulated_device_ = device;
+}
+
+// in, compute and out of a chunk on their own streams
+void LayerPipelined::pipeline(CudaHelper *helper, bool forward, long num_chunks, long num_buffers) {
+    if (emulated_device_ != NULL) {
+        EmulatedDevice *device = emulated_device_;
+        Pipeline pipeline(num_buffers, device);
+        pipeline.add_emulated_stage([this, helper, device, forward](long chunk, long buffer) {
+            long in_size;
+            double num_flops;
+            long out_size;
+            get_chunk_costs(forward, chunk, &in_size, &num_flops, &out_size);
+            device->launch([this, helper, forward, chunk, buffer]() {
                 if (forward) {
-                    forward_in(chunk_two, buffer);
+                    forward_in(chunk, buffer);
                 } else {
-                    backward_in(chunk_two, buffer);
+                    backward_in(chunk, buffer);
                 }
-            }
-
-            // zero out
-            if (chunk_zero < num_chunks && i > 1) {
-                long buffer = chunk_zero % 2;
+                check_cuda(cudaStreamSynchronize(helper->stream_in_));
+            }, device->get_copy_time(in_size), device->stream_in_);
+        }, device->stream_in_);
+        pipeline.add_emulated_stage([this, helper, device, forward](long chunk, long buffer) {
+            long in_size;
+            double num_flops;
+            long out_size;
+            get_chunk_costs(forward, chunk, &in_size, &num_flops, &out_size);
+            device->launch([this, helper, forward, chunk, buffer]() {
                 if (forward) {
-                    forward_out(chunk_zero, buffer);
+                    forward_compute(chunk, buffer);
                 } else {
-                    backward_out(chunk_zero, buffer);
+                    backward_compute(chunk, buffer);
                 }
-            }
-
-            // one compute
-            if (chunk_one < num_chunks && i > 0) {
-                long buffer = chunk_one % 2;
+                check_cuda(cudaStreamSynchronize(helper->stream_compute_));
+            }, device->get_compute_time(num_flops), device->stream_compute_);
+        }, device->stream_compute_);
+        pipeline.add_emulated_stage([this, helper, device, forward](long chunk, long buffer) {
+            long in_size;
+            double num_flops;
+            long out_size;
+            get_chunk_costs(forward, chunk, &in_size, &num_flops, &out_size);
+            device->launch([this, helper, forward, chunk, buffer]() {
                 if (forward) {
-                    forward_compute(chunk_one, buffer);
+                    forward_out(chunk, buffer);
                 } else {
-                    backward_compute(chunk_one, buffer);
+                    backward_out(chunk, buffer);
                 }
-            }
-        }
+                check_cuda(cudaStreamSynchronize(helper->stream_out_));
+            }, device->get_copy_time(out_size), device->stream_out_);
+        }, device->stream_out_);
+        pipeline.run(num_chunks);
+        return;
+    }
 
-        // sync all spanned calls
-        check_cuda(cudaDeviceSynchronize());
+    Pipeline pipeline(num_buffers);
+    if (forward) {
+        pipeline.add_stage([this](long chunk, long buffer) { forward_in(chunk, buffer); }, helper->stream_in_);
+        pipeline.add_stage([this](long chunk, long buffer) { forward_compute(chunk, buffer); }, helper->stream_compute_);
+        pipeline.add_stage([this](long chunk, long buffer) { forward_out(chunk, buffer); }, helper->stream_out_);
+    } else {
+        pipeline.add_stage([this](long chunk, long buffer) { backward_in(chunk, buffer); }, helper->stream_in_);
+        pipeline.add_stage([this](long chunk, long buffer) { backward_compute(chunk, buffer); }, helper->stream_compute_);
+        pipeline.add_stage([this](long chunk, long buffer) { backward_out(chunk, buffer); }, helper->stream_out_);
     }
+    pipeline.run(num_chunks);
 }
@@ -1,6 +1,7 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "relu.hpp"
+#include "chunking.hpp"
 
 #include <cmath>
 #include <limits>
@@ -18,12 +19,14 @@ void Relu::set(CudaHelper *helper, long num_nodes, long num_features) {
     alpha_ = 1.0;
     beta_ = 0.0;
 
-    check_cudnn(cudnnCreateActivationDescriptor(&relu_desc_));
-    double coef = std::numeric_limits<double>::max();
-    check_cudnn(cudnnSetActivationDescriptor(relu_desc_,
-                                             CUDNN_ACTIVATION_RELU,
-                                             CUDNN_PROPAGATE_NAN,
-                                             coef));
+    if (relu_desc_ == NULL) {
+        check_cudnn(cudnnCreateActivationDescriptor(&relu_desc_));
+        double coef = std::numeric_limits<double>::max();
+        check_cudnn(cudnnSetActivationDescriptor(relu_desc_,
+                                                 CUDNN_ACTIVATION_RELU,
+                                                 CUDNN_PROPAGATE_NAN,
+                                                 coef));
+    }
 
     y_.set(num_nodes, num_features, true);
     gradients_.set(num_nodes, num_features, true);
@@ -35,6 +38,7 @@ Matrix<float> *Relu::forward(Matrix<float> *x) {
         throw "Matrix shapes are unequal";
     }
     x_ = x;
+    y_.allocate();
 
     float *d_x;
     check_cuda(cudaMalloc(&d_x, x->size_ * sizeof(float)));
@@ -128,6 +132,20 @@ Matrix<float> *Relu::backward(Matrix<float> *incoming_gradients) {
     return &gradients_;
 }
 
+void Relu::release_y() {
+    y_.release();
+}
+
+void Relu::recompute_y() {
+    if (y_.values_ != NULL) {
+        return;
+    }
+    if (x_ == NULL) {
+        throw "Forward pass is missing";
+    }
+    forward(x_);
+}
+
 // CHUNKED --- CHUNKED --- CHUNKED
 
 ReluChunked::ReluChunked() {}
@@ -136,27 +154,29 @@ ReluChunked::ReluChunked(CudaHelper *helper, long chunk_size, long num_nodes, lo
     set(helper, chunk_size, num_nodes, num_features);
 }
 
+ReluChunked::ReluChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    set(helper, boundaries, num_features);
+}
+
 void ReluChunked::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_features);
+}
+
+void ReluChunked::set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
     name_ = "relu_chunked";
-    chunk_size_ = chunk_size;
+    chunk_size_ = get_max_chunk_size(boundaries);
     cuda_helper_ = helper;
     alpha_ = 1.0;
     beta_ = 0.0;
 
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size_);
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
-    }
+    num_chunks_ = boundaries->size() - 1;
 
     y_ = std::vector<Matrix<float>>(num_chunks_);
     gradients_ = std::vector<Matrix<float>>(num_chunks_);
-    long current_chunk_size = chunk_size_;
     for (int i = 0; i < num_chunks_; ++i) {
-        if (i == num_chunks_ - 1) {
-            current_chunk_size = last_chunk_size_;
-        }
+        long current_chunk_size = boundaries->at(i + 1) - boundaries->at(i);
         y_[i].set(current_chunk_size, num_features, true);
         gradients_[i].set(current_chunk_size, num_features, true);
     }
@@ -169,53 +189,69 @@ void ReluChunked::set(CudaHelper *helper, long chunk_size, long num_nodes, long
                                              coef));
 }
 
-std::vector<Matrix<float>> *ReluChunked::forward(std::vector<Matrix<float>> *x) {
+std::vector<Matrix<float>> *ReluChunked::forward_begin(std::vector<Matrix<float>> *x) {
     if (num_chunks_ != (long) x->size()) {
         throw "Input has wrong number of chunks";
     }
-    for (int i = 0; i < num_chunks_; ++i) {
-        to_row_major_inplace(&x->at(i));
-    }
+    x_ = x;
 
-    float *d_x;
-    check_cuda(cudaMalloc(&d_x, x->at(0).size_ * sizeof(float)));
-    cudnnTensorDescriptor_t x_desc;
-    check_cudnn(cudnnCreateTensorDescriptor(&x_desc));
+    return &y_;
+}
 
-    float *d_y;
-    check_cuda(cudaMalloc(&d_y, y_.at(0).size_ * sizeof(float)));
-    cudnnTensorDescriptor_t y_desc;
-    check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
+void ReluChunked::forward_chunk(long chunk) {
+    to_row_major_inplace(&x_->at(chunk));
+    y_.at(chunk).allocate();
 
-    for (int i = 0; i < num_chunks_; ++i) {
-        // in
-        check_cuda(cudaMemcpy(d_x, x->at(i).values_, x->at(i).size_ * sizeof(float),
-                              cudaMemcpyHostToDevice));
-        check_cudnn(cudnnSetTensor4dDescriptor(x_desc,
-                                               CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                               x->at(i).num_rows_, 1, 1, x->at(i).num_columns_));
-        check_cudnn(cudnnSetTensor4dDescriptor(y_desc,
-                                               CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
-                                               y_.at(i).num_rows_, 1, 1, y_.at(i).num_columns_));
+    if (d_x_forward_ == NULL) {
+        check_cuda(cudaMalloc(&d_x_forward_, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+        check_cudnn(cudnnCreateTensorDescriptor(&x_desc_forward_));
+        check_cuda(cudaMalloc(&d_y_forward_, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
+        check_cudnn(cudnnCreateTensorDescriptor(&y_desc_forward_));
+    }
 
-        // compute
-        check_cudnn(cudnnActivationForward(cuda_helper_->cudnn_handle,
-                                           relu_desc_,
-                                           &alpha_, x_desc, d_x,
-                                           &beta_, y_desc, d_y));
+    // in
+    check_cuda(cudaMemcpy(d_x_forward_, x_->at(chunk).values_, x_->at(chunk).size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    check_cudnn(cudnnSetTensor4dDescriptor(x_desc_forward_,
+                                           CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           x_->at(chunk).num_rows_, 1, 1, x_->at(chunk).num_columns_));
+    check_cudnn(cudnnSetTensor4dDescriptor(y_desc_forward_,
+                                           CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           y_.at(chunk).num_rows_, 1, 1, y_.at(chunk).num_columns_));
 
-        // out
-        check_cuda(cudaMemcpy(y_.at(i).values_, d_y,
-                              y_.at(i).size_ * sizeof(float),
-                              cudaMemcpyDeviceToHost));
-        y_.at(i).is_row_major_ = true;
+    // compute
+    check_cudnn(cudnnActivationForward(cuda_helper_->cudnn_handle,
+                                       relu_desc_,
+                                       &alpha_, x_desc_forward_, d_x_forward_,
+                                       &beta_, y_desc_forward_, d_y_forward_));
+
+    // out
+    check_cuda(cudaMemcpy(y_.at(chunk).values_, d_y_forward_,
+                          y_.at(chunk).size_ * sizeof(float),
+                          cudaMemcpyDeviceToHost));
+    y_.at(chunk).is_row_major_ = true;
+}
+
+void ReluChunked::forward_end() {
+    if (d_x_forward_ == NULL) {
+        return;
     }
 
     // free GPU memory
-    check_cuda(cudaFree(d_x));
-    check_cuda(cudaFree(d_y));
+    check_cuda(cudaFree(d_x_forward_));
+    check_cudnn(cudnnDestroyTensorDescriptor(x_desc_forward_));
+    check_cuda(cudaFree(d_y_forward_));
+    check_cudnn(cudnnDestroyTensorDescriptor(y_desc_forward_));
+    d_x_forward_ = NULL;
+    d_y_forward_ = NULL;
+}
 
-    x_ = x;
+std::vector<Matrix<float>> *ReluChunked::forward(std::vector<Matrix<float>> *x) {
+    forward_begin(x);
+    for (long i = 0; i < num_chunks_; ++i) {
+        forward_chunk(i);
+    }
+    forward_end();
 
     return &y_;
 }
@@ -231,22 +267,22 @@ std::vector<Matrix<float>> *ReluChunked::backward(std::vector<Matrix<float>> *in
     }
 
     float *d_y;
-    check_cuda(cudaMalloc(&d_y, y_.at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_y, chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t y_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
 
     float *d_dy;
-    check_cuda(cudaMalloc(&d_dy, incoming_gradients->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dy, chunk_size_ * incoming_gradients->at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t dy_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&dy_desc));
 
     float *d_x;
-    check_cuda(cudaMalloc(&d_x, x_->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_x, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t x_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&x_desc));
 
     float *d_dx;
-    check_cuda(cudaMalloc(&d_dx, x_->at(0).size_ * sizeof(float)));
+    check_cuda(cudaMalloc(&d_dx, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
     cudnnTensorDescriptor_t dx_desc;
     check_cudnn(cudnnCreateTensorDescriptor(&dx_desc));
 
@@ -285,6 +321,22 @@ std::vector<Matrix<float>> *ReluChunked::backward(std::vector<Matrix<float>> *in
     return &gradients_;
 }
 
+void ReluChunked::release_y() {
+    for (long i = 0; i < num_chunks_; ++i) {
+        y_.at(i).release();
+    }
+}
+
+void ReluChunked::recompute_y() {
+    if (y_.at(0).values_ != NULL) {
+        return;
+    }
+    if (x_ == NULL) {
+        throw "Forward pass is missing";
+    }
+    forward(x_);
+}
+
 // PIPELINED --- PIPELINED --- PIPELINED
 
 ReluPipelined::ReluPipelined() {}
@@ -293,8 +345,18 @@ ReluPipelined::ReluPipelined(CudaHelper *helper, long chunk_size, long num_nodes
     set(helper, chunk_size, num_nodes, num_features);
 }
 
+ReluPipelined::ReluPipelined(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    set(helper, boundaries, num_features);
+}
+
 void ReluPipelined::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
-    ReluChunked::set(helper, chunk_size, num_nodes, num_features);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_features);
+}
+
+void ReluPipelined::set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    ReluChunked::set(helper, boundaries, num_features);
 
     name_ = "relu_pipelined";
     num_steps_ = 2;
@@ -318,6 +380,7 @@ void ReluPipelined::forward_in(long chunk, long buffer) {
 }
 
 void ReluPipelined::forward_out(long chunk, long buffer) {
+    y_.at(chunk).allocate();
     check_cuda(cudaMemcpyAsync(y_.at(chunk).values_, d_y_.at(buffer), y_.at(chunk).size_ * sizeof(float),
                                cudaMemcpyDeviceToHost, cuda_helper_->stream_out_));
     y_.at(chunk).is_row_major_ = true;
@@ -376,14 +439,14 @@ std::vector<Matrix<float>> *ReluPipelined::forward(std::vector<Matrix<float>> *x
 
     // allocate
     for (long j = 0; j < num_steps_; ++j) {
-        check_cuda(cudaMalloc(&d_x_.at(j), x->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_x_.at(j), chunk_size_ * x->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&x_desc_.at(j)));
 
-        check_cuda(cudaMalloc(&d_y_.at(j), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_.at(j), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&y_desc_.at(j)));
     }
 
-    pipeline(true, num_chunks_);
+    pipeline(cuda_helper_, true, num_chunks_, num_steps_);
 
     // free
     for (long j = 0; j < num_steps_; ++j) {
@@ -411,20 +474,20 @@ std::vector<Matrix<float>> *ReluPipelined::backward(std::vector<Matrix<float>> *
 
     // allocate
     for (long j = 0; j < num_steps_; ++j) {
-        check_cuda(cudaMalloc(&d_x_.at(j), x_->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_x_.at(j), chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&x_desc_.at(j)));
 
-        check_cuda(cudaMalloc(&d_y_.at(j), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_.at(j), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&y_desc_.at(j)));
 
-        check_cuda(cudaMalloc(&d_dx_.at(j), x_->at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dx_.at(j), chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&dx_desc_.at(j)));
 
-        check_cuda(cudaMalloc(&d_dy_.at(j), y_.at(0).size_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_dy_.at(j), chunk_size_ * y_.at(0).num_columns_ * sizeof(float)));
         check_cudnn(cudnnCreateTensorDescriptor(&dy_desc_.at(j)));
     }
 
-    pipeline(false, num_chunks_);
+    pipeline(cuda_helper_, false, num_chunks_, num_steps_);
 
     // free
     for (long j = 0; j < num_steps_; ++j) {
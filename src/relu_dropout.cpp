@@ -0,0 +1,366 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "relu_dropout.hpp"
+#include "chunking.hpp"
+
+#include <cstdlib>
+#include <limits>
+
+
+ReluDropout::ReluDropout() {}
+
+ReluDropout::ReluDropout(CudaHelper *helper, long num_nodes, long num_features) {
+    set(helper, num_nodes, num_features);
+}
+
+ReluDropout::~ReluDropout() {
+    if (reserve_space_ != NULL) {
+        check_cuda(cudaFreeHost(reserve_space_));
+    }
+}
+
+void ReluDropout::set(CudaHelper *helper, long num_nodes, long num_features) {
+    name_ = "relu_dropout";
+    cuda_helper_ = helper;
+    alpha_ = 1.0;
+    beta_ = 0.0;
+    probability_ = 0.2;
+    seed_ = rand();
+
+    check_cudnn(cudnnCreateActivationDescriptor(&relu_desc_));
+    double coef = std::numeric_limits<double>::max();
+    check_cudnn(cudnnSetActivationDescriptor(relu_desc_,
+                                             CUDNN_ACTIVATION_RELU,
+                                             CUDNN_PROPAGATE_NAN,
+                                             coef));
+
+    y_.set(num_nodes, num_features, true);
+    gradients_.set(num_nodes, num_features, true);
+
+    check_cudnn(cudnnDropoutGetStatesSize(cuda_helper_->cudnn_handle, &state_size_));
+}
+
+void ReluDropout::set_keep_layout(bool keep_layout) {
+    keep_layout_ = keep_layout;
+}
+
+Matrix<float> *ReluDropout::forward(Matrix<float> *x) {
+    if (y_.num_rows_ != x->num_rows_ || y_.num_columns_ != x->num_columns_) {
+        throw "Matrix shapes are unequal";
+    }
+    if (!keep_layout_) {
+        to_row_major_inplace(x);
+    }
+
+    void *d_states;
+    check_cuda(cudaMalloc(&d_states, state_size_));
+    cudnnDropoutDescriptor_t dropout_desc;
+    check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc));
+    check_cudnn(cudnnSetDropoutDescriptor(dropout_desc, cuda_helper_->cudnn_handle, probability_,
+                                          d_states, state_size_, seed_));
+
+    cudnnTensorDescriptor_t x_desc;
+    check_cudnn(cudnnCreateTensorDescriptor(&x_desc));
+    check_cudnn(cudnnSetTensor4dDescriptor(x_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           x->num_rows_, 1, 1, x->num_columns_));
+    float *d_x;
+    check_cuda(cudaMalloc(&d_x, x->size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_x, x->values_, x->size_ * sizeof(float), cudaMemcpyHostToDevice));
+    float *d_relu;
+    check_cuda(cudaMalloc(&d_relu, x->size_ * sizeof(float)));
+
+    void *d_reserve_space;
+    check_cudnn(cudnnDropoutGetReserveSpaceSize(x_desc, &reserve_space_size_));
+    check_cuda(cudaMalloc(&d_reserve_space, reserve_space_size_));
+
+    // the output of the ReLU stays on the device, the dropout writes over the input
+    check_cudnn(cudnnActivationForward(cuda_helper_->cudnn_handle, relu_desc_,
+                                       &alpha_, x_desc, d_x,
+                                       &beta_, x_desc, d_relu));
+    check_cudnn(cudnnDropoutForward(cuda_helper_->cudnn_handle, dropout_desc,
+                                    x_desc, d_relu, x_desc, d_x,
+                                    d_reserve_space, reserve_space_size_));
+
+    check_cuda(cudaMemcpy(y_.values_, d_x, y_.size_ * sizeof(float), cudaMemcpyDeviceToHost));
+    y_.is_row_major_ = x->is_row_major_;
+    is_row_major_mask_ = x->is_row_major_;
+
+    if (reserve_space_ == NULL) {
+        check_cuda(cudaMallocHost(&reserve_space_, reserve_space_size_));
+    }
+    check_cuda(cudaMemcpy(reserve_space_, d_reserve_space, reserve_space_size_, cudaMemcpyDeviceToHost));
+
+    // free
+    check_cuda(cudaFree(d_states));
+    check_cudnn(cudnnDestroyDropoutDescriptor(dropout_desc));
+    check_cudnn(cudnnDestroyTensorDescriptor(x_desc));
+    check_cuda(cudaFree(d_x));
+    check_cuda(cudaFree(d_relu));
+    check_cuda(cudaFree(d_reserve_space));
+
+    return &y_;
+}
+
+Matrix<float> *ReluDropout::backward(Matrix<float> *incoming_gradients) {
+    if (y_.num_rows_ != incoming_gradients->num_rows_ || y_.num_columns_ != incoming_gradients->num_columns_) {
+        throw "Matrix shapes are unequal";
+    }
+    if (reserve_space_ == NULL) {
+        throw "Forward pass is missing";
+    }
+    to_layout_inplace(incoming_gradients, is_row_major_mask_);
+    to_layout_inplace(&y_, is_row_major_mask_);
+
+    void *d_states;
+    check_cuda(cudaMalloc(&d_states, state_size_));
+    cudnnDropoutDescriptor_t dropout_desc;
+    check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc));
+    check_cudnn(cudnnSetDropoutDescriptor(dropout_desc, cuda_helper_->cudnn_handle, probability_,
+                                          d_states, state_size_, seed_));
+
+    cudnnTensorDescriptor_t y_desc;
+    check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
+    check_cudnn(cudnnSetTensor4dDescriptor(y_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           y_.num_rows_, 1, 1, y_.num_columns_));
+    float *d_y;
+    check_cuda(cudaMalloc(&d_y, y_.size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_y, y_.values_, y_.size_ * sizeof(float), cudaMemcpyHostToDevice));
+    float *d_dy;
+    check_cuda(cudaMalloc(&d_dy, y_.size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_dy, incoming_gradients->values_, incoming_gradients->size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    float *d_dx;
+    check_cuda(cudaMalloc(&d_dx, y_.size_ * sizeof(float)));
+
+    void *d_reserve_space;
+    check_cuda(cudaMalloc(&d_reserve_space, reserve_space_size_));
+    check_cuda(cudaMemcpy(d_reserve_space, reserve_space_, reserve_space_size_, cudaMemcpyHostToDevice));
+
+    // the gradients of the dropout stay on the device, the ReLU writes over the incoming ones
+    check_cudnn(cudnnDropoutBackward(cuda_helper_->cudnn_handle, dropout_desc,
+                                     y_desc, d_dy, y_desc, d_dx,
+                                     d_reserve_space, reserve_space_size_));
+    check_cudnn(cudnnActivationBackward(cuda_helper_->cudnn_handle, relu_desc_,
+                                        &alpha_, y_desc, d_y,
+                                        y_desc, d_dx,
+                                        y_desc, d_y,
+                                        &beta_, y_desc, d_dy));
+
+    check_cuda(cudaMemcpy(gradients_.values_, d_dy, gradients_.size_ * sizeof(float), cudaMemcpyDeviceToHost));
+    gradients_.is_row_major_ = is_row_major_mask_;
+
+    // free
+    check_cuda(cudaFree(d_states));
+    check_cudnn(cudnnDestroyDropoutDescriptor(dropout_desc));
+    check_cudnn(cudnnDestroyTensorDescriptor(y_desc));
+    check_cuda(cudaFree(d_y));
+    check_cuda(cudaFree(d_dy));
+    check_cuda(cudaFree(d_dx));
+    check_cuda(cudaFree(d_reserve_space));
+
+    return &gradients_;
+}
+
+// CHUNKED --- CHUNKED --- CHUNKED
+
+ReluDropoutChunked::ReluDropoutChunked() {}
+
+ReluDropoutChunked::ReluDropoutChunked(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
+    set(helper, chunk_size, num_nodes, num_features);
+}
+
+ReluDropoutChunked::ReluDropoutChunked(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    set(helper, boundaries, num_features);
+}
+
+ReluDropoutChunked::~ReluDropoutChunked() {
+    for (char *reserve_space : reserve_space_) {
+        if (reserve_space != NULL) {
+            check_cuda(cudaFreeHost(reserve_space));
+        }
+    }
+}
+
+void ReluDropoutChunked::set(CudaHelper *helper, long chunk_size, long num_nodes, long num_features) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, &boundaries, num_features);
+}
+
+void ReluDropoutChunked::set(CudaHelper *helper, std::vector<long> *boundaries, long num_features) {
+    name_ = "relu_dropout_chunked";
+    cuda_helper_ = helper;
+    chunk_size_ = get_max_chunk_size(boundaries);
+    num_chunks_ = boundaries->size() - 1;
+    alpha_ = 1.0;
+    beta_ = 0.0;
+    probability_ = 0.2;
+    seed_ = rand();
+
+    check_cudnn(cudnnCreateActivationDescriptor(&relu_desc_));
+    double coef = std::numeric_limits<double>::max();
+    check_cudnn(cudnnSetActivationDescriptor(relu_desc_,
+                                             CUDNN_ACTIVATION_RELU,
+                                             CUDNN_PROPAGATE_NAN,
+                                             coef));
+
+    reserve_space_ = std::vector<char *>(num_chunks_, NULL);
+    y_ = std::vector<Matrix<float>>(num_chunks_);
+    gradients_ = std::vector<Matrix<float>>(num_chunks_);
+    for (long i = 0; i < num_chunks_; ++i) {
+        long current_chunk_size = boundaries->at(i + 1) - boundaries->at(i);
+        y_.at(i).set(current_chunk_size, num_features, true);
+        gradients_.at(i).set(current_chunk_size, num_features, true);
+    }
+    is_row_major_mask_ = std::vector<bool>(num_chunks_, true);
+
+    check_cudnn(cudnnDropoutGetStatesSize(cuda_helper_->cudnn_handle, &state_size_));
+}
+
+void ReluDropoutChunked::set_keep_layout(bool keep_layout) {
+    keep_layout_ = keep_layout;
+}
+
+std::vector<Matrix<float>> *ReluDropoutChunked::forward_begin(std::vector<Matrix<float>> *x) {
+    if ((long) x->size() != num_chunks_) {
+        throw "Input has wrong number of chunks";
+    }
+    x_ = x;
+
+    return &y_;
+}
+
+void ReluDropoutChunked::forward_chunk(long chunk) {
+    if (!keep_layout_) {
+        to_row_major_inplace(&x_->at(chunk));
+    }
+
+    // the random states are initialised once per pass
+    if (d_states_forward_ == NULL) {
+        check_cuda(cudaMalloc(&d_states_forward_, state_size_));
+        check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc_forward_));
+        check_cudnn(cudnnSetDropoutDescriptor(dropout_desc_forward_, cuda_helper_->cudnn_handle, probability_,
+                                              d_states_forward_, state_size_, seed_));
+
+        check_cuda(cudaMalloc(&d_x_forward_, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+        check_cuda(cudaMalloc(&d_y_forward_, chunk_size_ * x_->at(0).num_columns_ * sizeof(float)));
+        check_cudnn(cudnnCreateTensorDescriptor(&x_desc_forward_));
+        check_cudnn(cudnnSetTensor4dDescriptor(x_desc_forward_, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                               chunk_size_, 1, 1, x_->at(0).num_columns_));
+
+        check_cudnn(cudnnDropoutGetReserveSpaceSize(x_desc_forward_, &reserve_space_size_));
+        check_cuda(cudaMalloc(&d_reserve_space_forward_, reserve_space_size_));
+    }
+
+    check_cuda(cudaMemcpy(d_x_forward_, x_->at(chunk).values_, x_->at(chunk).size_ * sizeof(float),
+                          cudaMemcpyHostToDevice));
+    check_cudnn(cudnnSetTensor4dDescriptor(x_desc_forward_, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                           x_->at(chunk).num_rows_, 1, 1, x_->at(chunk).num_columns_));
+
+    // the output of the ReLU stays on the device, the dropout writes over the input
+    check_cudnn(cudnnActivationForward(cuda_helper_->cudnn_handle, relu_desc_,
+                                       &alpha_, x_desc_forward_, d_x_forward_,
+                                       &beta_, x_desc_forward_, d_y_forward_));
+    check_cudnn(cudnnDropoutForward(cuda_helper_->cudnn_handle, dropout_desc_forward_,
+                                    x_desc_forward_, d_y_forward_, x_desc_forward_, d_x_forward_,
+                                    d_reserve_space_forward_, reserve_space_size_));
+
+    check_cuda(cudaMemcpy(y_.at(chunk).values_, d_x_forward_, y_.at(chunk).size_ * sizeof(float),
+                          cudaMemcpyDeviceToHost));
+    y_.at(chunk).is_row_major_ = x_->at(chunk).is_row_major_;
+    is_row_major_mask_.at(chunk) = x_->at(chunk).is_row_major_;
+
+    if (reserve_space_.at(chunk) == NULL) {
+        check_cuda(cudaMallocHost(&reserve_space_.at(chunk), reserve_space_size_));
+    }
+    check_cuda(cudaMemcpy(reserve_space_.at(chunk), d_reserve_space_forward_, reserve_space_size_, cudaMemcpyDeviceToHost));
+}
+
+void ReluDropoutChunked::forward_end() {
+    if (d_states_forward_ == NULL) {
+        return;
+    }
+
+    // free
+    check_cuda(cudaFree(d_states_forward_));
+    check_cudnn(cudnnDestroyDropoutDescriptor(dropout_desc_forward_));
+    check_cuda(cudaFree(d_reserve_space_forward_));
+    check_cuda(cudaFree(d_x_forward_));
+    check_cuda(cudaFree(d_y_forward_));
+    check_cudnn(cudnnDestroyTensorDescriptor(x_desc_forward_));
+    d_states_forward_ = NULL;
+}
+
+std::vector<Matrix<float>> *ReluDropoutChunked::forward(std::vector<Matrix<float>> *x) {
+    forward_begin(x);
+    for (long i = 0; i < num_chunks_; ++i) {
+        forward_chunk(i);
+    }
+    forward_end();
+
+    return &y_;
+}
+
+std::vector<Matrix<float>> *ReluDropoutChunked::backward(std::vector<Matrix<float>> *incoming_gradients) {
+    if ((long) incoming_gradients->size() != num_chunks_) {
+        throw "Incoming gradients has wrong number of chunks";
+    }
+    if (reserve_space_.at(0) == NULL) {
+        throw "Forward pass is missing";
+    }
+
+    void *d_states;
+    check_cuda(cudaMalloc(&d_states, state_size_));
+    cudnnDropoutDescriptor_t dropout_desc;
+    check_cudnn(cudnnCreateDropoutDescriptor(&dropout_desc));
+    check_cudnn(cudnnSetDropoutDescriptor(dropout_desc, cuda_helper_->cudnn_handle, probability_,
+                                          d_states, state_size_, seed_));
+
+    long num_features = y_.at(0).num_columns_;
+    float *d_y;
+    check_cuda(cudaMalloc(&d_y, chunk_size_ * num_features * sizeof(float)));
+    float *d_dy;
+    check_cuda(cudaMalloc(&d_dy, chunk_size_ * num_features * sizeof(float)));
+    float *d_dx;
+    check_cuda(cudaMalloc(&d_dx, chunk_size_ * num_features * sizeof(float)));
+    cudnnTensorDescriptor_t y_desc;
+    check_cudnn(cudnnCreateTensorDescriptor(&y_desc));
+    void *d_reserve_space;
+    check_cuda(cudaMalloc(&d_reserve_space, reserve_space_size_));
+
+    for (long i = 0; i < num_chunks_; ++i) {
+        to_layout_inplace(&incoming_gradients->at(i), is_row_major_mask_.at(i));
+        to_layout_inplace(&y_.at(i), is_row_major_mask_.at(i));
+
+        check_cuda(cudaMemcpy(d_y, y_.at(i).values_, y_.at(i).size_ * sizeof(float), cudaMemcpyHostToDevice));
+        check_cuda(cudaMemcpy(d_dy, incoming_gradients->at(i).values_, incoming_gradients->at(i).size_ * sizeof(float),
+                              cudaMemcpyHostToDevice));
+        check_cuda(cudaMemcpy(d_reserve_space, reserve_space_.at(i), reserve_space_size_, cudaMemcpyHostToDevice));
+        check_cudnn(cudnnSetTensor4dDescriptor(y_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+                                               y_.at(i).num_rows_, 1, 1, y_.at(i).num_columns_));
+
+        // the gradients of the dropout stay on the device, the ReLU writes over the incoming ones
+        check_cudnn(cudnnDropoutBackward(cuda_helper_->cudnn_handle, dropout_desc,
+                                         y_desc, d_dy, y_desc, d_dx,
+                                         d_reserve_space, reserve_space_size_));
+        check_cudnn(cudnnActivationBackward(cuda_helper_->cudnn_handle, relu_desc_,
+                                            &alpha_, y_desc, d_y,
+                                            y_desc, d_dx,
+                                            y_desc, d_y,
+                                            &beta_, y_desc, d_dy));
+
+        check_cuda(cudaMemcpy(gradients_.at(i).values_, d_dy, gradients_.at(i).size_ * sizeof(float), cudaMemcpyDeviceToHost));
+        gradients_.at(i).is_row_major_ = is_row_major_mask_.at(i);
+    }
+
+    // free
+    check_cuda(cudaFree(d_states));
+    check_cudnn(cudnnDestroyDropoutDescriptor(dropout_desc));
+    check_cudnn(cudnnDestroyTensorDescriptor(y_desc));
+    check_cuda(cudaFree(d_y));
+    check_cuda(cudaFree(d_dy));
+    check_cuda(cudaFree(d_dx));
+    check_cuda(cudaFree(d_reserve_space));
+
+    return &gradients_;
+}
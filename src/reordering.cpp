@@ -0,0 +1,342 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "reordering.hpp"
+#include "chunking.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+
+std::string get_ordering_name(Ordering ordering) {
+    if (ordering == original) {
+        return "original";
+    } else if (ordering == rcm) {
+        return "rcm";
+    } else if (ordering == degree) {
+        return "degree";
+    } else if (ordering == community) {
+        return "community";
+    } else {
+        throw "Unknown ordering";
+    }
+}
+
+void get_permutation(SparseMatrix<float> *adjacency, Ordering ordering, std::vector<int> *new_ids) {
+    if (ordering == original) {
+        new_ids->resize(adjacency->num_rows_);
+        for (long i = 0; i < adjacency->num_rows_; ++i) {
+            new_ids->at(i) = i;
+        }
+    } else if (ordering == rcm) {
+        get_rcm_permutation(adjacency, new_ids);
+    } else if (ordering == degree) {
+        get_degree_permutation(adjacency, new_ids);
+    } else if (ordering == community) {
+        get_community_permutation(adjacency, 10, new_ids);
+    } else {
+        throw "Unknown ordering";
+    }
+}
+
+// undirected neighbourhoods without self-loops, A + A^T
+void get_undirected(SparseMatrix<float> *adjacency, std::vector<long> *offsets, std::vector<int> *neighbours) {
+    long num_nodes = adjacency->num_rows_;
+    if (adjacency->num_columns_ != num_nodes) {
+        throw "Adjacency is not square";
+    }
+
+    offsets->assign(num_nodes + 1, 0);
+    for (long row = 0; row < num_nodes; ++row) {
+        for (long j = adjacency->csr_row_ptr_[row]; j < adjacency->csr_row_ptr_[row + 1]; ++j) {
+            long column = adjacency->csr_col_ind_[j];
+            if (column != row) {
+                offsets->at(row + 1) += 1;
+                offsets->at(column + 1) += 1;
+            }
+        }
+    }
+    for (long i = 0; i < num_nodes; ++i) {
+        offsets->at(i + 1) += offsets->at(i);
+    }
+
+    neighbours->resize(offsets->at(num_nodes));
+    std::vector<long> positions(offsets->begin(), offsets->end() - 1);
+    for (long row = 0; row < num_nodes; ++row) {
+        for (long j = adjacency->csr_row_ptr_[row]; j < adjacency->csr_row_ptr_[row + 1]; ++j) {
+            long column = adjacency->csr_col_ind_[j];
+            if (column != row) {
+                neighbours->at(positions.at(row)) = column;
+                positions.at(row) += 1;
+                neighbours->at(positions.at(column)) = row;
+                positions.at(column) += 1;
+            }
+        }
+    }
+
+    // drop the duplicates of symmetric edges
+    long nnz = 0;
+    for (long i = 0; i < num_nodes; ++i) {
+        std::vector<int>::iterator begin = neighbours->begin() + offsets->at(i);
+        std::vector<int>::iterator end = neighbours->begin() + offsets->at(i + 1);
+        std::sort(begin, end);
+        end = std::unique(begin, end);
+        long degree = end - begin;
+        std::copy(begin, end, neighbours->begin() + nnz);
+        offsets->at(i) = nnz;
+        nnz = nnz + degree;
+    }
+    offsets->at(num_nodes) = nnz;
+    neighbours->resize(nnz);
+}
+
+void order_to_new_ids(std::vector<int> *order, std::vector<int> *new_ids) {
+    new_ids->resize(order->size());
+    for (long i = 0; i < (long) order->size(); ++i) {
+        new_ids->at(order->at(i)) = i;
+    }
+}
+
+// BFS from a minimum-degree node per component, neighbours visited by increasing degree, then reversed
+void get_rcm_permutation(SparseMatrix<float> *adjacency, std::vector<int> *new_ids) {
+    std::vector<long> offsets;
+    std::vector<int> neighbours;
+    get_undirected(adjacency, &offsets, &neighbours);
+    long num_nodes = adjacency->num_rows_;
+
+    std::vector<int> nodes_by_degree(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        nodes_by_degree.at(i) = i;
+    }
+    std::stable_sort(nodes_by_degree.begin(), nodes_by_degree.end(), [&offsets](int a, int b) {
+        return offsets.at(a + 1) - offsets.at(a) < offsets.at(b + 1) - offsets.at(b);
+    });
+
+    std::vector<int> order;
+    order.reserve(num_nodes);
+    std::vector<bool> visited(num_nodes, false);
+    for (long s = 0; s < num_nodes; ++s) {
+        int start = nodes_by_degree.at(s);
+        if (visited.at(start)) {
+            continue;
+        }
+        visited.at(start) = true;
+        long head = order.size();
+        order.push_back(start);
+        while (head < (long) order.size()) {
+            int node = order.at(head);
+            head = head + 1;
+            long first_new = order.size();
+            for (long j = offsets.at(node); j < offsets.at(node + 1); ++j) {
+                int neighbour = neighbours.at(j);
+                if (!visited.at(neighbour)) {
+                    visited.at(neighbour) = true;
+                    order.push_back(neighbour);
+                }
+            }
+            std::stable_sort(order.begin() + first_new, order.end(), [&offsets](int a, int b) {
+                return offsets.at(a + 1) - offsets.at(a) < offsets.at(b + 1) - offsets.at(b);
+            });
+        }
+    }
+    std::reverse(order.begin(), order.end());
+
+    order_to_new_ids(&order, new_ids);
+}
+
+// hubs first, their rows and feature rows end up close together
+void get_degree_permutation(SparseMatrix<float> *adjacency, std::vector<int> *new_ids) {
+    long num_nodes = adjacency->num_rows_;
+    std::vector<int> degrees(num_nodes, 0);
+    for (long j = 0; j < adjacency->nnz_; ++j) {
+        degrees.at(adjacency->csr_col_ind_[j]) += 1;
+    }
+    for (long i = 0; i < num_nodes; ++i) {
+        degrees.at(i) += adjacency->csr_row_ptr_[i + 1] - adjacency->csr_row_ptr_[i];
+    }
+
+    std::vector<int> order(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        order.at(i) = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&degrees](int a, int b) {
+        return degrees.at(a) > degrees.at(b);
+    });
+
+    order_to_new_ids(&order, new_ids);
+}
+
+// one synchronous label propagation round over the nodes [start, end)
+void propagate_labels(std::vector<long> *offsets, std::vector<int> *neighbours, std::vector<int> *labels,
+                      std::vector<int> *new_labels, long start, long end) {
+    std::vector<int> neighbour_labels;
+    for (long node = start; node < end; ++node) {
+        neighbour_labels.clear();
+        for (long j = offsets->at(node); j < offsets->at(node + 1); ++j) {
+            neighbour_labels.push_back(labels->at(neighbours->at(j)));
+        }
+        int label = labels->at(node);
+        if (neighbour_labels.empty()) {
+            new_labels->at(node) = label;
+            continue;
+        }
+        std::sort(neighbour_labels.begin(), neighbour_labels.end());
+
+        // most frequent label, the current label wins ties so labels do not oscillate
+        long best_count = 0;
+        int best_label = label;
+        for (long i = 0; i < (long) neighbour_labels.size();) {
+            long k = i;
+            while (k < (long) neighbour_labels.size() && neighbour_labels.at(k) == neighbour_labels.at(i)) {
+                k = k + 1;
+            }
+            long count = k - i;
+            if (count > best_count || (count == best_count && neighbour_labels.at(i) == label)) {
+                best_count = count;
+                best_label = neighbour_labels.at(i);
+            }
+            i = k;
+        }
+        new_labels->at(node) = best_label;
+    }
+}
+
+// nodes grouped by label propagation community, communities ordered by their smallest node
+void get_community_permutation(SparseMatrix<float> *adjacency, long num_iterations, std::vector<int> *new_ids) {
+    std::vector<long> offsets;
+    std::vector<int> neighbours;
+    get_undirected(adjacency, &offsets, &neighbours);
+    long num_nodes = adjacency->num_rows_;
+
+    std::vector<int> labels(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        labels.at(i) = i;
+    }
+    std::vector<int> new_labels(num_nodes);
+
+    long num_threads = std::max((long) std::thread::hardware_concurrency(), 1l);
+    long range_size = num_nodes / num_threads + 1;
+    std::vector<std::thread> threads;
+    for (long iteration = 0; iteration < num_iterations; ++iteration) {
+        threads.clear();
+        for (long start = 0; start < num_nodes; start = start + range_size) {
+            threads.push_back(std::thread(propagate_labels, &offsets, &neighbours, &labels, &new_labels,
+                                          start, std::min(start + range_size, num_nodes)));
+        }
+        for (long t = 0; t < (long) threads.size(); ++t) {
+            threads.at(t).join();
+        }
+        bool changed = labels != new_labels;
+        labels.swap(new_labels);
+        if (!changed) {
+            break;
+        }
+    }
+
+    std::vector<int> order(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        order.at(i) = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&labels](int a, int b) {
+        return labels.at(a) < labels.at(b);
+    });
+
+    order_to_new_ids(&order, new_ids);
+}
+
+void permute_sp_matrix(SparseMatrix<float> *sp_mat, std::vector<int> *new_ids, SparseMatrix<float> *permuted) {
+    long num_rows = sp_mat->num_rows_;
+    if ((long) new_ids->size() != num_rows || sp_mat->num_columns_ != num_rows) {
+        throw "Permutation does not match matrix";
+    }
+    permuted->set(sp_mat->num_rows_, sp_mat->num_columns_, sp_mat->nnz_);
+
+    permuted->csr_row_ptr_[0] = 0;
+    for (long row = 0; row < num_rows; ++row) {
+        permuted->csr_row_ptr_[new_ids->at(row) + 1] = sp_mat->csr_row_ptr_[row + 1] - sp_mat->csr_row_ptr_[row];
+    }
+    for (long row = 0; row < num_rows; ++row) {
+        permuted->csr_row_ptr_[row + 1] += permuted->csr_row_ptr_[row];
+    }
+
+    std::vector<std::pair<int, float>> entries;
+    for (long row = 0; row < num_rows; ++row) {
+        entries.clear();
+        for (long j = sp_mat->csr_row_ptr_[row]; j < sp_mat->csr_row_ptr_[row + 1]; ++j) {
+            entries.push_back(std::pair<int, float>(new_ids->at(sp_mat->csr_col_ind_[j]), sp_mat->csr_val_[j]));
+        }
+        std::sort(entries.begin(), entries.end());
+        long offset = permuted->csr_row_ptr_[new_ids->at(row)];
+        for (long j = 0; j < (long) entries.size(); ++j) {
+            permuted->csr_col_ind_[offset + j] = entries.at(j).first;
+            permuted->csr_val_[offset + j] = entries.at(j).second;
+        }
+    }
+}
+
+template<typename T>
+void permute_rows(Matrix<T> *mat, std::vector<int> *new_ids, Matrix<T> *permuted) {
+    if ((long) new_ids->size() != mat->num_rows_) {
+        throw "Permutation does not match matrix";
+    }
+    permuted->set(mat->num_rows_, mat->num_columns_, mat->is_row_major_);
+    for (long row = 0; row < mat->num_rows_; ++row) {
+        long new_row = new_ids->at(row);
+        if (mat->is_row_major_) {
+            std::memcpy(&permuted->values_[new_row * mat->num_columns_], &mat->values_[row * mat->num_columns_],
+                        mat->num_columns_ * sizeof(T));
+        } else {
+            for (long column = 0; column < mat->num_columns_; ++column) {
+                permuted->values_[column * mat->num_rows_ + new_row] = mat->values_[column * mat->num_rows_ + row];
+            }
+        }
+    }
+}
+
+template void permute_rows<float>(Matrix<float> *mat, std::vector<int> *new_ids, Matrix<float> *permuted);
+template void permute_rows<int>(Matrix<int> *mat, std::vector<int> *new_ids, Matrix<int> *permuted);
+
+template<typename T>
+void unpermute_rows(Matrix<T> *permuted, std::vector<int> *new_ids, Matrix<T> *mat) {
+    std::vector<int> old_ids(new_ids->size());
+    for (long i = 0; i < (long) new_ids->size(); ++i) {
+        old_ids.at(new_ids->at(i)) = i;
+    }
+    permute_rows<T>(permuted, &old_ids, mat);
+}
+
+template void unpermute_rows<float>(Matrix<float> *permuted, std::vector<int> *new_ids, Matrix<float> *mat);
+template void unpermute_rows<int>(Matrix<int> *permuted, std::vector<int> *new_ids, Matrix<int> *mat);
+
+long count_non_empty_tiles(SparseMatrix<float> *sp_mat, long chunk_size) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(sp_mat->num_columns_, chunk_size, &boundaries);
+    return count_non_empty_tiles(sp_mat, &boundaries);
+}
+
+long count_non_empty_tiles(SparseMatrix<float> *sp_mat, std::vector<long> *boundaries) {
+    long num_chunks = boundaries->size() - 1;
+    if (boundaries->back() != sp_mat->num_columns_) {
+        throw "Boundaries do not match the number of columns";
+    }
+    std::vector<long> column_chunks(sp_mat->num_columns_);
+    for (long i = 0; i < num_chunks; ++i) {
+        std::fill(column_chunks.begin() + boundaries->at(i), column_chunks.begin() + boundaries->at(i + 1), i);
+    }
+
+    long num_non_empty = 0;
+    std::vector<long> last_row_chunk(num_chunks, -1);
+    for (long row_chunk = 0; row_chunk < num_chunks; ++row_chunk) {
+        for (long row = boundaries->at(row_chunk); row < std::min(boundaries->at(row_chunk + 1), (long) sp_mat->num_rows_); ++row) {
+            for (long j = sp_mat->csr_row_ptr_[row]; j < sp_mat->csr_row_ptr_[row + 1]; ++j) {
+                long column_chunk = column_chunks.at(sp_mat->csr_col_ind_[j]);
+                if (last_row_chunk.at(column_chunk) != row_chunk) {
+                    last_row_chunk.at(column_chunk) = row_chunk;
+                    num_non_empty = num_non_empty + 1;
+                }
+            }
+        }
+    }
+    return num_non_empty;
+}
@@ -1,6 +1,7 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "sage_linear.hpp"
+#include "chunking.hpp"
 #include "dense_computation.hpp"
 
 #include <cmath>
@@ -24,6 +25,12 @@ void SageLinear::set(CudaHelper *helper, long in_features, long out_features, lo
     y_.set(num_nodes, num_out_features_, false);
 }
 
+void SageLinear::set_num_nodes(long num_nodes) {
+    linear_self_.set_num_nodes(num_nodes);
+    linear_neigh_.set_num_nodes(num_nodes);
+    y_.set(num_nodes, num_out_features_, false);
+}
+
 std::vector<Matrix<float> *> SageLinear::get_parameters() {
     std::vector<Matrix<float> *> self_params = linear_self_.get_parameters();
     std::vector<Matrix<float> *> neigh_params = linear_neigh_.get_parameters();
@@ -64,31 +71,50 @@ SageLinearGradients *SageLinear::backward(Matrix<float> *in_gradients) {
     return &input_gradients_;
 }
 
+Matrix<float> *SageLinear::get_y() {
+    return &y_;
+}
+
+Linear *SageLinear::get_linear_self() {
+    return &linear_self_;
+}
+
+Linear *SageLinear::get_linear_neigh() {
+    return &linear_neigh_;
+}
+
 // CHUNKED --- CHUNKED --- CHUNKED
 
+SageLinearChunkedParent::~SageLinearChunkedParent() {}
+
 SageLinearChunked::SageLinearChunked() {}
 
 SageLinearChunked::SageLinearChunked(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes) {
     set(helper, num_in_features, num_out_features, chunk_size, num_nodes);
 }
 
+SageLinearChunked::SageLinearChunked(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries) {
+    set(helper, num_in_features, num_out_features, boundaries);
+}
+
 void SageLinearChunked::set(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, num_in_features, num_out_features, &boundaries);
+}
+
+void SageLinearChunked::set(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries) {
     name_ = "sage-linear_chunked";
     cuda_helper_ = helper;
-    chunk_size_ = chunk_size;
+    chunk_size_ = get_max_chunk_size(boundaries);
     num_in_features_ = num_in_features;
     num_out_features_ = num_out_features;
 
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size_);
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
-    }
+    num_chunks_ = boundaries->size() - 1;
 
-    linear_self_.set(cuda_helper_, chunk_size, num_nodes, num_in_features_, num_out_features_);
-    linear_neigh_.set(cuda_helper_, chunk_size, num_nodes, num_in_features_, num_out_features_);
-    add_.set(cuda_helper_, chunk_size, num_nodes, num_out_features);
+    linear_self_.set(cuda_helper_, boundaries, num_in_features_, num_out_features_);
+    linear_neigh_.set(cuda_helper_, boundaries, num_in_features_, num_out_features_);
+    add_.set(cuda_helper_, boundaries, num_out_features);
 }
 
 std::vector<Matrix<float> *> SageLinearChunked::get_parameters() {
@@ -131,6 +157,31 @@ std::vector<Matrix<float>> *SageLinearChunked::forward(std::vector<Matrix<float>
     return y_;
 }
 
+std::vector<Matrix<float>> *SageLinearChunked::forward_begin(std::vector<Matrix<float>> *features, std::vector<Matrix<float>> *aggr) {
+    if (features->size() != aggr->size()) {
+        throw "Features and aggregated features have a different number of chunks";
+    }
+
+    std::vector<Matrix<float>> *y_self = linear_self_.forward_begin(features);
+    std::vector<Matrix<float>> *y_neigh = linear_neigh_.forward_begin(aggr);
+    y_ = add_.forward_begin(y_self, y_neigh);
+
+    return y_;
+}
+
+// keeps the buffers of all three layers on the device until forward_end, forward frees them after every layer
+void SageLinearChunked::forward_chunk(long chunk) {
+    linear_self_.forward_chunk(chunk);
+    linear_neigh_.forward_chunk(chunk);
+    add_.forward_chunk(chunk);
+}
+
+void SageLinearChunked::forward_end() {
+    linear_self_.forward_end();
+    linear_neigh_.forward_end();
+    add_.forward_end();
+}
+
 SageLinearGradientsChunked *SageLinearChunked::backward(std::vector<Matrix<float>> *incoming_gradients) {
     if (y_->size() != incoming_gradients->size()) {
         throw "Output and incoming gradients have a different number of chunks";
@@ -153,23 +204,28 @@ SageLinearPipelined::SageLinearPipelined(CudaHelper *helper, long num_in_feature
     set(helper, num_in_features, num_out_features, chunk_size, num_nodes);
 }
 
+SageLinearPipelined::SageLinearPipelined(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries) {
+    set(helper, num_in_features, num_out_features, boundaries);
+}
+
 void SageLinearPipelined::set(CudaHelper *helper, long num_in_features, long num_out_features, long chunk_size, long num_nodes) {
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    set(helper, num_in_features, num_out_features, &boundaries);
+}
+
+void SageLinearPipelined::set(CudaHelper *helper, long num_in_features, long num_out_features, std::vector<long> *boundaries) {
     name_ = "sage-linear_pipelined";
     cuda_helper_ = helper;
-    chunk_size_ = chunk_size;
+    chunk_size_ = get_max_chunk_size(boundaries);
     num_in_features_ = num_in_features;
     num_out_features_ = num_out_features;
 
-    num_chunks_ = ceil((float) num_nodes / (float) chunk_size_);
-    if (num_chunks_ * chunk_size_ > num_nodes) {
-        last_chunk_size_ = num_nodes - (num_chunks_ - 1) * chunk_size_;
-    } else {
-        last_chunk_size_ = chunk_size_;
-    }
+    num_chunks_ = boundaries->size() - 1;
 
-    linear_self_.set(cuda_helper_, chunk_size, num_nodes, num_in_features, num_out_features);
-    linear_neigh_.set(cuda_helper_, chunk_size, num_nodes, num_in_features, num_out_features);
-    add_.set(cuda_helper_, chunk_size, num_nodes, num_out_features);
+    linear_self_.set(cuda_helper_, boundaries, num_in_features, num_out_features);
+    linear_neigh_.set(cuda_helper_, boundaries, num_in_features, num_out_features);
+    add_.set(cuda_helper_, boundaries, num_out_features);
 }
 
 std::vector<Matrix<float> *> SageLinearPipelined::get_parameters() {
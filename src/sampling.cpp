@@ -0,0 +1,288 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "sampling.hpp"
+#include "sparse_computation.hpp"
+
+#include <algorithm>
+#include <random>
+
+
+// rows sampled with the same generator, so the sample does not depend on the number of threads
+const long sampling_group_size = 1024;
+
+
+long get_num_batches(long num_nodes, long batch_size) {
+    return (num_nodes + batch_size - 1) / batch_size;
+}
+
+void get_batch_order(long num_nodes, long seed, long epoch, std::vector<int> *order) {
+    order->resize(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        order->at(i) = i;
+    }
+    std::seed_seq seq{seed, epoch};
+    std::mt19937_64 generator(seq);
+    std::shuffle(order->begin(), order->end(), generator);
+}
+
+void get_batch_seeds(std::vector<int> *order, long batch, long batch_size, std::vector<int> *seeds) {
+    long first = batch * batch_size;
+    long last = std::min(first + batch_size, (long) order->size());
+    if (first >= last) {
+        throw "Batch out of range";
+    }
+    seeds->assign(order->begin() + first, order->begin() + last);
+}
+
+void get_dst_rows(Matrix<float> *src, long num_dst, Matrix<float> *dst) {
+    if (num_dst > src->num_rows_) {
+        throw "More dst nodes than src nodes";
+    }
+    dst->set(num_dst, src->num_columns_, src->is_row_major_);
+    if (src->is_row_major_) {
+        std::copy(src->values_, src->values_ + dst->size_, dst->values_);
+    } else {
+        for (long column = 0; column < src->num_columns_; ++column) {
+            std::copy(src->values_ + column * src->num_rows_, src->values_ + column * src->num_rows_ + num_dst,
+                      dst->values_ + column * num_dst);
+        }
+    }
+}
+
+void add_dst_rows(Matrix<float> *dst, Matrix<float> *src) {
+    if (dst->num_rows_ > src->num_rows_ || dst->num_columns_ != src->num_columns_) {
+        throw "Matrix shapes do not match";
+    }
+    for (long row = 0; row < dst->num_rows_; ++row) {
+        for (long column = 0; column < dst->num_columns_; ++column) {
+            long src_index = src->is_row_major_ ? row * src->num_columns_ + column : column * src->num_rows_ + row;
+            long dst_index = dst->is_row_major_ ? row * dst->num_columns_ + column : column * dst->num_rows_ + row;
+            src->values_[src_index] = src->values_[src_index] + dst->values_[dst_index];
+        }
+    }
+}
+
+// min(fanout, degree) neighbours of every dst node without replacement, Floyd's algorithm
+void sample_rows(SparseMatrix<float> *adjacency, std::vector<int> *dst_nodes, long seed, long stream,
+                 long first_group, long last_group, std::vector<int> *row_ptr, std::vector<int> *neighbours) {
+    long num_dst = dst_nodes->size();
+    std::vector<int> positions;
+    for (long group = first_group; group < last_group; ++group) {
+        std::seed_seq seq{seed, stream, group};
+        std::mt19937_64 generator(seq);
+        long last_row = std::min((group + 1) * sampling_group_size, num_dst);
+        for (long row = group * sampling_group_size; row < last_row; ++row) {
+            long node = dst_nodes->at(row);
+            long first_index = adjacency->csr_row_ptr_[node];
+            long degree = adjacency->csr_row_ptr_[node + 1] - first_index;
+            long num_samples = row_ptr->at(row + 1) - row_ptr->at(row);
+            int *sampled = neighbours->data() + row_ptr->at(row);
+
+            if (num_samples == degree) {
+                std::copy(adjacency->csr_col_ind_ + first_index, adjacency->csr_col_ind_ + first_index + degree, sampled);
+                continue;
+            }
+            positions.clear();
+            for (long j = degree - num_samples; j < degree; ++j) {
+                long position = std::uniform_int_distribution<long>(0, j)(generator);
+                if (std::find(positions.begin(), positions.end(), position) != positions.end()) {
+                    position = j;
+                }
+                positions.push_back(position);
+            }
+            for (long k = 0; k < num_samples; ++k) {
+                sampled[k] = adjacency->csr_col_ind_[first_index + positions.at(k)];
+            }
+        }
+    }
+}
+
+void gather_rows(Matrix<float> *features, FeatureCache *feature_cache, std::vector<int> *nodes, long first_row, long last_row,
+                 Matrix<float> *gathered, long *num_hits) {
+    long num_features = features->num_columns_;
+    *num_hits = 0;
+    for (long row = first_row; row < last_row; ++row) {
+        long node = nodes->at(row);
+        float *gathered_row = gathered->values_ + row * num_features;
+        float *cached_row = feature_cache == NULL ? NULL : feature_cache->get_row(node);
+        if (cached_row != NULL) {
+            std::copy(cached_row, cached_row + num_features, gathered_row);
+            *num_hits = *num_hits + 1;
+        } else if (features->is_row_major_) {
+            std::copy(features->values_ + node * num_features, features->values_ + (node + 1) * num_features, gathered_row);
+        } else {
+            for (long column = 0; column < num_features; ++column) {
+                gathered_row[column] = features->values_[column * features->num_rows_ + node];
+            }
+        }
+    }
+}
+
+void sample_background(NeighbourSampler *sampler, std::vector<int> seeds, long batch, MiniBatch *mini_batch,
+                       const char **error) {
+    try {
+        sampler->sample(&seeds, batch, mini_batch);
+    } catch (const char *e) {
+        *error = e;
+    }
+}
+
+NeighbourSampler::NeighbourSampler(SparseMatrix<float> *adjacency, Matrix<float> *features, Matrix<int> *classes,
+                                   std::vector<long> *fanouts, long seed) {
+    if (fanouts->empty()) {
+        throw "No fanouts given";
+    }
+    adjacency_ = adjacency;
+    features_ = features;
+    classes_ = classes;
+    fanouts_ = *fanouts;
+    seed_ = seed;
+    local_ids_.assign(adjacency_->num_rows_, -1);
+}
+
+NeighbourSampler::~NeighbourSampler() {
+    if (sampler_.joinable()) {
+        sampler_.join();
+    }
+}
+
+void NeighbourSampler::set_feature_cache(FeatureCache *feature_cache) {
+    wait();
+    if (feature_cache != NULL && (feature_cache->num_nodes_ != features_->num_rows_ ||
+                                  feature_cache->num_features_ != features_->num_columns_)) {
+        throw "Feature cache does not match the features";
+    }
+    feature_cache_ = feature_cache;
+}
+
+void NeighbourSampler::sample_block(long batch, long layer, std::vector<int> *dst_nodes, std::vector<int> *src_nodes,
+                                    SampledBlock *block) {
+    long num_dst = dst_nodes->size();
+    long fanout = fanouts_.at(layer);
+
+    std::vector<int> row_ptr(num_dst + 1);
+    row_ptr.at(0) = 0;
+    for (long row = 0; row < num_dst; ++row) {
+        long node = dst_nodes->at(row);
+        long degree = adjacency_->csr_row_ptr_[node + 1] - adjacency_->csr_row_ptr_[node];
+        row_ptr.at(row + 1) = row_ptr.at(row) + std::min(fanout, degree);
+    }
+    std::vector<int> neighbours(row_ptr.at(num_dst));
+
+    long num_groups = (num_dst + sampling_group_size - 1) / sampling_group_size;
+    long num_threads = std::max(std::min((long) std::thread::hardware_concurrency(), num_groups), 1l);
+    std::vector<std::thread> threads(num_threads);
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t) = std::thread(sample_rows, adjacency_, dst_nodes, seed_, batch * fanouts_.size() + layer,
+                                    t * num_groups / num_threads, (t + 1) * num_groups / num_threads,
+                                    &row_ptr, &neighbours);
+    }
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t).join();
+    }
+
+    // dst nodes first, then the new neighbours in the order they are sampled
+    *src_nodes = *dst_nodes;
+    for (long row = 0; row < num_dst; ++row) {
+        local_ids_.at(dst_nodes->at(row)) = row;
+    }
+    for (long k = 0; k < (long) neighbours.size(); ++k) {
+        if (local_ids_.at(neighbours.at(k)) == -1) {
+            local_ids_.at(neighbours.at(k)) = src_nodes->size();
+            src_nodes->push_back(neighbours.at(k));
+        }
+    }
+
+    block->num_dst = num_dst;
+    block->num_src = src_nodes->size();
+    block->adjacency.set(num_dst, block->num_src, neighbours.size());
+    std::copy(row_ptr.begin(), row_ptr.end(), block->adjacency.csr_row_ptr_);
+    for (long k = 0; k < (long) neighbours.size(); ++k) {
+        block->adjacency.csr_col_ind_[k] = local_ids_.at(neighbours.at(k));
+        block->adjacency.csr_val_[k] = 1.0;
+    }
+    for (long row = 0; row < num_dst; ++row) {
+        std::sort(block->adjacency.csr_col_ind_ + row_ptr.at(row), block->adjacency.csr_col_ind_ + row_ptr.at(row + 1));
+    }
+    for (long i = 0; i < block->num_src; ++i) {
+        local_ids_.at(src_nodes->at(i)) = -1;
+    }
+
+    block->adjacency_transposed.set(num_dst, block->num_src, neighbours.size());
+    std::copy(row_ptr.begin(), row_ptr.end(), block->adjacency_transposed.csr_row_ptr_);
+    std::copy(block->adjacency.csr_col_ind_, block->adjacency.csr_col_ind_ + neighbours.size(),
+              block->adjacency_transposed.csr_col_ind_);
+    std::copy(block->adjacency.csr_val_, block->adjacency.csr_val_ + neighbours.size(),
+              block->adjacency_transposed.csr_val_);
+    transpose_csr_matrix_cpu(&block->adjacency_transposed);
+    if (neighbours.empty()) {
+        block->adjacency_transposed.num_rows_ = block->num_src;
+        block->adjacency_transposed.num_columns_ = num_dst;
+    }
+
+    // dst nodes without neighbours aggregate to zero instead of nan
+    block->row_sum.set(num_dst, 1, true);
+    for (long row = 0; row < num_dst; ++row) {
+        block->row_sum.values_[row] = std::max(row_ptr.at(row + 1) - row_ptr.at(row), 1);
+    }
+}
+
+void NeighbourSampler::gather(MiniBatch *mini_batch) {
+    std::vector<int> *input_nodes = &mini_batch->nodes.front();
+    long num_rows = input_nodes->size();
+    mini_batch->features.set(num_rows, features_->num_columns_, true);
+
+    long num_threads = std::max(std::min((long) std::thread::hardware_concurrency(), num_rows / sampling_group_size), 1l);
+    std::vector<std::thread> threads(num_threads);
+    std::vector<long> num_hits(num_threads);
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t) = std::thread(gather_rows, features_, feature_cache_, input_nodes, t * num_rows / num_threads,
+                                    (t + 1) * num_rows / num_threads, &mini_batch->features, &num_hits.at(t));
+    }
+    mini_batch->num_cache_hits = 0;
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t).join();
+        mini_batch->num_cache_hits = mini_batch->num_cache_hits + num_hits.at(t);
+    }
+    mini_batch->num_cache_misses = num_rows - mini_batch->num_cache_hits;
+
+    std::vector<int> *seeds = &mini_batch->nodes.back();
+    mini_batch->classes.set(seeds->size(), 1, true);
+    for (long i = 0; i < (long) seeds->size(); ++i) {
+        mini_batch->classes.values_[i] = classes_->values_[seeds->at(i)];
+    }
+}
+
+void NeighbourSampler::sample(std::vector<int> *seeds, long batch, MiniBatch *mini_batch) {
+    long num_layers = fanouts_.size();
+    if ((long) mini_batch->blocks.size() != num_layers) {
+        mini_batch->blocks.clear();
+        mini_batch->blocks.resize(num_layers);
+    }
+    mini_batch->nodes.resize(num_layers + 1);
+    mini_batch->nodes.back() = *seeds;
+
+    // from the seeds to the input layer, the src nodes of a block are the dst nodes of the one before
+    for (long layer = num_layers - 1; layer >= 0; --layer) {
+        sample_block(batch, layer, &mini_batch->nodes.at(layer + 1), &mini_batch->nodes.at(layer),
+                     &mini_batch->blocks.at(layer));
+    }
+
+    gather(mini_batch);
+}
+
+void NeighbourSampler::sample_async(std::vector<int> *seeds, long batch, MiniBatch *mini_batch) {
+    wait();
+    sampler_ = std::thread(sample_background, this, *seeds, batch, mini_batch, &error_);
+}
+
+void NeighbourSampler::wait() {
+    if (sampler_.joinable()) {
+        sampler_.join();
+    }
+    if (error_ != NULL) {
+        const char *error = error_;
+        error_ = NULL;
+        throw error;
+    }
+}
@@ -0,0 +1,171 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "sanitize.hpp"
+#include "sparse_computation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+std::string get_normalization_name(Normalization normalization) {
+    if (normalization == no_normalization) {
+        return "none";
+    } else if (normalization == mean_normalization) {
+        return "mean";
+    } else if (normalization == symmetric_normalization) {
+        return "symmetric";
+    } else {
+        throw "Unknown normalization";
+    }
+}
+
+// rows of A and A^T merged, sorted by column, duplicates keep the largest value
+void sanitize_range(SparseMatrix<float> *adjacency, SparseMatrix<float> *transposed, bool add_self_loops,
+                    long first_row, long last_row, std::vector<int> *row_nnz, std::vector<int> *columns, std::vector<float> *values) {
+    std::vector<std::pair<int, float>> entries;
+    for (long row = first_row; row < last_row; ++row) {
+        entries.clear();
+        for (long j = adjacency->csr_row_ptr_[row]; j < adjacency->csr_row_ptr_[row + 1]; ++j) {
+            entries.push_back(std::make_pair(adjacency->csr_col_ind_[j], adjacency->csr_val_[j]));
+        }
+        if (transposed != NULL) {
+            for (long j = transposed->csr_row_ptr_[row]; j < transposed->csr_row_ptr_[row + 1]; ++j) {
+                entries.push_back(std::make_pair(transposed->csr_col_ind_[j], transposed->csr_val_[j]));
+            }
+        }
+        // an existing self-loop keeps its value
+        if (add_self_loops) {
+            entries.push_back(std::make_pair((int) row, 0.0f));
+        }
+
+        std::sort(entries.begin(), entries.end());
+        long nnz = 0;
+        for (long k = 0; k < (long) entries.size(); ++k) {
+            if (k + 1 < (long) entries.size() && entries.at(k + 1).first == entries.at(k).first) {
+                continue;
+            }
+            float value = entries.at(k).second;
+            if (add_self_loops && entries.at(k).first == row && value == 0.0) {
+                value = 1.0;
+            }
+            columns->push_back(entries.at(k).first);
+            values->push_back(value);
+            nnz = nnz + 1;
+        }
+        row_nnz->at(row) = nnz;
+    }
+}
+
+void copy_range(std::vector<int> *columns, std::vector<float> *values, SparseMatrix<float> *sanitized, long offset) {
+    if (columns->empty()) {
+        return;
+    }
+    std::memcpy(&sanitized->csr_col_ind_[offset], columns->data(), columns->size() * sizeof(int));
+    std::memcpy(&sanitized->csr_val_[offset], values->data(), values->size() * sizeof(float));
+}
+
+void sanitize_graph(SparseMatrix<float> *adjacency, bool add_self_loops, bool symmetrize, SparseMatrix<float> *sanitized) {
+    long num_nodes = adjacency->num_rows_;
+    if (adjacency->num_columns_ != num_nodes) {
+        throw "Adjacency is not square";
+    }
+
+    SparseMatrix<float> transposed;
+    if (symmetrize) {
+        transposed.set(adjacency->num_rows_, adjacency->num_columns_, adjacency->nnz_);
+        std::memcpy(transposed.csr_row_ptr_, adjacency->csr_row_ptr_, (adjacency->num_rows_ + 1) * sizeof(int));
+        std::memcpy(transposed.csr_col_ind_, adjacency->csr_col_ind_, adjacency->nnz_ * sizeof(int));
+        std::memcpy(transposed.csr_val_, adjacency->csr_val_, adjacency->nnz_ * sizeof(float));
+        transpose_csr_matrix_cpu(&transposed);
+    }
+
+    // every thread sanitizes its rows into its own buffers, which are copied into place once the row pointers are known
+    long num_threads = std::max(std::min((long) std::thread::hardware_concurrency(), num_nodes), 1l);
+    std::vector<int> row_nnz(num_nodes);
+    std::vector<std::vector<int>> columns(num_threads);
+    std::vector<std::vector<float>> values(num_threads);
+    std::vector<std::thread> threads(num_threads);
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t) = std::thread(sanitize_range, adjacency, symmetrize ? &transposed : NULL, add_self_loops,
+                                    t * num_nodes / num_threads, (t + 1) * num_nodes / num_threads,
+                                    &row_nnz, &columns.at(t), &values.at(t));
+    }
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t).join();
+    }
+
+    long nnz = 0;
+    for (long t = 0; t < num_threads; ++t) {
+        nnz = nnz + columns.at(t).size();
+    }
+    sanitized->set(num_nodes, num_nodes, nnz);
+    sanitized->csr_row_ptr_[0] = 0;
+    for (long row = 0; row < num_nodes; ++row) {
+        sanitized->csr_row_ptr_[row + 1] = sanitized->csr_row_ptr_[row] + row_nnz.at(row);
+    }
+
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t) = std::thread(copy_range, &columns.at(t), &values.at(t), sanitized,
+                                    (long) sanitized->csr_row_ptr_[t * num_nodes / num_threads]);
+    }
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t).join();
+    }
+}
+
+void normalize_range(SparseMatrix<float> *adjacency, Matrix<float> *degrees, Normalization normalization,
+                     long first_row, long last_row) {
+    for (long row = first_row; row < last_row; ++row) {
+        float degree = degrees->values_[row];
+        if (degree == 0.0) {
+            continue;
+        }
+        for (long j = adjacency->csr_row_ptr_[row]; j < adjacency->csr_row_ptr_[row + 1]; ++j) {
+            if (normalization == mean_normalization) {
+                adjacency->csr_val_[j] = adjacency->csr_val_[j] / degree;
+            } else {
+                float degree_column = degrees->values_[adjacency->csr_col_ind_[j]];
+                if (degree_column != 0.0) {
+                    adjacency->csr_val_[j] = adjacency->csr_val_[j] / std::sqrt(degree * degree_column);
+                }
+            }
+        }
+    }
+}
+
+void normalize_graph(SparseMatrix<float> *adjacency, Normalization normalization) {
+    if (normalization == no_normalization) {
+        return;
+    }
+    if (normalization != mean_normalization && normalization != symmetric_normalization) {
+        throw "Unknown normalization";
+    }
+    long num_nodes = adjacency->num_rows_;
+    if (normalization == symmetric_normalization && adjacency->num_columns_ != num_nodes) {
+        throw "Adjacency is not square";
+    }
+
+    // all degrees have to be known before the first value changes
+    Matrix<float> degrees(num_nodes, 1, true);
+    sp_mat_sum_rows(adjacency, &degrees);
+
+    long num_threads = std::max(std::min((long) std::thread::hardware_concurrency(), num_nodes), 1l);
+    std::vector<std::thread> threads(num_threads);
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t) = std::thread(normalize_range, adjacency, &degrees, normalization,
+                                    t * num_nodes / num_threads, (t + 1) * num_nodes / num_threads);
+    }
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t).join();
+    }
+}
+
+void sanitize_graph(SparseMatrix<float> *adjacency, bool add_self_loops, bool symmetrize, Normalization normalization,
+                    SparseMatrix<float> *sanitized) {
+    sanitize_graph(adjacency, add_self_loops, symmetrize, sanitized);
+    normalize_graph(sanitized, normalization);
+}
@@ -0,0 +1,40 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include <math.h>
+
+#include "sellmm.h"
+
+
+// one slice per block in x, lanes of the slice are threadIdx.x, columns of mat are threadIdx.y
+__global__ void sellmm(int *slice_ptr, int *slice_rows, int *col_ind, float *val, int slice_size,
+                       float *mat, float *result, int num_rows, int num_columns, int mat_columns, bool add_to_result) {
+    int slice = blockIdx.x;
+    int lane = threadIdx.x;
+    int column = blockIdx.y * blockDim.y + threadIdx.y;
+    int row = slice_rows[slice * slice_size + lane];
+    if (row < 0 || column >= mat_columns) {
+        return;
+    }
+
+    // lanes read consecutive column indices, padding has value zero
+    float sum = 0.0;
+    for (int idx = slice_ptr[slice] + lane; idx < slice_ptr[slice + 1]; idx = idx + slice_size) {
+        sum = sum + val[idx] * mat[column * num_columns + col_ind[idx]];
+    }
+
+    if (add_to_result) {
+        result[column * num_rows + row] = result[column * num_rows + row] + sum;
+    } else {
+        result[column * num_rows + row] = sum;
+    }
+}
+
+void sell_mat_mat_multi(int *slice_ptr, int *slice_rows, int *col_ind, float *val, int num_slices, int slice_size,
+                        float *mat, float *result, int num_rows, int num_columns, int mat_columns, bool add_to_result,
+                        cudaStream_t stream) {
+    int columns_per_block = 1024 / slice_size;
+    dim3 num_blocks(num_slices, ceil((float) mat_columns / (float) columns_per_block));
+    dim3 num_threads(slice_size, columns_per_block);
+    sellmm<<<num_blocks, num_threads, 0, stream>>>(slice_ptr, slice_rows, col_ind, val, slice_size,
+                                                   mat, result, num_rows, num_columns, mat_columns, add_to_result);
+}
@@ -2,6 +2,9 @@
 
 #include "sparse_computation.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <thread>
 #include <vector>
 
 
@@ -220,19 +223,55 @@ void sp_mat_sum_rows(CudaHelper *cuda_helper, SparseMatrix<float> *sp_mat, Matri
     check_cuda(cudaFree(d_buffer));
 }
 
+void sp_mat_sum_rows_range(SparseMatrix<float> *sp_mat, Matrix<float> *sum, long first_row, long last_row) {
+    for (long i = first_row; i < last_row; ++i) {
+        float row_sum = 0.0;
+        for (long j = sp_mat->csr_row_ptr_[i]; j < sp_mat->csr_row_ptr_[i + 1]; ++j) {
+            row_sum = row_sum + sp_mat->csr_val_[j];
+        }
+        sum->values_[i] = row_sum;
+    }
+}
+
 void sp_mat_sum_rows(SparseMatrix<float> *sp_mat, Matrix<float> *sum) {
+    long num_rows = sp_mat->num_rows_;
+    long num_threads = std::max(std::min((long) std::thread::hardware_concurrency(), num_rows), 1l);
+    std::vector<std::thread> threads(num_threads);
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t) = std::thread(sp_mat_sum_rows_range, sp_mat, sum, t * num_rows / num_threads, (t + 1) * num_rows / num_threads);
+    }
+    for (long t = 0; t < num_threads; ++t) {
+        threads.at(t).join();
+    }
+}
+
+void sp_mat_sum_rows(std::vector<SparseMatrix<float>> *sp_mats, Matrix<float> *sum) {
+    long num_chunks = std::lround(std::sqrt((double) sp_mats->size()));
+    if (num_chunks * num_chunks != (long) sp_mats->size()) {
+        throw "Vector has wrong number of chunks.";
+    }
+
     sum->set_values(0.0);
 
-    long first_index;
-    long last_index;
-    for (long i = 0; i < sp_mat->num_rows_; ++i) {
-        first_index = sp_mat->csr_row_ptr_[i];
-        last_index = sp_mat->csr_row_ptr_[i + 1];
-        if (first_index != last_index) {
-            for (long j = first_index; j < last_index; ++j) {
-                sum->values_[i] = sum->values_[i] + sp_mat->csr_val_[j];
+    // tiles of a row chunk are ordered by column chunk, like the columns of the whole matrix
+    long offset = 0;
+    for (long i = 0; i < num_chunks; ++i) {
+        float *sum_chunk = &sum->values_[offset];
+        for (long j = 0; j < num_chunks; ++j) {
+            SparseMatrix<float> *sp_mat = &sp_mats->at(i * num_chunks + j);
+            if (sp_mat->nnz_ == 0) {
+                continue;
+            }
+            for (long row = 0; row < sp_mat->num_rows_; ++row) {
+                for (long k = sp_mat->csr_row_ptr_[row]; k < sp_mat->csr_row_ptr_[row + 1]; ++k) {
+                    sum_chunk[row] = sum_chunk[row] + sp_mat->csr_val_[k];
+                }
             }
         }
+        offset = offset + sp_mats->at(i * num_chunks).num_rows_;
+    }
+    if (offset != sum->num_rows_) {
+        throw "Tiles do not match the sum";
     }
 }
 
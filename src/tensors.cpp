@@ -6,6 +6,7 @@
 #include "mmio_wrapper.hpp"
 
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <thread>
 
@@ -24,7 +25,9 @@ template Matrix<float>::Matrix(long num_rows, long num_columns, bool is_row_majo
 
 template<typename T>
 Matrix<T>::~Matrix() {
-    check_cuda(cudaFreeHost(values_));
+    if (is_owner_) {
+        check_cuda(cudaFreeHost(values_));
+    }
 }
 template Matrix<float>::~Matrix();
 template Matrix<int>::~Matrix();
@@ -34,10 +37,11 @@ void Matrix<T>::set(long num_rows, long num_columns, bool is_row_major) {
     num_rows_ = num_rows;
     num_columns_ = num_columns;
     size_ = num_rows_ * num_columns;
-    if (values_ != NULL) {
+    if (values_ != NULL && is_owner_) {
         check_cuda(cudaFreeHost(values_));
     }
     check_cuda(cudaMallocHost(&values_, size_ * sizeof(T)));
+    is_owner_ = true;
     is_row_major_ = is_row_major;
 }
 template void Matrix<int>::set(long num_rows, long num_columns, bool is_row_major);
@@ -48,15 +52,50 @@ void Matrix<T>::set(long num_rows, long num_columns, T *matrix_values, bool is_r
     num_rows_ = num_rows;
     num_columns_ = num_columns;
     size_ = num_rows_ * num_columns;
-    if (values_ != NULL) {
+    if (values_ != NULL && is_owner_) {
         check_cuda(cudaFreeHost(values_));
     }
     values_ = matrix_values;
+    is_owner_ = true;
     is_row_major_ = is_row_major;
 }
 template void Matrix<float>::set(long num_rows, long num_columns, float *matrix_values, bool is_row_major);
 template void Matrix<int>::set(long num_rows, long num_columns, int *matrix_values, bool is_row_major);
 
+template<typename T>
+void Matrix<T>::set_view(T *values) {
+    if (values_ != NULL && is_owner_) {
+        check_cuda(cudaFreeHost(values_));
+    }
+    values_ = values;
+    is_owner_ = false;
+}
+template void Matrix<float>::set_view(float *values);
+template void Matrix<int>::set_view(int *values);
+
+template<typename T>
+void Matrix<T>::release() {
+    if (!is_owner_) {
+        throw "Matrix is a view";
+    }
+    if (values_ != NULL) {
+        check_cuda(cudaFreeHost(values_));
+        values_ = NULL;
+    }
+}
+template void Matrix<float>::release();
+template void Matrix<int>::release();
+
+template<typename T>
+void Matrix<T>::allocate() {
+    if (values_ == NULL) {
+        check_cuda(cudaMallocHost(&values_, size_ * sizeof(T)));
+        is_owner_ = true;
+    }
+}
+template void Matrix<float>::allocate();
+template void Matrix<int>::allocate();
+
 template<typename T>
 void Matrix<T>::set_random_values() {
     for (long i = 0; i < num_rows_ * num_columns_; ++i) {
@@ -361,6 +400,87 @@ void load_mtx_matrix(std::string path, SparseMatrix<T> *sp_mat) {
 }
 template void load_mtx_matrix<float>(std::string path, SparseMatrix<float> *sp_mat);
 
+template<typename T>
+void load_csr_matrix(std::string path, SparseMatrix<T> *sp_mat) {
+    std::ifstream csr_file(path, std::ios::binary);
+    if (!csr_file.is_open()) {
+        throw "Could not open CSR file";
+    }
+
+    CsrFileHeader header;
+    csr_file.read(reinterpret_cast<char *>(&header), sizeof(CsrFileHeader));
+    if (!csr_file || std::memcmp(header.magic, csr_file_magic, sizeof(csr_file_magic)) != 0) {
+        throw "File is not in CSR format";
+    }
+
+    sp_mat->set(header.num_rows, header.num_columns, header.nnz);
+    csr_file.read(reinterpret_cast<char *>(sp_mat->csr_row_ptr_), (sp_mat->num_rows_ + 1) * sizeof(int));
+    csr_file.read(reinterpret_cast<char *>(sp_mat->csr_col_ind_), sp_mat->nnz_ * sizeof(int));
+    csr_file.read(reinterpret_cast<char *>(sp_mat->csr_val_), sp_mat->nnz_ * sizeof(T));
+    if (!csr_file) {
+        throw "CSR file is truncated";
+    }
+}
+template void load_csr_matrix<float>(std::string path, SparseMatrix<float> *sp_mat);
+
+template<typename T>
+void save_csr_matrix(SparseMatrix<T> *sp_mat, std::string path) {
+    CsrFileHeader header;
+    std::memcpy(header.magic, csr_file_magic, sizeof(csr_file_magic));
+    header.num_rows = sp_mat->num_rows_;
+    header.num_columns = sp_mat->num_columns_;
+    header.nnz = sp_mat->nnz_;
+
+    std::ofstream csr_file(path, std::ios::binary | std::ios::trunc);
+    csr_file.write(reinterpret_cast<char *>(&header), sizeof(CsrFileHeader));
+    csr_file.write(reinterpret_cast<char *>(sp_mat->csr_row_ptr_), (sp_mat->num_rows_ + 1) * sizeof(int));
+    csr_file.write(reinterpret_cast<char *>(sp_mat->csr_col_ind_), sp_mat->nnz_ * sizeof(int));
+    csr_file.write(reinterpret_cast<char *>(sp_mat->csr_val_), sp_mat->nnz_ * sizeof(T));
+    if (!csr_file) {
+        throw "Could not write CSR file";
+    }
+}
+template void save_csr_matrix<float>(SparseMatrix<float> *sp_mat, std::string path);
+
+template<typename T>
+void load_sp_matrix(std::string path, SparseMatrix<T> *sp_mat) {
+    std::string extension = ".csr";
+    if (path.size() > extension.size() &&
+        path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+        load_csr_matrix<T>(path, sp_mat);
+    } else {
+        load_mtx_matrix<T>(path, sp_mat);
+    }
+}
+template void load_sp_matrix<float>(std::string path, SparseMatrix<float> *sp_mat);
+
+void load_sp_matrix_row_ptr(std::string path, std::vector<int> *row_ptr) {
+    std::string extension = ".csr";
+    if (path.size() > extension.size() &&
+        path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+        std::ifstream csr_file(path, std::ios::binary);
+        if (!csr_file.is_open()) {
+            throw "Could not open CSR file";
+        }
+
+        CsrFileHeader header;
+        csr_file.read(reinterpret_cast<char *>(&header), sizeof(CsrFileHeader));
+        if (!csr_file || std::memcmp(header.magic, csr_file_magic, sizeof(csr_file_magic)) != 0) {
+            throw "File is not in CSR format";
+        }
+
+        row_ptr->resize(header.num_rows + 1);
+        csr_file.read(reinterpret_cast<char *>(row_ptr->data()), (header.num_rows + 1) * sizeof(int));
+        if (!csr_file) {
+            throw "CSR file is truncated";
+        }
+    } else {
+        SparseMatrix<float> sp_mat;
+        load_mtx_matrix<float>(path, &sp_mat);
+        row_ptr->assign(sp_mat.csr_row_ptr_, sp_mat.csr_row_ptr_ + sp_mat.num_rows_ + 1);
+    }
+}
+
 template<typename T>
 void save_npy_matrix(Matrix<T> *mat, std::string path) {
     to_row_major_inplace(mat);
@@ -380,6 +500,18 @@ void save_npy_matrix_no_trans(Matrix<T> *mat, std::string path) {
 template void save_npy_matrix_no_trans<float>(Matrix<float> *mat, std::string path);
 template void save_npy_matrix_no_trans<int>(Matrix<int> *mat, std::string path);
 
+// a view keeps its memory, the transposed values are copied back into it
+template<typename T>
+void replace_values(Matrix<T> *mat, T *values) {
+    if (mat->is_owner_) {
+        check_cuda(cudaFreeHost(mat->values_));
+        mat->values_ = values;
+    } else {
+        std::memcpy(mat->values_, values, mat->size_ * sizeof(T));
+        check_cuda(cudaFreeHost(values));
+    }
+}
+
 template<typename T>
 void to_column_major_inplace(Matrix<T> *mat) {
     if (mat->is_row_major_) {
@@ -387,8 +519,7 @@ void to_column_major_inplace(Matrix<T> *mat) {
         check_cuda(cudaMallocHost(&values_T, mat->size_ * sizeof(T)));
         transpose<T>(values_T, mat->values_, mat->num_rows_, mat->num_columns_);
 
-        check_cuda(cudaFreeHost(mat->values_));
-        mat->values_ = values_T;
+        replace_values(mat, values_T);
         mat->is_row_major_ = false;
     }
 }
@@ -418,14 +549,24 @@ void to_row_major_inplace(Matrix<T> *mat) {
         check_cuda(cudaMallocHost(&values_T, mat->size_ * sizeof(T)));
         transpose<T>(values_T, mat->values_, mat->num_columns_, mat->num_rows_);
 
-        check_cuda(cudaFreeHost(mat->values_));
-        mat->values_ = values_T;
+        replace_values(mat, values_T);
         mat->is_row_major_ = true;
     }
 }
 template void to_row_major_inplace<float>(Matrix<float> *mat);
 template void to_row_major_inplace<int>(Matrix<int> *mat);
 
+template<typename T>
+void to_layout_inplace(Matrix<T> *mat, bool is_row_major) {
+    if (is_row_major) {
+        to_row_major_inplace(mat);
+    } else {
+        to_column_major_inplace(mat);
+    }
+}
+template void to_layout_inplace<float>(Matrix<float> *mat, bool is_row_major);
+template void to_layout_inplace<int>(Matrix<int> *mat, bool is_row_major);
+
 template<typename T>
 void to_row_major(Matrix<T> *mat_row, Matrix<T> *mat) {
     if (!mat->is_row_major_) {
@@ -531,3 +672,21 @@ bool check_equality(Matrix<float> *a, Matrix<float> *b) {
     }
     return true;
 }
+
+bool check_equality(SparseMatrix<float> *a, SparseMatrix<float> *b) {
+    if (a->num_rows_ != b->num_rows_ || a->num_columns_ != b->num_columns_ || a->nnz_ != b->nnz_) {
+        return false;
+    }
+
+    for (int i = 0; i < a->num_rows_ + 1; ++i) {
+        if (a->csr_row_ptr_[i] != b->csr_row_ptr_[i]) {
+            return false;
+        }
+    }
+    for (int i = 0; i < a->nnz_; ++i) {
+        if (a->csr_col_ind_[i] != b->csr_col_ind_[i] || a->csr_val_[i] != b->csr_val_[i]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "adam.hpp"
+#include "checkpoint.hpp"
+#include "cuda_helper.hpp"
+#include "sage_linear.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string test_dir_path = dir_path + "/tests";
+
+
+void copy_matrices(std::vector<Matrix<float> *> *matrices, std::vector<Matrix<float>> *copies) {
+    copies->resize(matrices->size());
+    for (long i = 0; i < (long) matrices->size(); ++i) {
+        copies->at(i).set(matrices->at(i)->num_rows_, matrices->at(i)->num_columns_, matrices->at(i)->is_row_major_);
+        std::copy(matrices->at(i)->values_, matrices->at(i)->values_ + matrices->at(i)->size_, copies->at(i).values_);
+    }
+}
+
+int check_matrices(std::vector<Matrix<float> *> *matrices, std::vector<Matrix<float>> *copies) {
+    for (long i = 0; i < (long) matrices->size(); ++i) {
+        if (matrices->at(i)->is_row_major_ != copies->at(i).is_row_major_ || !check_equality(matrices->at(i), &copies->at(i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_checkpoint(long num_nodes, long num_in_features, long num_out_features) {
+    CudaHelper cuda_helper;
+    SageLinear sage_linear(&cuda_helper, num_in_features, num_out_features, num_nodes);
+    std::vector<Matrix<float> *> parameters = sage_linear.get_parameters();
+    Adam adam(&cuda_helper, 0.003, parameters, sage_linear.get_gradients());
+    std::vector<Matrix<float> *> states = parameters;
+    for (long i = 0; i < (long) parameters.size(); ++i) {
+        adam.get_momentum_ms()->at(i).set_random_values();
+        adam.get_momentum_vs()->at(i).set_random_values();
+        states.push_back(&adam.get_momentum_ms()->at(i));
+        states.push_back(&adam.get_momentum_vs()->at(i));
+    }
+    adam.set_t(7);
+
+    std::vector<Matrix<float>> saved;
+    copy_matrices(&states, &saved);
+    std::string path = test_dir_path + "/checkpoint.bin";
+    Checkpoint checkpoint;
+    checkpoint.save(path, 3, &parameters, &adam);
+
+    // training continues while the checkpoint is written
+    for (long i = 0; i < (long) states.size(); ++i) {
+        states.at(i)->set_random_values();
+    }
+    adam.set_t(8);
+    checkpoint.wait();
+
+    if (restore_checkpoint(path, &parameters, &adam) != 3 || adam.get_t() != 7) {
+        return 0;
+    }
+    if (!check_matrices(&states, &saved)) {
+        return 0;
+    }
+
+    // only the parameters, like for inference
+    for (long i = 0; i < (long) parameters.size(); ++i) {
+        parameters.at(i)->set_random_values();
+    }
+    if (restore_checkpoint(path, &parameters, NULL) != 3 || !check_matrices(&parameters, &saved)) {
+        return 0;
+    }
+
+    // a flipped byte is detected by the checksum
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(-1, std::ios::end);
+    file.put(1);
+    file.close();
+    int corrupted_detected = 0;
+    try {
+        restore_checkpoint(path, &parameters, &adam);
+    } catch (const char *e) {
+        corrupted_detected = 1;
+    }
+    std::remove(path.c_str());
+
+    return corrupted_detected;
+}
+
+// only the parameters, without an optimiser
+int test_checkpoint_parameters(long num_nodes, long num_in_features, long num_out_features) {
+    CudaHelper cuda_helper;
+    SageLinear sage_linear(&cuda_helper, num_in_features, num_out_features, num_nodes);
+    std::vector<Matrix<float> *> parameters = sage_linear.get_parameters();
+    std::vector<Matrix<float>> saved;
+    copy_matrices(&parameters, &saved);
+    std::string path = test_dir_path + "/checkpoint_parameters.bin";
+    Checkpoint checkpoint;
+    checkpoint.save(path, 5, &parameters, NULL);
+    checkpoint.wait();
+
+    for (long i = 0; i < (long) parameters.size(); ++i) {
+        parameters.at(i)->set_random_values();
+    }
+    int is_restored = restore_checkpoint(path, &parameters, NULL) == 5 && check_matrices(&parameters, &saved);
+    std::remove(path.c_str());
+
+    return is_restored;
+}
+
+TEST_CASE("Checkpoint", "[checkpoint]") {
+    CHECK(test_checkpoint(1 << 10, 512, 256));
+    CHECK(test_checkpoint(1 << 10, 256, 7));
+    CHECK(test_checkpoint_parameters(1 << 10, 256, 7));
+}
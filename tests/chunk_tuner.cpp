@@ -0,0 +1,226 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunk_tuner.hpp"
+#include "chunking.hpp"
+#include "tensors.hpp"
+
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+const long tuner_num_nodes = 100000;
+
+// ten neighbours per node
+void get_tuner_row_ptr(std::vector<int> *row_ptr) {
+    row_ptr->resize(tuner_num_nodes + 1);
+    for (long i = 0; i <= tuner_num_nodes; ++i) {
+        row_ptr->at(i) = 10 * i;
+    }
+}
+
+// the trial is fastest for chunks of 8192 rows
+double get_tuner_seconds(std::vector<long> *boundaries) {
+    return 1.0 + std::abs(std::log2((double) get_max_chunk_size(boundaries)) - 13.0);
+}
+
+int test_chunk_memory() {
+    std::vector<long> channels = {64, 32, 8};
+    long chunked = get_chunk_memory(1 << 12, 1 << 15, &channels, 1);
+    return chunked > 0 && get_chunk_memory(1 << 13, 1 << 15, &channels, 1) > chunked &&
+           get_chunk_memory(1 << 12, 1 << 16, &channels, 1) > chunked && get_chunk_memory(1 << 12, 1 << 15, &channels, 2) > chunked;
+}
+
+int test_chunk_tuner_fastest() {
+    std::vector<int> row_ptr;
+    get_tuner_row_ptr(&row_ptr);
+    ChunkTuner chunk_tuner(1l << 40, {64, 32, 8}, 1);
+    long chunk_size = chunk_tuner.tune(row_ptr.data(), tuner_num_nodes, 1 << 10, 1 << 20, get_tuner_seconds);
+
+    // 1 << 17 is one chunk already
+    return chunk_size == 1 << 13 && chunk_tuner.get_trials()->size() == 8;
+}
+
+int test_chunk_tuner_budget() {
+    std::vector<int> row_ptr;
+    get_tuner_row_ptr(&row_ptr);
+    std::vector<long> channels = {64, 32, 8};
+    std::vector<long> boundaries;
+    get_balanced_boundaries(row_ptr.data(), tuner_num_nodes, channels.at(0), ceil((float) tuner_num_nodes / (float) (1 << 12)), &boundaries);
+    long budget = get_chunk_memory(get_max_chunk_size(&boundaries), get_max_chunk_nnz(row_ptr.data(), &boundaries), &channels, 2);
+
+    ChunkTuner chunk_tuner(budget, channels, 2);
+    long chunk_size = chunk_tuner.tune(row_ptr.data(), tuner_num_nodes, 1 << 10, 1 << 20, get_tuner_seconds);
+    for (ChunkTrial &trial : *chunk_tuner.get_trials()) {
+        if ((trial.memory <= budget) != (trial.seconds > 0.0)) {
+            return 0;
+        }
+    }
+    return chunk_size == 1 << 12;
+}
+
+int test_chunk_tuner_cache() {
+    std::vector<int> row_ptr;
+    get_tuner_row_ptr(&row_ptr);
+    std::string dataset_path = "/tmp";
+    ChunkTuner chunk_tuner(1l << 40, {64, 32, 8}, 1);
+    std::remove(chunk_tuner.get_cache_path(dataset_path).c_str());
+
+    long chunk_size = chunk_tuner.tune_cached(dataset_path, row_ptr.data(), tuner_num_nodes, 1 << 10, 1 << 20, get_tuner_seconds);
+    long num_trials = 0;
+    long chunk_size_cached = chunk_tuner.tune_cached(dataset_path, row_ptr.data(), tuner_num_nodes, 1 << 10, 1 << 20,
+                                                     [&num_trials](std::vector<long> *) {
+                                                         num_trials = num_trials + 1;
+                                                         return 1.0;
+                                                     });
+
+    // a different budget is tuned again
+    ChunkTuner other_tuner(1l << 39, {64, 32, 8}, 1);
+    int is_other_path = other_tuner.get_cache_path(dataset_path) != chunk_tuner.get_cache_path(dataset_path);
+    std::string path = chunk_tuner.get_cache_path(dataset_path);
+    std::remove(path.c_str());
+
+    // so are the parts of a partition tool, which fit the budget here
+    std::vector<long> parts = {0, 30000, 70000, tuner_num_nodes};
+    save_boundaries(dataset_path + "/boundaries.npy", &parts);
+    int is_parts_path = chunk_tuner.get_cache_path(dataset_path) != path;
+    long chunk_size_parts = chunk_tuner.tune_cached(dataset_path, row_ptr.data(), tuner_num_nodes, 1 << 10, 1 << 20, get_tuner_seconds);
+    std::remove(chunk_tuner.get_cache_path(dataset_path).c_str());
+    std::remove((dataset_path + "/boundaries.npy").c_str());
+
+    return chunk_size == 1 << 13 && chunk_size_cached == chunk_size && num_trials == 0 && is_other_path && is_parts_path &&
+           chunk_size_parts == 40000;
+}
+
+// the parts of the partition tool win without a trial if they fit, else their capped boundaries are timed
+int test_chunk_tuner_parts() {
+    std::vector<int> row_ptr;
+    get_tuner_row_ptr(&row_ptr);
+    std::vector<long> channels = {64, 32, 8};
+    std::vector<long> parts = {0, 30000, 70000, tuner_num_nodes};
+    long num_trials = 0;
+    auto trial = [&num_trials, &parts](std::vector<long> *boundaries) {
+        num_trials = num_trials + 1;
+        // every part boundary stays
+        for (long part_boundary : parts) {
+            if (std::find(boundaries->begin(), boundaries->end(), part_boundary) == boundaries->end()) {
+                return 0.0;
+            }
+        }
+        return get_tuner_seconds(boundaries);
+    };
+
+    ChunkTuner chunk_tuner(1l << 40, channels, 1);
+    long chunk_size = chunk_tuner.tune(row_ptr.data(), &parts, 1 << 10, 1 << 20, trial);
+    if (chunk_size != 40000 || num_trials != 0) {
+        return 0;
+    }
+
+    // the parts do not fit, chunks of 8192 rows are fastest
+    long budget = get_chunk_memory(1 << 14, 10 * (1 << 14), &channels, 1);
+    ChunkTuner small_tuner(budget, channels, 1);
+    chunk_size = small_tuner.tune(row_ptr.data(), &parts, 1 << 10, 1 << 20, trial);
+    for (ChunkTrial &chunk_trial : *small_tuner.get_trials()) {
+        if (chunk_trial.seconds > 0.0 && chunk_trial.memory > budget) {
+            return 0;
+        }
+    }
+    // 1 << 10 up to 1 << 15, below the largest part
+    return chunk_size == 1 << 13 && num_trials == 5 && small_tuner.get_trials()->size() == 7;
+}
+
+// every node reads its two neighbours on the ring
+static void get_ring(SparseMatrix<float> *ring) {
+    long num_nodes = ring->num_rows_;
+    for (long i = 0; i < num_nodes; ++i) {
+        ring->csr_row_ptr_[i] = 2 * i;
+        ring->csr_col_ind_[2 * i] = (i + num_nodes - 1) % num_nodes;
+        ring->csr_col_ind_[2 * i + 1] = (i + 1) % num_nodes;
+        if (ring->csr_col_ind_[2 * i] > ring->csr_col_ind_[2 * i + 1]) {
+            std::swap(ring->csr_col_ind_[2 * i], ring->csr_col_ind_[2 * i + 1]);
+        }
+        ring->csr_val_[2 * i] = 1.0;
+        ring->csr_val_[2 * i + 1] = 1.0;
+    }
+    ring->csr_row_ptr_[num_nodes] = 2 * num_nodes;
+}
+
+// chunks 0 and 2 of a ring of six nodes in three chunks
+int test_chunks_subgraph() {
+    long num_nodes = 6;
+    SparseMatrix<float> ring(num_nodes, num_nodes, 2 * num_nodes);
+    get_ring(&ring);
+    std::vector<long> boundaries = {0, 2, 4, 6};
+    std::vector<long> chunks = {0, 2};
+
+    SparseMatrix<float> subgraph;
+    get_chunks_subgraph(&ring, &boundaries, &chunks, &subgraph);
+
+    // nodes 0, 1, 4, 5 keep the edges 0-1, 4-5 and 5-0
+    std::vector<int> row_ptr = {0, 2, 3, 4, 6};
+    std::vector<int> col_ind = {1, 3, 0, 3, 0, 2};
+    if (subgraph.num_rows_ != 4 || subgraph.nnz_ != 6) {
+        return 0;
+    }
+    return std::equal(row_ptr.begin(), row_ptr.end(), subgraph.csr_row_ptr_) &&
+           std::equal(col_ind.begin(), col_ind.end(), subgraph.csr_col_ind_);
+}
+
+// the ring of six nodes in three chunks keeps the edges 0-1, 2-3 and 4-5 on the diagonal
+int test_diagonal_subgraph() {
+    long num_nodes = 6;
+    SparseMatrix<float> ring(num_nodes, num_nodes, 2 * num_nodes);
+    get_ring(&ring);
+    std::vector<long> boundaries = {0, 2, 4, 6};
+
+    SparseMatrix<float> diagonal;
+    get_diagonal_subgraph(&ring, &boundaries, &diagonal);
+    std::vector<int> row_ptr = {0, 1, 2, 3, 4, 5, 6};
+    std::vector<int> col_ind = {1, 0, 3, 2, 5, 4};
+    if (diagonal.num_rows_ != num_nodes || diagonal.nnz_ != num_nodes) {
+        return 0;
+    }
+    if (!std::equal(row_ptr.begin(), row_ptr.end(), diagonal.csr_row_ptr_) ||
+        !std::equal(col_ind.begin(), col_ind.end(), diagonal.csr_col_ind_)) {
+        return 0;
+    }
+
+    // every chunk reads both others, one chunk has no tiles off the diagonal
+    std::vector<long> one_chunk = {0, 6};
+    return get_num_off_diagonal_tiles(&ring, &boundaries) == 6 && get_num_off_diagonal_tiles(&diagonal, &boundaries) == 0 &&
+           get_num_off_diagonal_tiles(&ring, &one_chunk) == 0;
+}
+
+
+TEST_CASE("Chunk tuner, memory", "[chunktuner]") {
+    CHECK(test_chunk_memory());
+}
+
+TEST_CASE("Chunk tuner, fastest", "[chunktuner]") {
+    CHECK(test_chunk_tuner_fastest());
+}
+
+TEST_CASE("Chunk tuner, budget", "[chunktuner]") {
+    CHECK(test_chunk_tuner_budget());
+
+    std::vector<int> row_ptr;
+    get_tuner_row_ptr(&row_ptr);
+    ChunkTuner chunk_tuner(1, {64, 32, 8}, 1);
+    CHECK_THROWS(chunk_tuner.tune(row_ptr.data(), tuner_num_nodes, 1 << 10, 1 << 20, get_tuner_seconds));
+}
+
+TEST_CASE("Chunk tuner, partition tool", "[chunktuner]") {
+    CHECK(test_chunk_tuner_parts());
+}
+
+TEST_CASE("Chunk tuner, cache", "[chunktuner]") {
+    CHECK(test_chunk_tuner_cache());
+}
+
+TEST_CASE("Chunk tuner, subgraph", "[chunktuner]") {
+    CHECK(test_chunks_subgraph());
+    CHECK(test_diagonal_subgraph());
+}
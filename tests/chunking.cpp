@@ -0,0 +1,325 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string test_dir_path = dir_path + "/tests";
+const std::string flickr_dir_path = dir_path + "/flickr";
+
+
+// tiling by slicing and transposing twice, as double_chunk_up_sp used to do it
+void double_chunk_up_sp_transpose(SparseMatrix<float> *sp_mat, std::vector<SparseMatrix<float>> *chunks, std::vector<long> *boundaries) {
+    long num_chunks = boundaries->size() - 1;
+    for (long i = 0; i < num_chunks; ++i) {
+        SparseMatrix<float> sp_mat_chunk;
+        get_rows(&sp_mat_chunk, sp_mat, boundaries->at(i), boundaries->at(i + 1) - 1);
+        transpose_csr_matrix_cpu(&sp_mat_chunk);
+        if (sp_mat_chunk.nnz_ == 0) {
+            continue;
+        }
+        for (long j = 0; j < num_chunks; ++j) {
+            get_rows(&chunks->at(i * num_chunks + j), &sp_mat_chunk, boundaries->at(j), boundaries->at(j + 1) - 1);
+            transpose_csr_matrix_cpu(&chunks->at(i * num_chunks + j));
+        }
+    }
+}
+
+int check_double_chunk_up_sp(SparseMatrix<float> *adjacency, std::vector<long> *boundaries) {
+    long num_chunks = boundaries->size() - 1;
+
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp(adjacency, &adjacencies, boundaries);
+
+    std::vector<SparseMatrix<float>> adjacencies_transpose(num_chunks * num_chunks);
+    double_chunk_up_sp_transpose(adjacency, &adjacencies_transpose, boundaries);
+
+    for (long i = 0; i < num_chunks * num_chunks; ++i) {
+        if (adjacencies.at(i).nnz_ != adjacencies_transpose.at(i).nnz_) {
+            return 0;
+        }
+        // empty tiles keep the shape of the transposed tile in the old tiling
+        if (adjacencies.at(i).nnz_ > 0 && !check_equality(&adjacencies.at(i), &adjacencies_transpose.at(i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_double_chunk_up_sp(long chunk_size) {
+    std::string path = flickr_dir_path + "/adjacency.mtx";
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(path);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(adjacency.num_rows_, chunk_size, &boundaries);
+
+    return check_double_chunk_up_sp(&adjacency, &boundaries);
+}
+
+int test_chunk_cache(long chunk_size) {
+    std::string path = flickr_dir_path + "/adjacency.mtx";
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(path);
+    long num_nodes = adjacency.num_rows_;
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp(&adjacency, &adjacencies, &boundaries);
+
+    std::string cache_path = test_dir_path + "/adjacency.tiles";
+    std::remove(cache_path.c_str());
+    save_double_chunked_sp(&adjacencies, &boundaries, path, cache_path);
+
+    std::vector<SparseMatrix<float>> adjacencies_cached(num_chunks * num_chunks);
+    if (!load_double_chunked_sp(&adjacencies_cached, &boundaries, path, cache_path)) {
+        return 0;
+    }
+    for (long i = 0; i < num_chunks * num_chunks; ++i) {
+        if (!check_equality(&adjacencies.at(i), &adjacencies_cached.at(i))) {
+            return 0;
+        }
+    }
+
+    // cache is keyed by boundaries, even if the number of chunks is the same
+    std::vector<long> other_boundaries = boundaries;
+    other_boundaries.at(1) = other_boundaries.at(1) - 1;
+    std::vector<SparseMatrix<float>> adjacencies_other(num_chunks * num_chunks);
+    if (load_double_chunked_sp(&adjacencies_other, &other_boundaries, path, cache_path)) {
+        return 0;
+    }
+
+    Matrix<float> sum(num_nodes, 1, true);
+    sp_mat_sum_rows(&adjacency, &sum);
+    Matrix<float> sum_chunked(num_nodes, 1, true);
+    sp_mat_sum_rows(&adjacencies_cached, &sum_chunked);
+
+    std::remove(cache_path.c_str());
+
+    return check_equality(&sum, &sum_chunked);
+}
+
+int test_row_ptr_cache() {
+    std::string path = flickr_dir_path + "/adjacency.mtx";
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(path);
+    std::string cache_path = get_row_ptr_cache_path(path);
+    std::remove(cache_path.c_str());
+
+    // a miss parses the mtx and fills the cache, which the next call reads
+    std::vector<int> row_ptr;
+    load_sp_matrix_row_ptr_cached(path, &row_ptr);
+    std::vector<int> row_ptr_cached;
+    if (!load_row_ptr(&row_ptr_cached, path, cache_path)) {
+        return 0;
+    }
+    std::vector<int> expected(adjacency.csr_row_ptr_, adjacency.csr_row_ptr_ + adjacency.num_rows_ + 1);
+    if (row_ptr != expected || row_ptr_cached != expected) {
+        return 0;
+    }
+
+    // the cache of another file does not match
+    std::string other_path = test_dir_path + "/adjacency_other.mtx";
+    std::ofstream other_file(other_path);
+    other_file << "%%MatrixMarket matrix coordinate real general" << std::endl;
+    other_file.close();
+    int is_stale = !load_row_ptr(&row_ptr_cached, other_path, cache_path);
+    std::remove(other_path.c_str());
+    std::remove(cache_path.c_str());
+
+    return is_stale;
+}
+
+TEST_CASE("Double chunk up sparse matrix", "[chunking][tiles]") {
+    CHECK(test_double_chunk_up_sp(1 << 15));
+    CHECK(test_double_chunk_up_sp(1 << 14));
+    CHECK(test_double_chunk_up_sp(1 << 13));
+    CHECK(test_double_chunk_up_sp(1000));
+}
+
+TEST_CASE("Chunk cache", "[chunking][cache]") {
+    CHECK(test_row_ptr_cache());
+    CHECK(test_chunk_cache(1 << 15));
+    CHECK(test_chunk_cache(1 << 14));
+    CHECK(test_chunk_cache(1 << 13));
+}
+
+int test_index_tiles(long chunk_size) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    long num_chunks = ceil((double) adjacency.num_rows_ / (double) chunk_size);
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp(&adjacency, &adjacencies, chunk_size);
+
+    TileIndex index;
+    index_tiles(&adjacencies, &index);
+    if (index.num_chunks != num_chunks || index.nnz != adjacency.nnz_ || index.max_nnz != max_nnz(&adjacencies)) {
+        return 0;
+    }
+
+    // every non-empty tile is listed once, in column order
+    long num_non_empty = 0;
+    for (long i = 0; i < num_chunks; ++i) {
+        long k = 0;
+        for (long j = 0; j < num_chunks; ++j) {
+            if (adjacencies.at(i * num_chunks + j).nnz_ > 0) {
+                if (k >= (long) index.non_empty.at(i).size() || index.non_empty.at(i).at(k) != j) {
+                    return 0;
+                }
+                k = k + 1;
+                num_non_empty = num_non_empty + 1;
+            }
+        }
+        if (k != (long) index.non_empty.at(i).size()) {
+            return 0;
+        }
+    }
+    return num_non_empty == index.num_non_empty;
+}
+
+TEST_CASE("Tile index", "[chunking][tiles]") {
+    CHECK(test_index_tiles(1 << 15));
+    CHECK(test_index_tiles(1 << 12));
+    CHECK(test_index_tiles(1000));
+}
+
+int test_balanced_boundaries(long num_chunks, long num_features) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    long num_nodes = adjacency.num_rows_;
+    std::vector<long> boundaries;
+    get_balanced_boundaries(&adjacency, num_features, num_chunks, &boundaries);
+    if ((long) boundaries.size() != num_chunks + 1 || boundaries.front() != 0 || boundaries.back() != num_nodes) {
+        return 0;
+    }
+
+    // every chunk is within the cost of its heaviest row of an equal share
+    double total_cost = (double) adjacency.nnz_ + (double) num_nodes * (double) num_features;
+    for (long i = 0; i < num_chunks; ++i) {
+        if (boundaries.at(i + 1) <= boundaries.at(i)) {
+            return 0;
+        }
+        double cost = 0.0;
+        double max_row_cost = 0.0;
+        for (long row = boundaries.at(i); row < boundaries.at(i + 1); ++row) {
+            double row_cost = (double) (adjacency.csr_row_ptr_[row + 1] - adjacency.csr_row_ptr_[row]) + (double) num_features;
+            cost = cost + row_cost;
+            max_row_cost = std::max(max_row_cost, row_cost);
+        }
+        if (std::abs(cost - total_cost / (double) num_chunks) > 2.0 * max_row_cost + 1.0) {
+            return 0;
+        }
+    }
+
+    if (!check_double_chunk_up_sp(&adjacency, &boundaries)) {
+        return 0;
+    }
+
+    // chunking and stitching follow the boundaries
+    Matrix<float> features(num_nodes, 8, true);
+    features.set_random_values();
+    std::vector<Matrix<float>> features_chunked(num_chunks);
+    chunk_up(&features, &features_chunked, &boundaries);
+    for (long i = 0; i < num_chunks; ++i) {
+        if (features_chunked.at(i).num_rows_ != boundaries.at(i + 1) - boundaries.at(i)) {
+            return 0;
+        }
+    }
+    Matrix<float> features_stitched(num_nodes, 8, true);
+    stitch(&features_chunked, &features_stitched);
+
+    return check_equality(&features, &features_stitched);
+}
+
+TEST_CASE("Balanced boundaries", "[chunking][boundaries]") {
+    CHECK(test_balanced_boundaries(1, 500));
+    CHECK(test_balanced_boundaries(3, 500));
+    CHECK(test_balanced_boundaries(8, 0));
+    CHECK(test_balanced_boundaries(13, 16));
+}
+
+int test_cap_boundaries(std::vector<long> boundaries, long max_chunk_size, std::vector<long> expected) {
+    cap_boundaries(&boundaries, max_chunk_size);
+    return boundaries == expected && get_max_chunk_size(&boundaries) <= max_chunk_size;
+}
+
+TEST_CASE("Capped boundaries", "[chunking][boundaries]") {
+    CHECK(test_cap_boundaries({0, 10, 12, 30}, 10, {0, 10, 12, 21, 30}));
+    CHECK(test_cap_boundaries({0, 10, 12, 30}, 18, {0, 10, 12, 30}));
+    CHECK(test_cap_boundaries({0, 7}, 2, {0, 1, 3, 5, 7}));
+    std::vector<long> boundaries = {0, 5, 9};
+    CHECK_FALSE(cap_boundaries(&boundaries, 5));
+    CHECK(cap_boundaries(&boundaries, 4));
+}
+
+// induced subgraph of the nodes of the clusters, straight from the whole adjacency
+int test_cluster_subgraph(long chunk_size, long clusters_per_batch) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    long num_nodes = adjacency.num_rows_;
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    std::vector<SparseMatrix<float>> tiles(num_chunks * num_chunks);
+    double_chunk_up_sp(&adjacency, &tiles, &boundaries);
+
+    std::vector<std::vector<long>> batches;
+    get_cluster_batches(num_chunks, clusters_per_batch, 0, 1, &batches);
+    std::vector<int> covered(num_chunks, 0);
+    for (long b = 0; b < (long) batches.size(); ++b) {
+        if ((long) batches.at(b).size() > clusters_per_batch) {
+            return 0;
+        }
+        for (long cluster : batches.at(b)) {
+            covered.at(cluster) = covered.at(cluster) + 1;
+        }
+    }
+    if (std::count(covered.begin(), covered.end(), 1) != num_chunks) {
+        return 0;
+    }
+
+    std::vector<long> *clusters = &batches.front();
+    std::vector<int> nodes;
+    get_cluster_nodes(&boundaries, clusters, &nodes);
+    std::vector<int> local_ids(num_nodes, -1);
+    for (long i = 0; i < (long) nodes.size(); ++i) {
+        local_ids.at(nodes.at(i)) = i;
+    }
+    long nnz = 0;
+    for (long i = 0; i < (long) nodes.size(); ++i) {
+        for (long k = adjacency.csr_row_ptr_[nodes.at(i)]; k < adjacency.csr_row_ptr_[nodes.at(i) + 1]; ++k) {
+            if (local_ids.at(adjacency.csr_col_ind_[k]) != -1) {
+                nnz = nnz + 1;
+            }
+        }
+    }
+    SparseMatrix<float> expected(nodes.size(), nodes.size(), nnz);
+    expected.csr_row_ptr_[0] = 0;
+    long dest = 0;
+    for (long i = 0; i < (long) nodes.size(); ++i) {
+        for (long k = adjacency.csr_row_ptr_[nodes.at(i)]; k < adjacency.csr_row_ptr_[nodes.at(i) + 1]; ++k) {
+            if (local_ids.at(adjacency.csr_col_ind_[k]) != -1) {
+                expected.csr_col_ind_[dest] = local_ids.at(adjacency.csr_col_ind_[k]);
+                expected.csr_val_[dest] = adjacency.csr_val_[k];
+                dest = dest + 1;
+            }
+        }
+        expected.csr_row_ptr_[i + 1] = dest;
+    }
+
+    SparseMatrix<float> subgraph;
+    get_cluster_subgraph(&tiles, &boundaries, clusters, &subgraph);
+
+    return check_equality(&subgraph, &expected);
+}
+
+TEST_CASE("Cluster subgraph", "[chunking][clusters]") {
+    CHECK(test_cluster_subgraph(1 << 14, 1));
+    CHECK(test_cluster_subgraph(1 << 12, 4));
+    CHECK(test_cluster_subgraph(1000, 7));
+}
@@ -0,0 +1,397 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "data_parallel.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+
+// the forked processes may not get CUDA memory, so their matrices are views
+void set_view_matrix(Matrix<float> *matrix, long num_rows, long num_columns, float *values) {
+    matrix->num_rows_ = num_rows;
+    matrix->num_columns_ = num_columns;
+    matrix->size_ = num_rows * num_columns;
+    matrix->set_view(values);
+}
+
+// exit status of every process is 0 if function returned 1
+int run_processes(long num_processes, std::function<int(long rank)> function) {
+    std::vector<pid_t> pids;
+    for (long rank = 0; rank < num_processes; ++rank) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int result = 0;
+            try {
+                result = function(rank);
+            } catch (const char *e) {
+                result = 0;
+            }
+            _exit(result == 1 ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+    int is_ok = 1;
+    for (pid_t pid : pids) {
+        int status;
+        if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            is_ok = 0;
+        }
+    }
+    return is_ok;
+}
+
+int test_allreduce(long num_processes) {
+    long num_rounds = 10;
+    long count = 3 * 5 + 7;
+    SharedSegment segment(sizeof(SharedBarrierState) + SharedAllreduce::get_slots_size(num_processes, count) * sizeof(float));
+    SharedBarrierState *state = reinterpret_cast<SharedBarrierState *>(segment.get_data());
+    SharedBarrier::init(state);
+    float *slots = reinterpret_cast<float *>(segment.get_data() + sizeof(SharedBarrierState));
+
+    return run_processes(num_processes, [state, slots, num_processes, num_rounds, count](long rank) {
+        SharedBarrier barrier(state, num_processes);
+        SharedAllreduce allreduce(&barrier, slots, rank, num_processes, count);
+        std::vector<float> a_values(3 * 5);
+        std::vector<float> b_values(7);
+        Matrix<float> a;
+        Matrix<float> b;
+        set_view_matrix(&a, 3, 5, a_values.data());
+        set_view_matrix(&b, 7, 1, b_values.data());
+        std::vector<Matrix<float> *> matrices = {&a, &b};
+
+        for (long round = 0; round < num_rounds; ++round) {
+            for (long k = 0; k < a.size_; ++k) {
+                a.values_[k] = rank * k + round;
+            }
+            for (long k = 0; k < b.size_; ++k) {
+                b.values_[k] = -rank - k * round;
+            }
+            allreduce.allreduce(&matrices);
+            // the mean of rank over the processes
+            float mean_rank = (num_processes - 1) / 2.0;
+            for (long k = 0; k < a.size_; ++k) {
+                if (std::abs(a.values_[k] - (mean_rank * k + round)) > 1e-4 * (1.0 + std::abs(a.values_[k]))) {
+                    return 0;
+                }
+            }
+            for (long k = 0; k < b.size_; ++k) {
+                if (std::abs(b.values_[k] - (-mean_rank - k * round)) > 1e-4 * (1.0 + std::abs(b.values_[k]))) {
+                    return 0;
+                }
+            }
+
+            // the root overwrites what the allreduce left
+            b.values_[0] = rank + round;
+            allreduce.broadcast(&matrices, num_processes - 1);
+            if (b.values_[0] != num_processes - 1 + round) {
+                return 0;
+            }
+        }
+        return 1;
+    });
+}
+
+// the process that waits for an aborted one does not wait forever
+int test_abort() {
+    SharedSegment segment(sizeof(SharedBarrierState));
+    SharedBarrierState *state = reinterpret_cast<SharedBarrierState *>(segment.get_data());
+    SharedBarrier::init(state);
+
+    return run_processes(2, [state](long rank) {
+        SharedBarrier barrier(state, 2);
+        if (rank == 0) {
+            barrier.abort();
+            return 1;
+        }
+        try {
+            barrier.wait();
+            barrier.wait();
+        } catch (const char *e) {
+            return 1;
+        }
+        return 0;
+    });
+}
+
+int test_named_segment() {
+    std::string name = "/alzheimer_test_" + std::to_string(getpid());
+    SharedSegment *created = new SharedSegment(name, 1000);
+    SharedSegment attached(name);
+    if (attached.get_size() != 1000) {
+        return 0;
+    }
+    created->get_data()[999] = 42;
+    if (attached.get_data()[999] != 42) {
+        return 0;
+    }
+    delete created;
+    // unlinked, the attached mapping stays
+    int is_unlinked = 0;
+    try {
+        SharedSegment again(name);
+    } catch (const char *e) {
+        is_unlinked = 1;
+    }
+    return is_unlinked && attached.get_data()[999] == 42;
+}
+
+// node i reads i - 1, i + 1 and i + 10 of a graph with 30 nodes
+int test_partition_graph(long first_row, long last_row, long num_hops) {
+    long num_nodes = 30;
+    std::vector<int> row_ptr;
+    std::vector<int> col_ind;
+    std::vector<float> values;
+    for (long i = 0; i < num_nodes; ++i) {
+        row_ptr.push_back(col_ind.size());
+        std::vector<long> neighbours = {i - 1, i + 1, i + 10};
+        for (long neighbour : neighbours) {
+            if (neighbour >= 0 && neighbour < num_nodes) {
+                col_ind.push_back(neighbour);
+                values.push_back(neighbour + 0.5);
+            }
+        }
+    }
+    row_ptr.push_back(col_ind.size());
+
+    // hops from the rows, by relaxing every edge num_hops times
+    std::vector<long> hops(num_nodes, -1);
+    for (long i = first_row; i < last_row && i < num_nodes; ++i) {
+        hops.at(i) = 0;
+    }
+    for (long hop = 1; hop <= num_hops; ++hop) {
+        std::vector<long> last_hops = hops;
+        for (long i = 0; i < num_nodes; ++i) {
+            for (long k = row_ptr.at(i); k < row_ptr.at(i + 1); ++k) {
+                if (last_hops.at(i) == hop - 1 && hops.at(col_ind.at(k)) == -1) {
+                    hops.at(col_ind.at(k)) = hop;
+                }
+            }
+        }
+    }
+
+    std::vector<long> nodes;
+    SparseMatrix<float> adjacency;
+    get_partition_graph(row_ptr.data(), col_ind.data(), values.data(), num_nodes, first_row, last_row, num_hops, &nodes,
+                        &adjacency);
+    long num_rows = last_row - first_row;
+    long num_expected_nodes = 0;
+    for (long i = 0; i < num_nodes; ++i) {
+        num_expected_nodes = num_expected_nodes + (hops.at(i) != -1);
+    }
+    if ((long) nodes.size() != num_expected_nodes) {
+        return 0;
+    }
+    if (adjacency.num_rows_ != (long) nodes.size() || adjacency.num_columns_ != (long) nodes.size()) {
+        return 0;
+    }
+    for (long i = 0; i < (long) nodes.size(); ++i) {
+        if (i < num_rows && nodes.at(i) != first_row + i) {
+            return 0;
+        }
+        // the halo is sorted, outside of the rows and at most num_hops away
+        if (i > num_rows && nodes.at(i) <= nodes.at(i - 1)) {
+            return 0;
+        }
+        if (i >= num_rows && (hops.at(nodes.at(i)) < 1 || hops.at(nodes.at(i)) > num_hops)) {
+            return 0;
+        }
+    }
+
+    for (long i = 0; i < (long) nodes.size(); ++i) {
+        long num_entries = adjacency.csr_row_ptr_[i + 1] - adjacency.csr_row_ptr_[i];
+        long global = nodes.at(i);
+        // the neighbours in the partition, all of them for the nodes before the last hop
+        long num_local_neighbours = 0;
+        for (long k = row_ptr.at(global); k < row_ptr.at(global + 1); ++k) {
+            num_local_neighbours = num_local_neighbours + (hops.at(col_ind.at(k)) != -1);
+        }
+        if (hops.at(global) < num_hops && num_local_neighbours != row_ptr.at(global + 1) - row_ptr.at(global)) {
+            return 0;
+        }
+        if (num_local_neighbours == 0) {
+            if (num_entries != 1 || adjacency.csr_col_ind_[adjacency.csr_row_ptr_[i]] != i) {
+                return 0;
+            }
+            continue;
+        }
+        // the same neighbours with the same values as in the graph, in sorted local order
+        if (num_entries != num_local_neighbours) {
+            return 0;
+        }
+        for (long k = adjacency.csr_row_ptr_[i]; k < adjacency.csr_row_ptr_[i + 1]; ++k) {
+            long neighbour = nodes.at(adjacency.csr_col_ind_[k]);
+            if (adjacency.csr_val_[k] != neighbour + 0.5) {
+                return 0;
+            }
+            if (k > adjacency.csr_row_ptr_[i] && adjacency.csr_col_ind_[k] <= adjacency.csr_col_ind_[k - 1]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+// y += A x of a CSR matrix, row-major
+void multiply_rows(long num_rows, int *row_ptr, int *col_ind, float *values, float *x, float *y, long num_features) {
+    for (long row = 0; row < num_rows; ++row) {
+        for (long k = row_ptr[row]; k < row_ptr[row + 1]; ++k) {
+            for (long column = 0; column < num_features; ++column) {
+                y[row * num_features + column] += values[k] * x[col_ind[k] * num_features + column];
+            }
+        }
+    }
+}
+
+// the processes aggregate their rows of a symmetric graph with a halo one hop deep as on the whole graph, forward with
+// the halo rows from their owners, backward with the gradients of the halo rows added by their owners
+int test_halo_exchange(long num_processes) {
+    long num_nodes = 40;
+    long num_features = 3;
+    std::vector<int> row_ptr;
+    std::vector<int> col_ind;
+    std::vector<float> values;
+    for (long i = 0; i < num_nodes; ++i) {
+        row_ptr.push_back(col_ind.size());
+        std::vector<long> neighbours = {i - 10, i - 1, i, i + 1, i + 10};
+        for (long neighbour : neighbours) {
+            if (neighbour >= 0 && neighbour < num_nodes) {
+                col_ind.push_back(neighbour);
+                values.push_back(1.0 + (i + neighbour) % 3);
+            }
+        }
+    }
+    row_ptr.push_back(col_ind.size());
+    std::vector<float> x_global(num_nodes * num_features);
+    for (long k = 0; k < (long) x_global.size(); ++k) {
+        x_global.at(k) = k % 7 - 3.0;
+    }
+    std::vector<float> y_global(num_nodes * num_features, 0.0);
+    multiply_rows(num_nodes, row_ptr.data(), col_ind.data(), values.data(), x_global.data(), y_global.data(), num_features);
+
+    // before the fork, the processes may not get CUDA memory
+    std::vector<std::vector<long>> nodes(num_processes);
+    std::vector<SparseMatrix<float>> adjacencies(num_processes);
+    for (long rank = 0; rank < num_processes; ++rank) {
+        get_partition_graph(row_ptr.data(), col_ind.data(), values.data(), num_nodes, rank * num_nodes / num_processes,
+                            (rank + 1) * num_nodes / num_processes, 1, &nodes.at(rank), &adjacencies.at(rank));
+    }
+
+    std::string segment_name = "/alzheimer_test_halo_" + std::to_string(getpid());
+    SharedSegment segment(sizeof(SharedBarrierState) + num_processes * sizeof(long));
+    SharedBarrierState *state = reinterpret_cast<SharedBarrierState *>(segment.get_data());
+    SharedBarrier::init(state);
+    long *num_halo_nodes = reinterpret_cast<long *>(segment.get_data() + sizeof(SharedBarrierState));
+
+    return run_processes(num_processes, [&](long rank) {
+        SharedBarrier barrier(state, num_processes);
+        long first_row = rank * num_nodes / num_processes;
+        long num_rows = (rank + 1) * num_nodes / num_processes - first_row;
+        long num_local_nodes = nodes.at(rank).size();
+        long num_halo_rows = num_local_nodes - num_rows;
+        SparseMatrix<float> *adjacency = &adjacencies.at(rank);
+
+        // a row-major chunk of the rows, a column-major one of the halo
+        std::vector<long> boundaries = {0, num_rows, num_local_nodes};
+        std::vector<float> rows_values(num_rows * num_features);
+        std::vector<float> halo_values(num_halo_rows * num_features, -1.0);
+        std::vector<Matrix<float>> x(2);
+        set_view_matrix(&x.at(0), num_rows, num_features, rows_values.data());
+        set_view_matrix(&x.at(1), num_halo_rows, num_features, halo_values.data());
+        x.at(1).is_row_major_ = false;
+        std::copy(x_global.begin() + first_row * num_features, x_global.begin() + (first_row + num_rows) * num_features,
+                  rows_values.begin());
+
+        SharedHaloExchange halo_exchange(&barrier, num_halo_nodes, segment_name, rank, num_processes, &nodes.at(rank),
+                                         num_rows, num_features, &boundaries);
+        if (halo_exchange.get_num_halo_nodes() != num_halo_rows) {
+            return 0;
+        }
+        halo_exchange.exchange(&x);
+        std::vector<float> x_local(num_local_nodes * num_features);
+        for (long i = 0; i < num_local_nodes; ++i) {
+            for (long column = 0; column < num_features; ++column) {
+                float value = i < num_rows ? rows_values.at(i * num_features + column)
+                                           : halo_values.at(column * num_halo_rows + i - num_rows);
+                if (value != x_global.at(nodes.at(rank).at(i) * num_features + column)) {
+                    return 0;
+                }
+                x_local.at(i * num_features + column) = value;
+            }
+        }
+        std::vector<float> y_local(num_local_nodes * num_features, 0.0);
+        multiply_rows(num_local_nodes, adjacency->csr_row_ptr_, adjacency->csr_col_ind_, adjacency->csr_val_,
+                      x_local.data(), y_local.data(), num_features);
+        for (long k = 0; k < num_rows * num_features; ++k) {
+            if (std::abs(y_local.at(k) - y_global.at(first_row * num_features + k)) > 1e-4) {
+                return 0;
+            }
+        }
+
+        // incoming gradients x on the rows and none on the halo, A^T x = A x on the whole graph
+        std::fill(x_local.begin() + num_rows * num_features, x_local.end(), 0.0);
+        std::vector<float> gradients_local(num_local_nodes * num_features, 0.0);
+        multiply_rows(num_local_nodes, adjacency->csr_row_ptr_, adjacency->csr_col_ind_, adjacency->csr_val_,
+                      x_local.data(), gradients_local.data(), num_features);
+        std::copy(gradients_local.begin(), gradients_local.begin() + num_rows * num_features, rows_values.begin());
+        for (long i = num_rows; i < num_local_nodes; ++i) {
+            for (long column = 0; column < num_features; ++column) {
+                halo_values.at(column * num_halo_rows + i - num_rows) = gradients_local.at(i * num_features + column);
+            }
+        }
+        halo_exchange.reduce(&x);
+        for (long k = 0; k < num_rows * num_features; ++k) {
+            if (std::abs(rows_values.at(k) - y_global.at(first_row * num_features + k)) > 1e-4) {
+                return 0;
+            }
+        }
+        for (float value : halo_values) {
+            if (value != 0.0) {
+                return 0;
+            }
+        }
+        return 1;
+    });
+}
+
+TEST_CASE("Data parallel, partition graph", "[dataparallel]") {
+    CHECK(test_partition_graph(0, 30, 1));
+    CHECK(test_partition_graph(0, 10, 1));
+    CHECK(test_partition_graph(10, 20, 1));
+    CHECK(test_partition_graph(25, 30, 1));
+    CHECK(test_partition_graph(0, 10, 3));
+    CHECK(test_partition_graph(10, 20, 3));
+    CHECK(test_partition_graph(25, 30, 3));
+    CHECK(test_partition_graph(12, 13, 2));
+    CHECK_THROWS(test_partition_graph(20, 10, 1));
+    CHECK_THROWS(test_partition_graph(0, 10, 0));
+}
+
+TEST_CASE("Data parallel, shared segment", "[dataparallel]") {
+    CHECK(test_named_segment());
+}
+
+TEST_CASE("Data parallel, allreduce", "[dataparallel]") {
+    CHECK(test_allreduce(1));
+    CHECK(test_allreduce(2));
+    CHECK(test_allreduce(4));
+    CHECK(test_allreduce(7));
+}
+
+TEST_CASE("Data parallel, halo exchange", "[dataparallel]") {
+    CHECK(test_halo_exchange(1));
+    CHECK(test_halo_exchange(2));
+    CHECK(test_halo_exchange(3));
+    CHECK(test_halo_exchange(5));
+}
+
+TEST_CASE("Data parallel, abort", "[dataparallel]") {
+    CHECK(test_abort());
+}
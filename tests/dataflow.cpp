@@ -0,0 +1,157 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "dataflow.hpp"
+
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// band of tiles, row chunk i reads the chunks i - 1, i and i + 1
+void set_band_tile_index(long num_chunks, TileIndex *tile_index) {
+    tile_index->num_chunks = num_chunks;
+    tile_index->non_empty = std::vector<std::vector<long>>(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        for (long j = std::max(i - 1, 0l); j < std::min(i + 2, num_chunks); ++j) {
+            tile_index->non_empty.at(i).push_back(j);
+        }
+    }
+}
+
+// dropout -> aggregation -> linear(dropout, aggregation) -> relu, every task checks that the chunks it reads are done
+int test_dataflow_dependencies(long num_chunks, long num_threads) {
+    TileIndex tile_index;
+    set_band_tile_index(num_chunks, &tile_index);
+
+    long num_nodes = 4;
+    std::vector<std::vector<int>> is_done(num_nodes, std::vector<int>(num_chunks, 0));
+    std::vector<int> is_ended(num_nodes, 0);
+    std::mutex mutex;
+    long num_errors = 0;
+
+    auto check = [&](long node, long chunk, std::vector<long> inputs) {
+        std::mt19937 generator(node * num_chunks + chunk);
+        std::this_thread::sleep_for(std::chrono::microseconds(generator() % 200));
+        std::lock_guard<std::mutex> lock(mutex);
+        for (long input : inputs) {
+            if (!is_done.at(input).at(chunk)) {
+                num_errors = num_errors + 1;
+            }
+        }
+        if (chunk > 0 && !is_done.at(node).at(chunk - 1)) {
+            num_errors = num_errors + 1;
+        }
+        is_done.at(node).at(chunk) = 1;
+    };
+    auto end = [&](long node) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!is_done.at(node).at(num_chunks - 1) || is_ended.at(node)) {
+            num_errors = num_errors + 1;
+        }
+        is_ended.at(node) = 1;
+    };
+
+    Dataflow dataflow(num_chunks, &tile_index);
+    long dropout = dataflow.add_node("dropout", [&](long chunk) { check(0, chunk, {}); }, [&]() { end(0); }, {}, {});
+    long aggregation = dataflow.add_node("aggregation", [&](long chunk) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (long j : tile_index.non_empty.at(chunk)) {
+                if (!is_done.at(0).at(j)) {
+                    num_errors = num_errors + 1;
+                }
+            }
+        }
+        check(1, chunk, {}); }, [&]() { end(1); }, {dropout}, {tile_edge});
+    long linear = dataflow.add_node("linear", [&](long chunk) { check(2, chunk, {0, 1}); }, [&]() { end(2); },
+                                    {dropout, aggregation}, {chunk_edge, chunk_edge});
+    dataflow.add_node("relu", [&](long chunk) { check(3, chunk, {2}); }, [&]() { end(3); }, {linear}, {chunk_edge});
+    dataflow.run(num_threads);
+
+    if (num_errors > 0) {
+        return 0;
+    }
+    for (long n = 0; n < num_nodes; ++n) {
+        if (!is_ended.at(n)) {
+            return 0;
+        }
+        for (long c = 0; c < num_chunks; ++c) {
+            if (!is_done.at(n).at(c)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// a single thread runs element-wise chains chunk by chunk
+int test_dataflow_order() {
+    long num_chunks = 3;
+    std::vector<std::string> order;
+    Dataflow dataflow(num_chunks, NULL);
+    long a = dataflow.add_node("a", [&](long chunk) { order.push_back("a" + std::to_string(chunk)); }, NULL, {}, {});
+    long b = dataflow.add_node("b", [&](long chunk) { order.push_back("b" + std::to_string(chunk)); }, NULL, {a}, {chunk_edge});
+    dataflow.add_node("c", [&](long chunk) { order.push_back("c" + std::to_string(chunk)); }, NULL, {b}, {all_edge});
+    dataflow.run(1);
+
+    std::vector<std::string> expected = {"a0", "b0", "a1", "b1", "a2", "b2", "c0", "c1", "c2"};
+    return order == expected;
+}
+
+int test_dataflow_error() {
+    Dataflow dataflow(10, NULL);
+    long a = dataflow.add_node("a", [](long) {}, NULL, {}, {});
+    dataflow.add_node("b", [](long chunk) {
+        if (chunk == 5) {
+            throw "Task failed";
+        }
+    }, NULL, {a}, {chunk_edge});
+    try {
+        dataflow.run(4);
+    } catch (const char *error) {
+        return std::string(error) == "Task failed";
+    }
+    return 0;
+}
+
+// check_cuda and check_cudnn throw strings, they reach the caller as they are
+int test_dataflow_string_error() {
+    Dataflow dataflow(10, NULL);
+    dataflow.add_node("a", [](long chunk) {
+        if (chunk == 3) {
+            throw std::string("CUDA error");
+        }
+    }, NULL, {}, {});
+    try {
+        dataflow.run(4);
+    } catch (std::string error) {
+        return error == "CUDA error";
+    }
+    return 0;
+}
+
+int test_dataflow_cycle() {
+    Dataflow dataflow(10, NULL);
+    try {
+        dataflow.add_node("a", [](long) {}, NULL, {0}, {chunk_edge});
+    } catch (const char *error) {
+        return std::string(error) == "Input is not an earlier node";
+    }
+    return 0;
+}
+
+TEST_CASE("Dataflow", "[dataflow]") {
+    CHECK(test_dataflow_dependencies(1, 1));
+    CHECK(test_dataflow_dependencies(7, 1));
+    CHECK(test_dataflow_dependencies(7, 4));
+    CHECK(test_dataflow_dependencies(32, 8));
+    CHECK(test_dataflow_order());
+    CHECK(test_dataflow_error());
+    CHECK(test_dataflow_string_error());
+    CHECK(test_dataflow_cycle());
+}
@@ -0,0 +1,356 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "cuda_helper.hpp"
+#include "emulated_device.hpp"
+#include "feature_aggregation.hpp"
+#include "linear.hpp"
+#include "pipeline.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+
+int test_emulated_memory() {
+    EmulatedDevice device(1000, 1e9);
+    void *a = device.allocate(600);
+    try {
+        device.allocate(600);
+        return 0;
+    } catch (const char *error) {
+        if (std::string(error) != "Out of emulated device memory") {
+            return 0;
+        }
+    }
+    device.deallocate(a);
+    void *b = device.allocate(1000);
+    device.deallocate(b);
+
+    EmulatedDeviceStats stats = device.get_stats();
+    return stats.peak_memory == 1000 && device.get_memory_used() == 0;
+}
+
+int test_emulated_bandwidth() {
+    long size = 1 << 20;
+    EmulatedDevice device(size, 1e8);
+    std::vector<char> x(size, 7);
+    std::vector<char> y(size, 0);
+    char *d_x = (char *) device.allocate(size);
+
+    device.memcpy_async(d_x, x.data(), size, device.stream_in_);
+    device.memcpy_async(y.data(), d_x, size, device.stream_in_);
+    device.synchronize();
+
+    // two copies of about 10 ms each, on the same stream
+    EmulatedDeviceStats stats = device.get_stats();
+    device.deallocate(d_x);
+    double seconds = 2.0 * size / 1e8;
+    return y == x && std::abs(stats.time - seconds) < 1e-9 && std::abs(stats.busy_time - seconds) < 1e-9
+           && stats.overlap_ratio == 1.0 && stats.stall_time == 0.0;
+}
+
+int is_close(std::vector<Matrix<float>> *a, std::vector<Matrix<float>> *b) {
+    for (long i = 0; i < (long) a->size(); ++i) {
+        to_column_major_inplace(&a->at(i));
+        to_column_major_inplace(&b->at(i));
+        for (long j = 0; j < a->at(i).size_; ++j) {
+            if (std::abs(a->at(i).values_[j] - b->at(i).values_[j]) > 1e-5 * (1.0 + std::abs(b->at(i).values_[j]))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// the stages of chunk c start once the stage before is done with c and the stage after with c - num_buffers
+double get_pipeline_time(std::vector<double> *in, std::vector<double> *compute, std::vector<double> *out, long num_buffers) {
+    long num_chunks = in->size();
+    std::vector<double> in_end(num_chunks);
+    std::vector<double> compute_end(num_chunks);
+    std::vector<double> out_end(num_chunks);
+    for (long c = 0; c < num_chunks; ++c) {
+        double in_start = c > 0 ? in_end.at(c - 1) : 0.0;
+        double compute_start = c > 0 ? compute_end.at(c - 1) : 0.0;
+        double out_start = c > 0 ? out_end.at(c - 1) : 0.0;
+        if (c >= num_buffers) {
+            in_start = std::max(in_start, compute_end.at(c - num_buffers));
+            compute_start = std::max(compute_start, out_end.at(c - num_buffers));
+        }
+        in_end.at(c) = in_start + in->at(c);
+        compute_end.at(c) = std::max(compute_start, in_end.at(c)) + compute->at(c);
+        out_end.at(c) = std::max(out_start, compute_end.at(c)) + out->at(c);
+    }
+    return out_end.at(num_chunks - 1);
+}
+
+// LinearPipelined on the emulated device computes what LinearChunked computes, on the virtual timeline of its pipeline
+int test_emulated_linear_pipelined(long num_nodes, long chunk_size) {
+    long num_in_features = 32;
+    long num_out_features = 16;
+    long num_buffers = 2;
+    double bandwidth = 1e9;
+    double flop_rate = 1e11;
+    long num_chunks = (num_nodes + chunk_size - 1) / chunk_size;
+
+    CudaHelper cuda_helper;
+    LinearChunked linear(&cuda_helper, chunk_size, num_nodes, num_in_features, num_out_features);
+    LinearPipelined linear_pipelined(&cuda_helper, chunk_size, num_nodes, num_in_features, num_out_features);
+    std::vector<Matrix<float> *> parameters = linear.get_parameters();
+    std::vector<Matrix<float> *> parameters_pipelined = linear_pipelined.get_parameters();
+    for (long i = 0; i < (long) parameters.size(); ++i) {
+        std::copy(parameters.at(i)->values_, parameters.at(i)->values_ + parameters.at(i)->size_, parameters_pipelined.at(i)->values_);
+    }
+    EmulatedDevice device(1 << 20, bandwidth, flop_rate);
+    linear_pipelined.set_emulated_device(&device);
+
+    Matrix<float> x(num_nodes, num_in_features, true);
+    x.set_random_values();
+    Matrix<float> incoming_gradients(num_nodes, num_out_features, true);
+    incoming_gradients.set_random_values();
+    std::vector<Matrix<float>> x_chunked(num_chunks);
+    std::vector<Matrix<float>> incoming_gradients_chunked(num_chunks);
+    chunk_up(&x, &x_chunked, chunk_size);
+    chunk_up(&incoming_gradients, &incoming_gradients_chunked, chunk_size);
+
+    std::vector<double> in(num_chunks);
+    std::vector<double> compute(num_chunks);
+    std::vector<double> out(num_chunks);
+    for (long c = 0; c < num_chunks; ++c) {
+        long num_rows = x_chunked.at(c).num_rows_;
+        in.at(c) = num_rows * num_in_features * sizeof(float) / bandwidth;
+        compute.at(c) = 2.0 * num_rows * num_in_features * num_out_features / flop_rate;
+        out.at(c) = num_rows * num_out_features * sizeof(float) / bandwidth;
+    }
+
+    std::vector<Matrix<float>> *y = linear.forward(&x_chunked);
+    std::vector<Matrix<float>> *y_pipelined = linear_pipelined.forward(&x_chunked);
+    EmulatedDeviceStats stats = device.get_stats();
+    double time = get_pipeline_time(&in, &compute, &out, num_buffers);
+    if (!is_close(y_pipelined, y) || std::abs(stats.time - time) > 1e-9 * time) {
+        return 0;
+    }
+    // the streams overlap as soon as there is a second chunk
+    if (num_chunks > 1 && (stats.overlap_ratio <= 1.0 || stats.busy_time >= stats.time + 1e-12)) {
+        return 0;
+    }
+
+    for (long c = 0; c < num_chunks; ++c) {
+        long num_rows = x_chunked.at(c).num_rows_;
+        in.at(c) = num_rows * (num_in_features + num_out_features) * sizeof(float) / bandwidth;
+        compute.at(c) = 2.0 * compute.at(c);
+        out.at(c) = num_rows * num_in_features * sizeof(float) / bandwidth;
+    }
+
+    device.reset_stats();
+    std::vector<Matrix<float>> *gradients = linear.backward(&incoming_gradients_chunked);
+    std::vector<Matrix<float>> *gradients_pipelined = linear_pipelined.backward(&incoming_gradients_chunked);
+    stats = device.get_stats();
+    time = get_pipeline_time(&in, &compute, &out, num_buffers);
+    if (!is_close(gradients_pipelined, gradients) || std::abs(stats.time - time) > 1e-9 * time) {
+        return 0;
+    }
+
+    std::vector<Matrix<float> *> parameter_gradients = linear.get_gradients();
+    std::vector<Matrix<float> *> parameter_gradients_pipelined = linear_pipelined.get_gradients();
+    for (long i = 0; i < (long) parameter_gradients.size(); ++i) {
+        for (long j = 0; j < parameter_gradients.at(i)->size_; ++j) {
+            float expected = parameter_gradients.at(i)->values_[j];
+            if (std::abs(parameter_gradients_pipelined.at(i)->values_[j] - expected) > 1e-4 * (1.0 + std::abs(expected))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// a self-loop and a few random neighbours per node
+void get_emulated_graph(long num_nodes, SparseMatrix<float> *graph) {
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> neighbour_distribution(0, num_nodes - 1);
+    std::vector<std::vector<int>> rows(num_nodes);
+    for (long row = 0; row < num_nodes; ++row) {
+        rows.at(row).push_back(row);
+        for (long k = 0; k < 4; ++k) {
+            rows.at(row).push_back(neighbour_distribution(generator));
+        }
+        std::sort(rows.at(row).begin(), rows.at(row).end());
+        rows.at(row).erase(std::unique(rows.at(row).begin(), rows.at(row).end()), rows.at(row).end());
+    }
+    long nnz = 0;
+    for (long row = 0; row < num_nodes; ++row) {
+        nnz = nnz + rows.at(row).size();
+    }
+    graph->set(num_nodes, num_nodes, nnz);
+    graph->csr_row_ptr_[0] = 0;
+    for (long row = 0; row < num_nodes; ++row) {
+        graph->csr_row_ptr_[row + 1] = graph->csr_row_ptr_[row] + rows.at(row).size();
+        for (long k = 0; k < (long) rows.at(row).size(); ++k) {
+            graph->csr_col_ind_[graph->csr_row_ptr_[row] + k] = rows.at(row).at(k);
+            graph->csr_val_[graph->csr_row_ptr_[row] + k] = 1.0;
+        }
+    }
+}
+
+// y = A (x / sum_x) / sum_y on the host, sum_x and sum_y may be NULL
+void get_emulated_aggregation(SparseMatrix<float> *graph, Matrix<float> *x, Matrix<float> *sum_x, Matrix<float> *sum_y,
+                              Matrix<float> *y) {
+    y->set(x->num_rows_, x->num_columns_, true);
+    y->set_values(0.0);
+    for (long row = 0; row < graph->num_rows_; ++row) {
+        for (long l = graph->csr_row_ptr_[row]; l < graph->csr_row_ptr_[row + 1]; ++l) {
+            long neighbour = graph->csr_col_ind_[l];
+            float weight = graph->csr_val_[l];
+            if (sum_x != NULL) {
+                weight = weight / sum_x->values_[neighbour];
+            }
+            for (long column = 0; column < x->num_columns_; ++column) {
+                y->values_[row * y->num_columns_ + column] += weight * x->values_[neighbour * x->num_columns_ + column];
+            }
+        }
+        if (sum_y != NULL) {
+            for (long column = 0; column < x->num_columns_; ++column) {
+                y->values_[row * y->num_columns_ + column] /= sum_y->values_[row];
+            }
+        }
+    }
+}
+
+// FeatureAggregationPipelined on the emulated device only touches the memory of the device, within its capacity
+int test_emulated_feature_aggregation_pipelined(long num_nodes, long chunk_size, std::string reduction) {
+    long num_features = 8;
+    long num_steps = 2;
+    double bandwidth = 1e9;
+    double flop_rate = 1e10;
+    bool mean = reduction == "mean";
+
+    SparseMatrix<float> graph;
+    get_emulated_graph(num_nodes, &graph);
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    std::vector<SparseMatrix<float>> tiles(num_chunks * num_chunks);
+    double_chunk_up_sp(&graph, &tiles, &boundaries);
+    Matrix<float> sum(num_nodes, 1, true);
+    sp_mat_sum_rows(&tiles, &sum);
+    long tiles_max_nnz = max_nnz(&tiles);
+
+    CudaHelper cuda_helper;
+    FeatureAggregationPipelined aggregation(&cuda_helper, &tiles, &sum, reduction, num_features, &boundaries);
+    long memory = chunk_size * num_features * sizeof(float)
+                  + num_steps * ((chunk_size + 1) * sizeof(int) + tiles_max_nnz * (sizeof(int) + sizeof(float))
+                                 + chunk_size * num_features * sizeof(float) + (mean ? chunk_size * sizeof(float) : 0));
+
+    Matrix<float> x(num_nodes, num_features, true);
+    x.set_random_values();
+    std::vector<Matrix<float>> x_chunked(num_chunks);
+    chunk_up(&x, &x_chunked, &boundaries);
+
+    // one byte short of the buffers of the pipeline
+    EmulatedDevice small_device(memory - 1, bandwidth, flop_rate);
+    aggregation.set_emulated_device(&small_device);
+    try {
+        aggregation.forward(&x_chunked);
+        return 0;
+    } catch (const char *error) {
+        if (std::string(error) != "Out of emulated device memory") {
+            return 0;
+        }
+    }
+
+    EmulatedDevice device(memory, bandwidth, flop_rate);
+    aggregation.set_emulated_device(&device);
+    Matrix<float> expected;
+    get_emulated_aggregation(&graph, &x, NULL, mean ? &sum : NULL, &expected);
+    std::vector<Matrix<float>> expected_chunked(num_chunks);
+    chunk_up(&expected, &expected_chunked, &boundaries);
+    std::vector<Matrix<float>> *y = aggregation.forward(&x_chunked);
+    EmulatedDeviceStats stats = device.get_stats();
+    if (!is_close(y, &expected_chunked) || stats.peak_memory != memory || device.get_memory_used() != 0) {
+        return 0;
+    }
+
+    // every copy and kernel takes its cost once, the streams overlap
+    double busy_sum = 0.0;
+    for (long row = 0; row < num_chunks; ++row) {
+        long num_rows = boundaries.at(row + 1) - boundaries.at(row);
+        busy_sum = busy_sum + num_rows * num_features * sizeof(float) / bandwidth;
+        if (mean) {
+            busy_sum = busy_sum + num_rows * sizeof(float) / bandwidth + num_rows * num_features / flop_rate;
+        }
+        for (long column = 0; column < num_chunks; ++column) {
+            SparseMatrix<float> *tile = &tiles.at(row * num_chunks + column);
+            if (tile->nnz_ == 0) {
+                continue;
+            }
+            long num_x_rows = boundaries.at(column + 1) - boundaries.at(column);
+            busy_sum = busy_sum + ((tile->num_rows_ + 1) * sizeof(int) + tile->nnz_ * (sizeof(int) + sizeof(float))
+                                   + num_x_rows * num_features * sizeof(float)) / bandwidth;
+            busy_sum = busy_sum + 2.0 * tile->nnz_ * num_features / flop_rate;
+        }
+    }
+    if (std::abs(stats.overlap_ratio * stats.busy_time - busy_sum) > 1e-9 * busy_sum) {
+        return 0;
+    }
+    if (num_chunks > 1 && stats.time >= busy_sum) {
+        return 0;
+    }
+
+    Matrix<float> incoming_gradients(num_nodes, num_features, true);
+    incoming_gradients.set_random_values();
+    std::vector<Matrix<float>> incoming_gradients_chunked(num_chunks);
+    chunk_up(&incoming_gradients, &incoming_gradients_chunked, &boundaries);
+    get_emulated_aggregation(&graph, &incoming_gradients, mean ? &sum : NULL, NULL, &expected);
+    chunk_up(&expected, &expected_chunked, &boundaries);
+    std::vector<Matrix<float>> *gradients = aggregation.backward(&incoming_gradients_chunked);
+    return is_close(gradients, &expected_chunked) && device.get_memory_used() == 0;
+}
+
+int test_emulated_error() {
+    EmulatedDevice device(1 << 10, 1e9);
+    Pipeline pipeline(2, &device);
+    pipeline.add_emulated_stage([&device](long chunk, long) {
+        device.launch([chunk]() {
+            if (chunk == 3) {
+                throw "Kernel failed";
+            }
+        }, 0.0, device.stream_compute_);
+    }, device.stream_compute_);
+    pipeline.add_stage([](long, long) {}, NULL);
+    try {
+        pipeline.run(10);
+    } catch (const char *error) {
+        return std::string(error) == "Kernel failed";
+    }
+    return 0;
+}
+
+// check_cuda throws strings, a kernel that fails in it reaches the caller as it is
+int test_emulated_string_error() {
+    EmulatedDevice device(1 << 10, 1e9);
+    device.launch([]() { throw std::string("CUDA error"); }, 0.0, device.stream_compute_);
+    try {
+        device.synchronize();
+    } catch (std::string error) {
+        return error == "CUDA error";
+    }
+    return 0;
+}
+
+TEST_CASE("Emulated device", "[emulated]") {
+    CHECK(test_emulated_memory());
+    CHECK(test_emulated_bandwidth());
+    CHECK(test_emulated_linear_pipelined(100, 100));
+    CHECK(test_emulated_linear_pipelined(1000, 64));
+    CHECK(test_emulated_linear_pipelined(4096, 256));
+    CHECK(test_emulated_feature_aggregation_pipelined(100, 100, "mean"));
+    CHECK(test_emulated_feature_aggregation_pipelined(1000, 64, "mean"));
+    CHECK(test_emulated_feature_aggregation_pipelined(1000, 300, "sum"));
+    CHECK(test_emulated_error());
+    CHECK(test_emulated_string_error());
+}
@@ -8,6 +8,8 @@
 #include "sparse_computation.hpp"
 
 #include "catch2/catch.hpp"
+#include <algorithm>
+#include <cmath>
 
 
 const std::string home = std::getenv("HOME");
@@ -134,3 +136,57 @@ TEST_CASE("Feature aggregation, pipelined", "[aggr][pipelined]") {
     CHECK(test_graph_conv_chunked(&graph_convolution, 1 << 14));
     CHECK(test_graph_conv_chunked(&graph_convolution, 1 << 13));
 }
+
+// halo aggregate plus the diagonal tile times the own chunk is the whole row chunk of the product
+int test_halo_aggregates(long chunk_size) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    long num_nodes = adjacency.num_rows_;
+    long num_features = 9;
+    Matrix<float> x(num_nodes, num_features, false);
+    for (long i = 0; i < x.size_; ++i) {
+        x.values_[i] = (float) (i % 13) - 6.0;
+    }
+
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    std::vector<SparseMatrix<float>> tiles(num_chunks * num_chunks);
+    double_chunk_up_sp(&adjacency, &tiles, &boundaries);
+    TileIndex tile_index;
+    index_tiles(&tiles, &tile_index);
+    std::vector<Matrix<float>> x_chunked(num_chunks);
+    chunk_up(&x, &x_chunked, &boundaries);
+    to_column_major_inplace(&x);
+    std::vector<Matrix<float>> aggregates(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        aggregates.at(i).set(boundaries.at(i + 1) - boundaries.at(i), num_features, false);
+    }
+    get_halo_aggregates(&tiles, &tile_index, &x_chunked, &aggregates);
+
+    for (long i = 0; i < num_chunks; ++i) {
+        SparseMatrix<float> *diagonal = &tiles.at(i * num_chunks + i);
+        for (long column = 0; column < num_features; ++column) {
+            for (long row = 0; row < diagonal->num_rows_; ++row) {
+                float expected = 0.0;
+                long node = boundaries.at(i) + row;
+                for (long k = adjacency.csr_row_ptr_[node]; k < adjacency.csr_row_ptr_[node + 1]; ++k) {
+                    expected = expected + adjacency.csr_val_[k] * x.values_[column * num_nodes + adjacency.csr_col_ind_[k]];
+                }
+                float result = aggregates.at(i).values_[column * diagonal->num_rows_ + row];
+                for (long k = diagonal->csr_row_ptr_[row]; k < diagonal->csr_row_ptr_[row + 1]; ++k) {
+                    result = result + diagonal->csr_val_[k] * x_chunked.at(i).values_[column * diagonal->num_rows_ + diagonal->csr_col_ind_[k]];
+                }
+                if (std::abs(result - expected) > 1e-3 * std::max(std::abs(expected), 1.0f)) {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+TEST_CASE("Feature aggregation, halo aggregates", "[aggr][history]") {
+    CHECK(test_halo_aggregates(1 << 15));
+    CHECK(test_halo_aggregates(1 << 12));
+    CHECK(test_halo_aggregates(1000));
+}
@@ -0,0 +1,80 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "feature_cache.hpp"
+#include "sampling.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string flickr_dir_path = dir_path + "/flickr";
+
+
+int test_feature_cache(long num_cached) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    Matrix<float> features = load_npy_matrix<float>(flickr_dir_path + "/features.npy");
+    Matrix<int> classes = load_npy_matrix<int>(flickr_dir_path + "/classes.npy");
+    long num_nodes = adjacency.num_rows_;
+
+    FeatureCache feature_cache(&adjacency, &features, num_cached);
+    if ((long) feature_cache.nodes_.size() != std::min(num_cached, num_nodes)) {
+        return 0;
+    }
+
+    // no node outside the cache has a higher in-degree than one inside
+    std::vector<long> in_degrees;
+    get_in_degrees(&adjacency, &in_degrees);
+    long min_cached_degree = in_degrees.at(feature_cache.nodes_.back());
+    for (long node = 0; node < num_nodes; ++node) {
+        float *row = feature_cache.get_row(node);
+        if (row == NULL) {
+            if (in_degrees.at(node) > min_cached_degree) {
+                return 0;
+            }
+            continue;
+        }
+        to_row_major_inplace(&features);
+        if (!std::equal(row, row + features.num_columns_, features.values_ + node * features.num_columns_)) {
+            return 0;
+        }
+    }
+
+    // the same mini-batch with and without the cache
+    std::vector<long> fanouts = {10, 10};
+    std::vector<int> order;
+    get_batch_order(num_nodes, 0, 0, &order);
+    std::vector<int> seeds;
+    get_batch_seeds(&order, 0, 512, &seeds);
+    NeighbourSampler sampler(&adjacency, &features, &classes, &fanouts, 0);
+    MiniBatch mini_batch;
+    sampler.sample(&seeds, 0, &mini_batch);
+    if (mini_batch.num_cache_hits != 0) {
+        return 0;
+    }
+    sampler.set_feature_cache(&feature_cache);
+    MiniBatch mini_batch_cached;
+    sampler.sample(&seeds, 0, &mini_batch_cached);
+    if (!check_equality(&mini_batch.features, &mini_batch_cached.features)) {
+        return 0;
+    }
+
+    long num_hits = 0;
+    for (long i = 0; i < (long) mini_batch_cached.nodes.front().size(); ++i) {
+        if (feature_cache.get_row(mini_batch_cached.nodes.front().at(i)) != NULL) {
+            num_hits = num_hits + 1;
+        }
+    }
+    return num_hits > 0 && mini_batch_cached.num_cache_hits == num_hits &&
+           mini_batch_cached.num_cache_hits + mini_batch_cached.num_cache_misses == (long) mini_batch_cached.nodes.front().size();
+}
+
+TEST_CASE("Feature cache", "[featurecache]") {
+    CHECK(test_feature_cache(1000));
+    CHECK(test_feature_cache(20000));
+    CHECK(test_feature_cache(1l << 20));
+}
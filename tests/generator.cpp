@@ -0,0 +1,113 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "generator.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string test_dir_path = dir_path + "/tests";
+
+
+int test_generate_graph(GraphModel model, bool symmetrize) {
+    GeneratorOptions options;
+    options.model = model;
+    options.num_nodes = 10000;
+    options.num_edges = 100000;
+    options.batch_size = 1 << 12;
+    options.seed = 42;
+    std::string csr_path = test_dir_path + "/generated.csr";
+
+    // the same seed gives the same graph with any number of threads and memory limit
+    IngestOptions ingest_options;
+    ingest_options.symmetrize = symmetrize;
+    ingest_options.num_threads = 1;
+    ingest_options.tmp_dir = test_dir_path;
+    long nnz = generate_graph(csr_path, &options, &ingest_options);
+    SparseMatrix<float> adjacency;
+    load_sp_matrix<float>(csr_path, &adjacency);
+
+    ingest_options.num_threads = 4;
+    ingest_options.memory_limit = 1 << 16;
+    generate_graph(csr_path, &options, &ingest_options);
+    SparseMatrix<float> adjacency_parallel;
+    load_sp_matrix<float>(csr_path, &adjacency_parallel);
+    std::remove(csr_path.c_str());
+
+    if (adjacency.nnz_ != nnz || !check_equality(&adjacency, &adjacency_parallel)) {
+        return 0;
+    }
+    if (!symmetrize && nnz > options.num_edges) {
+        return 0;
+    }
+
+    // skewed degrees, the largest degree is far above the average
+    long max_degree = 0;
+    for (long i = 0; i < adjacency.num_rows_; ++i) {
+        max_degree = std::max(max_degree, (long) (adjacency.csr_row_ptr_[i + 1] - adjacency.csr_row_ptr_[i]));
+    }
+    if (max_degree < 10 * nnz / adjacency.num_rows_) {
+        return 0;
+    }
+
+    if (symmetrize) {
+        SparseMatrix<float> adjacency_transposed;
+        adjacency_transposed.set(adjacency.num_rows_, adjacency.num_columns_, adjacency.nnz_);
+        std::copy(adjacency.csr_val_, adjacency.csr_val_ + adjacency.nnz_, adjacency_transposed.csr_val_);
+        std::copy(adjacency.csr_row_ptr_, adjacency.csr_row_ptr_ + adjacency.num_rows_ + 1, adjacency_transposed.csr_row_ptr_);
+        std::copy(adjacency.csr_col_ind_, adjacency.csr_col_ind_ + adjacency.nnz_, adjacency_transposed.csr_col_ind_);
+        transpose_csr_matrix_cpu(&adjacency_transposed);
+        return check_equality(&adjacency, &adjacency_transposed);
+    }
+    return 1;
+}
+
+int test_generate_features() {
+    GeneratorOptions options;
+    options.num_nodes = 1000;
+    options.num_features = 16;
+    options.num_classes = 5;
+    options.batch_size = 1 << 10;
+    std::string features_path = test_dir_path + "/generated_features.npy";
+    std::string classes_path = test_dir_path + "/generated_classes.npy";
+
+    IngestOptions ingest_options;
+    ingest_options.num_threads = 3;
+    generate_features(features_path, &options, &ingest_options);
+    generate_labels(classes_path, &options, &ingest_options);
+
+    Matrix<float> features = load_npy_matrix<float>(features_path);
+    Matrix<int> classes = load_npy_matrix<int>(classes_path);
+    std::remove(features_path.c_str());
+    std::remove(classes_path.c_str());
+
+    if (features.num_rows_ != options.num_nodes || features.num_columns_ != options.num_features) {
+        return 0;
+    }
+    if (classes.num_rows_ != options.num_nodes) {
+        return 0;
+    }
+    for (long i = 0; i < classes.size_; ++i) {
+        if (classes.values_[i] < 0 || classes.values_[i] >= options.num_classes) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+TEST_CASE("Generate graph", "[generator]") {
+    CHECK(test_generate_graph(rmat, false));
+    CHECK(test_generate_graph(rmat, true));
+    CHECK(test_generate_graph(power_law, false));
+    CHECK(test_generate_graph(power_law, true));
+}
+
+TEST_CASE("Generate features", "[generator]") {
+    CHECK(test_generate_features());
+}
@@ -0,0 +1,190 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "hybrid.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string flickr_dir_path = dir_path + "/flickr";
+
+
+// result = sp_mat * mat row by row, in column-major order
+void csr_mat_mat_multi(SparseMatrix<float> *sp_mat, Matrix<float> *mat, Matrix<float> *result) {
+    to_column_major_inplace(mat);
+    result->set(sp_mat->num_rows_, mat->num_columns_, false);
+    for (long column = 0; column < mat->num_columns_; ++column) {
+        for (long row = 0; row < sp_mat->num_rows_; ++row) {
+            float sum = 0.0;
+            for (long j = sp_mat->csr_row_ptr_[row]; j < sp_mat->csr_row_ptr_[row + 1]; ++j) {
+                sum = sum + sp_mat->csr_val_[j] * mat->values_[column * mat->num_rows_ + sp_mat->csr_col_ind_[j]];
+            }
+            result->values_[column * sp_mat->num_rows_ + row] = sum;
+        }
+    }
+}
+
+int check_close(Matrix<float> *a, Matrix<float> *b) {
+    if (a->size_ != b->size_ || a->is_row_major_ != b->is_row_major_) {
+        return 0;
+    }
+    for (long i = 0; i < a->size_; ++i) {
+        if (std::abs(a->values_[i] - b->values_[i]) > 1e-4 * std::max(std::abs(a->values_[i]), 1.0f)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int check_hybrid(SparseMatrix<float> *sp_mat, HybridSparseMatrix *hybrid) {
+    // every row is in exactly one lane, every non-zero in the slices or the hubs
+    std::vector<long> lanes(sp_mat->num_rows_, 0);
+    for (long i = 0; i < (long) hybrid->slice_rows_.size(); ++i) {
+        if (hybrid->slice_rows_.at(i) >= 0) {
+            lanes.at(hybrid->slice_rows_.at(i)) = lanes.at(hybrid->slice_rows_.at(i)) + 1;
+        }
+    }
+    if (std::count(lanes.begin(), lanes.end(), 1) != sp_mat->num_rows_) {
+        return 0;
+    }
+    long sell_nnz = 0;
+    for (long i = 0; i < (long) hybrid->sell_val_.size(); ++i) {
+        if (hybrid->sell_val_.at(i) != 0.0) {
+            sell_nnz = sell_nnz + 1;
+        }
+    }
+    for (long i = 0; i < (long) hybrid->hub_rows_.size(); ++i) {
+        long row = hybrid->hub_rows_.at(i);
+        if (sp_mat->csr_row_ptr_[row + 1] - sp_mat->csr_row_ptr_[row] <= hybrid->hub_degree_) {
+            return 0;
+        }
+    }
+    if (sell_nnz + hybrid->hub_nnz_ != sp_mat->nnz_) {
+        return 0;
+    }
+
+    Matrix<float> features(sp_mat->num_columns_, 17, true);
+    features.set_random_values();
+    Matrix<float> expected;
+    csr_mat_mat_multi(sp_mat, &features, &expected);
+
+    Matrix<float> result(sp_mat->num_rows_, 17, true);
+    result.set_random_values();
+    hybrid_mat_mat_multi(hybrid, &features, &result, false);
+    if (!check_close(&expected, &result)) {
+        return 0;
+    }
+
+    // adding to the result doubles it
+    hybrid_mat_mat_multi(hybrid, &features, &result, true);
+    for (long i = 0; i < expected.size_; ++i) {
+        expected.values_[i] = 2 * expected.values_[i];
+    }
+    return check_close(&expected, &result);
+}
+
+// mostly rows with a handful of non-zeros and a few hubs connected to a large share of the nodes
+void get_skewed_matrix(long num_rows, long num_hubs, long hub_degree, SparseMatrix<float> *sp_mat) {
+    std::mt19937_64 generator(1);
+    std::uniform_int_distribution<long> degree_distribution(1, 4);
+    std::uniform_int_distribution<int> column_distribution(0, num_rows - 1);
+    std::uniform_real_distribution<float> value_distribution(0.0, 1.0);
+    std::vector<std::vector<int>> rows(num_rows);
+    for (long row = 0; row < num_rows; ++row) {
+        long degree = row % (num_rows / num_hubs) == 0 ? hub_degree : degree_distribution(generator);
+        for (long k = 0; k < degree; ++k) {
+            rows.at(row).push_back(column_distribution(generator));
+        }
+        std::sort(rows.at(row).begin(), rows.at(row).end());
+        rows.at(row).erase(std::unique(rows.at(row).begin(), rows.at(row).end()), rows.at(row).end());
+    }
+
+    long nnz = 0;
+    for (long row = 0; row < num_rows; ++row) {
+        nnz = nnz + rows.at(row).size();
+    }
+    sp_mat->set(num_rows, num_rows, nnz);
+    sp_mat->csr_row_ptr_[0] = 0;
+    for (long row = 0; row < num_rows; ++row) {
+        sp_mat->csr_row_ptr_[row + 1] = sp_mat->csr_row_ptr_[row] + rows.at(row).size();
+        for (long k = 0; k < (long) rows.at(row).size(); ++k) {
+            sp_mat->csr_col_ind_[sp_mat->csr_row_ptr_[row] + k] = rows.at(row).at(k);
+            sp_mat->csr_val_[sp_mat->csr_row_ptr_[row] + k] = value_distribution(generator) + 0.5;
+        }
+    }
+}
+
+int test_hybrid_skewed(long num_rows, long num_hubs, long hub_degree) {
+    SparseMatrix<float> sp_mat;
+    get_skewed_matrix(num_rows, num_hubs, hub_degree, &sp_mat);
+
+    HybridSparseMatrix hybrid;
+    if (!to_hybrid_if_skewed(&sp_mat, &hybrid)) {
+        return 0;
+    }
+    if ((long) hybrid.hub_rows_.size() != num_hubs) {
+        return 0;
+    }
+
+    return check_hybrid(&sp_mat, &hybrid);
+}
+
+int test_hybrid(long hub_degree, long slice_size, long sort_window) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    HybridSparseMatrix hybrid;
+    to_hybrid(&adjacency, hub_degree, slice_size, sort_window, &hybrid);
+
+    return check_hybrid(&adjacency, &hybrid);
+}
+
+TEST_CASE("Hybrid sparse matrix", "[hybrid]") {
+    CHECK(test_hybrid(16, 32, 1024));
+    CHECK(test_hybrid(4, 8, 8));
+    CHECK(test_hybrid(1l << 30, 32, 1));
+    CHECK(test_hybrid_skewed(10000, 10, 4000));
+    CHECK(test_hybrid_skewed(1000, 2, 900));
+}
+
+TEST_CASE("Hybrid selection", "[hybrid]") {
+    // a few light hubs do not make the matrix skewed
+    SparseMatrix<float> sp_mat;
+    get_skewed_matrix(10000, 10, 40, &sp_mat);
+    CHECK(get_hub_degree(&sp_mat) == 0);
+
+    get_skewed_matrix(10000, 100, 1000, &sp_mat);
+    long hub_degree = get_hub_degree(&sp_mat);
+    CHECK(hub_degree > 4);
+    CHECK(hub_degree < 1000);
+
+    std::vector<long> histogram;
+    get_degree_histogram(&sp_mat, &histogram);
+    long num_rows = 0;
+    for (long i = 0; i < (long) histogram.size(); ++i) {
+        num_rows = num_rows + histogram.at(i);
+    }
+    CHECK(num_rows == 10000);
+}
+
+TEST_CASE("Hybrid tiles", "[hybrid]") {
+    // a skewed tile, a tile without heavy hubs and an empty tile
+    std::vector<SparseMatrix<float>> tiles(3);
+    get_skewed_matrix(10000, 10, 4000, &tiles.at(0));
+    get_skewed_matrix(10000, 10, 40, &tiles.at(1));
+
+    HybridTiles hybrid_tiles;
+    to_hybrid_tiles(&tiles, &hybrid_tiles);
+    REQUIRE(hybrid_tiles.is_hybrid_.size() == 3);
+    CHECK(hybrid_tiles.is_hybrid_.at(0));
+    CHECK(!hybrid_tiles.is_hybrid_.at(1));
+    CHECK(!hybrid_tiles.is_hybrid_.at(2));
+    CHECK(check_hybrid(&tiles.at(0), &hybrid_tiles.hybrids_.at(0)));
+    CHECK(hybrid_tiles.max_hub_nnz_ == hybrid_tiles.hybrids_.at(0).hub_nnz_);
+    CHECK(hybrid_tiles.max_sell_size_ == (long) hybrid_tiles.hybrids_.at(0).sell_val_.size());
+}
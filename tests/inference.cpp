@@ -0,0 +1,187 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "inference.hpp"
+#include "reordering.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include "cnpy.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string test_dir_path = dir_path + "/tests";
+
+const long inference_num_nodes = 1000;
+
+
+// every node points to its two neighbours and to the node across the ring
+void get_inference_graph(SparseMatrix<float> *graph) {
+    graph->set(inference_num_nodes, inference_num_nodes, 3 * inference_num_nodes);
+    for (long i = 0; i < inference_num_nodes; ++i) {
+        std::vector<long> neighbours = {(i + inference_num_nodes - 1) % inference_num_nodes, (i + 1) % inference_num_nodes,
+                                        (i + inference_num_nodes / 2) % inference_num_nodes};
+        std::sort(neighbours.begin(), neighbours.end());
+        graph->csr_row_ptr_[i] = 3 * i;
+        for (long k = 0; k < 3; ++k) {
+            graph->csr_col_ind_[3 * i + k] = neighbours.at(k);
+            graph->csr_val_[3 * i + k] = 1.0;
+        }
+    }
+    graph->csr_row_ptr_[inference_num_nodes] = 3 * inference_num_nodes;
+}
+
+// row-major outputs of every layer on the host, mean aggregation
+std::vector<std::vector<float>> get_expected_outputs(SparseMatrix<float> *graph, Matrix<float> *features,
+                                                     std::vector<Matrix<float>> *parameters) {
+    std::vector<std::vector<float>> outputs;
+    std::vector<float> x(features->values_, features->values_ + features->size_);
+    long num_in_features = features->num_columns_;
+    long num_layers = parameters->size() / 4;
+    for (long l = 0; l < num_layers; ++l) {
+        Matrix<float> *weight_self = &parameters->at(4 * l);
+        Matrix<float> *weight_neighbourhood = &parameters->at(4 * l + 2);
+        long num_out_features = weight_self->num_columns_;
+        std::vector<float> y(inference_num_nodes * num_out_features);
+        for (long n = 0; n < inference_num_nodes; ++n) {
+            std::vector<float> aggregation(num_in_features, 0.0);
+            long degree = graph->csr_row_ptr_[n + 1] - graph->csr_row_ptr_[n];
+            for (long k = graph->csr_row_ptr_[n]; k < graph->csr_row_ptr_[n + 1]; ++k) {
+                for (long f = 0; f < num_in_features; ++f) {
+                    aggregation.at(f) = aggregation.at(f) + x.at(graph->csr_col_ind_[k] * num_in_features + f) / degree;
+                }
+            }
+            for (long c = 0; c < num_out_features; ++c) {
+                float value = parameters->at(4 * l + 1).values_[c] + parameters->at(4 * l + 3).values_[c];
+                for (long f = 0; f < num_in_features; ++f) {
+                    value = value + x.at(n * num_in_features + f) * weight_self->values_[c * num_in_features + f] +
+                            aggregation.at(f) * weight_neighbourhood->values_[c * num_in_features + f];
+                }
+                if (l < num_layers - 1 && value < 0.0) {
+                    value = 0.0;
+                }
+                y.at(n * num_out_features + c) = value;
+            }
+        }
+        outputs.push_back(y);
+        x = y;
+        num_in_features = num_out_features;
+    }
+
+    return outputs;
+}
+
+// permute runs on the graph in RCM order and checks the outputs in the original order
+int test_inference(long chunk_size, bool spill, bool permute) {
+    std::vector<long> channels = {32, 16, 16, 8};
+    long num_layers = channels.size() - 1;
+    std::string predictions_path = test_dir_path + "/predictions.npy";
+    std::string embeddings_path = test_dir_path + "/embeddings.npy";
+
+    Matrix<float> features(inference_num_nodes, channels.front(), true);
+    features.set_random_values();
+    std::vector<Matrix<float>> parameters(4 * num_layers);
+    std::vector<Matrix<float> *> parameter_pointers;
+    for (long l = 0; l < num_layers; ++l) {
+        parameters.at(4 * l).set(channels.at(l), channels.at(l + 1), false);
+        parameters.at(4 * l + 1).set(channels.at(l + 1), 1, false);
+        parameters.at(4 * l + 2).set(channels.at(l), channels.at(l + 1), false);
+        parameters.at(4 * l + 3).set(channels.at(l + 1), 1, false);
+    }
+    for (Matrix<float> &parameter : parameters) {
+        parameter.set_random_values();
+        parameter_pointers.push_back(&parameter);
+    }
+    SparseMatrix<float> graph;
+    get_inference_graph(&graph);
+    std::vector<std::vector<float>> expected = get_expected_outputs(&graph, &features, &parameters);
+
+    std::vector<int> new_ids;
+    SparseMatrix<float> graph_permuted;
+    Matrix<float> features_permuted;
+    if (permute) {
+        get_permutation(&graph, rcm, &new_ids);
+        permute_sp_matrix(&graph, &new_ids, &graph_permuted);
+        permute_rows<float>(&features, &new_ids, &features_permuted);
+    }
+    SparseMatrix<float> *input_graph = permute ? &graph_permuted : &graph;
+    Matrix<float> *input_features = permute ? &features_permuted : &features;
+
+    std::vector<long> boundaries;
+    get_uniform_boundaries(inference_num_nodes, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+    double_chunk_up_sp(input_graph, &adjacencies, &boundaries);
+    Matrix<float> sum(inference_num_nodes, 1, true);
+    sp_mat_sum_rows(&adjacencies, &sum);
+    std::vector<Matrix<float>> features_chunked(num_chunks);
+    chunk_up(input_features, &features_chunked, &boundaries);
+
+    CudaHelper cuda_helper;
+    Inference inference(&cuda_helper, &adjacencies, &sum, &boundaries, parameter_pointers);
+    inference.set_embeddings_path(embeddings_path);
+    if (spill) {
+        inference.set_spill_dir(test_dir_path);
+    }
+    if (permute) {
+        inference.set_permutation(&new_ids);
+    }
+    if (inference.run(&features_chunked, predictions_path) != inference_num_nodes) {
+        return 0;
+    }
+
+    std::vector<float> *expected_embeddings = &expected.at(num_layers - 2);
+    cnpy::NpyArray embeddings = cnpy::npy_load(embeddings_path);
+    if (embeddings.shape.at(0) != (size_t) inference_num_nodes || embeddings.num_vals != expected_embeddings->size()) {
+        return 0;
+    }
+    for (long k = 0; k < (long) expected_embeddings->size(); ++k) {
+        if (std::abs(embeddings.data<float>()[k] - expected_embeddings->at(k)) > 1e-4 * (1.0 + std::abs(expected_embeddings->at(k)))) {
+            return 0;
+        }
+    }
+
+    // a prediction may only differ from the expected one if the scores are too close to tell apart
+    std::vector<float> *expected_scores = &expected.back();
+    long num_classes = channels.back();
+    cnpy::NpyArray predictions = cnpy::npy_load(predictions_path);
+    if (predictions.num_vals != (size_t) inference_num_nodes) {
+        return 0;
+    }
+    for (long n = 0; n < inference_num_nodes; ++n) {
+        int prediction = predictions.data<int>()[n];
+        float max_score = expected_scores->at(n * num_classes);
+        for (long c = 1; c < num_classes; ++c) {
+            max_score = std::max(max_score, expected_scores->at(n * num_classes + c));
+        }
+        if (prediction < 0 || prediction >= num_classes || expected_scores->at(n * num_classes + prediction) < max_score - 1e-4) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+TEST_CASE("Inference", "[inference]") {
+    CHECK(test_inference(inference_num_nodes, false, false));
+    CHECK(test_inference(300, false, false));
+    CHECK(test_inference(128, false, false));
+}
+
+TEST_CASE("Inference, spill", "[inference]") {
+    CHECK(test_inference(300, true, false));
+    CHECK(test_inference(128, true, false));
+}
+
+TEST_CASE("Inference, reordered graph", "[inference]") {
+    CHECK(test_inference(300, false, true));
+    CHECK(test_inference(128, true, true));
+}
@@ -0,0 +1,190 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "ingest.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include "cnpy.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string test_dir_path = dir_path + "/tests";
+
+
+// dense reference of the expected adjacency
+int check_adjacency(SparseMatrix<float> *adjacency, std::vector<Edge> *edges, long num_nodes) {
+    if (adjacency->num_rows_ != num_nodes || adjacency->num_columns_ != num_nodes) {
+        return 0;
+    }
+    std::vector<int> dense(num_nodes * num_nodes, 0);
+    for (long i = 0; i < (long) edges->size(); ++i) {
+        dense.at(edges->at(i).first * num_nodes + edges->at(i).second) = 1;
+    }
+    long nnz = 0;
+    for (long i = 0; i < (long) dense.size(); ++i) {
+        nnz = nnz + dense.at(i);
+    }
+    if (adjacency->nnz_ != nnz) {
+        return 0;
+    }
+    for (long row = 0; row < num_nodes; ++row) {
+        for (long j = adjacency->csr_row_ptr_[row]; j < adjacency->csr_row_ptr_[row + 1]; ++j) {
+            if (dense.at(row * num_nodes + adjacency->csr_col_ind_[j]) != 1 || adjacency->csr_val_[j] != 1.0) {
+                return 0;
+            }
+            // columns are sorted and unique
+            if (j > adjacency->csr_row_ptr_[row] && adjacency->csr_col_ind_[j] <= adjacency->csr_col_ind_[j - 1]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int test_ingest_edge_list(bool symmetrize, long memory_limit, long block_size) {
+    long num_nodes = 1000;
+    long num_edges = 20000;
+    std::string path = test_dir_path + "/edges.csv";
+    std::string csr_path = test_dir_path + "/adjacency.csr";
+
+    std::vector<Edge> edges;
+    std::ofstream file(path);
+    file << "source,destination" << std::endl;
+    for (long i = 0; i < num_edges; ++i) {
+        // includes duplicates and self-loops
+        Edge edge(rand() % num_nodes, rand() % num_nodes);
+        file << edge.first << "," << edge.second << std::endl;
+        edges.push_back(edge);
+        if (symmetrize) {
+            edges.push_back(Edge(edge.second, edge.first));
+        }
+    }
+    file.close();
+
+    IngestOptions options;
+    options.num_nodes = num_nodes;
+    options.symmetrize = symmetrize;
+    options.memory_limit = memory_limit;
+    options.block_size = block_size;
+    options.num_threads = 4;
+    options.tmp_dir = test_dir_path;
+    ingest_edge_list(path, csr_path, &options);
+
+    SparseMatrix<float> adjacency;
+    load_sp_matrix<float>(csr_path, &adjacency);
+
+    std::remove(path.c_str());
+    std::remove(csr_path.c_str());
+
+    return check_adjacency(&adjacency, &edges, num_nodes);
+}
+
+int test_ingest_feature_table(long block_size) {
+    long num_rows = 5000;
+    long num_columns = 7;
+    std::string path = test_dir_path + "/features.csv";
+    std::string npy_path = test_dir_path + "/features_ingested.npy";
+
+    Matrix<float> features(num_rows, num_columns, true);
+    features.set_random_values();
+    std::ofstream file(path);
+    for (long i = 0; i < num_rows; ++i) {
+        for (long j = 0; j < num_columns; ++j) {
+            if (j > 0) {
+                file << ",";
+            }
+            file.precision(9);
+            file << features.values_[i * num_columns + j];
+        }
+        file << std::endl;
+    }
+    file.close();
+
+    IngestOptions options;
+    options.block_size = block_size;
+    options.num_threads = 4;
+    if (ingest_feature_table(path, npy_path, &options) != num_rows) {
+        return 0;
+    }
+
+    Matrix<float> features_ingested = load_npy_matrix<float>(npy_path);
+
+    std::remove(path.c_str());
+    std::remove(npy_path.c_str());
+
+    return check_equality(&features, &features_ingested);
+}
+
+// the parser threads throw, the error reaches the caller
+int test_ingest_negative_id() {
+    std::string path = test_dir_path + "/edges_negative.csv";
+    std::string csr_path = test_dir_path + "/adjacency_negative.csr";
+    std::ofstream file(path);
+    for (long i = 0; i < 1000; ++i) {
+        file << i << "," << (i == 500 ? -1 : i + 1) << std::endl;
+    }
+    file.close();
+
+    IngestOptions options;
+    options.num_threads = 4;
+    options.tmp_dir = test_dir_path;
+    int is_thrown = 0;
+    try {
+        ingest_edge_list(path, csr_path, &options);
+    } catch (const char *e) {
+        is_thrown = 1;
+    }
+
+    std::remove(path.c_str());
+    std::remove(csr_path.c_str());
+    return is_thrown;
+}
+
+// the buffer never grows past the edges the memory limit allows and no edge is lost to the runs
+int test_buffer_edges(long memory_limit, long num_new_edges) {
+    IngestOptions options;
+    options.memory_limit = memory_limit;
+    options.num_threads = 2;
+    options.tmp_dir = test_dir_path;
+    long max_edges = get_max_buffered_edges(&options);
+
+    std::vector<Edge> edges;
+    std::vector<std::string> run_paths;
+    std::vector<Edge> new_edges;
+    long num_edges = 0;
+    for (long round = 0; round < 100; ++round) {
+        new_edges.clear();
+        for (long i = 0; i < num_new_edges; ++i) {
+            new_edges.push_back(Edge(num_edges, num_edges));
+            num_edges = num_edges + 1;
+        }
+        buffer_edges(&edges, &new_edges, &run_paths, &options);
+        if ((long) edges.capacity() > max_edges) {
+            return 0;
+        }
+    }
+
+    std::string csr_path = test_dir_path + "/adjacency_buffered.csr";
+    long nnz = write_sorted_csr(&edges, &run_paths, csr_path, num_edges, &options);
+    std::remove(csr_path.c_str());
+    return !run_paths.empty() && nnz == num_edges;
+}
+
+TEST_CASE("Ingest edge list", "[ingest]") {
+    CHECK(test_ingest_edge_list(false, 1l << 32, 1l << 26));
+    CHECK(test_ingest_edge_list(true, 1l << 32, 1l << 26));
+    CHECK(test_ingest_edge_list(false, 1l << 32, 1l << 12));
+    CHECK(test_ingest_edge_list(true, 1l << 14, 1l << 12));
+    CHECK(test_ingest_negative_id());
+    CHECK(test_buffer_edges(1l << 12, 7));
+    CHECK(test_buffer_edges(1l << 12, 100));
+}
+
+TEST_CASE("Ingest feature table", "[ingest]") {
+    CHECK(test_ingest_feature_table(1l << 26));
+    CHECK(test_ingest_feature_table(1l << 12));
+}
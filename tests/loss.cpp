@@ -6,6 +6,7 @@
 #include "tensors.hpp"
 
 #include "catch2/catch.hpp"
+#include <cmath>
 #include <iostream>
 #include <string>
 
@@ -84,6 +85,33 @@ int test_loss_chunked(long chunk_size) {
     return read_return_value(path);
 }
 
+// the chunks past the labels are a halo, neither in the loss nor in the gradients
+int test_loss_halo(long num_rows, long num_halo_rows, long chunk_size) {
+    long num_classes = 7;
+    Matrix<float> input(num_rows + num_halo_rows, num_classes, true);
+    input.set_random_values();
+    Matrix<int> classes(num_rows, 1, true);
+    for (long i = 0; i < num_rows; ++i) {
+        classes.values_[i] = i % num_classes;
+    }
+    double expected = 0.0;
+    for (long i = 0; i < num_rows; ++i) {
+        expected = expected - input.values_[i * num_classes + classes.values_[i]];
+    }
+    expected = expected / num_rows;
+
+    long num_chunks = ceil((double) input.num_rows_ / (double) chunk_size);
+    std::vector<Matrix<float>> input_chunked(num_chunks);
+    chunk_up(&input, &input_chunked, chunk_size);
+    NLLLoss loss_layer(num_rows, num_classes);
+    float loss = loss_layer.forward(&input_chunked, &classes);
+    if (std::abs(loss - expected) > 1e-4 * (1.0 + std::abs(expected))) {
+        return 0;
+    }
+
+    Matrix<float> *gradients = loss_layer.backward();
+    return gradients->num_rows_ == num_rows;
+}
 
 TEST_CASE("Loss", "[loss]") {
     CHECK(test_loss());
@@ -94,3 +122,9 @@ TEST_CASE("Loss, chunked", "[loss][chunked]") {
     CHECK(test_loss_chunked(1 << 12));
     CHECK(test_loss_chunked(1 << 8));
 }
+
+TEST_CASE("Loss, halo", "[loss][chunked]") {
+    CHECK(test_loss_halo(100, 30, 100));
+    CHECK(test_loss_halo(100, 30, 16));
+    CHECK(test_loss_halo(100, 0, 7));
+}
@@ -0,0 +1,133 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "memory_planner.hpp"
+#include "tensors.hpp"
+
+#include <catch2/catch.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// x -> a -> b -> c -> d, only two are live at a time
+int test_memory_planner_chain() {
+    long num_rows = 1000;
+    long num_columns = 64;
+    Matrix<float> x(num_rows, num_columns, true);
+    std::vector<Matrix<float>> chain(4);
+    for (long i = 0; i < (long) chain.size(); ++i) {
+        chain.at(i).set(num_rows, num_columns, true);
+    }
+
+    MemoryPlanner memory_planner;
+    memory_planner.add_step({&x}, {&chain.at(0)});
+    for (long i = 1; i < (long) chain.size(); ++i) {
+        memory_planner.add_step({&chain.at(i - 1)}, {&chain.at(i)});
+    }
+    memory_planner.plan();
+
+    long size = num_rows * num_columns * sizeof(float);
+    return memory_planner.get_num_tensors() == 4 && memory_planner.get_size_before() == 4 * size &&
+           memory_planner.get_size_after() == 2 * size;
+}
+
+// random steps, tensors live at the same time never share memory
+int test_memory_planner_random(long num_tensors, long num_steps) {
+    std::mt19937 generator(num_tensors);
+    std::vector<Matrix<float>> tensors(num_tensors);
+    for (long i = 0; i < num_tensors; ++i) {
+        tensors.at(i).set(1 + generator() % 1000, 1 + generator() % 32, true);
+    }
+
+    std::vector<long> first(num_tensors, -1);
+    std::vector<long> last(num_tensors, -1);
+    MemoryPlanner memory_planner;
+    for (long step = 0; step < num_steps; ++step) {
+        std::vector<Matrix<float> *> reads;
+        std::vector<Matrix<float> *> writes;
+        for (long k = 0; k < 3; ++k) {
+            long i = generator() % num_tensors;
+            if (first.at(i) == step) {
+                continue;
+            }
+            if (first.at(i) < 0) {
+                first.at(i) = step;
+                writes.push_back(&tensors.at(i));
+            } else {
+                reads.push_back(&tensors.at(i));
+            }
+            last.at(i) = step;
+        }
+        memory_planner.add_step(reads, writes);
+    }
+    memory_planner.plan();
+
+    for (long i = 0; i < num_tensors; ++i) {
+        if (first.at(i) < 0) {
+            continue;
+        }
+        long offset_i = memory_planner.get_offset(&tensors.at(i));
+        for (long j = 0; j < num_tensors; ++j) {
+            if (j == i || first.at(j) < 0 || first.at(i) > last.at(j) || first.at(j) > last.at(i)) {
+                continue;
+            }
+            long offset_j = memory_planner.get_offset(&tensors.at(j));
+            if (offset_i < offset_j + tensors.at(j).size_ && offset_j < offset_i + tensors.at(i).size_) {
+                return 0;
+            }
+        }
+    }
+    return memory_planner.get_size_after() <= memory_planner.get_size_before() + num_tensors * 64 * (long) sizeof(float);
+}
+
+// views keep their memory through layout changes
+int test_memory_planner_apply() {
+    Matrix<float> x(3, 2, true);
+    Matrix<float> a(3, 2, true);
+    Matrix<float> b(3, 2, true);
+    MemoryPlanner memory_planner;
+    memory_planner.add_step({&x}, {&a});
+    memory_planner.add_step({&a}, {&b});
+    memory_planner.plan();
+    memory_planner.apply();
+
+    if (a.is_owner_ || b.is_owner_ || !x.is_owner_) {
+        return 0;
+    }
+    float *values = a.values_;
+    for (long i = 0; i < a.size_; ++i) {
+        a.values_[i] = i;
+    }
+    to_column_major_inplace(&a);
+    if (a.values_ != values || a.values_[1] != 2.0 || a.values_[3] != 1.0) {
+        return 0;
+    }
+    to_row_major_inplace(&a);
+    for (long i = 0; i < a.size_; ++i) {
+        if (a.values_[i] != i) {
+            return 0;
+        }
+    }
+    return a.values_ == values;
+}
+
+int test_memory_planner_read_before_write() {
+    Matrix<float> a(3, 2, true);
+    Matrix<float> b(3, 2, true);
+    MemoryPlanner memory_planner;
+    memory_planner.add_step({&a}, {&b});
+    try {
+        memory_planner.add_step({&b}, {&a});
+    } catch (const char *error) {
+        return std::string(error) == "Tensor is read before it is written";
+    }
+    return 0;
+}
+
+TEST_CASE("Memory planner", "[memoryplanner]") {
+    CHECK(test_memory_planner_chain());
+    CHECK(test_memory_planner_random(10, 20));
+    CHECK(test_memory_planner_random(100, 200));
+    CHECK(test_memory_planner_apply());
+    CHECK(test_memory_planner_read_before_write());
+}
@@ -0,0 +1,193 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "model.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+
+const long model_num_nodes = 1000;
+const long model_chunk_size = 300;
+
+ModelConfig get_test_config(ModelMode mode, bool optimize) {
+    ModelConfig config;
+    config.mode = mode;
+    config.channels = {32, 16, 16, 8};
+    config.fuse_relu_dropout = optimize;
+    config.fuse_sage_linear_add = optimize;
+    config.elide_layout_changes = optimize;
+    config.eliminate_dead_buffers = optimize;
+    return config;
+}
+
+long find_node(ModelGraph *graph, std::string name) {
+    for (long i = 0; i < (long) graph->get_nodes()->size(); ++i) {
+        if (!graph->get_nodes()->at(i).is_removed && graph->get_nodes()->at(i).name == name) {
+            return i;
+        }
+    }
+    return -2;
+}
+
+// every node points to its two neighbours on a ring
+static void get_ring(SparseMatrix<float> *ring) {
+    ring->set(model_num_nodes, model_num_nodes, 2 * model_num_nodes);
+    for (long i = 0; i < model_num_nodes; ++i) {
+        long left = (i + model_num_nodes - 1) % model_num_nodes;
+        long right = (i + 1) % model_num_nodes;
+        ring->csr_row_ptr_[i] = 2 * i;
+        ring->csr_col_ind_[2 * i] = std::min(left, right);
+        ring->csr_col_ind_[2 * i + 1] = std::max(left, right);
+        ring->csr_val_[2 * i] = 0.5;
+        ring->csr_val_[2 * i + 1] = 0.5;
+    }
+    ring->csr_row_ptr_[model_num_nodes] = 2 * model_num_nodes;
+}
+
+void append_row_major(Matrix<float> *mat, std::vector<float> *values) {
+    to_row_major_inplace(mat);
+    values->insert(values->end(), mat->values_, mat->values_ + mat->size_);
+}
+
+// the weights of the first model go into the second one
+void share_parameters(Model *model, std::vector<std::vector<float>> *parameters) {
+    std::vector<Matrix<float> *> model_parameters = model->get_parameters();
+    for (long i = 0; i < (long) model_parameters.size(); ++i) {
+        Matrix<float> *parameter = model_parameters.at(i);
+        if (parameters->size() < model_parameters.size()) {
+            parameters->push_back(std::vector<float>(parameter->values_, parameter->values_ + parameter->size_));
+        } else {
+            std::copy(parameters->at(i).begin(), parameters->at(i).end(), parameter->values_);
+        }
+    }
+}
+
+// output and parameter gradients of one forward and backward pass, the same seeds and weights for every model
+std::vector<float> run_model(ModelConfig config, bool optimize, std::vector<std::vector<float>> *parameters) {
+    CudaHelper cuda_helper;
+    ModelGraph graph(config);
+    if (optimize) {
+        graph.optimize();
+    }
+
+    Matrix<float> features(model_num_nodes, config.channels.front(), true);
+    Matrix<float> incoming_gradients(model_num_nodes, config.channels.back(), true);
+    std::srand(42);
+    features.set_random_values();
+    incoming_gradients.set_random_values();
+    SparseMatrix<float> ring;
+    get_ring(&ring);
+
+    std::vector<float> values;
+    Model *model;
+    if (config.mode == model_full) {
+        std::srand(43);
+        model = new Model(&cuda_helper, &graph, &ring, &ring, "sum", NULL);
+        share_parameters(model, parameters);
+        std::srand(44);
+        append_row_major(model->forward(&features), &values);
+        model->backward(&incoming_gradients);
+    } else {
+        std::vector<long> boundaries;
+        get_uniform_boundaries(model_num_nodes, model_chunk_size, &boundaries);
+        long num_chunks = boundaries.size() - 1;
+        std::vector<SparseMatrix<float>> adjacencies(num_chunks * num_chunks);
+        double_chunk_up_sp(&ring, &adjacencies, &boundaries);
+        Matrix<float> sum(model_num_nodes, 1, true);
+        sp_mat_sum_rows(&adjacencies, &sum);
+        std::vector<Matrix<float>> features_chunked(num_chunks);
+        chunk_up(&features, &features_chunked, &boundaries);
+        std::vector<Matrix<float>> incoming_gradients_chunked(num_chunks);
+        chunk_up(&incoming_gradients, &incoming_gradients_chunked, &boundaries);
+
+        std::srand(43);
+        model = new Model(&cuda_helper, &graph, &adjacencies, &sum, "mean", &boundaries);
+        share_parameters(model, parameters);
+        std::srand(44);
+        for (Matrix<float> &chunk : *model->forward(&features_chunked)) {
+            append_row_major(&chunk, &values);
+        }
+        model->backward(&incoming_gradients_chunked);
+    }
+    for (Matrix<float> *gradients : model->get_gradients()) {
+        append_row_major(gradients, &values);
+    }
+    delete model;
+
+    return values;
+}
+
+int test_model_equal(ModelMode mode) {
+    // a dropout in column-major layout draws its mask in another order, so the layouts stay as they are
+    ModelConfig config = get_test_config(mode, true);
+    config.elide_layout_changes = false;
+    std::vector<std::vector<float>> parameters;
+    std::vector<float> expected = run_model(get_test_config(mode, false), false, &parameters);
+    std::vector<float> optimized = run_model(config, true, &parameters);
+    if (expected.size() != optimized.size()) {
+        return 0;
+    }
+    for (long i = 0; i < (long) expected.size(); ++i) {
+        if (std::abs(expected.at(i) - optimized.at(i)) > 1e-4 * (1.0 + std::abs(expected.at(i)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+TEST_CASE("Model, graph", "[model]") {
+    ModelGraph graph(get_test_config(model_chunked, true));
+    CHECK(graph.get_num_nodes() == 12);
+    CHECK(graph.get_num_layout_changes() == 6);
+    CHECK(graph.get_nodes()->at(graph.get_output()).op == op_log_softmax);
+
+    graph.optimize();
+    CHECK(graph.get_num_nodes() == 10);
+    CHECK(find_node(&graph, "relu_0") == -2);
+    CHECK(graph.get_nodes()->at(find_node(&graph, "relu_dropout_1")).op == op_relu_dropout);
+    CHECK(graph.get_nodes()->at(find_node(&graph, "relu_dropout_2")).gradient_sum == sum_in_place);
+}
+
+TEST_CASE("Model, layout changes", "[model]") {
+    ModelGraph graph(get_test_config(model_full, true));
+    graph.optimize();
+    // only the log-softmax reads a column-major output
+    CHECK(graph.is_input_column_major());
+    CHECK(graph.get_num_layout_changes() == 1);
+
+    // the dropouts after the ReLUs get row-major inputs
+    ModelGraph graph_pipelined(get_test_config(model_pipelined, true));
+    graph_pipelined.optimize();
+    CHECK(graph_pipelined.get_num_nodes() == 12);
+    CHECK(graph_pipelined.get_num_layout_changes() == 5);
+    CHECK_THROWS(graph_pipelined.fuse_relu_dropout());
+}
+
+TEST_CASE("Model, dead buffers", "[model]") {
+    ModelGraph graph(get_test_config(model_chunked, true));
+    graph.optimize();
+    CHECK_FALSE(graph.get_nodes()->at(find_node(&graph, "dropout_0")).needs_input_gradients);
+    CHECK_FALSE(graph.get_nodes()->at(find_node(&graph, "graph_convolution_0")).needs_input_gradients);
+    CHECK_FALSE(graph.get_nodes()->at(find_node(&graph, "linear_0")).needs_input_gradients);
+    CHECK(graph.get_nodes()->at(find_node(&graph, "relu_dropout_1")).needs_input_gradients);
+    CHECK(graph.get_nodes()->at(find_node(&graph, "linear_1")).needs_input_gradients);
+}
+
+TEST_CASE("Model, full", "[model]") {
+    CHECK(test_model_equal(model_full));
+}
+
+TEST_CASE("Model, chunked", "[model]") {
+    CHECK(test_model_equal(model_chunked));
+}
+
+TEST_CASE("Model, pipelined", "[model]") {
+    CHECK(test_model_equal(model_pipelined));
+}
@@ -0,0 +1,184 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "feature_aggregation.hpp"
+#include "numa.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+
+const long numa_num_nodes = 2000;
+
+
+// the cpus of the real topology split over two nodes, so the placements differ on a single socket too
+void get_two_node_topology(NumaTopology *topology) {
+    NumaTopology real_topology;
+    get_numa_topology(&real_topology);
+    std::vector<int> cpus;
+    for (std::vector<int> &node_cpus : real_topology.cpus) {
+        cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+    }
+    long half = std::max((long) cpus.size() / 2, 1l);
+    topology->nodes = {real_topology.nodes.front(), real_topology.nodes.back()};
+    topology->cpus = {std::vector<int>(cpus.begin(), cpus.begin() + half),
+                      std::vector<int>(cpus.end() - half, cpus.end())};
+}
+
+// every node has four neighbours spread over the graph
+void get_numa_graph(SparseMatrix<float> *graph) {
+    graph->set(numa_num_nodes, numa_num_nodes, 4 * numa_num_nodes);
+    for (long i = 0; i < numa_num_nodes; ++i) {
+        std::vector<int> neighbours;
+        for (long k = 0; k < 4; ++k) {
+            neighbours.push_back((i * 7 + k * 523 + 1) % numa_num_nodes);
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        graph->csr_row_ptr_[i] = 4 * i;
+        for (long k = 0; k < 4; ++k) {
+            graph->csr_col_ind_[4 * i + k] = neighbours.at(k);
+            graph->csr_val_[4 * i + k] = (float) (k + 1);
+        }
+    }
+    graph->csr_row_ptr_[numa_num_nodes] = 4 * numa_num_nodes;
+}
+
+int test_run_on_numa_nodes(NumaPlacement placement, long num_chunks) {
+    NumaTopology topology;
+    get_two_node_topology(&topology);
+    std::vector<std::atomic<long>> visits(num_chunks);
+    std::vector<int> cpus(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        visits.at(i) = 0;
+    }
+    run_on_numa_nodes(&topology, placement, num_chunks, [&visits, &cpus](long i) {
+        visits.at(i) += 1;
+        cpus.at(i) = sched_getcpu();
+    });
+
+    for (long i = 0; i < num_chunks; ++i) {
+        if (visits.at(i) != 1) {
+            return 0;
+        }
+        std::vector<int> *node_cpus = &topology.cpus.at(get_numa_node(i, num_chunks, topology.nodes.size(), placement));
+        if (std::find(node_cpus->begin(), node_cpus->end(), cpus.at(i)) == node_cpus->end()) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// check_cuda throws strings, they reach the caller instead of terminating the process
+int test_run_on_numa_nodes_error(NumaPlacement placement) {
+    NumaTopology topology;
+    get_two_node_topology(&topology);
+    try {
+        run_on_numa_nodes(&topology, placement, 13, [](long i) {
+            if (i == 5) {
+                throw std::string("CUDA error");
+            }
+        });
+    } catch (std::string error) {
+        return error == "CUDA error";
+    }
+    return 0;
+}
+
+int test_place(NumaPlacement placement, long chunk_size) {
+    NumaTopology topology;
+    get_numa_topology(&topology);
+
+    SparseMatrix<float> graph;
+    get_numa_graph(&graph);
+    long num_features = 5;
+    Matrix<float> x(numa_num_nodes, num_features, true);
+    x.set_random_values();
+
+    std::vector<long> boundaries;
+    get_uniform_boundaries(numa_num_nodes, chunk_size, &boundaries);
+    long num_chunks = boundaries.size() - 1;
+    std::vector<SparseMatrix<float>> tiles(num_chunks * num_chunks);
+    double_chunk_up_sp(&graph, &tiles, &boundaries);
+    TileIndex tile_index;
+    index_tiles(&tiles, &tile_index);
+    std::vector<Matrix<float>> x_chunked(num_chunks);
+    chunk_up(&x, &x_chunked, &boundaries);
+    std::vector<Matrix<float>> expected(num_chunks);
+    std::vector<Matrix<float>> aggregates(num_chunks);
+    for (long i = 0; i < num_chunks; ++i) {
+        expected.at(i).set(boundaries.at(i + 1) - boundaries.at(i), num_features, false);
+        aggregates.at(i).set(boundaries.at(i + 1) - boundaries.at(i), num_features, false);
+    }
+    get_halo_aggregates(&tiles, &tile_index, &x_chunked, &expected);
+
+    // the values survive the move, the pages are on the node of their chunk if the kernel tells
+    place_chunks(&topology, placement, &x_chunked);
+    place_chunks(&topology, placement, &aggregates);
+    place_tiles(&topology, placement, &tiles);
+    for (long i = 0; i < num_chunks; ++i) {
+        long node = topology.nodes.at(get_numa_node(i, num_chunks, topology.nodes.size(), placement));
+        long x_node = get_numa_node_of(x_chunked.at(i).values_);
+        long tile_node = get_numa_node_of(tiles.at(i * num_chunks + i).csr_col_ind_);
+        if ((x_node != -1 && x_node != node) || (tile_node != -1 && tile_node != node)) {
+            return 0;
+        }
+    }
+    // the row-major chunks of x are converted on their node and stay there
+    get_halo_aggregates(&tiles, &tile_index, &x_chunked, &aggregates, &topology, placement);
+    for (long i = 0; i < num_chunks && placement != numa_none; ++i) {
+        long node = topology.nodes.at(get_numa_node(i, num_chunks, topology.nodes.size(), placement));
+        long x_node = get_numa_node_of(x_chunked.at(i).values_);
+        if (x_chunked.at(i).is_row_major_ || (x_node != -1 && x_node != node)) {
+            return 0;
+        }
+    }
+
+    for (long i = 0; i < num_chunks; ++i) {
+        for (long k = 0; k < expected.at(i).size_; ++k) {
+            if (std::abs(expected.at(i).values_[k] - aggregates.at(i).values_[k]) > 1e-5 * (1.0 + std::abs(expected.at(i).values_[k]))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+TEST_CASE("NUMA, topology", "[numa]") {
+    NumaTopology topology;
+    get_numa_topology(&topology);
+    CHECK(topology.nodes.size() > 0);
+    CHECK(topology.nodes.size() == topology.cpus.size());
+    for (std::vector<int> &cpus : topology.cpus) {
+        CHECK(cpus.size() > 0);
+    }
+}
+
+TEST_CASE("NUMA, chunk nodes", "[numa]") {
+    CHECK(get_numa_node(3, 10, 2, numa_interleaved) == 1);
+    CHECK(get_numa_node(4, 10, 2, numa_interleaved) == 0);
+    CHECK(get_numa_node(4, 10, 2, numa_blocked) == 0);
+    CHECK(get_numa_node(5, 10, 2, numa_blocked) == 1);
+    CHECK(get_numa_node(9, 10, 4, numa_blocked) == 3);
+    CHECK(get_numa_node(9, 10, 4, numa_none) == 0);
+}
+
+TEST_CASE("NUMA, pinned workers", "[numa]") {
+    CHECK(test_run_on_numa_nodes(numa_interleaved, 1));
+    CHECK(test_run_on_numa_nodes(numa_interleaved, 13));
+    CHECK(test_run_on_numa_nodes(numa_blocked, 13));
+    CHECK(test_run_on_numa_nodes_error(numa_none));
+    CHECK(test_run_on_numa_nodes_error(numa_blocked));
+}
+
+TEST_CASE("NUMA, placement", "[numa]") {
+    CHECK(test_place(numa_none, 300));
+    CHECK(test_place(numa_interleaved, 300));
+    CHECK(test_place(numa_blocked, 128));
+}
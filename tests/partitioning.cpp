@@ -0,0 +1,133 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "partitioning.hpp"
+#include "reordering.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string flickr_dir_path = dir_path + "/flickr";
+
+
+int check_partition(SparseMatrix<float> *adjacency, PartitionOptions *options, std::vector<int> *parts) {
+    long num_nodes = adjacency->num_rows_;
+    if ((long) parts->size() != num_nodes) {
+        return 0;
+    }
+    std::vector<long> part_sizes(options->num_parts, 0);
+    for (long i = 0; i < num_nodes; ++i) {
+        if (parts->at(i) < 0 || parts->at(i) >= options->num_parts) {
+            return 0;
+        }
+        part_sizes.at(parts->at(i)) = part_sizes.at(parts->at(i)) + 1;
+    }
+    long max_part_size = ceil((double) num_nodes / (double) options->num_parts * (1.0 + options->imbalance));
+    if (*std::max_element(part_sizes.begin(), part_sizes.end()) > max_part_size) {
+        return 0;
+    }
+
+    // parts become the chunks of the permuted graph
+    std::vector<int> new_ids;
+    std::vector<long> boundaries;
+    get_partition_permutation(parts, options->num_parts, &new_ids, &boundaries);
+    if (boundaries.front() != 0 || boundaries.back() != num_nodes) {
+        return 0;
+    }
+    for (long i = 0; i < num_nodes; ++i) {
+        long chunk = std::upper_bound(boundaries.begin(), boundaries.end(), (long) new_ids.at(i)) - boundaries.begin() - 1;
+        if (part_sizes.at(parts->at(i)) != boundaries.at(chunk + 1) - boundaries.at(chunk)) {
+            return 0;
+        }
+    }
+    SparseMatrix<float> adjacency_permuted;
+    permute_sp_matrix(adjacency, &new_ids, &adjacency_permuted);
+    std::vector<int> chunk_parts;
+    get_boundary_parts(&boundaries, &chunk_parts);
+
+    return count_cut_edges(&adjacency_permuted, &chunk_parts) == count_cut_edges(adjacency, parts);
+}
+
+int test_partitioning(long num_parts) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    long num_nodes = adjacency.num_rows_;
+
+    PartitionOptions options;
+    options.num_parts = num_parts;
+    std::vector<int> parts;
+    partition_graph(&adjacency, &options, &parts);
+    if (!check_partition(&adjacency, &options, &parts)) {
+        return 0;
+    }
+
+    // cuts fewer edges than chunks of equal size in the original order
+    std::vector<long> boundaries;
+    get_uniform_boundaries(num_nodes, ceil((double) num_nodes / (double) num_parts), &boundaries);
+    std::vector<int> uniform_parts;
+    get_boundary_parts(&boundaries, &uniform_parts);
+
+    return count_cut_edges(&adjacency, &parts) < count_cut_edges(&adjacency, &uniform_parts);
+}
+
+// disjoint cliques with shuffled ids, each clique is a part without cut edges
+int test_partitioning_cliques(long num_cliques, long clique_size) {
+    long num_nodes = num_cliques * clique_size;
+    std::vector<int> ids(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        ids.at(i) = i;
+    }
+    std::mt19937_64 generator(1);
+    std::shuffle(ids.begin(), ids.end(), generator);
+    std::vector<int> cliques(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        cliques.at(ids.at(i)) = i / clique_size;
+    }
+
+    std::vector<std::vector<int>> neighbours(num_nodes);
+    for (long i = 0; i < num_nodes; ++i) {
+        for (long j = 0; j < clique_size; ++j) {
+            long neighbour = ids.at((i / clique_size) * clique_size + j);
+            if (neighbour != ids.at(i)) {
+                neighbours.at(ids.at(i)).push_back(neighbour);
+            }
+        }
+    }
+    SparseMatrix<float> adjacency(num_nodes, num_nodes, num_nodes * (clique_size - 1));
+    adjacency.csr_row_ptr_[0] = 0;
+    for (long i = 0; i < num_nodes; ++i) {
+        std::sort(neighbours.at(i).begin(), neighbours.at(i).end());
+        adjacency.csr_row_ptr_[i + 1] = adjacency.csr_row_ptr_[i] + neighbours.at(i).size();
+        for (long j = 0; j < (long) neighbours.at(i).size(); ++j) {
+            adjacency.csr_col_ind_[adjacency.csr_row_ptr_[i] + j] = neighbours.at(i).at(j);
+            adjacency.csr_val_[adjacency.csr_row_ptr_[i] + j] = 1.0;
+        }
+    }
+
+    PartitionOptions options;
+    options.num_parts = num_cliques;
+    std::vector<int> parts;
+    partition_graph(&adjacency, &options, &parts);
+    if (!check_partition(&adjacency, &options, &parts)) {
+        return 0;
+    }
+
+    return count_cut_edges(&adjacency, &parts) == 0;
+}
+
+TEST_CASE("Partitioning", "[partitioning]") {
+    CHECK(test_partitioning(2));
+    CHECK(test_partitioning(8));
+    CHECK(test_partitioning(32));
+}
+
+TEST_CASE("Partitioning cliques", "[partitioning]") {
+    CHECK(test_partitioning_cliques(4, 50));
+    CHECK(test_partitioning_cliques(16, 64));
+}
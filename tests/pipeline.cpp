@@ -1,9 +1,14 @@
 // Copyright 2020 Marcel Wagenländer
 
 #include "cuda_helper.hpp"
+#include "pipeline.hpp"
 #include "tensors.hpp"
 
+#include <atomic>
 #include <catch2/catch.hpp>
+#include <chrono>
+#include <random>
+#include <thread>
 
 
 void forward_pipeline(std::vector<Matrix<float>> *x, std::vector<Matrix<float>> *y) {
@@ -149,4 +154,83 @@ TEST_CASE("Forward pipeline", "[forward][pipeline]") {
     for (int i = 0; i < num_chunks; ++i) {
         print_matrix(&y.at(i));
     }
-}
\ No newline at end of file
+}
+
+// load, decompress, compute and store on the CPU, every stage checks that its input buffer still holds its chunk
+int test_pipeline_cpu(long num_chunks, long num_buffers) {
+    long num_stages = 4;
+    std::vector<std::vector<long>> buffers(num_stages, std::vector<long>(num_buffers, -1));
+    std::vector<long> result(num_chunks, -1);
+    std::atomic<long> num_errors(0);
+
+    Pipeline pipeline(num_buffers);
+    for (long s = 0; s < num_stages; ++s) {
+        pipeline.add_stage([&buffers, &result, &num_errors, s, num_stages](long chunk, long buffer) {
+            std::mt19937 generator(chunk * num_stages + s);
+            std::this_thread::sleep_for(std::chrono::microseconds(generator() % 200));
+            if (s > 0 && buffers.at(s - 1).at(buffer) != chunk * s) {
+                num_errors += 1;
+            }
+            long value = chunk * (s + 1);
+            if (s < num_stages - 1) {
+                buffers.at(s).at(buffer) = value;
+            } else {
+                result.at(chunk) = value;
+            }
+        }, NULL);
+    }
+    pipeline.run(num_chunks);
+
+    if (num_errors > 0) {
+        return 0;
+    }
+    for (long chunk = 0; chunk < num_chunks; ++chunk) {
+        if (result.at(chunk) != chunk * num_stages) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_pipeline_error() {
+    Pipeline pipeline(2);
+    pipeline.add_stage([](long, long) {}, NULL);
+    pipeline.add_stage([](long chunk, long) {
+        if (chunk == 5) {
+            throw "Stage failed";
+        }
+    }, NULL);
+    pipeline.add_stage([](long, long) {}, NULL);
+    try {
+        pipeline.run(20);
+    } catch (const char *error) {
+        return std::string(error) == "Stage failed";
+    }
+    return 0;
+}
+
+// check_cuda and check_cudnn throw strings, they reach the caller as they are
+int test_pipeline_string_error() {
+    Pipeline pipeline(2);
+    pipeline.add_stage([](long, long) {}, NULL);
+    pipeline.add_stage([](long chunk, long) {
+        if (chunk == 3) {
+            throw std::string("CUDA error");
+        }
+    }, NULL);
+    try {
+        pipeline.run(20);
+    } catch (std::string error) {
+        return error == "CUDA error";
+    }
+    return 0;
+}
+
+TEST_CASE("Pipeline scheduler", "[pipeline][scheduler]") {
+    CHECK(test_pipeline_cpu(1, 1));
+    CHECK(test_pipeline_cpu(17, 1));
+    CHECK(test_pipeline_cpu(17, 2));
+    CHECK(test_pipeline_cpu(64, 3));
+    CHECK(test_pipeline_error());
+    CHECK(test_pipeline_string_error());
+}
@@ -0,0 +1,107 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "dropout.hpp"
+#include "relu.hpp"
+#include "tensors.hpp"
+
+#include <catch2/catch.hpp>
+#include <vector>
+
+
+const long recompute_num_nodes = 10000;
+const long recompute_num_features = 64;
+
+bool equal_values(Matrix<float> *a, float *b) {
+    for (long i = 0; i < a->size_; ++i) {
+        if (a->values_[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// releases the output and computes it again, it has to equal the output of the forward pass
+template<typename L>
+int test_recompute(L *layer) {
+    CudaHelper cuda_helper;
+    Matrix<float> x(recompute_num_nodes, recompute_num_features, true);
+    x.set_random_values();
+    layer->set(&cuda_helper, recompute_num_nodes, recompute_num_features);
+
+    Matrix<float> *y = layer->forward(&x);
+    std::vector<float> expected(y->values_, y->values_ + y->size_);
+
+    layer->release_y();
+    layer->release_y();
+    if (y->values_ != NULL) {
+        return 0;
+    }
+    layer->recompute_y();
+    layer->recompute_y();
+
+    return equal_values(y, expected.data());
+}
+
+template<typename L>
+int test_recompute_chunked(L *layer, long chunk_size) {
+    CudaHelper cuda_helper;
+    Matrix<float> x(recompute_num_nodes, recompute_num_features, true);
+    x.set_random_values();
+    std::vector<long> boundaries;
+    get_uniform_boundaries(recompute_num_nodes, chunk_size, &boundaries);
+    std::vector<Matrix<float>> x_chunked(boundaries.size() - 1);
+    chunk_up(&x, &x_chunked, &boundaries);
+    layer->set(&cuda_helper, &boundaries, recompute_num_features);
+
+    std::vector<Matrix<float>> *y = layer->forward(&x_chunked);
+    std::vector<std::vector<float>> expected;
+    for (Matrix<float> &chunk : *y) {
+        expected.push_back(std::vector<float>(chunk.values_, chunk.values_ + chunk.size_));
+    }
+
+    layer->release_y();
+    for (Matrix<float> &chunk : *y) {
+        if (chunk.values_ != NULL) {
+            return 0;
+        }
+    }
+    layer->recompute_y();
+
+    for (long i = 0; i < (long) y->size(); ++i) {
+        if (!equal_values(&y->at(i), expected.at(i).data())) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+TEST_CASE("Recompute, ReLU", "[recompute]") {
+    Relu relu;
+    CHECK(test_recompute(&relu));
+}
+
+TEST_CASE("Recompute, dropout", "[recompute]") {
+    Dropout dropout;
+    CHECK(test_recompute(&dropout));
+}
+
+TEST_CASE("Recompute, ReLU, chunked", "[recompute][chunked]") {
+    ReluChunked relu;
+    CHECK(test_recompute_chunked(&relu, 1 << 12));
+    CHECK(test_recompute_chunked(&relu, 1 << 8));
+}
+
+TEST_CASE("Recompute, dropout, chunked", "[recompute][chunked]") {
+    DropoutChunked dropout;
+    CHECK(test_recompute_chunked(&dropout, 1 << 12));
+    CHECK(test_recompute_chunked(&dropout, 1 << 8));
+}
+
+TEST_CASE("Recompute, view", "[recompute]") {
+    Matrix<float> matrix(100, 10, true);
+    std::vector<float> arena(matrix.size_);
+    matrix.set_view(arena.data());
+    CHECK_THROWS(matrix.release());
+}
@@ -0,0 +1,56 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "reordering.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <string>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string flickr_dir_path = dir_path + "/flickr";
+
+
+int test_reordering(Ordering ordering, long chunk_size) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    long num_nodes = adjacency.num_rows_;
+
+    std::vector<int> new_ids;
+    get_permutation(&adjacency, ordering, &new_ids);
+    std::vector<int> old_ids(num_nodes, -1);
+    for (long i = 0; i < num_nodes; ++i) {
+        if (new_ids.at(i) < 0 || new_ids.at(i) >= num_nodes || old_ids.at(new_ids.at(i)) != -1) {
+            return 0;
+        }
+        old_ids.at(new_ids.at(i)) = i;
+    }
+
+    // permuting with the inverse gives back the original
+    SparseMatrix<float> adjacency_permuted;
+    permute_sp_matrix(&adjacency, &new_ids, &adjacency_permuted);
+    SparseMatrix<float> adjacency_restored;
+    permute_sp_matrix(&adjacency_permuted, &old_ids, &adjacency_restored);
+    if (!check_equality(&adjacency, &adjacency_restored)) {
+        return 0;
+    }
+
+    Matrix<float> features(num_nodes, 16, true);
+    features.set_random_values();
+    Matrix<float> features_permuted;
+    permute_rows<float>(&features, &new_ids, &features_permuted);
+    Matrix<float> features_restored;
+    unpermute_rows<float>(&features_permuted, &new_ids, &features_restored);
+    if (!check_equality(&features, &features_restored)) {
+        return 0;
+    }
+
+    // locality orderings concentrate the nonzeros in fewer tiles
+    return count_non_empty_tiles(&adjacency_permuted, chunk_size) <= count_non_empty_tiles(&adjacency, chunk_size);
+}
+
+TEST_CASE("Reordering", "[reordering]") {
+    CHECK(test_reordering(rcm, 1 << 12));
+    CHECK(test_reordering(degree, 1 << 12));
+    CHECK(test_reordering(community, 1 << 12));
+}
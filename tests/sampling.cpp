@@ -0,0 +1,181 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "sampling.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string flickr_dir_path = dir_path + "/flickr";
+
+
+int check_block(SparseMatrix<float> *adjacency, std::vector<int> *dst_nodes, std::vector<int> *src_nodes,
+                long fanout, SampledBlock *block) {
+    if (block->num_dst != (long) dst_nodes->size() || block->num_src != (long) src_nodes->size()) {
+        return 0;
+    }
+    if (block->adjacency.num_rows_ != block->num_dst || block->adjacency.num_columns_ != block->num_src) {
+        return 0;
+    }
+    // dst nodes are the first src nodes, every src node once
+    if (!std::equal(dst_nodes->begin(), dst_nodes->end(), src_nodes->begin())) {
+        return 0;
+    }
+    std::vector<int> sorted_src = *src_nodes;
+    std::sort(sorted_src.begin(), sorted_src.end());
+    if (std::adjacent_find(sorted_src.begin(), sorted_src.end()) != sorted_src.end()) {
+        return 0;
+    }
+
+    for (long row = 0; row < block->num_dst; ++row) {
+        long node = dst_nodes->at(row);
+        long degree = adjacency->csr_row_ptr_[node + 1] - adjacency->csr_row_ptr_[node];
+        long first_index = block->adjacency.csr_row_ptr_[row];
+        long last_index = block->adjacency.csr_row_ptr_[row + 1];
+        if (last_index - first_index != std::min(fanout, degree)) {
+            return 0;
+        }
+        if (block->row_sum.values_[row] != std::max(last_index - first_index, 1l)) {
+            return 0;
+        }
+        // sorted, so no duplicates if strictly increasing, and all real neighbours
+        for (long j = first_index; j < last_index; ++j) {
+            if (j > first_index && block->adjacency.csr_col_ind_[j] <= block->adjacency.csr_col_ind_[j - 1]) {
+                return 0;
+            }
+            int neighbour = src_nodes->at(block->adjacency.csr_col_ind_[j]);
+            if (!std::binary_search(adjacency->csr_col_ind_ + adjacency->csr_row_ptr_[node],
+                                    adjacency->csr_col_ind_ + adjacency->csr_row_ptr_[node + 1], neighbour)) {
+                return 0;
+            }
+        }
+    }
+
+    SparseMatrix<float> adjacency_transposed;
+    adjacency_transposed.set(block->adjacency_transposed.num_rows_, block->adjacency_transposed.num_columns_,
+                             block->adjacency_transposed.nnz_);
+    std::copy(block->adjacency_transposed.csr_row_ptr_, block->adjacency_transposed.csr_row_ptr_ + block->num_src + 1,
+              adjacency_transposed.csr_row_ptr_);
+    std::copy(block->adjacency_transposed.csr_col_ind_, block->adjacency_transposed.csr_col_ind_ + adjacency_transposed.nnz_,
+              adjacency_transposed.csr_col_ind_);
+    std::copy(block->adjacency_transposed.csr_val_, block->adjacency_transposed.csr_val_ + adjacency_transposed.nnz_,
+              adjacency_transposed.csr_val_);
+    transpose_csr_matrix_cpu(&adjacency_transposed);
+
+    return check_equality(&block->adjacency, &adjacency_transposed);
+}
+
+int check_mini_batch(SparseMatrix<float> *adjacency, Matrix<float> *features, Matrix<int> *classes,
+                     std::vector<long> *fanouts, std::vector<int> *seeds, MiniBatch *mini_batch) {
+    long num_layers = fanouts->size();
+    if ((long) mini_batch->blocks.size() != num_layers || mini_batch->nodes.back() != *seeds) {
+        return 0;
+    }
+    for (long i = 0; i < num_layers; ++i) {
+        if (!check_block(adjacency, &mini_batch->nodes.at(i + 1), &mini_batch->nodes.at(i), fanouts->at(i),
+                         &mini_batch->blocks.at(i))) {
+            return 0;
+        }
+    }
+
+    std::vector<int> *input_nodes = &mini_batch->nodes.front();
+    if (mini_batch->features.num_rows_ != (long) input_nodes->size() || !mini_batch->features.is_row_major_) {
+        return 0;
+    }
+    to_row_major_inplace(features);
+    for (long i = 0; i < (long) input_nodes->size(); ++i) {
+        for (long j = 0; j < features->num_columns_; ++j) {
+            if (mini_batch->features.values_[i * features->num_columns_ + j] !=
+                features->values_[input_nodes->at(i) * features->num_columns_ + j]) {
+                return 0;
+            }
+        }
+    }
+    for (long i = 0; i < (long) seeds->size(); ++i) {
+        if (mini_batch->classes.values_[i] != classes->values_[seeds->at(i)]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_sampling(std::vector<long> fanouts, long batch_size, bool full_neighbourhood) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    Matrix<float> features = load_npy_matrix<float>(flickr_dir_path + "/features.npy");
+    Matrix<int> classes = load_npy_matrix<int>(flickr_dir_path + "/classes.npy");
+    long num_nodes = adjacency.num_rows_;
+
+    std::vector<int> order;
+    get_batch_order(num_nodes, 0, 0, &order);
+    std::vector<int> seeds;
+    get_batch_seeds(&order, 0, batch_size, &seeds);
+
+    NeighbourSampler sampler(&adjacency, &features, &classes, &fanouts, 0);
+    MiniBatch mini_batch;
+    sampler.sample(&seeds, 0, &mini_batch);
+    if (!check_mini_batch(&adjacency, &features, &classes, &fanouts, &seeds, &mini_batch)) {
+        return 0;
+    }
+
+    // sampling in the background gives the same mini-batch
+    MiniBatch mini_batch_async;
+    sampler.sample_async(&seeds, 0, &mini_batch_async);
+    sampler.wait();
+    for (long i = 0; i < (long) fanouts.size(); ++i) {
+        if (mini_batch_async.nodes.at(i) != mini_batch.nodes.at(i) ||
+            !check_equality(&mini_batch_async.blocks.at(i).adjacency, &mini_batch.blocks.at(i).adjacency)) {
+            return 0;
+        }
+    }
+
+    // another batch number gives another sample, unless the fanouts take all neighbours
+    MiniBatch mini_batch_other;
+    sampler.sample(&seeds, 1, &mini_batch_other);
+    return (mini_batch_other.nodes.front() == mini_batch.nodes.front()) == full_neighbourhood;
+}
+
+int test_batch_order(long num_nodes, long batch_size) {
+    std::vector<int> order;
+    get_batch_order(num_nodes, 0, 3, &order);
+    std::vector<int> covered(num_nodes, 0);
+    for (long batch = 0; batch < get_num_batches(num_nodes, batch_size); ++batch) {
+        std::vector<int> seeds;
+        get_batch_seeds(&order, batch, batch_size, &seeds);
+        for (long i = 0; i < (long) seeds.size(); ++i) {
+            covered.at(seeds.at(i)) = covered.at(seeds.at(i)) + 1;
+        }
+    }
+    return std::count(covered.begin(), covered.end(), 1) == num_nodes;
+}
+
+TEST_CASE("Neighbour sampling", "[sampling]") {
+    CHECK(test_sampling({25, 10, 10}, 1024, false));
+    CHECK(test_sampling({5, 5}, 4000, false));
+    CHECK(test_sampling({1}, 100, false));
+    CHECK(test_sampling({1000, 1000}, 100, true));
+}
+
+TEST_CASE("Batch order", "[sampling]") {
+    CHECK(test_batch_order(1000, 128));
+    CHECK(test_batch_order(1024, 128));
+}
+
+TEST_CASE("Dst rows", "[sampling]") {
+    Matrix<float> src(100, 7, false);
+    src.set_random_values();
+    Matrix<float> dst;
+    get_dst_rows(&src, 40, &dst);
+    CHECK(dst.num_rows_ == 40);
+    CHECK(dst.values_[3 * 40 + 5] == src.values_[3 * 100 + 5]);
+
+    float before = src.values_[3 * 100 + 5];
+    to_row_major_inplace(&dst);
+    add_dst_rows(&dst, &src);
+    CHECK(src.values_[3 * 100 + 5] == 2 * before);
+}
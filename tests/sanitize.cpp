@@ -0,0 +1,140 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "sanitize.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include "catch2/catch.hpp"
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+const std::string home = std::getenv("HOME");
+const std::string dir_path = home + "/gpu_memory_reduction/alzheimer/data";
+const std::string flickr_dir_path = dir_path + "/flickr";
+
+
+void set_sp_matrix(long num_nodes, std::vector<int> *row_ptr, std::vector<int> *col_ind, SparseMatrix<float> *sp_mat) {
+    sp_mat->set(num_nodes, num_nodes, col_ind->size());
+    std::memcpy(sp_mat->csr_row_ptr_, row_ptr->data(), row_ptr->size() * sizeof(int));
+    std::memcpy(sp_mat->csr_col_ind_, col_ind->data(), col_ind->size() * sizeof(int));
+    for (long i = 0; i < sp_mat->nnz_; ++i) {
+        sp_mat->csr_val_[i] = 1.0;
+    }
+}
+
+int check_structure(SparseMatrix<float> *sp_mat, std::vector<int> *row_ptr, std::vector<int> *col_ind) {
+    if (sp_mat->nnz_ != (long) col_ind->size()) {
+        return 0;
+    }
+    for (long i = 0; i < (long) row_ptr->size(); ++i) {
+        if (sp_mat->csr_row_ptr_[i] != row_ptr->at(i)) {
+            return 0;
+        }
+    }
+    for (long i = 0; i < (long) col_ind->size(); ++i) {
+        if (sp_mat->csr_col_ind_[i] != col_ind->at(i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_sanitize_small() {
+    // 0 -> 1 twice, 1 -> 0, 1 -> 2, 2 -> 2 with weight 2, 3 -> 0, columns out of order
+    std::vector<int> row_ptr = {0, 2, 4, 5, 6};
+    std::vector<int> col_ind = {1, 1, 2, 0, 2, 0};
+    SparseMatrix<float> adjacency;
+    set_sp_matrix(4, &row_ptr, &col_ind, &adjacency);
+    adjacency.csr_val_[4] = 2.0;
+
+    SparseMatrix<float> sanitized;
+    sanitize_graph(&adjacency, false, false, &sanitized);
+    std::vector<int> expected_row_ptr = {0, 1, 3, 4, 5};
+    std::vector<int> expected_col_ind = {1, 0, 2, 2, 0};
+    if (!check_structure(&sanitized, &expected_row_ptr, &expected_col_ind)) {
+        return 0;
+    }
+
+    sanitize_graph(&adjacency, true, true, &sanitized);
+    expected_row_ptr = {0, 3, 6, 8, 10};
+    expected_col_ind = {0, 1, 3, 0, 1, 2, 1, 2, 0, 3};
+    if (!check_structure(&sanitized, &expected_row_ptr, &expected_col_ind)) {
+        return 0;
+    }
+    // the existing self-loop keeps its weight, the added ones get one
+    if (sanitized.csr_val_[7] != 2.0 || sanitized.csr_val_[0] != 1.0 || sanitized.csr_val_[9] != 1.0) {
+        return 0;
+    }
+
+    // the row sums are 3, 3, 3 and 2
+    normalize_graph(&sanitized, symmetric_normalization);
+    if (std::abs(sanitized.csr_val_[2] - 1.0 / std::sqrt(3.0 * 2.0)) > 1e-6 ||
+        std::abs(sanitized.csr_val_[7] - 2.0 / 3.0) > 1e-6) {
+        return 0;
+    }
+
+    return 1;
+}
+
+int test_sanitize(bool add_self_loops, Normalization normalization) {
+    SparseMatrix<float> adjacency = load_mtx_matrix<float>(flickr_dir_path + "/adjacency.mtx");
+    SparseMatrix<float> sanitized;
+    sanitize_graph(&adjacency, add_self_loops, true, normalization, &sanitized);
+
+    // sorted rows without duplicates, self-loops if asked for
+    for (long row = 0; row < sanitized.num_rows_; ++row) {
+        bool has_self_loop = false;
+        for (long j = sanitized.csr_row_ptr_[row]; j < sanitized.csr_row_ptr_[row + 1]; ++j) {
+            if (j > sanitized.csr_row_ptr_[row] && sanitized.csr_col_ind_[j] <= sanitized.csr_col_ind_[j - 1]) {
+                return 0;
+            }
+            if (sanitized.csr_col_ind_[j] == row) {
+                has_self_loop = true;
+            }
+        }
+        if (add_self_loops && !has_self_loop) {
+            return 0;
+        }
+    }
+
+    // symmetric structure, values too unless the normalization depends on the row only
+    SparseMatrix<float> transposed;
+    sanitize_graph(&sanitized, false, false, &transposed);
+    transpose_csr_matrix_cpu(&transposed);
+    if (transposed.nnz_ != sanitized.nnz_) {
+        return 0;
+    }
+    for (long i = 0; i < sanitized.nnz_; ++i) {
+        if (transposed.csr_col_ind_[i] != sanitized.csr_col_ind_[i]) {
+            return 0;
+        }
+        if (normalization != mean_normalization &&
+            std::abs(transposed.csr_val_[i] - sanitized.csr_val_[i]) > 1e-6 * std::abs(sanitized.csr_val_[i])) {
+            return 0;
+        }
+    }
+
+    // mean normalized rows sum to one, up to rounding over the hubs
+    if (normalization == mean_normalization) {
+        Matrix<float> sum(sanitized.num_rows_, 1, true);
+        sp_mat_sum_rows(&sanitized, &sum);
+        for (long row = 0; row < sanitized.num_rows_; ++row) {
+            bool is_empty = sanitized.csr_row_ptr_[row] == sanitized.csr_row_ptr_[row + 1];
+            if (!is_empty && std::abs(sum.values_[row] - 1.0) > 1e-3) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+TEST_CASE("Sanitize graph", "[sanitize]") {
+    CHECK(test_sanitize_small());
+    CHECK(test_sanitize(false, no_normalization));
+    CHECK(test_sanitize(false, mean_normalization));
+    CHECK(test_sanitize(true, symmetric_normalization));
+}
@@ -0,0 +1,97 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "generator.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+void print_usage() {
+    std::cout << "Usage: generate --output DIR [--model rmat|power-law] [--nodes N] [--edges N]" << std::endl;
+    std::cout << "                [--rmat A,B,C] [--exponent E] [--no-permute] [--features F] [--classes C]" << std::endl;
+    std::cout << "                [--seed S] [--symmetrize] [--memory-limit MiB] [--threads N] [--tmp-dir DIR]" << std::endl;
+    std::cout << "Writes DIR/adjacency.csr, DIR/features.npy and DIR/classes.npy" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    GeneratorOptions options;
+    IngestOptions ingest_options;
+    std::string output_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--symmetrize") {
+            ingest_options.symmetrize = true;
+            continue;
+        } else if (arg == "--no-permute") {
+            options.permute = false;
+            continue;
+        }
+        if (i + 1 == argc) {
+            print_usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--output") {
+            output_path = value;
+        } else if (arg == "--model" && value == "rmat") {
+            options.model = rmat;
+        } else if (arg == "--model" && value == "power-law") {
+            options.model = power_law;
+        } else if (arg == "--nodes") {
+            options.num_nodes = std::atol(value.c_str());
+        } else if (arg == "--edges") {
+            options.num_edges = std::atol(value.c_str());
+        } else if (arg == "--rmat") {
+            if (std::sscanf(value.c_str(), "%lf,%lf,%lf", &options.a, &options.b, &options.c) != 3) {
+                print_usage();
+                return 1;
+            }
+        } else if (arg == "--exponent") {
+            options.exponent = std::atof(value.c_str());
+        } else if (arg == "--features") {
+            options.num_features = std::atol(value.c_str());
+        } else if (arg == "--classes") {
+            options.num_classes = std::atol(value.c_str());
+        } else if (arg == "--seed") {
+            options.seed = std::atol(value.c_str());
+        } else if (arg == "--memory-limit") {
+            ingest_options.memory_limit = std::atol(value.c_str()) << 20;
+        } else if (arg == "--threads") {
+            ingest_options.num_threads = std::atol(value.c_str());
+        } else if (arg == "--tmp-dir") {
+            ingest_options.tmp_dir = value;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (output_path.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        generate_features(output_path + "/features.npy", &options, &ingest_options);
+        std::cout << "Features: " << options.num_nodes << " x " << options.num_features << " in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+
+        start = std::chrono::steady_clock::now();
+        generate_labels(output_path + "/classes.npy", &options, &ingest_options);
+        std::cout << "Labels: " << options.num_nodes << " in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+
+        start = std::chrono::steady_clock::now();
+        long nnz = generate_graph(output_path + "/adjacency.csr", &options, &ingest_options);
+        std::cout << "Edges: " << nnz << " unique edges in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+    } catch (const char *e) {
+        std::cerr << e << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "ingest.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+void print_usage() {
+    std::cout << "Usage: ingest --output DIR [--edges FILE] [--features FILE] [--labels FILE]" << std::endl;
+    std::cout << "              [--symmetrize] [--num-nodes N] [--memory-limit MiB] [--threads N] [--tmp-dir DIR]" << std::endl;
+    std::cout << "Writes DIR/adjacency.csr, DIR/features.npy and DIR/classes.npy" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    IngestOptions options;
+    std::string edges_path;
+    std::string features_path;
+    std::string labels_path;
+    std::string output_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--symmetrize") {
+            options.symmetrize = true;
+            continue;
+        }
+        if (i + 1 == argc) {
+            print_usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--edges") {
+            edges_path = value;
+        } else if (arg == "--features") {
+            features_path = value;
+        } else if (arg == "--labels") {
+            labels_path = value;
+        } else if (arg == "--output") {
+            output_path = value;
+        } else if (arg == "--num-nodes") {
+            options.num_nodes = std::atol(value.c_str());
+        } else if (arg == "--memory-limit") {
+            options.memory_limit = std::atol(value.c_str()) << 20;
+        } else if (arg == "--threads") {
+            options.num_threads = std::atol(value.c_str());
+        } else if (arg == "--tmp-dir") {
+            options.tmp_dir = value;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (output_path.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::chrono::steady_clock::time_point start;
+        // the number of feature rows fixes the number of nodes if not given
+        if (!features_path.empty()) {
+            start = std::chrono::steady_clock::now();
+            long num_rows = ingest_feature_table(features_path, output_path + "/features.npy", &options);
+            if (options.num_nodes == 0) {
+                options.num_nodes = num_rows;
+            }
+            std::cout << "Features: " << num_rows << " rows in "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+        }
+        if (!labels_path.empty()) {
+            start = std::chrono::steady_clock::now();
+            long num_rows = ingest_label_table(labels_path, output_path + "/classes.npy", &options);
+            std::cout << "Labels: " << num_rows << " rows in "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+        }
+        if (!edges_path.empty()) {
+            start = std::chrono::steady_clock::now();
+            long nnz = ingest_edge_list(edges_path, output_path + "/adjacency.csr", &options);
+            std::cout << "Edges: " << nnz << " unique edges in "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+        }
+    } catch (const char *e) {
+        std::cerr << e << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
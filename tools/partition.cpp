@@ -0,0 +1,109 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "chunking.hpp"
+#include "dataset.hpp"
+#include "partitioning.hpp"
+#include "reordering.hpp"
+#include "tensors.hpp"
+
+#include "cnpy.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+void print_usage() {
+    std::cout << "Usage: partition --input DIR --output DIR (--parts K | --chunk-size N) [--imbalance F] [--seed S]" << std::endl;
+    std::cout << "Writes the partitioned adjacency.csr, features.npy, classes.npy, permutation.npy and boundaries.npy to DIR" << std::endl;
+}
+
+void print_report(std::string name, SparseMatrix<float> *adjacency, std::vector<long> *boundaries) {
+    std::vector<int> parts;
+    get_boundary_parts(boundaries, &parts);
+    std::cout << name << ": " << boundaries->size() - 1 << " chunks, cut edges " << count_cut_edges(adjacency, &parts)
+              << " of " << adjacency->nnz_ << ", non-empty tiles " << count_non_empty_tiles(adjacency, boundaries)
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::string input_path;
+    std::string output_path;
+    PartitionOptions options;
+    options.num_parts = 0;
+    long chunk_size = 0;
+    for (int i = 1; i + 1 < argc; i = i + 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        if (arg == "--input") {
+            input_path = value;
+        } else if (arg == "--output") {
+            output_path = value;
+        } else if (arg == "--parts") {
+            options.num_parts = std::atol(value.c_str());
+        } else if (arg == "--chunk-size") {
+            chunk_size = std::atol(value.c_str());
+        } else if (arg == "--imbalance") {
+            options.imbalance = std::atof(value.c_str());
+        } else if (arg == "--seed") {
+            options.seed = std::atol(value.c_str());
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (input_path.empty() || output_path.empty() || (options.num_parts < 1 && chunk_size < 1) || argc % 2 == 0) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        SparseMatrix<float> adjacency;
+        load_sp_matrix<float>(get_adjacency_path(input_path), &adjacency);
+        Matrix<float> features = load_npy_matrix<float>(input_path + "/features.npy");
+        Matrix<int> classes = load_npy_matrix<int>(input_path + "/classes.npy");
+        long num_nodes = adjacency.num_rows_;
+        if (options.num_parts < 1) {
+            options.num_parts = ceil((double) num_nodes / (double) chunk_size);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<int> parts;
+        partition_graph(&adjacency, &options, &parts);
+        std::cout << "Partitioning into " << options.num_parts << " parts in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+
+        std::vector<int> new_ids;
+        std::vector<long> boundaries;
+        get_partition_permutation(&parts, options.num_parts, &new_ids, &boundaries);
+
+        SparseMatrix<float> adjacency_permuted;
+        permute_sp_matrix(&adjacency, &new_ids, &adjacency_permuted);
+        Matrix<float> features_permuted;
+        permute_rows<float>(&features, &new_ids, &features_permuted);
+        Matrix<int> classes_permuted;
+        permute_rows<int>(&classes, &new_ids, &classes_permuted);
+
+        save_csr_matrix<float>(&adjacency_permuted, output_path + "/adjacency.csr");
+        save_npy_matrix<float>(&features_permuted, output_path + "/features.npy");
+        std::vector<size_t> shape = {(size_t) classes_permuted.size_};
+        cnpy::npy_save<int>(output_path + "/classes.npy", classes_permuted.values_, shape, "w");
+        // maps results of the partitioned dataset back to the original ids, see unpermute_rows
+        cnpy::npy_save<int>(output_path + "/permutation.npy", new_ids.data(), {new_ids.size()}, "w");
+        // the trainers take these as chunks instead of balancing by the chunk size
+        save_boundaries(output_path + "/boundaries.npy", &boundaries);
+
+        // before, chunks of equal size in the original order
+        std::vector<long> uniform_boundaries;
+        get_uniform_boundaries(num_nodes, ceil((double) num_nodes / (double) (boundaries.size() - 1)), &uniform_boundaries);
+        print_report("Before", &adjacency, &uniform_boundaries);
+        print_report("After", &adjacency_permuted, &boundaries);
+        print_boundaries(&boundaries);
+    } catch (const char *e) {
+        std::cerr << e << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
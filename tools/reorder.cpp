@@ -0,0 +1,142 @@
+// Copyright 2020 Marcel Wagenländer
+
+#include "cuda_helper.hpp"
+#include "dataset.hpp"
+#include "reordering.hpp"
+#include "sparse_computation.hpp"
+#include "tensors.hpp"
+
+#include "cnpy.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+void print_usage() {
+    std::cout << "Usage: reorder --input DIR --output DIR [--ordering rcm|degree|community] [--chunk-size N]..." << std::endl;
+    std::cout << "Writes the reordered adjacency.csr, features.npy, classes.npy and permutation.npy to DIR" << std::endl;
+}
+
+// average time of the SpMM of one feature aggregation, without transfers. result is column-major
+double time_sp_mat_mat_multi(CudaHelper *cuda_helper, SparseMatrix<float> *adjacency, Matrix<float> *features, long num_runs,
+                             Matrix<float> *result) {
+    to_column_major_inplace(features);
+    SparseMatrixCuda<float> d_adjacency;
+    malloc_memcpy_sp_mat(&d_adjacency, adjacency);
+    float *d_features;
+    check_cuda(cudaMalloc(&d_features, features->size_ * sizeof(float)));
+    check_cuda(cudaMemcpy(d_features, features->values_, features->size_ * sizeof(float), cudaMemcpyHostToDevice));
+    float *d_result;
+    check_cuda(cudaMalloc(&d_result, features->size_ * sizeof(float)));
+
+    sp_mat_mat_multi_cuda(cuda_helper, &d_adjacency, d_features, d_result, features->num_columns_, false);
+    check_cuda(cudaDeviceSynchronize());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < num_runs; ++i) {
+        sp_mat_mat_multi_cuda(cuda_helper, &d_adjacency, d_features, d_result, features->num_columns_, false);
+    }
+    check_cuda(cudaDeviceSynchronize());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / num_runs;
+
+    result->set(features->num_rows_, features->num_columns_, false);
+    check_cuda(cudaMemcpy(result->values_, d_result, result->size_ * sizeof(float), cudaMemcpyDeviceToHost));
+    check_cuda(cudaFree(d_result));
+    check_cuda(cudaFree(d_features));
+
+    return seconds;
+}
+
+int main(int argc, char **argv) {
+    std::string input_path;
+    std::string output_path;
+    Ordering ordering = rcm;
+    std::vector<long> chunk_sizes;
+    for (int i = 1; i + 1 < argc; i = i + 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        if (arg == "--input") {
+            input_path = value;
+        } else if (arg == "--output") {
+            output_path = value;
+        } else if (arg == "--ordering" && value == "rcm") {
+            ordering = rcm;
+        } else if (arg == "--ordering" && value == "degree") {
+            ordering = degree;
+        } else if (arg == "--ordering" && value == "community") {
+            ordering = community;
+        } else if (arg == "--chunk-size") {
+            chunk_sizes.push_back(std::atol(value.c_str()));
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (input_path.empty() || output_path.empty() || argc % 2 == 0) {
+        print_usage();
+        return 1;
+    }
+    if (chunk_sizes.empty()) {
+        chunk_sizes = {1 << 14, 1 << 15, 1 << 16, 1 << 17};
+    }
+
+    try {
+        SparseMatrix<float> adjacency;
+        load_sp_matrix<float>(get_adjacency_path(input_path), &adjacency);
+        Matrix<float> features = load_npy_matrix<float>(input_path + "/features.npy");
+        Matrix<int> classes = load_npy_matrix<int>(input_path + "/classes.npy");
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<int> new_ids;
+        get_permutation(&adjacency, ordering, &new_ids);
+        std::cout << "Ordering " << get_ordering_name(ordering) << " in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+
+        SparseMatrix<float> adjacency_permuted;
+        permute_sp_matrix(&adjacency, &new_ids, &adjacency_permuted);
+        Matrix<float> features_permuted;
+        permute_rows<float>(&features, &new_ids, &features_permuted);
+        Matrix<int> classes_permuted;
+        permute_rows<int>(&classes, &new_ids, &classes_permuted);
+
+        save_csr_matrix<float>(&adjacency_permuted, output_path + "/adjacency.csr");
+        save_npy_matrix<float>(&features_permuted, output_path + "/features.npy");
+        std::vector<size_t> shape = {(size_t) classes_permuted.size_};
+        cnpy::npy_save<int>(output_path + "/classes.npy", classes_permuted.values_, shape, "w");
+        // maps results of the reordered dataset back to the original ids, see unpermute_rows
+        cnpy::npy_save<int>(output_path + "/permutation.npy", new_ids.data(), {new_ids.size()}, "w");
+
+        for (long i = 0; i < (long) chunk_sizes.size(); ++i) {
+            long num_tiles = count_non_empty_tiles(&adjacency, chunk_sizes.at(i));
+            long num_tiles_permuted = count_non_empty_tiles(&adjacency_permuted, chunk_sizes.at(i));
+            std::cout << "Chunk size " << chunk_sizes.at(i) << ": non-empty tiles " << num_tiles << " -> "
+                      << num_tiles_permuted << std::endl;
+        }
+
+        CudaHelper cuda_helper;
+        long num_runs = 10;
+        Matrix<float> result;
+        double seconds = time_sp_mat_mat_multi(&cuda_helper, &adjacency, &features, num_runs, &result);
+        Matrix<float> result_permuted;
+        double seconds_permuted = time_sp_mat_mat_multi(&cuda_helper, &adjacency_permuted, &features_permuted, num_runs,
+                                                        &result_permuted);
+        std::cout << "SpMM: " << seconds << " s -> " << seconds_permuted << " s, speedup "
+                  << seconds / seconds_permuted << std::endl;
+
+        // the aggregation of the reordered graph, mapped back to the original ids, is the original aggregation
+        Matrix<float> result_restored;
+        unpermute_rows<float>(&result_permuted, &new_ids, &result_restored);
+        float max_difference = 0.0;
+        for (long i = 0; i < result.size_; ++i) {
+            max_difference = std::max(max_difference, std::abs(result.values_[i] - result_restored.values_[i]));
+        }
+        std::cout << "SpMM: max difference to the original order " << max_difference << std::endl;
+    } catch (const char *e) {
+        std::cerr << e << std::endl;
+        return 1;
+    }
+
+    return 0;
+}